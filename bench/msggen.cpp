@@ -0,0 +1,646 @@
+// msggen.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "msggen.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "util.h"
+
+namespace
+{
+  const time_t s_BaseTime = 1700000000;
+
+  const std::vector<std::string> s_FirstNames =
+  {
+    "Alice", "Bob", "Carol", "David", "Erik", "Fatima", "George", "Hiroshi", "Ingrid", "Jonas",
+    "Karin", "Liam", "Maria", "Noah", "Olivia", "Pedro", "Quinn", "Rania", "Sven", "Tanya",
+  };
+
+  const std::vector<std::string> s_NonAsciiFirstNames =
+  {
+    "Åsa", "Björn", "Zoë", "José", "Günther", "Renée", "Søren", "Małgorzata", "Łukasz", "Dvořák",
+  };
+
+  const std::vector<std::string> s_LastNames =
+  {
+    "Andersson", "Brown", "Chen", "Davis", "Evans", "Garcia", "Hansen", "Ito", "Johnson", "Kim",
+    "Lopez", "Martin", "Nguyen", "Olsen", "Patel", "Rossi", "Smith", "Tanaka", "Wilson", "Young",
+  };
+
+  const std::vector<std::string> s_Domains =
+  {
+    "example.com", "example.org", "mail.example.net", "corp.example.com", "lists.example.org",
+  };
+
+  const std::vector<std::string> s_Words =
+  {
+    "the", "of", "and", "to", "in", "is", "for", "that", "with", "on", "as", "this", "be", "are",
+    "we", "will", "please", "meeting", "project", "review", "update", "schedule", "release",
+    "budget", "report", "draft", "attached", "thanks", "regards", "question", "proposal",
+    "customer", "server", "deadline", "quarter", "agenda", "feedback", "invoice", "contract",
+    "design", "document", "version", "change", "request", "issue", "status", "team", "today",
+    "tomorrow", "next", "week", "monday", "friday", "morning", "afternoon", "call", "notes",
+    "summary", "plan", "estimate", "support", "ticket", "backup", "migration", "performance",
+  };
+
+  // non-ascii words representable in iso-8859-1
+  const std::vector<std::string> s_Latin1Words =
+  {
+    "café", "naïve", "Größe", "über", "señor", "façade", "smörgåsbord", "jalapeño", "résumé",
+    "Ærøskøbing", "crème", "brûlée", "fiancée", "Öl", "mañana",
+  };
+
+  // non-ascii words not representable in iso-8859-1
+  const std::vector<std::string> s_Utf8Words =
+  {
+    "日本語", "привет", "Ελληνικά", "中文", "안녕하세요", "שלום", "€uro", "…", "👍",
+  };
+
+  const std::vector<std::string> s_AttachmentTypes =
+  {
+    "application/pdf", "image/png", "image/jpeg", "application/zip",
+    "application/vnd.openxmlformats-officedocument.wordprocessingml.document",
+  };
+
+  const std::vector<std::string> s_AttachmentExts =
+  {
+    "pdf", "png", "jpg", "zip", "docx",
+  };
+
+  char Capitalize(char p_Ch)
+  {
+    return ((p_Ch >= 'a') && (p_Ch <= 'z')) ? static_cast<char>(p_Ch - 'a' + 'A') : p_Ch;
+  }
+}
+
+MsgGen::MsgGen(uint32_t p_Seed)
+  : m_State((p_Seed != 0) ? p_Seed : 0x9e3779b9)
+{
+}
+
+std::vector<MsgGen::Msg> MsgGen::Generate(uint32_t p_Count)
+{
+  std::vector<Msg> msgs;
+  msgs.reserve(p_Count);
+  for (uint32_t uid = 1; uid <= p_Count; ++uid)
+  {
+    msgs.push_back(GenerateMsg(uid));
+  }
+
+  return msgs;
+}
+
+bool MsgGen::WriteMaildir(const std::vector<Msg>& p_Msgs, const std::string& p_Dir)
+{
+  Util::MkDir(p_Dir);
+  Util::MkDir(p_Dir + "/new");
+  Util::MkDir(p_Dir + "/tmp");
+  Util::MkDir(p_Dir + "/cur");
+  if (!Util::Exists(p_Dir + "/cur")) return false;
+
+  for (const auto& msg : p_Msgs)
+  {
+    Util::WriteFile(p_Dir + "/cur/" + std::to_string(msg.m_Uid) + ".eml", msg.m_Data);
+  }
+
+  return true;
+}
+
+MsgGen::Msg MsgGen::GenerateMsg(uint32_t p_Uid)
+{
+  Msg msg;
+  msg.m_Uid = p_Uid;
+  msg.m_Time = s_BaseTime + (p_Uid * 3600) + Rand(0, 3599);
+
+  // charset determines which non-ascii content may be used
+  const uint32_t charsetPick = Rand(0, 99);
+  const std::string charset = (charsetPick < 60) ? "utf-8" : ((charsetPick < 85) ? "iso-8859-1" : "us-ascii");
+  const bool nonAscii = (charset != "us-ascii");
+
+  // reply to a recent thread, or start a new one
+  Thread* thread = nullptr;
+  if (!m_Threads.empty() && Chance(40))
+  {
+    const uint32_t maxBack = std::min<uint32_t>(m_Threads.size() - 1, 20);
+    thread = &m_Threads.at(m_Threads.size() - 1 - Rand(0, maxBack));
+  }
+
+  const std::string fromName = GetName();
+  const std::string toName = GetName();
+  const std::string messageId = "<" + std::to_string(p_Uid) + "." + Util::ToHexString(Rand()) +
+    "@" + s_Domains.at(Rand(0, s_Domains.size() - 1)) + ">";
+
+  std::string subject;
+  if (thread != nullptr)
+  {
+    subject = "Re: " + thread->m_Subject;
+  }
+  else
+  {
+    subject = GetWords(Rand(3, 9), nonAscii && Chance(30));
+    subject[0] = Capitalize(subject[0]);
+  }
+
+  const uint32_t sizePick = Rand(0, 99);
+  const uint32_t words = (sizePick < 60) ? Rand(30, 300) : ((sizePick < 90) ? Rand(300, 1500) : Rand(1500, 8000));
+  std::string quoted;
+  if (thread != nullptr)
+  {
+    std::vector<std::string> lines = Util::Split(thread->m_LastText, '\n');
+    lines.resize(std::min<size_t>(lines.size(), 20));
+    quoted = "On " + GetDate(msg.m_Time - 3600) + ", " + fromName + " wrote:\n";
+    for (const auto& line : lines)
+    {
+      quoted += "> " + line + "\n";
+    }
+  }
+
+  // @note: words not representable in iso-8859-1 are replaced by ToLatin1() when encoding
+  const std::string text = GetText(words, nonAscii, quoted);
+
+  // headers
+  std::string header;
+  header += "Date: " + GetDate(msg.m_Time) + "\r\n";
+  header += "From: " + GetAddress(fromName) + "\r\n";
+  header += "To: " + GetAddress(toName) + "\r\n";
+  if (Chance(25))
+  {
+    header += "Cc: " + GetAddress(GetName()) + ",\r\n " + GetAddress(GetName()) + "\r\n";
+  }
+
+  const bool subjectNonAscii = std::any_of(subject.begin(), subject.end(), [](char p_Ch) { return (p_Ch & 0x80) != 0; });
+  header += "Subject: " + (subjectNonAscii ? EncodeHeaderWord(subject, charset, Chance(50)) : subject) + "\r\n";
+  header += "Message-ID: " + messageId + "\r\n";
+  if (thread != nullptr)
+  {
+    thread->m_References += (thread->m_References.empty() ? "" : "\r\n ") + thread->m_LastMessageId;
+    header += "In-Reply-To: " + thread->m_LastMessageId + "\r\n";
+    header += "References: " + thread->m_References + "\r\n";
+  }
+
+  header += "MIME-Version: 1.0\r\n";
+
+  // body structure
+  Part top;
+  const uint32_t structurePick = Rand(0, 99);
+  if (structurePick < 35)
+  {
+    top = GetTextPart("plain", text, charset);
+  }
+  else if (structurePick < 85)
+  {
+    const std::string boundary = GetBoundary();
+    const std::vector<Part> parts =
+      { GetTextPart("plain", text, charset), GetTextPart("html", GetHtml(text), charset) };
+    top.m_Headers = "Content-Type: multipart/alternative; boundary=\"" + boundary + "\"\r\n";
+    top.m_Payload = GetMultipart("alternative", boundary, parts, true /* p_WithPayload */);
+    top.m_Skeleton = GetMultipart("alternative", boundary, parts, false /* p_WithPayload */);
+    if (structurePick >= 75)
+    {
+      // html only
+      top = GetTextPart("html", GetHtml(text), charset);
+    }
+  }
+  else
+  {
+    std::vector<Part> parts;
+    if (Chance(50))
+    {
+      parts.push_back(GetTextPart("plain", text, charset));
+    }
+    else
+    {
+      const std::string altBoundary = GetBoundary();
+      const std::vector<Part> altParts =
+        { GetTextPart("plain", text, charset), GetTextPart("html", GetHtml(text), charset) };
+      Part alt;
+      alt.m_Headers = "Content-Type: multipart/alternative; boundary=\"" + altBoundary + "\"\r\n";
+      alt.m_Payload = GetMultipart("alternative", altBoundary, altParts, true /* p_WithPayload */);
+      alt.m_Skeleton = GetMultipart("alternative", altBoundary, altParts, false /* p_WithPayload */);
+      parts.push_back(alt);
+    }
+
+    const uint32_t attachments = Rand(1, 3);
+    for (uint32_t i = 0; i < attachments; ++i)
+    {
+      parts.push_back(GetAttachmentPart());
+    }
+
+    const std::string boundary = GetBoundary();
+    top.m_Headers = "Content-Type: multipart/mixed; boundary=\"" + boundary + "\"\r\n";
+    top.m_Payload = GetMultipart("mixed", boundary, parts, true /* p_WithPayload */);
+    top.m_Skeleton = GetMultipart("mixed", boundary, parts, false /* p_WithPayload */);
+  }
+
+  msg.m_Header = header + top.m_Headers + "\r\n";
+  msg.m_Structure = top.m_Headers + "\r\n" + top.m_Skeleton;
+  msg.m_Data = msg.m_Header + top.m_Payload;
+
+  // update thread
+  if (thread == nullptr)
+  {
+    m_Threads.push_back(Thread());
+    thread = &m_Threads.back();
+    thread->m_Subject = subject;
+  }
+
+  thread->m_LastMessageId = messageId;
+  thread->m_LastText = text.substr(0, 2048);
+
+  return msg;
+}
+
+uint32_t MsgGen::Rand()
+{
+  // xorshift32, for identical sequences on all platforms
+  m_State ^= m_State << 13;
+  m_State ^= m_State >> 17;
+  m_State ^= m_State << 5;
+  return m_State;
+}
+
+uint32_t MsgGen::Rand(uint32_t p_Min, uint32_t p_Max)
+{
+  return p_Min + (Rand() % (p_Max - p_Min + 1));
+}
+
+bool MsgGen::Chance(uint32_t p_Percent)
+{
+  return Rand(0, 99) < p_Percent;
+}
+
+std::string MsgGen::GetName()
+{
+  const std::string& firstName = Chance(20) ? s_NonAsciiFirstNames.at(Rand(0, s_NonAsciiFirstNames.size() - 1))
+                                            : s_FirstNames.at(Rand(0, s_FirstNames.size() - 1));
+  return firstName + " " + s_LastNames.at(Rand(0, s_LastNames.size() - 1));
+}
+
+std::string MsgGen::GetAddress(const std::string& p_Name)
+{
+  std::string user = Util::ToLower(s_LastNames.at(Rand(0, s_LastNames.size() - 1))) + "." + std::to_string(Rand(1, 99));
+  const std::string address = "<" + user + "@" + s_Domains.at(Rand(0, s_Domains.size() - 1)) + ">";
+  const bool nonAscii = std::any_of(p_Name.begin(), p_Name.end(), [](char p_Ch) { return (p_Ch & 0x80) != 0; });
+  return (nonAscii ? EncodeHeaderWord(p_Name, "utf-8", Chance(50)) : ("\"" + p_Name + "\"")) + " " + address;
+}
+
+std::string MsgGen::GetWords(uint32_t p_Count, bool p_NonAscii)
+{
+  std::string str;
+  for (uint32_t i = 0; i < p_Count; ++i)
+  {
+    if (i > 0)
+    {
+      str += " ";
+    }
+
+    if (p_NonAscii && Chance(8))
+    {
+      str += Chance(50) ? s_Latin1Words.at(Rand(0, s_Latin1Words.size() - 1))
+                        : s_Utf8Words.at(Rand(0, s_Utf8Words.size() - 1));
+    }
+    else
+    {
+      str += s_Words.at(Rand(0, s_Words.size() - 1));
+    }
+  }
+
+  return str;
+}
+
+std::string MsgGen::GetText(uint32_t p_Words, bool p_NonAscii, const std::string& p_Quoted)
+{
+  // paragraphs wrapped at 72 columns, or occasionally unwrapped (as common from mobile clients)
+  const bool wrapped = Chance(80);
+  std::string text = "Hi,\n\n";
+  uint32_t remaining = p_Words;
+  while (remaining > 0)
+  {
+    const uint32_t paragraphWords = std::min(remaining, Rand(20, 120));
+    remaining -= paragraphWords;
+
+    std::string paragraph = GetWords(paragraphWords, p_NonAscii) + ".";
+    paragraph[0] = Capitalize(paragraph[0]);
+    if (Chance(10))
+    {
+      paragraph += " See https://www.example.com/docs/" + std::to_string(Rand(1000, 9999)) + "?ref=mail for details.";
+    }
+
+    if (wrapped)
+    {
+      size_t lineStart = 0;
+      size_t lastSpace = std::string::npos;
+      for (size_t i = 0; i < paragraph.size(); ++i)
+      {
+        if (paragraph[i] == ' ')
+        {
+          lastSpace = i;
+        }
+
+        if (((i - lineStart) >= 72) && (lastSpace != std::string::npos) && (lastSpace > lineStart))
+        {
+          paragraph[lastSpace] = '\n';
+          lineStart = lastSpace + 1;
+          lastSpace = std::string::npos;
+        }
+      }
+    }
+
+    text += paragraph + "\n\n";
+  }
+
+  text += "Regards,\n" + s_FirstNames.at(Rand(0, s_FirstNames.size() - 1)) + "\n";
+  if (!p_Quoted.empty())
+  {
+    text += "\n" + p_Quoted;
+  }
+
+  return text;
+}
+
+std::string MsgGen::GetHtml(const std::string& p_Text)
+{
+  std::string html =
+    "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><style type=\"text/css\">"
+    "p { margin: 0 0 1em 0; } .sig { color: #888888; }</style></head>\n"
+    "<body><div style=\"font-family: Arial, sans-serif; font-size: 14px;\">\n<p>";
+
+  bool inQuote = false;
+  const std::vector<std::string> lines = Util::Split(p_Text, '\n');
+  for (const auto& line : lines)
+  {
+    const bool isQuote = (line.compare(0, 2, "> ") == 0);
+    if (isQuote != inQuote)
+    {
+      html += isQuote ? "</p>\n<blockquote type=\"cite\"><p>" : "</p></blockquote>\n<p>";
+      inQuote = isQuote;
+    }
+
+    if (line.empty())
+    {
+      html += "</p>\n<p>";
+      continue;
+    }
+
+    std::string escaped;
+    for (size_t i = isQuote ? 2 : 0; i < line.size(); ++i)
+    {
+      switch (line[i])
+      {
+        case '&': escaped += "&amp;"; break;
+        case '<': escaped += "&lt;"; break;
+        case '>': escaped += "&gt;"; break;
+        case '"': escaped += "&quot;"; break;
+        default: escaped += line[i]; break;
+      }
+    }
+
+    html += escaped + "<br>\n";
+  }
+
+  html += inQuote ? "</p></blockquote>\n" : "</p>\n";
+  if (Chance(30))
+  {
+    html += "<table border=\"1\" cellpadding=\"4\"><tr><th>Item</th><th>Status</th></tr>\n";
+    const uint32_t rows = Rand(2, 8);
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+      html += "<tr><td>" + GetWords(Rand(1, 4), false) + "</td><td><b>" + GetWords(1, false) + "</b></td></tr>\n";
+    }
+
+    html += "</table>\n";
+  }
+
+  html += "<p class=\"sig\">&nbsp;&mdash;<br><a href=\"https://www.example.com/\">www.example.com</a></p>\n"
+    "</div></body></html>\n";
+  return html;
+}
+
+std::string MsgGen::GetBinary(uint32_t p_Size)
+{
+  std::string data(p_Size, '\0');
+  for (auto& ch : data)
+  {
+    ch = static_cast<char>(Rand() & 0xff);
+  }
+
+  return data;
+}
+
+std::string MsgGen::GetBoundary()
+{
+  return "----=_Part_" + std::to_string(Rand(100000, 999999)) + "_" + Util::ToHexString(Rand());
+}
+
+MsgGen::Part MsgGen::GetTextPart(const std::string& p_Type, const std::string& p_Text, const std::string& p_Charset)
+{
+  Part part;
+  const std::string text = (p_Charset == "iso-8859-1") ? ToLatin1(p_Text) : p_Text;
+  std::string encoding;
+  if (p_Charset == "us-ascii")
+  {
+    encoding = "7bit";
+    part.m_Payload = text;
+    Util::ReplaceString(part.m_Payload, "\n", "\r\n");
+  }
+  else if ((p_Charset == "utf-8") && Chance(25))
+  {
+    encoding = "base64";
+    part.m_Payload = EncodeBase64(text);
+  }
+  else
+  {
+    encoding = "quoted-printable";
+    part.m_Payload = EncodeQuotedPrintable(text);
+  }
+
+  const std::string flowed = ((p_Type == "plain") && Chance(20)) ? "; format=flowed" : "";
+  part.m_Headers = "Content-Type: text/" + p_Type + "; charset=\"" + p_Charset + "\"" + flowed + "\r\n" +
+    "Content-Transfer-Encoding: " + encoding + "\r\n";
+  return part;
+}
+
+MsgGen::Part MsgGen::GetAttachmentPart()
+{
+  // attachment sizes are skewed towards smaller files
+  const uint32_t sizePick = Rand(0, 99);
+  const uint32_t size = (sizePick < 70) ? Rand(2 * 1024, 64 * 1024) : Rand(64 * 1024, 512 * 1024);
+  const uint32_t typeIndex = Rand(0, s_AttachmentTypes.size() - 1);
+  const std::string filename = GetWords(Rand(1, 3), false) + "." + s_AttachmentExts.at(typeIndex);
+
+  Part part;
+  part.m_Headers = "Content-Type: " + s_AttachmentTypes.at(typeIndex) + "; name=\"" + filename + "\"\r\n" +
+    "Content-Disposition: attachment; filename=\"" + filename + "\"\r\n" +
+    "Content-Transfer-Encoding: base64\r\n";
+  part.m_Payload = EncodeBase64(GetBinary(size));
+  return part;
+}
+
+std::string MsgGen::GetMultipart(const std::string& p_SubType, const std::string& p_Boundary,
+                                 const std::vector<Part>& p_Parts, bool p_WithPayload)
+{
+  std::string data = p_WithPayload ? ("This is a multi-part message in MIME format (" + p_SubType + ").\r\n") : "";
+  for (const auto& part : p_Parts)
+  {
+    data += "\r\n--" + p_Boundary + "\r\n" + part.m_Headers + "\r\n" +
+      (p_WithPayload ? part.m_Payload : part.m_Skeleton);
+  }
+
+  data += "\r\n--" + p_Boundary + "--\r\n";
+  return data;
+}
+
+std::string MsgGen::EncodeHeaderWord(const std::string& p_Str, const std::string& p_Charset, bool p_Base64)
+{
+  const std::string str = (p_Charset == "iso-8859-1") ? ToLatin1(p_Str) : p_Str;
+  if (p_Base64)
+  {
+    std::string encoded = EncodeBase64(str);
+    Util::ReplaceString(encoded, "\r\n", "");
+    return "=?" + p_Charset + "?B?" + encoded + "?=";
+  }
+
+  std::string encoded;
+  for (const auto& ch : str)
+  {
+    const unsigned char uch = static_cast<unsigned char>(ch);
+    if (uch == ' ')
+    {
+      encoded += "_";
+    }
+    else if ((uch & 0x80) || (uch == '=') || (uch == '?') || (uch == '_'))
+    {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "=%02X", uch);
+      encoded += buf;
+    }
+    else
+    {
+      encoded += ch;
+    }
+  }
+
+  return "=?" + p_Charset + "?Q?" + encoded + "?=";
+}
+
+std::string MsgGen::EncodeQuotedPrintable(const std::string& p_Str)
+{
+  std::string encoded;
+  size_t lineLen = 0;
+  for (size_t i = 0; i < p_Str.size(); ++i)
+  {
+    const unsigned char uch = static_cast<unsigned char>(p_Str[i]);
+    if (uch == '\n')
+    {
+      encoded += "\r\n";
+      lineLen = 0;
+      continue;
+    }
+
+    std::string token;
+    const bool isLineEnd = ((i + 1) == p_Str.size()) || (p_Str[i + 1] == '\n');
+    if ((uch & 0x80) || (uch == '=') || (uch < 0x20) || ((uch == ' ') && isLineEnd))
+    {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "=%02X", uch);
+      token = buf;
+    }
+    else
+    {
+      token = std::string(1, static_cast<char>(uch));
+    }
+
+    // soft line break to keep encoded lines within 76 characters
+    if ((lineLen + token.size()) > 75)
+    {
+      encoded += "=\r\n";
+      lineLen = 0;
+    }
+
+    encoded += token;
+    lineLen += token.size();
+  }
+
+  return encoded;
+}
+
+std::string MsgGen::EncodeBase64(const std::string& p_Str)
+{
+  static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string encoded;
+  encoded.reserve(((p_Str.size() + 2) / 3) * 4 + (p_Str.size() / 57) * 2 + 2);
+  size_t lineLen = 0;
+  for (size_t i = 0; i < p_Str.size(); i += 3)
+  {
+    const uint32_t remaining = p_Str.size() - i;
+    uint32_t val = static_cast<unsigned char>(p_Str[i]) << 16;
+    val |= (remaining > 1) ? (static_cast<unsigned char>(p_Str[i + 1]) << 8) : 0;
+    val |= (remaining > 2) ? static_cast<unsigned char>(p_Str[i + 2]) : 0;
+
+    encoded += chars[(val >> 18) & 0x3f];
+    encoded += chars[(val >> 12) & 0x3f];
+    encoded += (remaining > 1) ? chars[(val >> 6) & 0x3f] : '=';
+    encoded += (remaining > 2) ? chars[val & 0x3f] : '=';
+
+    lineLen += 4;
+    if (lineLen >= 76)
+    {
+      encoded += "\r\n";
+      lineLen = 0;
+    }
+  }
+
+  if (lineLen > 0)
+  {
+    encoded += "\r\n";
+  }
+
+  return encoded;
+}
+
+std::string MsgGen::ToLatin1(const std::string& p_Str)
+{
+  // code points up to U+00FF map directly, others are replaced
+  std::string latin1;
+  latin1.reserve(p_Str.size());
+  for (size_t i = 0; i < p_Str.size(); ++i)
+  {
+    const unsigned char uch = static_cast<unsigned char>(p_Str[i]);
+    if (uch < 0x80)
+    {
+      latin1 += static_cast<char>(uch);
+    }
+    else if (((uch == 0xc2) || (uch == 0xc3)) && ((i + 1) < p_Str.size()))
+    {
+      latin1 += static_cast<char>(((uch & 0x03) << 6) | (static_cast<unsigned char>(p_Str[i + 1]) & 0x3f));
+      ++i;
+    }
+    else if ((uch & 0xc0) == 0xc0)
+    {
+      latin1 += '?';
+    }
+  }
+
+  return latin1;
+}
+
+std::string MsgGen::GetDate(time_t p_Time)
+{
+  static const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char* months[] =
+    { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  // @note: formatted without strftime to be independent of locale
+  struct tm tmval;
+  gmtime_r(&p_Time, &tmval);
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s, %d %s %d %02d:%02d:%02d +0000", days[tmval.tm_wday], tmval.tm_mday,
+           months[tmval.tm_mon], tmval.tm_year + 1900, tmval.tm_hour, tmval.tm_min, tmval.tm_sec);
+  return std::string(buf);
+}
@@ -0,0 +1,83 @@
+// msggen.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Deterministic generator of synthetic email messages with realistic variation in size,
+// charset, transfer encoding, mime structure (plain, html, alternative, attachments) and
+// reply threads. The same seed always yields the same mailbox, on all platforms.
+class MsgGen
+{
+public:
+  struct Msg
+  {
+    uint32_t m_Uid = 0;
+    time_t m_Time = 0;
+    std::string m_Header;    // rfc822 header, as fetched by UID FETCH HEADER
+    std::string m_Structure; // mime skeleton, as written from the imap bodystructure
+    std::string m_Data;      // complete rfc822 message
+  };
+
+public:
+  explicit MsgGen(uint32_t p_Seed);
+
+  std::vector<Msg> Generate(uint32_t p_Count);
+
+  static bool WriteMaildir(const std::vector<Msg>& p_Msgs, const std::string& p_Dir);
+
+  static std::string EncodeQuotedPrintable(const std::string& p_Str);
+  static std::string EncodeBase64(const std::string& p_Str);
+  static std::string ToLatin1(const std::string& p_Str);
+
+private:
+  struct Thread
+  {
+    std::string m_Subject;
+    std::string m_References;
+    std::string m_LastMessageId;
+    std::string m_LastText;
+  };
+
+  struct Part
+  {
+    std::string m_Headers;
+    std::string m_Payload;
+    std::string m_Skeleton; // nested multipart structure without payloads
+  };
+
+private:
+  Msg GenerateMsg(uint32_t p_Uid);
+
+  uint32_t Rand();
+  uint32_t Rand(uint32_t p_Min, uint32_t p_Max);
+  bool Chance(uint32_t p_Percent);
+
+  std::string GetName();
+  std::string GetAddress(const std::string& p_Name);
+  std::string GetWords(uint32_t p_Count, bool p_NonAscii);
+  std::string GetText(uint32_t p_Words, bool p_NonAscii, const std::string& p_Quoted);
+  std::string GetHtml(const std::string& p_Text);
+  std::string GetBinary(uint32_t p_Size);
+  std::string GetBoundary();
+
+  Part GetTextPart(const std::string& p_Type, const std::string& p_Text, const std::string& p_Charset);
+  Part GetAttachmentPart();
+  static std::string GetMultipart(const std::string& p_SubType, const std::string& p_Boundary,
+                                  const std::vector<Part>& p_Parts, bool p_WithPayload);
+
+  static std::string EncodeHeaderWord(const std::string& p_Str, const std::string& p_Charset, bool p_Base64);
+  static std::string GetDate(time_t p_Time);
+
+private:
+  uint32_t m_State = 0;
+  std::vector<Thread> m_Threads;
+};
@@ -0,0 +1,668 @@
+// nmailbench.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <libetpan/mailstream.h>
+#include <libetpan/mmapstring.h>
+
+#include "body.h"
+#include "cacheutil.h"
+#include "encoding.h"
+#include "header.h"
+#include "htmltotext.h"
+#include "imapcache.h"
+#include "log.h"
+#include "mimecodec.h"
+#include "searchengine.h"
+#include "ui.h"
+#include "util.h"
+#include "version.h"
+
+#include "msggen.h"
+
+namespace
+{
+  struct Options
+  {
+    uint32_t m_Count = 2000;
+    uint32_t m_Iterations = 5;
+    uint32_t m_Seed = 1;
+    std::string m_Filter;
+    std::string m_HtmlToTextCmd = "cat";
+  };
+
+  // @note: results are accumulated here so the compiler cannot elide benchmarked work
+  volatile size_t s_Sink = 0;
+
+  std::string JsonEscape(const std::string& p_Str)
+  {
+    std::string escaped;
+    for (const auto& ch : p_Str)
+    {
+      switch (ch)
+      {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        default: escaped += ch; break;
+      }
+    }
+
+    return escaped;
+  }
+
+  void ShowHelp()
+  {
+    std::cout <<
+      "nmail-bench measures nmail hot paths on a deterministic synthetic mailbox.\n"
+      "\n"
+      "Usage: nmail-bench [OPTION]\n"
+      "\n"
+      "Options:\n"
+      "   -c, --count <N>         number of messages to generate (default 2000)\n"
+      "   -f, --filter <STR>      only run benchmarks with name containing STR\n"
+      "   -g, --generate <DIR>    write generated messages in Maildir format and exit\n"
+      "   -h, --help              display this help and exit\n"
+      "   -i, --iterations <N>    number of timed iterations per benchmark (default 5)\n"
+      "   -l, --list              list benchmark names and exit\n"
+      "   -s, --seed <N>          generator seed (default 1)\n"
+      "   -x, --html-cmd <CMD>    external html to text command to compare with\n"
+      "                           (default cat, i.e. process and temp file overhead)\n"
+      "\n"
+      "Results are written to stdout as one json object per line, the first line\n"
+      "describes the run and each following line one benchmark.\n"
+      "\n";
+  }
+
+  bool IsSelected(const Options& p_Options, const std::string& p_Name)
+  {
+    return p_Options.m_Filter.empty() || (p_Name.find(p_Options.m_Filter) != std::string::npos);
+  }
+
+  bool IsAnySelected(const Options& p_Options, const std::vector<std::string>& p_Names)
+  {
+    return std::any_of(p_Names.begin(), p_Names.end(),
+                       [&](const std::string& p_Name) { return IsSelected(p_Options, p_Name); });
+  }
+
+  // Runs p_Run (with iteration 0 as warm-up, not timed) and writes a json result line.
+  void RunBench(const std::string& p_Name, const Options& p_Options, size_t p_Items, size_t p_Bytes,
+                const std::function<void(uint32_t)>& p_Run)
+  {
+    if (!IsSelected(p_Options, p_Name)) return;
+
+    p_Run(0);
+
+    std::vector<int64_t> durations;
+    for (uint32_t i = 1; i <= p_Options.m_Iterations; ++i)
+    {
+      const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      p_Run(i);
+      const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      durations.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count());
+    }
+
+    std::sort(durations.begin(), durations.end());
+    const int64_t minUs = durations.front();
+    const int64_t medianUs = durations.at(durations.size() / 2);
+    const int64_t maxUs = durations.back();
+    const double medianSec = std::max<int64_t>(medianUs, 1) / 1000000.0;
+
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"bench\":\"%s\",\"items\":%zu,\"bytes\":%zu,\"iterations\":%u,"
+             "\"min_us\":%lld,\"median_us\":%lld,\"max_us\":%lld,"
+             "\"items_per_s\":%.1f,\"mb_per_s\":%.3f}",
+             JsonEscape(p_Name).c_str(), p_Items, p_Bytes, p_Options.m_Iterations,
+             (long long)minUs, (long long)medianUs, (long long)maxUs,
+             p_Items / medianSec, p_Bytes / medianSec / (1024.0 * 1024.0));
+    std::cout << buf << std::endl;
+  }
+
+  size_t GetTotalSize(const std::vector<std::string>& p_Strs)
+  {
+    size_t size = 0;
+    for (const auto& str : p_Strs)
+    {
+      size += str.size();
+    }
+
+    return size;
+  }
+
+  // Reads p_Response through a mailstream with p_BufferSize read buffer, from a local socket fed by
+  // a writer thread, the way the imap parser reads a fetch response: a line, then the body literal.
+  size_t ReadStream(const std::string& p_Response, const std::vector<size_t>& p_LiteralSizes,
+                    size_t p_BufferSize)
+  {
+    int fds[2] = { -1, -1 };
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return 0;
+
+    std::thread writer([&]()
+    {
+      size_t offset = 0;
+      while (offset < p_Response.size())
+      {
+        ssize_t len = write(fds[1], p_Response.data() + offset, p_Response.size() - offset);
+        if (len <= 0) break;
+
+        offset += len;
+      }
+
+      close(fds[1]);
+    });
+
+    const size_t defaultBufferSize = mailstream_get_default_buffer_size();
+    mailstream_set_default_buffer_size(p_BufferSize);
+    mailstream* stream = mailstream_socket_open(fds[0]);
+    mailstream_set_default_buffer_size(defaultBufferSize);
+
+    size_t readBytes = 0;
+    if (stream != nullptr)
+    {
+      MMAPString* line = mmap_string_new("");
+      std::string literal;
+      for (const auto& literalSize : p_LiteralSizes)
+      {
+        if (mailstream_read_line(stream, line) == nullptr) break;
+
+        // @note: mailstream_read() may return less than requested, like read()
+        literal.resize(literalSize);
+        size_t literalOffset = 0;
+        while (literalOffset < literalSize)
+        {
+          ssize_t len = mailstream_read(stream, &literal[literalOffset], literalSize - literalOffset);
+          if (len <= 0) break;
+
+          literalOffset += len;
+        }
+
+        if (literalOffset != literalSize) break;
+
+        if (mailstream_read_line(stream, line) == nullptr) break;
+
+        readBytes += literalSize;
+      }
+
+      mmap_string_free(line);
+      mailstream_close(stream);
+    }
+    else
+    {
+      close(fds[0]);
+    }
+
+    writer.join();
+    return readBytes;
+  }
+
+  std::string GetPayload(const std::string& p_Data, const std::string& p_Encoding)
+  {
+    // payload of the first part with specified transfer encoding
+    const std::string label = "Content-Transfer-Encoding: " + p_Encoding + "\r\n\r\n";
+    const size_t begin = p_Data.find(label);
+    if (begin == std::string::npos) return "";
+
+    const size_t payloadBegin = begin + label.size();
+    const size_t payloadEnd = p_Data.find("\r\n--", payloadBegin);
+    return p_Data.substr(payloadBegin, (payloadEnd != std::string::npos) ? (payloadEnd - payloadBegin)
+                                                                         : std::string::npos);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  std::string generateDir;
+  bool listOnly = false;
+  std::vector<std::string> args(argv + 1, argv + argc);
+  for (auto it = args.begin(); it != args.end(); ++it)
+  {
+    if (((*it == "-c") || (*it == "--count")) && (std::distance(it + 1, args.end()) > 0))
+    {
+      ++it;
+      options.m_Count = std::max(1, std::atoi(it->c_str()));
+    }
+    else if (((*it == "-f") || (*it == "--filter")) && (std::distance(it + 1, args.end()) > 0))
+    {
+      ++it;
+      options.m_Filter = *it;
+    }
+    else if (((*it == "-g") || (*it == "--generate")) && (std::distance(it + 1, args.end()) > 0))
+    {
+      ++it;
+      generateDir = *it;
+    }
+    else if ((*it == "-h") || (*it == "--help"))
+    {
+      ShowHelp();
+      return 0;
+    }
+    else if (((*it == "-i") || (*it == "--iterations")) && (std::distance(it + 1, args.end()) > 0))
+    {
+      ++it;
+      options.m_Iterations = std::max(1, std::atoi(it->c_str()));
+    }
+    else if ((*it == "-l") || (*it == "--list"))
+    {
+      listOnly = true;
+    }
+    else if (((*it == "-s") || (*it == "--seed")) && (std::distance(it + 1, args.end()) > 0))
+    {
+      ++it;
+      options.m_Seed = std::strtoul(it->c_str(), nullptr, 10);
+    }
+    else if (((*it == "-x") || (*it == "--html-cmd")) && (std::distance(it + 1, args.end()) > 0))
+    {
+      ++it;
+      options.m_HtmlToTextCmd = *it;
+    }
+    else
+    {
+      ShowHelp();
+      return 1;
+    }
+  }
+
+  const std::vector<std::string> benchNames =
+  {
+    "header_parse", "body_parse", "html_to_text", "body_parse_html", "body_parse_html_cmd",
+    "base64_decode", "qp_decode", "convert_to_utf8", "word_wrap", "to_wstring", "wstring_width",
+    "cache_set_headers", "cache_get_headers", "cache_set_bodys", "cache_get_bodys", "search_index",
+    "search_query", "display_uids", "stream_read", "stream_read_8k",
+  };
+
+  if (listOnly)
+  {
+    for (const auto& benchName : benchNames)
+    {
+      std::cout << benchName << "\n";
+    }
+
+    return 0;
+  }
+
+  setlocale(LC_ALL, "");
+
+  MsgGen msgGen(options.m_Seed);
+  const std::vector<MsgGen::Msg> msgs = msgGen.Generate(options.m_Count);
+  if (!generateDir.empty())
+  {
+    return MsgGen::WriteMaildir(msgs, generateDir) ? 0 : 1;
+  }
+
+  // use a private application dir, to not touch the user's cache and logs
+  char appDirTemplate[] = "/tmp/nmailbench.XXXXXX";
+  if (mkdtemp(appDirTemplate) == nullptr)
+  {
+    std::cerr << "failed to create temp dir\n";
+    return 1;
+  }
+
+  const std::string appDir = appDirTemplate;
+  Util::SetApplicationDir(appDir);
+  Util::InitTempDir();
+  CacheUtil::InitCacheDir();
+  Log::SetPath(appDir + "/log.txt");
+
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+           "{\"version\":\"%s\",\"seed\":%u,\"count\":%u,\"iterations\":%u,\"simd\":\"%s\",\"xapian\":\"%s\","
+           "\"html_cmd\":\"%s\"}",
+           JsonEscape(Version::GetUiAppVersion()).c_str(), options.m_Seed, options.m_Count,
+           options.m_Iterations, JsonEscape(MimeCodec::GetSimdName()).c_str(),
+           JsonEscape(SearchEngine::GetXapianVersion()).c_str(), JsonEscape(options.m_HtmlToTextCmd).c_str());
+  std::cout << buf << std::endl;
+
+  // inputs shared by several benchmarks
+  std::vector<std::string> datas;
+  std::map<uint32_t, Header> headers;
+  std::map<uint32_t, Body> bodys;
+  std::set<uint32_t> uids;
+  size_t headerBytes = 0;
+  for (const auto& msg : msgs)
+  {
+    datas.push_back(msg.m_Data);
+    headers[msg.m_Uid].SetHeaderData(msg.m_Header, msg.m_Structure, msg.m_Time);
+    bodys[msg.m_Uid].SetData(msg.m_Data);
+    uids.insert(msg.m_Uid);
+    headerBytes += msg.m_Header.size() + msg.m_Structure.size();
+  }
+
+  const size_t dataBytes = GetTotalSize(datas);
+
+  std::vector<std::string> texts;
+  std::vector<std::wstring> wtexts;
+  std::vector<std::string> htmls;
+  for (auto& uidBody : bodys)
+  {
+    texts.push_back(uidBody.second.GetTextPlain());
+    wtexts.push_back(Util::ToWString(texts.back()));
+    const std::string html = uidBody.second.GetHtml();
+    if (!html.empty())
+    {
+      htmls.push_back(html);
+    }
+  }
+
+  const size_t textBytes = GetTotalSize(texts);
+
+  if (IsSelected(options, "header_parse"))
+  {
+    RunBench("header_parse", options, msgs.size(), headerBytes, [&](uint32_t)
+    {
+      for (const auto& msg : msgs)
+      {
+        Header header;
+        header.SetHeaderData(msg.m_Header, msg.m_Structure, msg.m_Time);
+        s_Sink += header.GetSubject().size();
+      }
+    });
+  }
+
+  if (IsSelected(options, "body_parse"))
+  {
+    RunBench("body_parse", options, msgs.size(), dataBytes, [&](uint32_t)
+    {
+      for (const auto& data : datas)
+      {
+        Body body;
+        body.SetData(data);
+        s_Sink += body.GetTextPlain().size();
+      }
+    });
+  }
+
+  if (IsSelected(options, "html_to_text"))
+  {
+    RunBench("html_to_text", options, htmls.size(), GetTotalSize(htmls), [&](uint32_t)
+    {
+      for (const auto& html : htmls)
+      {
+        s_Sink += HtmlToText::Convert(html).size();
+      }
+    });
+  }
+
+  if (IsAnySelected(options, { "body_parse_html", "body_parse_html_cmd" }))
+  {
+    // html-only messages, parsed with the built-in converter and with an external command
+    std::vector<std::string> htmlDatas;
+    for (const auto& msg : msgs)
+    {
+      if (msg.m_Structure.compare(0, 24, "Content-Type: text/html;") == 0)
+      {
+        htmlDatas.push_back(msg.m_Data);
+      }
+    }
+
+    auto parseAll = [&](uint32_t)
+    {
+      for (const auto& htmlData : htmlDatas)
+      {
+        Body body;
+        body.SetData(htmlData);
+        s_Sink += body.GetTextPlain().size();
+      }
+    };
+
+    Util::SetHtmlToTextConvertCmd("builtin");
+    RunBench("body_parse_html", options, htmlDatas.size(), GetTotalSize(htmlDatas), parseAll);
+
+    Util::SetHtmlToTextConvertCmd(options.m_HtmlToTextCmd);
+    RunBench("body_parse_html_cmd", options, htmlDatas.size(), GetTotalSize(htmlDatas), parseAll);
+    Util::SetHtmlToTextConvertCmd("builtin");
+  }
+
+  if (IsSelected(options, "base64_decode"))
+  {
+    std::vector<std::string> payloads;
+    for (const auto& data : datas)
+    {
+      const std::string payload = GetPayload(data, "base64");
+      if (!payload.empty())
+      {
+        payloads.push_back(payload);
+      }
+    }
+
+    RunBench("base64_decode", options, payloads.size(), GetTotalSize(payloads), [&](uint32_t)
+    {
+      for (const auto& payload : payloads)
+      {
+        s_Sink += MimeCodec::Base64Decode(payload.c_str(), payload.size()).size();
+      }
+    });
+  }
+
+  if (IsSelected(options, "qp_decode"))
+  {
+    std::vector<std::string> payloads;
+    for (const auto& text : texts)
+    {
+      payloads.push_back(MsgGen::EncodeQuotedPrintable(text));
+    }
+
+    RunBench("qp_decode", options, payloads.size(), GetTotalSize(payloads), [&](uint32_t)
+    {
+      for (const auto& payload : payloads)
+      {
+        s_Sink += MimeCodec::QuotedPrintableDecode(payload.c_str(), payload.size()).size();
+      }
+    });
+  }
+
+  if (IsSelected(options, "convert_to_utf8"))
+  {
+    std::vector<std::string> latin1s;
+    for (const auto& text : texts)
+    {
+      latin1s.push_back(MsgGen::ToLatin1(text));
+    }
+
+    RunBench("convert_to_utf8", options, latin1s.size() * 2, GetTotalSize(latin1s) * 2, [&](uint32_t)
+    {
+      for (const auto& latin1 : latin1s)
+      {
+        std::string str = latin1;
+        Encoding::ConvertToUtf8("iso-8859-1", str);
+        s_Sink += str.size();
+
+        str = latin1;
+        Encoding::ConvertToUtf8("windows-1252", str);
+        s_Sink += str.size();
+      }
+    });
+  }
+
+  if (IsSelected(options, "word_wrap"))
+  {
+    RunBench("word_wrap", options, wtexts.size(), textBytes, [&](uint32_t)
+    {
+      for (const auto& wtext : wtexts)
+      {
+        s_Sink += Util::WordWrap(wtext, 80, true /* p_ProcessFormatFlowed */, false /* p_OutputFormatFlowed */,
+                                 true /* p_QuoteWrap */, 8 /* p_ExpandTabSize */).size();
+      }
+    });
+  }
+
+  if (IsAnySelected(options, { "to_wstring", "wstring_width" }))
+  {
+    // message list row fields, mostly ascii with some non-ascii names and subjects
+    std::vector<std::string> fields;
+    for (auto& uidHeader : headers)
+    {
+      fields.push_back(uidHeader.second.GetShortFrom());
+      fields.push_back(uidHeader.second.GetSubject());
+    }
+
+    std::vector<std::wstring> wfields;
+    for (const auto& field : fields)
+    {
+      wfields.push_back(Util::ToWString(field));
+    }
+
+    const size_t fieldBytes = GetTotalSize(fields);
+    RunBench("to_wstring", options, fields.size(), fieldBytes, [&](uint32_t)
+    {
+      for (const auto& field : fields)
+      {
+        s_Sink += Util::ToWString(field).size();
+      }
+    });
+
+    RunBench("wstring_width", options, wfields.size(), fieldBytes, [&](uint32_t)
+    {
+      for (const auto& wfield : wfields)
+      {
+        s_Sink += Util::WStringWidth(wfield);
+      }
+    });
+  }
+
+  if (IsAnySelected(options, { "cache_set_headers", "cache_get_headers", "cache_set_bodys", "cache_get_bodys" }))
+  {
+    std::unique_ptr<ImapCache> imapCache(new ImapCache(false /* p_CacheEncrypt */, "" /* p_Pass */));
+    imapCache->SetHeaders("BenchHeaders", headers);
+    imapCache->SetBodys("BenchBodys", bodys);
+
+    // @note: each iteration writes a separate folder, so inserts are not turned into replaces
+    RunBench("cache_set_headers", options, headers.size(), headerBytes, [&](uint32_t p_Iteration)
+    {
+      imapCache->SetHeaders("BenchHeaders" + std::to_string(p_Iteration), headers);
+    });
+
+    RunBench("cache_get_headers", options, headers.size(), headerBytes, [&](uint32_t)
+    {
+      s_Sink += imapCache->GetHeaders("BenchHeaders", uids, false /* p_Prefetch */).size();
+    });
+
+    RunBench("cache_set_bodys", options, bodys.size(), dataBytes, [&](uint32_t p_Iteration)
+    {
+      imapCache->SetBodys("BenchBodys" + std::to_string(p_Iteration), bodys);
+    });
+
+    RunBench("cache_get_bodys", options, bodys.size(), dataBytes, [&](uint32_t)
+    {
+      s_Sink += imapCache->GetBodys("BenchBodys", uids, false /* p_Prefetch */).size();
+    });
+  }
+
+  if (IsAnySelected(options, { "search_index", "search_query" }))
+  {
+    const std::string searchDir = Util::GetTempDir() + "search";
+    auto indexAll = [&](const std::string& p_DbPath)
+    {
+      SearchEngine searchEngine(p_DbPath);
+      for (auto& uidBody : bodys)
+      {
+        const Header& header = headers.at(uidBody.first);
+        searchEngine.Index("INBOX_" + std::to_string(uidBody.first), header.GetTimeStamp(),
+                           uidBody.second.GetTextPlain(), header.GetSubject(), header.GetFrom(),
+                           header.GetTo() + " " + header.GetCc(), "INBOX");
+      }
+
+      searchEngine.Commit();
+    };
+
+    // @note: each iteration indexes into a new database
+    RunBench("search_index", options, bodys.size(), textBytes, [&](uint32_t p_Iteration)
+    {
+      indexAll(searchDir + std::to_string(p_Iteration));
+    });
+
+    const std::vector<std::string> queries =
+    {
+      "meeting", "project review", "budget OR invoice", "\"next week\"", "from:smith", "café",
+      "deadline AND NOT friday", "perf*",
+    };
+
+    indexAll(searchDir);
+    SearchEngine searchEngine(searchDir);
+    RunBench("search_query", options, queries.size(), 0, [&](uint32_t)
+    {
+      for (const auto& query : queries)
+      {
+        bool hasMore = false;
+        s_Sink += searchEngine.Search(query, 0, 100, hasMore).size();
+      }
+    });
+  }
+
+  if (IsSelected(options, "display_uids"))
+  {
+    // @note: Ui::UpdateDisplayUids() requires an ncurses ui, this measures its dominating part,
+    // rebuilding the sorted display key maps from cached headers, for date descending / ascending.
+    std::map<uint32_t, Header> sortHeaders = headers;
+    RunBench("display_uids", options, sortHeaders.size() * 2, 0, [&](uint32_t)
+    {
+      std::map<std::string, uint32_t> displayUidsDesc;
+      std::map<std::string, uint32_t> displayUidsAsc;
+      for (auto& uid : uids)
+      {
+        std::map<uint32_t, Header>::iterator hit = sortHeaders.find(uid);
+        const Header* header = (hit != sortHeaders.end()) ? &hit->second : nullptr;
+        displayUidsDesc.insert(std::pair<std::string, uint32_t>(
+          Ui::GetDateUidKey(header, uid, false /* p_Ascending */), uid));
+        displayUidsAsc.insert(std::pair<std::string, uint32_t>(
+          Ui::GetDateUidKey(header, uid, true /* p_Ascending */), uid));
+      }
+
+      s_Sink += displayUidsDesc.size() + displayUidsAsc.size();
+    });
+  }
+
+  if (IsAnySelected(options, { "stream_read", "stream_read_8k" }))
+  {
+    // @note: measures the mailstream buffering used for imap downloads, over a local socket, i.e.
+    // excluding network latency and tls. The 8k variant uses the buffer size of upstream libetpan.
+    std::string response;
+    std::vector<size_t> literalSizes;
+    for (const auto& msg : msgs)
+    {
+      response += "* " + std::to_string(msg.m_Uid) + " FETCH (UID " + std::to_string(msg.m_Uid) +
+        " BODY[] {" + std::to_string(msg.m_Data.size()) + "}\r\n" + msg.m_Data + ")\r\n";
+      literalSizes.push_back(msg.m_Data.size());
+    }
+
+    // a reader stopping early should fail the benchmark, not terminate it
+    signal(SIGPIPE, SIG_IGN);
+    const size_t networkBufferSize = 64 * 1024; // default network_buffer_kb
+    RunBench("stream_read", options, literalSizes.size(), dataBytes, [&](uint32_t)
+    {
+      s_Sink += ReadStream(response, literalSizes, networkBufferSize);
+    });
+
+    RunBench("stream_read_8k", options, literalSizes.size(), dataBytes, [&](uint32_t)
+    {
+      s_Sink += ReadStream(response, literalSizes, 8192);
+    });
+  }
+
+  Util::CleanupTempDir();
+  Util::RmDir(appDir);
+
+  return 0;
+}
@@ -47,6 +47,8 @@
 
 #include "clist.h"
 
+#include "mailarena_private.h"
+
 clist * clist_new(void) {
   clist * lst;
   
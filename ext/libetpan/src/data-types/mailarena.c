@@ -0,0 +1,335 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2024 - Kristofer Berggren
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailarena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LIBETPAN_REENTRANT
+#	define MAILARENA_THREAD __thread
+#else
+#	define MAILARENA_THREAD
+#endif
+
+/* allocations are aligned, and prefixed with their size for realloc */
+#define MAILARENA_ALIGN 16
+#define MAILARENA_HEADER MAILARENA_ALIGN
+
+/* chunks larger than this are not kept for reuse by mailarena_reset() */
+#define MAILARENA_MAX_RETAIN (4 * 1024 * 1024)
+
+struct mailarena_chunk {
+  struct mailarena_chunk * next;
+  char * begin;
+  char * cur;
+  char * end;
+};
+
+struct mailarena {
+  /* most recent, and largest, chunk first */
+  struct mailarena_chunk * chunks;
+  size_t chunk_size;
+  size_t used;
+};
+
+static MAILARENA_THREAD struct mailarena * attached_arena = NULL;
+static MAILARENA_THREAD int attached_alloc = 0;
+
+static struct mailarena_chunk * chunk_new(size_t size)
+{
+  struct mailarena_chunk * chunk;
+  uintptr_t begin;
+
+  chunk = malloc(sizeof(* chunk) + MAILARENA_ALIGN + size);
+  if (chunk == NULL)
+    return NULL;
+
+  begin = (uintptr_t) (chunk + 1);
+  begin = (begin + MAILARENA_ALIGN - 1) & ~((uintptr_t) MAILARENA_ALIGN - 1);
+
+  chunk->next = NULL;
+  chunk->begin = (char *) begin;
+  chunk->cur = chunk->begin;
+  chunk->end = chunk->begin + size;
+
+  return chunk;
+}
+
+static void * arena_alloc(struct mailarena * arena, size_t size)
+{
+  struct mailarena_chunk * chunk;
+  size_t needed;
+  char * p;
+
+  if (size > SIZE_MAX / 4)
+    return NULL;
+
+  needed = MAILARENA_HEADER + ((size + MAILARENA_ALIGN - 1) & ~((size_t) MAILARENA_ALIGN - 1));
+
+  chunk = arena->chunks;
+  if ((chunk == NULL) || ((size_t) (chunk->end - chunk->cur) < needed)) {
+    size_t chunk_size;
+
+    chunk_size = arena->chunk_size;
+    if (chunk != NULL)
+      chunk_size = (size_t) (chunk->end - chunk->begin) * 2;
+    while (chunk_size < needed)
+      chunk_size *= 2;
+
+    chunk = chunk_new(chunk_size);
+    if (chunk == NULL)
+      return NULL;
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+
+  p = chunk->cur;
+  * (size_t *) p = size;
+  chunk->cur += needed;
+  arena->used += needed;
+
+  return p + MAILARENA_HEADER;
+}
+
+static int arena_owns(struct mailarena * arena, const void * ptr)
+{
+  struct mailarena_chunk * chunk;
+  uintptr_t p;
+
+  p = (uintptr_t) ptr;
+  for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    if ((p >= (uintptr_t) chunk->begin) && (p < (uintptr_t) chunk->end))
+      return 1;
+  }
+
+  return 0;
+}
+
+struct mailarena * mailarena_new(size_t chunk_size)
+{
+  struct mailarena * arena;
+
+  arena = malloc(sizeof(* arena));
+  if (arena == NULL)
+    return NULL;
+
+  arena->chunks = NULL;
+  arena->chunk_size = (chunk_size < 1024) ? 1024 : chunk_size;
+  arena->used = 0;
+
+  return arena;
+}
+
+void mailarena_free(struct mailarena * arena)
+{
+  struct mailarena_chunk * chunk;
+
+  if (arena == NULL)
+    return;
+
+  if (attached_arena == arena)
+    mailarena_detach();
+
+  chunk = arena->chunks;
+  while (chunk != NULL) {
+    struct mailarena_chunk * next;
+
+    next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  free(arena);
+}
+
+void mailarena_reset(struct mailarena * arena)
+{
+  struct mailarena_chunk * chunk;
+
+  if (arena == NULL)
+    return;
+
+  chunk = arena->chunks;
+  if (chunk == NULL)
+    return;
+
+  if ((size_t) (chunk->end - chunk->begin) > MAILARENA_MAX_RETAIN) {
+    arena->chunks = NULL;
+  }
+  else {
+    arena->chunks = chunk;
+    chunk->cur = chunk->begin;
+    chunk = chunk->next;
+    arena->chunks->next = NULL;
+  }
+
+  while (chunk != NULL) {
+    struct mailarena_chunk * next;
+
+    next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  arena->used = 0;
+}
+
+size_t mailarena_get_used(struct mailarena * arena)
+{
+  return (arena != NULL) ? arena->used : 0;
+}
+
+size_t mailarena_get_size(struct mailarena * arena)
+{
+  struct mailarena_chunk * chunk;
+  size_t size;
+
+  size = 0;
+  if (arena != NULL) {
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next)
+      size += (size_t) (chunk->end - chunk->begin);
+  }
+
+  return size;
+}
+
+void mailarena_attach(struct mailarena * arena)
+{
+  attached_arena = arena;
+  attached_alloc = (arena != NULL);
+}
+
+void mailarena_hold(void)
+{
+  attached_alloc = 0;
+}
+
+void mailarena_detach(void)
+{
+  attached_arena = NULL;
+  attached_alloc = 0;
+}
+
+int mailarena_owns(const void * ptr)
+{
+  if ((ptr == NULL) || (attached_arena == NULL))
+    return 0;
+
+  return arena_owns(attached_arena, ptr);
+}
+
+void * mailarena_malloc(size_t size)
+{
+  if (attached_alloc)
+    return arena_alloc(attached_arena, size);
+
+  return malloc(size);
+}
+
+void * mailarena_calloc(size_t count, size_t size)
+{
+  void * ptr;
+
+  if (!attached_alloc)
+    return calloc(count, size);
+
+  if ((size != 0) && (count > SIZE_MAX / size))
+    return NULL;
+
+  ptr = arena_alloc(attached_arena, count * size);
+  if (ptr != NULL)
+    memset(ptr, 0, count * size);
+
+  return ptr;
+}
+
+void * mailarena_realloc(void * ptr, size_t size)
+{
+  size_t old_size;
+  void * new_ptr;
+
+  if (ptr == NULL)
+    return mailarena_malloc(size);
+
+  if (!mailarena_owns(ptr))
+    return realloc(ptr, size);
+
+  old_size = * (size_t *) ((char *) ptr - MAILARENA_HEADER);
+  if (size <= old_size)
+    return ptr;
+
+  new_ptr = mailarena_malloc(size);
+  if (new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size);
+
+  return new_ptr;
+}
+
+void mailarena_release(void * ptr)
+{
+  if (mailarena_owns(ptr))
+    return;
+
+  free(ptr);
+}
+
+char * mailarena_strdup(const char * str)
+{
+  return mailarena_strndup(str, strlen(str));
+}
+
+char * mailarena_strndup(const char * str, size_t len)
+{
+  const char * nul;
+  char * dup;
+
+  nul = memchr(str, '\0', len);
+  if (nul != NULL)
+    len = (size_t) (nul - str);
+
+  dup = mailarena_malloc(len + 1);
+  if (dup == NULL)
+    return NULL;
+
+  memcpy(dup, str, len);
+  dup[len] = '\0';
+
+  return dup;
+}
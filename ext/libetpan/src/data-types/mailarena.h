@@ -0,0 +1,127 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2024 - Kristofer Berggren
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILARENA_H
+#define MAILARENA_H
+
+#ifndef LIBETPAN_CONFIG_H
+#       include <libetpan/libetpan-config.h>
+#endif
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  mailarena is a bump allocator for parse trees. While an arena is
+  attached to the current thread, allocations made by the MIME and IMF
+  parsers (and the clist they build on) are served from the arena and
+  frees of arena memory are ignored. The whole tree is then released
+  at once with mailarena_reset().
+
+  Typical use:
+
+    mailarena_attach(arena);
+    mailmime_parse(message, length, &cur_token, &mime);
+    mailarena_hold();
+    ... extract data from mime, allocations are regular malloc again ...
+    mailmime_free(mime);  (no-op, mime is owned by the arena)
+    mailarena_detach();
+    mailarena_reset(arena);
+
+  Memory owned by an arena must not be passed to free() by the
+  application, and must not be accessed after mailarena_reset().
+*/
+
+struct mailarena;
+
+/* Allocate a new arena, initial chunk size of chunk_size bytes */
+LIBETPAN_EXPORT
+struct mailarena * mailarena_new(size_t chunk_size);
+
+/* Destroys an arena and all memory allocated from it */
+LIBETPAN_EXPORT
+void mailarena_free(struct mailarena * arena);
+
+/* Release all memory allocated from the arena, keeping its largest chunk for reuse */
+LIBETPAN_EXPORT
+void mailarena_reset(struct mailarena * arena);
+
+/* Number of bytes currently allocated from the arena */
+LIBETPAN_EXPORT
+size_t mailarena_get_used(struct mailarena * arena);
+
+/* Number of bytes reserved by the arena */
+LIBETPAN_EXPORT
+size_t mailarena_get_size(struct mailarena * arena);
+
+/* Attach arena to current thread, subsequent parser allocations are served from it */
+LIBETPAN_EXPORT
+void mailarena_attach(struct mailarena * arena);
+
+/* Stop allocating from the attached arena, frees of its memory are still ignored */
+LIBETPAN_EXPORT
+void mailarena_hold(void);
+
+/* Detach arena from current thread */
+LIBETPAN_EXPORT
+void mailarena_detach(void);
+
+/* Returns 1 if ptr is owned by the arena attached to current thread */
+LIBETPAN_EXPORT
+int mailarena_owns(const void * ptr);
+
+/* Allocator entry points used by the parsers, see mailarena_private.h */
+LIBETPAN_EXPORT
+void * mailarena_malloc(size_t size);
+
+LIBETPAN_EXPORT
+void * mailarena_calloc(size_t count, size_t size);
+
+LIBETPAN_EXPORT
+void * mailarena_realloc(void * ptr, size_t size);
+
+LIBETPAN_EXPORT
+void mailarena_release(void * ptr);
+
+LIBETPAN_EXPORT
+char * mailarena_strdup(const char * str);
+
+LIBETPAN_EXPORT
+char * mailarena_strndup(const char * str, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
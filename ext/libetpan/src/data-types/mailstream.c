@@ -56,6 +56,20 @@
 struct timeval mailstream_network_delay =
 {  DEFAULT_NETWORK_TIMEOUT, 0 };
 
+static size_t mailstream_default_buffer_size = 8192;
+
+LIBETPAN_EXPORT
+void mailstream_set_default_buffer_size(size_t buffer_size)
+{
+  mailstream_default_buffer_size = buffer_size;
+}
+
+LIBETPAN_EXPORT
+size_t mailstream_get_default_buffer_size(void)
+{
+  return mailstream_default_buffer_size;
+}
+
 LIBETPAN_EXPORT
 mailstream * mailstream_new(mailstream_low * low, size_t buffer_size)
 {
@@ -65,9 +79,10 @@ mailstream * mailstream_new(mailstream_low * low, size_t buffer_size)
   if (s == NULL)
     goto err;
 
-  s->read_buffer = malloc(buffer_size);
-  if (s->read_buffer == NULL)
+  s->read_buffer_base = malloc(buffer_size);
+  if (s->read_buffer_base == NULL)
     goto free_s;
+  s->read_buffer = s->read_buffer_base;
   s->read_buffer_len = 0;
 
   s->write_buffer = malloc(buffer_size);
@@ -89,7 +104,7 @@ mailstream * mailstream_new(mailstream_low * low, size_t buffer_size)
   return s;
 
  free_read_buffer:
-  free(s->read_buffer);
+  free(s->read_buffer_base);
  free_s:
   free(s);
  err:
@@ -189,10 +204,13 @@ static ssize_t read_from_internal_buffer(mailstream * s,
   if (count != 0)
     memcpy(buf, s->read_buffer, count);
 
+  /* consume by advancing, the buffer is rewound once drained, which is
+     always the case before it is filled again */
   s->read_buffer_len -= count;
   if (s->read_buffer_len != 0)
-    memmove(s->read_buffer, s->read_buffer + count,
-	    s->read_buffer_len);
+    s->read_buffer += count;
+  else
+    s->read_buffer = s->read_buffer_base;
 
   return count;
 }
@@ -217,7 +235,8 @@ ssize_t mailstream_read(mailstream * s, void * buf, size_t count)
     return read_bytes;
   }
 
-  if (left > s->buffer_max_size) {
+  if (left >= s->buffer_max_size) {
+    /* large reads go directly to the destination */
     read_bytes = mailstream_low_read(s->low, cur_buf, left);
 
     if (read_bytes == -1) {
@@ -284,7 +303,7 @@ int mailstream_close(mailstream * s)
   mailstream_low_close(s->low);
   mailstream_low_free(s->low);
   
-  free(s->read_buffer);
+  free(s->read_buffer_base);
   free(s->write_buffer);
   
   free(s);
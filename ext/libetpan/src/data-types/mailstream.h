@@ -55,6 +55,17 @@ extern "C" {
 LIBETPAN_EXPORT
 mailstream * mailstream_new(mailstream_low * low, size_t buffer_size);
 
+/*
+  mailstream_set_default_buffer_size() sets the size of the read and write
+  buffers of streams created by mailstream_socket_open(), mailstream_ssl_open()
+  and similar functions. Default is 8192 bytes.
+*/
+LIBETPAN_EXPORT
+void mailstream_set_default_buffer_size(size_t buffer_size);
+
+LIBETPAN_EXPORT
+size_t mailstream_get_default_buffer_size(void);
+
 LIBETPAN_EXPORT
 ssize_t mailstream_write(mailstream * s, const void * buf, size_t count);
 
@@ -83,14 +83,12 @@ char * mailstream_read_line_append(mailstream * stream, MMAPString * line)
 
   do {
     if (stream->read_buffer_len > 0) {
-      size_t i;
+      const char * eol;
 
-      i = 0;
-      while (i < stream->read_buffer_len) {
-        if (stream->read_buffer[i] == '\n')
-          return mailstream_read_len_append(stream, line, i + 1);
-        i++;
-      }
+      eol = memchr(stream->read_buffer, '\n', stream->read_buffer_len);
+      if (eol != NULL)
+        return mailstream_read_len_append(stream, line,
+                                          eol - stream->read_buffer + 1);
       if (mailstream_read_len_append(stream, line,
 				     stream->read_buffer_len) == NULL)
         return NULL;
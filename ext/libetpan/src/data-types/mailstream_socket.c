@@ -442,7 +442,7 @@ mailstream * mailstream_socket_open_timeout(int fd, time_t timeout)
     goto err;
 	mailstream_low_set_timeout(low, timeout);
 
-  s = mailstream_new(low, 8192);
+  s = mailstream_new(low, mailstream_get_default_buffer_size());
   if (s == NULL)
     goto free_low;
 
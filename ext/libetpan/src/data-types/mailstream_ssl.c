@@ -1145,7 +1145,7 @@ mailstream * mailstream_ssl_open_with_callback_timeout(int fd, time_t timeout,
   if (low == NULL)
     goto err;
 
-  s = mailstream_new(low, 8192);
+  s = mailstream_new(low, mailstream_get_default_buffer_size());
   if (s == NULL)
     goto free_low;
 
@@ -87,6 +87,9 @@ struct _mailstream {
   void (* logger)(mailstream * s, int log_type,
       const char * str, size_t size, void * logger_context);
   void * logger_context;
+
+  /* allocated read buffer, read_buffer points to the unconsumed data in it */
+  char * read_buffer_base;
 };
 
 struct mailstream_low_driver {
@@ -2675,6 +2675,9 @@ mailimap * mailimap_new(size_t imap_progr_rate,
   f->is_163_workaround_enabled = 0;
   f->is_rambler_workaround_enabled = 0;
   f->is_qip_workaround_enabled = 0;
+
+  f->imap_msg_body_buffer_handler = NULL;
+  f->imap_msg_body_buffer_handler_context = NULL;
   return f;
   
  free_stream_buffer:
@@ -2752,6 +2755,15 @@ void mailimap_set_msg_body_handler(mailimap * session,
   session->imap_msg_body_handler_context = context;
 }
 
+LIBETPAN_EXPORT
+void mailimap_set_msg_body_buffer_handler(mailimap * session,
+                                          mailimap_msg_body_buffer_handler * handler,
+                                          void * context)
+{
+  session->imap_msg_body_buffer_handler = handler;
+  session->imap_msg_body_buffer_handler_context = context;
+}
+
 static inline void imap_logger(mailstream * s, int log_type,
     const char * str, size_t size, void * context)
 {
@@ -836,6 +836,26 @@ void mailimap_set_msg_body_handler(mailimap * session,
                                    mailimap_msg_body_handler * handler,
                                    void * context);
 
+/*
+    mailimap_set_msg_body_buffer_handler() set a callback providing the
+      destination buffer of a message body section downloaded using FETCH.
+
+    @param session    IMAP session
+    @param handler    set a callback function. It is called with the size of
+      the body section literal when its download starts, and returns a buffer
+      of at least that size, owned by the application. The literal is read
+      from the network directly into the buffer, and the body section in the
+      FETCH result is left empty. If the callback returns NULL the literal is
+      stored in the FETCH result as usual. Not used when a msg body handler
+      is set.
+    @param context    parameter that's passed to the callback function.
+*/
+
+LIBETPAN_EXPORT
+void mailimap_set_msg_body_buffer_handler(mailimap * session,
+                                          mailimap_msg_body_buffer_handler * handler,
+                                          void * context);
+
 /*
     mailimap_set_timeout() set the network timeout of the IMAP session.
 
@@ -5979,10 +5979,12 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
   int res;
   size_t number_token;
   bool use_msg_body_handler;
+  char * body_buffer;
   
   cur_token = * indx;
   use_msg_body_handler = (parser_ctx->msg_body_handler != NULL
                           && parser_ctx->msg_body_parse_in_progress);
+  body_buffer = NULL;
   
   r = mailimap_oaccolade_parse(fd, buffer, parser_ctx, &cur_token);
   if (r != MAILIMAP_NO_ERROR) {
@@ -6029,7 +6031,14 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
     goto err;
   }
 
-  if (use_msg_body_handler) {
+  if (!use_msg_body_handler && (parser_ctx->msg_body_buffer_handler != NULL)
+      && parser_ctx->msg_body_parse_in_progress) {
+    /* literal is read directly into a buffer owned by the application */
+    body_buffer = parser_ctx->msg_body_buffer_handler(parser_ctx->msg_body_att_type, parser_ctx->msg_body_section,
+                                                      number, parser_ctx->msg_body_buffer_handler_context);
+  }
+
+  if (use_msg_body_handler || (body_buffer != NULL)) {
     literal = mmap_string_new("");
   }
   else {
@@ -6052,6 +6061,9 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
           goto free_literal;
         }
       }
+      else if (body_buffer != NULL) {
+        memcpy(body_buffer, buffer->str + cur_token, number);
+      }
       else {
         if (mmap_string_append_len(literal, buffer->str + cur_token,
                                    number) == NULL) {
@@ -6085,6 +6097,9 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
           goto free_literal;
         }
       }
+      else if (body_buffer != NULL) {
+        memcpy(body_buffer, buffer->str + cur_token, left);
+      }
       else {
         if (mmap_string_append_len(literal, buffer->str + cur_token,
                                    left) == NULL) {
@@ -6100,7 +6115,7 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
       size_t bytes_to_read;
       
       bytes_to_read = needed;
-      if (bytes_to_read > MAX_READ_PROGRESS) {
+      if ((bytes_to_read > MAX_READ_PROGRESS) && (body_buffer == NULL)) {
         bytes_to_read = MAX_READ_PROGRESS;
       }
       if (fd == NULL) {
@@ -6120,6 +6135,9 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
           }
         }
       }
+      else if (body_buffer != NULL) {
+        read_bytes = mailstream_read(fd, body_buffer + current_prog, bytes_to_read);
+      }
       else {
         read_bytes = mailstream_read(fd, literal->str + literal->len, bytes_to_read);
         if (read_bytes > 0) {
@@ -6135,8 +6153,10 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
 
       if (needed > 0 && mailimap_parser_context_is_rambler_workaround_enabled(parser_ctx)) {
         /* workaround issue with Rambler IMAP server */
-        char const * search_beg = use_msg_body_handler ? read_buffer : literal->str;
-        char const * search_end = use_msg_body_handler ? read_buffer + read_bytes : literal->str + literal->len;
+        char const * search_beg = use_msg_body_handler ? read_buffer :
+          ((body_buffer != NULL) ? body_buffer : literal->str);
+        char const * search_end = use_msg_body_handler ? read_buffer + read_bytes :
+          ((body_buffer != NULL) ? body_buffer + current_prog + read_bytes : literal->str + literal->len);
         char tag_response_end[] = " OK completed\r\n";
         size_t tag_response_end_len = sizeof(tag_response_end) - 1;
         /* Looking backward for pattern " UID \d+)\r\n\d+ OK completed\r\n$" */
@@ -6172,7 +6192,7 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
       }
     }
     
-    if (!use_msg_body_handler) {
+    if (!use_msg_body_handler && (body_buffer == NULL)) {
       literal->str[number] = 0;
     }
     
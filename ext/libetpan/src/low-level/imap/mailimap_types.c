@@ -3275,6 +3275,9 @@ mailimap_parser_context_new(mailimap * session)
   ctx->msg_body_section = NULL;
   ctx->msg_body_att_type = 0;
 
+  ctx->msg_body_buffer_handler = session->imap_msg_body_buffer_handler;
+  ctx->msg_body_buffer_handler_context = session->imap_msg_body_buffer_handler_context;
+
   return ctx;
 
 err:
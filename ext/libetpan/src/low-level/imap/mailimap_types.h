@@ -3344,6 +3344,9 @@ typedef void mailimap_msg_att_handler(struct mailimap_msg_att * msg_att, void *
 typedef bool mailimap_msg_body_handler(int msg_att_type, struct mailimap_msg_att_body_section * section,
                                        const char * bytes, size_t length, void * context);
 
+typedef char * mailimap_msg_body_buffer_handler(int msg_att_type, struct mailimap_msg_att_body_section * section,
+                                                size_t length, void * context);
+
 typedef struct mailimap mailimap;
 
 struct mailimap {
@@ -3394,6 +3397,9 @@ struct mailimap {
   int is_163_workaround_enabled;
   int is_rambler_workaround_enabled;
   int is_qip_workaround_enabled;
+
+  mailimap_msg_body_buffer_handler * imap_msg_body_buffer_handler;
+  void * imap_msg_body_buffer_handler_context;
 };
 
 
@@ -3585,6 +3591,9 @@ struct mailimap_parser_context {
   struct mailimap_msg_att_body_section * msg_body_section;
   int msg_body_att_type;
   bool msg_body_parse_in_progress;
+
+  mailimap_msg_body_buffer_handler * msg_body_buffer_handler;
+  void * msg_body_buffer_handler_context;
 };
 
 LIBETPAN_EXPORT
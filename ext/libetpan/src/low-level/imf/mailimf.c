@@ -57,6 +57,8 @@
 #include <string.h>
 #include "mailmime_decode.h"
 
+#include "mailarena_private.h"
+
 #ifndef TRUE
 #define TRUE 1
 #endif
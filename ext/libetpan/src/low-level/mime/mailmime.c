@@ -63,6 +63,8 @@
 #include "mailmime_disposition.h"
 #include "mailimf.h"
 
+#include "mailarena_private.h"
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -60,6 +60,8 @@
 #include "mmapstring.h"
 #include "mailimf.h"
 
+#include "mailarena_private.h"
+
 #ifndef TRUE
 #define TRUE 1
 #endif
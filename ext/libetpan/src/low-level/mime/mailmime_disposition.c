@@ -44,6 +44,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "mailarena_private.h"
+
 static int
 mailmime_disposition_parm_parse(const char * message, size_t length,
 				size_t * indx,
@@ -43,6 +43,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "mailarena_private.h"
+
 void mailmime_attribute_free(char * attribute)
 {
   mailmime_token_free(attribute);
@@ -475,6 +477,10 @@ struct mailmime * mailmime_new(int mm_type,
 
 void mailmime_free(struct mailmime * mime)
 {
+  /* a tree parsed into an arena is released by mailarena_reset() */
+  if (mailarena_owns(mime))
+    return;
+
   switch (mime->mm_type) {
   case MAILMIME_SINGLE:
     if ((mime->mm_body == NULL) && (mime->mm_data.mm_single != NULL))
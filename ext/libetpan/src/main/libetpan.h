@@ -52,6 +52,7 @@ extern "C" {
 #include <libetpan/mailsem.h>
 #include <libetpan/carray.h>
 #include <libetpan/chash.h>
+#include <libetpan/mailarena.h>
 #include <libetpan/maillock.h>
   
 /* mbox driver */
@@ -72,8 +72,6 @@ void AddressBook::Cleanup()
   m_Db.reset();
   if (m_AddressBookEncrypt && m_Dirty)
   {
-    Util::RmDir(GetAddressBookCacheDbDir());
-    Util::MkDir(GetAddressBookCacheDbDir());
     CacheUtil::EncryptCacheDir(m_Pass, GetAddressBookTempDbDir(), GetAddressBookCacheDbDir());
     m_Dirty = false;
   }
@@ -84,15 +82,7 @@ bool AddressBook::ChangePass(const bool p_CacheEncrypt,
 {
   if (!p_CacheEncrypt) return true;
 
-  Util::RmDir(GetAddressBookTempDbDir());
-  Util::MkDir(GetAddressBookTempDbDir());
-  if (!CacheUtil::DecryptCacheDir(p_OldPass, GetAddressBookCacheDbDir(), GetAddressBookTempDbDir())) return false;
-
-  Util::RmDir(GetAddressBookCacheDbDir());
-  Util::MkDir(GetAddressBookCacheDbDir());
-  if (!CacheUtil::EncryptCacheDir(p_NewPass, GetAddressBookTempDbDir(), GetAddressBookCacheDbDir())) return false;
-
-  return true;
+  return CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, GetAddressBookCacheDbDir());
 }
 
 void AddressBook::Add(const std::string& p_MsgId, const std::set<std::string>& p_Addresses)
@@ -0,0 +1,91 @@
+// arenahelp.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "arenahelp.h"
+
+#ifdef LIBETPAN_CUSTOM
+#include <libetpan/mailarena.h>
+
+namespace
+{
+  // arena chunks are kept between parses, so a thread parsing messages of similar size
+  // does not allocate at all once warmed up
+  class ThreadArena
+  {
+  public:
+    ~ThreadArena()
+    {
+      if (m_Arena != NULL)
+      {
+        mailarena_free(m_Arena);
+      }
+    }
+
+    struct mailarena* Get()
+    {
+      if (m_Arena == NULL)
+      {
+        m_Arena = mailarena_new(64 * 1024);
+      }
+
+      return m_Arena;
+    }
+
+    bool m_InUse = false;
+
+  private:
+    struct mailarena* m_Arena = NULL;
+  };
+
+  thread_local ThreadArena s_ThreadArena;
+}
+
+ArenaScope::ArenaScope()
+{
+  // nested scopes use the arena state of the outermost scope
+  if (s_ThreadArena.m_InUse) return;
+
+  struct mailarena* arena = s_ThreadArena.Get();
+  if (arena == NULL) return;
+
+  s_ThreadArena.m_InUse = true;
+  m_Outermost = true;
+  mailarena_attach(arena);
+}
+
+ArenaScope::~ArenaScope()
+{
+  if (!m_Outermost) return;
+
+  mailarena_detach();
+  mailarena_reset(s_ThreadArena.Get());
+  s_ThreadArena.m_InUse = false;
+}
+
+void ArenaScope::Hold()
+{
+  if (!m_Outermost) return;
+
+  mailarena_hold();
+}
+
+#else
+
+// system libetpan does not provide arena allocation, parse trees are freed as usual
+ArenaScope::ArenaScope()
+{
+}
+
+ArenaScope::~ArenaScope()
+{
+}
+
+void ArenaScope::Hold()
+{
+}
+
+#endif
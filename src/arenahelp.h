@@ -0,0 +1,25 @@
+// arenahelp.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+// Scope within which libetpan mime / imf parse trees are allocated from a per-thread
+// arena. After Hold() allocations are regular heap allocations again, while the parsed
+// tree remains valid until the outermost scope ends and the arena is reset in O(1).
+// Freeing the tree (mailmime_free) inside the scope is a no-op. Requires the bundled
+// (custom) libetpan, with system libetpan the scope has no effect.
+class ArenaScope
+{
+public:
+  ArenaScope();
+  ~ArenaScope();
+
+  void Hold();
+
+private:
+  bool m_Outermost = false;
+};
@@ -78,13 +78,7 @@ bool Auth::ChangePass(const bool p_CacheEncrypt,
 {
   if (!p_CacheEncrypt) return true;
 
-  m_AuthEncrypt = p_CacheEncrypt;
-  m_Pass = p_OldPass;
-  LoadCache();
-  m_Pass = p_NewPass;
-  SaveCache();
-
-  return true;
+  return CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, GetAuthCacheDir());
 }
 
 bool Auth::GenerateToken(const std::string& p_Auth)
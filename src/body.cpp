@@ -1,6 +1,6 @@
 // body.cpp
 //
-// Copyright (c) 2019-2023 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -9,10 +9,14 @@
 
 #include <libetpan/mailmime.h>
 
+#include "arenahelp.h"
+#include "coprocess.h"
 #include "encoding.h"
 #include "header.h"
+#include "htmltotext.h"
 #include "log.h"
 #include "loghelp.h"
+#include "mimecodec.h"
 #include "util.h"
 
 void Body::FromMime(mailmime* p_Mime)
@@ -27,9 +31,11 @@ void Body::FromHeader(const std::string& p_Data)
 {
   if (m_ParseVersion != GetCurrentParseVersion())
   {
+    ArenaScope arenaScope;
     struct mailmime* mime = NULL;
     size_t current_index = 0;
     mailmime_parse(p_Data.c_str(), p_Data.size(), &current_index, &mime);
+    arenaScope.Hold();
 
     if (mime != NULL)
     {
@@ -94,7 +100,7 @@ std::map<ssize_t, PartInfo> Body::GetPartInfos() const
   return m_PartInfos;
 }
 
-std::map<ssize_t, std::string> Body::GetPartDatas()
+const std::map<ssize_t, std::string>& Body::GetPartDatas()
 {
   if (!m_PartDatasParsed)
   {
@@ -132,13 +138,33 @@ bool Body::IsFormatFlowed() const
   return false;
 }
 
+size_t Body::GetMemorySize() const
+{
+  size_t size = sizeof(Body) + m_Data.capacity() + m_TextHtml.capacity() + m_TextPlain.capacity() +
+    m_Html.capacity();
+  for (const auto& partInfo : m_PartInfos)
+  {
+    size += sizeof(partInfo) + partInfo.second.m_MimeType.capacity() + partInfo.second.m_Filename.capacity() +
+      partInfo.second.m_ContentId.capacity() + partInfo.second.m_Charset.capacity();
+  }
+
+  for (const auto& partData : m_PartDatas)
+  {
+    size += sizeof(partData) + partData.second.capacity();
+  }
+
+  return size;
+}
+
 void Body::Parse()
 {
   // @note: this function should not be called directly, only via ParseIfNeeded()
   LOG_DURATION();
+  ArenaScope arenaScope;
   struct mailmime* mime = NULL;
   size_t current_index = 0;
   mailmime_parse(m_Data.c_str(), m_Data.size(), &current_index, &mime);
+  arenaScope.Hold();
 
   if (mime != NULL)
   {
@@ -189,17 +215,28 @@ void Body::ParseHtml()
     std::string partHtml = m_Html;
     Encoding::ConvertToUtf8(partEnc, partHtml);
 
-    // @todo: more elegant removal of meta-tags
-    Util::ReplaceString(partHtml, "<meta ", "<beta ");
-    Util::ReplaceString(partHtml, "<META ", "<BETA ");
+    const std::string& htmlToTextConvertCmd = Util::GetHtmlToTextConvertCmd();
+    if (htmlToTextConvertCmd.empty())
+    {
+      m_TextHtml = HtmlToText::Convert(partHtml);
+    }
+    else
+    {
+      // @todo: more elegant removal of meta-tags
+      Util::ReplaceString(partHtml, "<meta ", "<beta ");
+      Util::ReplaceString(partHtml, "<META ", "<BETA ");
 
-    const std::string& textHtmlPath = Util::GetTempFilename(".html");
-    Util::WriteFile(textHtmlPath, partHtml);
+      if (!CoProcessPool::Convert(htmlToTextConvertCmd, partHtml, m_TextHtml))
+      {
+        const std::string& textHtmlPath = Util::GetTempFilename(".html");
+        Util::WriteFile(textHtmlPath, partHtml);
 
-    const std::string& cmd = "cat " + textHtmlPath + " | " + Util::GetHtmlToTextConvertCmd();
-    m_TextHtml = Util::RunCommand(cmd);
+        const std::string& cmd = "cat " + textHtmlPath + " | " + htmlToTextConvertCmd;
+        m_TextHtml = Util::RunCommand(cmd);
 
-    Util::DeleteFile(textHtmlPath);
+        Util::DeleteFile(textHtmlPath);
+      }
+    }
   }
 
   m_HtmlParsed = true;
@@ -384,23 +421,38 @@ void Body::ParseMimeData(mailmime* p_Mime, std::string p_MimeType)
   {
     case MAILMIME_DATA_TEXT:
       {
-        size_t index = 0;
-        char* parsedStr = NULL;
-        size_t parsedLen = 0;
-        int rv = mailmime_part_parse(data->dt_data.dt_text.dt_data,
-                                     data->dt_data.dt_text.dt_length, &index,
-                                     data->dt_encoding, &parsedStr, &parsedLen);
+        const char* text = data->dt_data.dt_text.dt_data;
+        const size_t textLen = data->dt_data.dt_text.dt_length;
+        std::string partData;
+        int rv = MAILIMF_NO_ERROR;
+        switch (data->dt_encoding)
+        {
+          case MAILMIME_MECHANISM_BASE64:
+            partData = MimeCodec::Base64Decode(text, textLen);
+            break;
+
+          case MAILMIME_MECHANISM_QUOTED_PRINTABLE:
+            partData = MimeCodec::QuotedPrintableDecode(text, textLen);
+            break;
+
+          default:
+            {
+              size_t index = 0;
+              char* parsedStr = NULL;
+              size_t parsedLen = 0;
+              rv = mailmime_part_parse(text, textLen, &index, data->dt_encoding, &parsedStr, &parsedLen);
+              if ((rv == MAILIMF_NO_ERROR) && (parsedStr != NULL))
+              {
+                partData = std::string(parsedStr, parsedLen);
+                mmap_string_unref(parsedStr);
+              }
+            }
+            break;
+        }
 
         if (rv == MAILIMF_NO_ERROR)
         {
           PartInfo partInfo;
-          std::string partData;
-
-          if (parsedStr != NULL)
-          {
-            partData = std::string(parsedStr, parsedLen);
-            mmap_string_unref(parsedStr);
-          }
 
           partInfo.m_Charset = charset;
           partInfo.m_MimeType = p_MimeType;
@@ -502,7 +554,7 @@ size_t Body::GetCurrentParseVersion()
 {
   static std::hash<std::string> hashStr;
   static size_t htmlToTextCmdHash = hashStr(Util::GetHtmlToTextConvertCmd());
-  static size_t parseVersion = 1 + htmlToTextCmdHash; // update offset when parsing changes
+  static size_t parseVersion = 2 + htmlToTextCmdHash; // update offset when parsing changes
   return parseVersion;
 }
 
@@ -1,6 +1,6 @@
 // body.h
 //
-// Copyright (c) 2019-2021 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -46,9 +46,10 @@ public:
   std::string GetTextHtml() const;
   std::string GetHtml() const;
   std::map<ssize_t, PartInfo> GetPartInfos() const;
-  std::map<ssize_t, std::string> GetPartDatas();
+  const std::map<ssize_t, std::string>& GetPartDatas();
   bool HasAttachments() const;
   bool IsFormatFlowed() const;
+  size_t GetMemorySize() const;
 
   inline bool ParseIfNeeded(bool p_ForceParse = false)
   {
@@ -0,0 +1,189 @@
+// bodyparser.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "bodyparser.h"
+
+#include <algorithm>
+
+#include "log.h"
+#include "loghelp.h"
+#include "util.h"
+
+BodyParser::BodyParser()
+{
+  // leave one core for the ui and network threads
+  const unsigned hwThreads = std::thread::hardware_concurrency();
+  const unsigned numThreads = std::max(1U, std::min(8U, (hwThreads > 1) ? (hwThreads - 1) : 1U));
+  LOG_DEBUG("start %u threads", numThreads);
+
+  m_Running = true;
+  for (unsigned i = 0; i < numThreads; ++i)
+  {
+    m_Threads.push_back(std::thread(&BodyParser::Process, this));
+  }
+}
+
+BodyParser::~BodyParser()
+{
+  LOG_DEBUG("stop threads");
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Running = false;
+
+    // unparsed async bodies are dropped, and will be fetched again when needed
+    m_Queue.clear();
+    m_QueueCondVar.notify_all();
+  }
+
+  for (auto& thread : m_Threads)
+  {
+    thread.join();
+  }
+}
+
+std::map<uint32_t, Body> BodyParser::Parse(const std::map<uint32_t, std::string>& p_Datas)
+{
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+  if (p_Datas.empty()) return batch->m_Bodys;
+
+  LOG_DURATION();
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  Enqueue(batch, p_Datas, true /* p_Priority */);
+  m_DoneCondVar.wait(lock, [&]() { return (batch->m_Remaining == 0) || !m_Running; });
+  return batch->m_Bodys;
+}
+
+void BodyParser::AsyncParse(const std::string& p_Folder, const std::map<uint32_t, std::string>& p_Datas,
+                            const std::function<void(const std::string&, const std::map<uint32_t, Body>&)>& p_Handler)
+{
+  if (p_Datas.empty()) return;
+
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+  batch->m_Folder = p_Folder;
+  batch->m_Handler = p_Handler;
+
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  std::multiset<uint32_t>& pendingUids = m_PendingUids[p_Folder];
+  for (auto& data : p_Datas)
+  {
+    pendingUids.insert(data.first);
+  }
+
+  Enqueue(batch, p_Datas, false /* p_Priority */);
+}
+
+std::set<uint32_t> BodyParser::GetPendingUids(const std::string& p_Folder)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  auto pit = m_PendingUids.find(p_Folder);
+  if (pit == m_PendingUids.end()) return std::set<uint32_t>();
+
+  return std::set<uint32_t>(pit->second.begin(), pit->second.end());
+}
+
+void BodyParser::WaitPendingUids(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_DoneCondVar.wait(lock, [&]()
+  {
+    if (!m_Running) return true;
+
+    auto pit = m_PendingUids.find(p_Folder);
+    if (pit == m_PendingUids.end()) return true;
+
+    for (auto& uid : p_Uids)
+    {
+      if (pit->second.count(uid) > 0) return false;
+    }
+
+    return true;
+  });
+}
+
+void BodyParser::Process()
+{
+  THREAD_REGISTER();
+
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while (m_Running)
+  {
+    if (m_Queue.empty())
+    {
+      m_QueueCondVar.wait(lock);
+      continue;
+    }
+
+    Job job = std::move(m_Queue.front());
+    m_Queue.pop_front();
+    lock.unlock();
+
+    Body body;
+    body.SetData(job.m_Data);
+    std::string().swap(job.m_Data);
+
+    lock.lock();
+    Batch& batch = *job.m_Batch;
+    batch.m_Bodys[job.m_Uid] = std::move(body);
+    if (--batch.m_Remaining > 0) continue;
+
+    if (batch.m_Handler)
+    {
+      // handler (cache write) runs outside the lock, uids remain pending until it is done
+      lock.unlock();
+      batch.m_Handler(batch.m_Folder, batch.m_Bodys);
+      lock.lock();
+
+      std::multiset<uint32_t>& pendingUids = m_PendingUids[batch.m_Folder];
+      for (auto& parsedBody : batch.m_Bodys)
+      {
+        auto uit = pendingUids.find(parsedBody.first);
+        if (uit != pendingUids.end())
+        {
+          pendingUids.erase(uit);
+        }
+      }
+
+      if (pendingUids.empty())
+      {
+        m_PendingUids.erase(batch.m_Folder);
+      }
+    }
+
+    m_DoneCondVar.notify_all();
+  }
+
+  m_DoneCondVar.notify_all();
+}
+
+// caller must hold m_Mutex
+void BodyParser::Enqueue(const std::shared_ptr<Batch>& p_Batch, const std::map<uint32_t, std::string>& p_Datas,
+                         bool p_Priority)
+{
+  p_Batch->m_Remaining = p_Datas.size();
+
+  // priority (user requested) bodies are parsed before queued prefetch bodies
+  std::deque<Job> jobs;
+  for (auto& data : p_Datas)
+  {
+    Job job;
+    job.m_Uid = data.first;
+    job.m_Data = data.second;
+    job.m_Batch = p_Batch;
+    jobs.push_back(std::move(job));
+  }
+
+  if (p_Priority)
+  {
+    m_Queue.insert(m_Queue.begin(), std::make_move_iterator(jobs.begin()), std::make_move_iterator(jobs.end()));
+  }
+  else
+  {
+    m_Queue.insert(m_Queue.end(), std::make_move_iterator(jobs.begin()), std::make_move_iterator(jobs.end()));
+  }
+
+  m_QueueCondVar.notify_all();
+}
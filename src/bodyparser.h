@@ -0,0 +1,66 @@
+// bodyparser.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "body.h"
+
+// Worker pool parsing raw message data into Body objects, so that mime parsing, charset
+// conversion and html-to-text conversion does not occupy the network thread.
+class BodyParser
+{
+public:
+  BodyParser();
+  virtual ~BodyParser();
+
+  std::map<uint32_t, Body> Parse(const std::map<uint32_t, std::string>& p_Datas);
+  void AsyncParse(const std::string& p_Folder, const std::map<uint32_t, std::string>& p_Datas,
+                  const std::function<void(const std::string&, const std::map<uint32_t, Body>&)>& p_Handler);
+  std::set<uint32_t> GetPendingUids(const std::string& p_Folder);
+  void WaitPendingUids(const std::string& p_Folder, const std::set<uint32_t>& p_Uids);
+
+private:
+  struct Batch
+  {
+    std::string m_Folder;
+    size_t m_Remaining = 0;
+    std::map<uint32_t, Body> m_Bodys;
+    std::function<void(const std::string&, const std::map<uint32_t, Body>&)> m_Handler;
+  };
+
+  struct Job
+  {
+    uint32_t m_Uid = 0;
+    std::string m_Data;
+    std::shared_ptr<Batch> m_Batch;
+  };
+
+private:
+  void Process();
+  void Enqueue(const std::shared_ptr<Batch>& p_Batch, const std::map<uint32_t, std::string>& p_Datas,
+               bool p_Priority);
+
+private:
+  bool m_Running = false;
+  std::vector<std::thread> m_Threads;
+  std::mutex m_Mutex;
+  std::condition_variable m_QueueCondVar;
+  std::condition_variable m_DoneCondVar;
+  std::deque<Job> m_Queue;
+  std::map<std::string, std::multiset<uint32_t>> m_PendingUids;
+};
@@ -1,16 +1,40 @@
 // cacheutil.cpp
 //
-// Copyright (c) 2020-2022 Kristofer Berggren
+// Copyright (c) 2020-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #include "cacheutil.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include "crypto.h"
 #include "loghelp.h"
 #include "util.h"
 
+std::mutex CacheUtil::m_FileStampsMutex;
+std::map<std::string, CacheUtil::FileStamp> CacheUtil::m_FileStamps;
+
+namespace
+{
+  // a file modified within this time of its stamp being taken may be modified again without
+  // its mtime changing (filesystem timestamp granularity), so its stamp is not trusted
+  const int64_t s_RacyStampNs = 2 * 1000000000LL;
+
+  int64_t GetRealTimeNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+}
+
 void CacheUtil::InitCacheDir()
 {
   static const int version = 5;
@@ -23,6 +47,11 @@ std::string CacheUtil::GetCacheDir()
   return Util::GetApplicationDir() + std::string("cache/");
 }
 
+std::string CacheUtil::GetDataKeyPath()
+{
+  return GetCacheDir() + std::string("datakey");
+}
+
 bool CacheUtil::CommonInitCacheDir(const std::string& p_Dir, int p_Version, bool p_Encrypted)
 {
   const std::string& versionPath = p_Dir + "version";
@@ -62,31 +91,86 @@ bool CacheUtil::CommonInitCacheDir(const std::string& p_Dir, int p_Version, bool
 bool CacheUtil::DecryptCacheDir(const std::string& p_Pass, const std::string& p_SrcDir, const std::string& p_DstDir)
 {
   const std::vector<std::string>& files = Util::ListDir(p_SrcDir);
-  for (auto& file : files)
+  return ProcessFiles(files, [&](const std::string& p_File, unsigned p_MaxThreads)
   {
-    if (!Crypto::AESDecryptFile(p_SrcDir + "/" + file, p_DstDir + "/" + file, p_Pass))
+    const std::string& dstPath = p_DstDir + "/" + p_File;
+    if (!Crypto::AESDecryptFile(p_SrcDir + "/" + p_File, dstPath, p_Pass, p_MaxThreads))
     {
-      Util::DeleteFile(p_DstDir + "/" + file);
+      Util::DeleteFile(dstPath);
       return false;
     }
-  }
 
-  return true;
+    SetFileStampBackdated(dstPath);
+    return true;
+  });
 }
 
 bool CacheUtil::EncryptCacheDir(const std::string& p_Pass, const std::string& p_SrcDir, const std::string& p_DstDir)
 {
+  // files unchanged since they were decrypted (or last encrypted) are skipped
   const std::vector<std::string>& files = Util::ListDir(p_SrcDir);
-  for (auto& file : files)
+  bool rv = ProcessFiles(files, [&](const std::string& p_File, unsigned p_MaxThreads)
   {
-    if (!Crypto::AESEncryptFile(p_SrcDir + "/" + file, p_DstDir + "/" + file, p_Pass))
+    const std::string& srcPath = p_SrcDir + "/" + p_File;
+    const std::string& dstPath = p_DstDir + "/" + p_File;
+    if (IsFileStampCurrent(srcPath) && Util::Exists(dstPath)) return true;
+
+    // stamp taken before reading, so a write during encryption is detected next time
+    FileStamp fileStamp;
+    const bool hasFileStamp = GetFileStamp(srcPath, fileStamp);
+    if (!Crypto::AESEncryptFile(srcPath, dstPath, p_Pass, p_MaxThreads))
     {
-      Util::DeleteFile(p_DstDir + "/" + file);
+      Util::DeleteFile(dstPath);
       return false;
     }
+
+    if (hasFileStamp)
+    {
+      SetFileStamp(srcPath, fileStamp);
+    }
+
+    return true;
+  });
+
+  // remove encrypted files whose decrypted file has been deleted
+  const std::string srcPrefix = p_SrcDir + "/";
+  std::lock_guard<std::mutex> lock(m_FileStampsMutex);
+  for (auto it = m_FileStamps.lower_bound(srcPrefix); it != m_FileStamps.end(); /* incremented in loop */)
+  {
+    if (it->first.compare(0, srcPrefix.size(), srcPrefix) != 0) break;
+
+    const std::string& file = it->first.substr(srcPrefix.size());
+    if (Util::Exists(it->first) || (file.find('/') != std::string::npos))
+    {
+      ++it;
+      continue;
+    }
+
+    LOG_DEBUG("remove stale %s", file.c_str());
+    Util::DeleteFile(p_DstDir + "/" + file);
+    it = m_FileStamps.erase(it);
   }
 
-  return true;
+  return rv;
+}
+
+bool CacheUtil::ChangePassCacheDir(const std::string& p_OldPass, const std::string& p_NewPass,
+                                   const std::string& p_Dir)
+{
+  // files encrypted using the data key are not affected by pass change, only files in
+  // older formats, encrypted using the pass directly, need to be re-encrypted
+  const std::vector<std::string>& files = Util::ListDir(p_Dir);
+  return ProcessFiles(files, [&](const std::string& p_File, unsigned p_MaxThreads)
+  {
+    const std::string path = p_Dir + "/" + p_File;
+    if (!Crypto::IsPassEncryptedFile(path)) return true;
+
+    const std::string tmpPath = path + ".tmp";
+    const bool rv = Crypto::AESDecryptFile(path, tmpPath, p_OldPass, p_MaxThreads) &&
+      Crypto::AESEncryptFile(tmpPath, path, p_NewPass, p_MaxThreads);
+    Util::DeleteFile(tmpPath);
+    return rv;
+  });
 }
 
 void CacheUtil::ReadVersionFromFile(const std::string& p_Path, int& p_Version)
@@ -102,3 +186,96 @@ void CacheUtil::WriteVersionToFile(const std::string& p_Path, const int p_Versio
 {
   Util::WriteFile(p_Path, Util::ToHex(std::to_string(p_Version)));
 }
+
+bool CacheUtil::ProcessFiles(const std::vector<std::string>& p_Files,
+                             const std::function<bool(const std::string&, unsigned)>& p_Func)
+{
+  // the thread budget is shared between files and the chunks within each file, so the total
+  // number of threads stays bounded by hwThreads
+  static const unsigned hwThreads = std::max(1U, std::min(8U, std::thread::hardware_concurrency()));
+  const unsigned numThreads = (unsigned)std::max<size_t>(1, std::min<size_t>(hwThreads, p_Files.size()));
+  const unsigned fileThreads = std::max(1U, hwThreads / numThreads);
+
+  std::atomic<size_t> nextIndex(0);
+  std::atomic<bool> rv(true);
+  auto worker = [&]()
+  {
+    size_t index = 0;
+    while ((index = nextIndex++) < p_Files.size())
+    {
+      if (!p_Func(p_Files.at(index), fileThreads))
+      {
+        LOG_DEBUG("failed to process %s", p_Files.at(index).c_str());
+        rv = false;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < numThreads; ++i)
+  {
+    threads.push_back(std::thread(worker));
+  }
+
+  worker();
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  return rv;
+}
+
+bool CacheUtil::GetFileStamp(const std::string& p_Path, FileStamp& p_FileStamp)
+{
+  p_FileStamp.m_StampTimeNs = GetRealTimeNs();
+  struct stat sb;
+  if (stat(p_Path.c_str(), &sb) != 0) return false;
+
+  p_FileStamp.m_Size = sb.st_size;
+#if defined(__APPLE__)
+  p_FileStamp.m_MTimeNs = ((int64_t)sb.st_mtimespec.tv_sec * 1000000000LL) + sb.st_mtimespec.tv_nsec;
+#else
+  p_FileStamp.m_MTimeNs = ((int64_t)sb.st_mtim.tv_sec * 1000000000LL) + sb.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+void CacheUtil::SetFileStamp(const std::string& p_Path, const FileStamp& p_FileStamp)
+{
+  std::lock_guard<std::mutex> lock(m_FileStampsMutex);
+  m_FileStamps[p_Path] = p_FileStamp;
+}
+
+void CacheUtil::SetFileStampBackdated(const std::string& p_Path)
+{
+  // @note: a just decrypted file has no other writer yet, so its mtime can be set back to make
+  // its stamp trusted (not racy), and any later write is then detected by a changed mtime
+  const int64_t mtimeNs = GetRealTimeNs() - s_RacyStampNs;
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = mtimeNs / 1000000000LL;
+  times[0].tv_nsec = times[1].tv_nsec = mtimeNs % 1000000000LL;
+  if (utimensat(AT_FDCWD, p_Path.c_str(), times, 0) != 0)
+  {
+    LOG_DEBUG("failed to set mtime %s", p_Path.c_str());
+  }
+
+  FileStamp fileStamp;
+  if (GetFileStamp(p_Path, fileStamp))
+  {
+    SetFileStamp(p_Path, fileStamp);
+  }
+}
+
+bool CacheUtil::IsFileStampCurrent(const std::string& p_Path)
+{
+  FileStamp fileStamp;
+  if (!GetFileStamp(p_Path, fileStamp)) return false;
+
+  std::lock_guard<std::mutex> lock(m_FileStampsMutex);
+  auto it = m_FileStamps.find(p_Path);
+  return (it != m_FileStamps.end()) && (it->second.m_Size == fileStamp.m_Size) &&
+    (it->second.m_MTimeNs == fileStamp.m_MTimeNs) &&
+    ((it->second.m_StampTimeNs - it->second.m_MTimeNs) >= s_RacyStampNs);
+}
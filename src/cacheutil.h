@@ -1,23 +1,51 @@
 // cacheutil.h
 //
-// Copyright (c) 2020-2021 Kristofer Berggren
+// Copyright (c) 2020-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class CacheUtil
 {
 public:
   static void InitCacheDir();
   static std::string GetCacheDir();
+  static std::string GetDataKeyPath();
 
   static bool CommonInitCacheDir(const std::string& p_Dir, int p_Version, bool p_Encrypted);
   static bool DecryptCacheDir(const std::string& p_Pass, const std::string& p_SrcDir, const std::string& p_DstDir);
   static bool EncryptCacheDir(const std::string& p_Pass, const std::string& p_SrcDir, const std::string& p_DstDir);
+  static bool ChangePassCacheDir(const std::string& p_OldPass, const std::string& p_NewPass, const std::string& p_Dir);
   static void ReadVersionFromFile(const std::string& p_Path, int& p_Version);
   static void WriteVersionToFile(const std::string& p_Path, const int p_Version);
+
+private:
+  // size and modification time of a decrypted file when it was last in sync with its
+  // encrypted counterpart, and the time the stamp was taken
+  struct FileStamp
+  {
+    int64_t m_Size = 0;
+    int64_t m_MTimeNs = 0;
+    int64_t m_StampTimeNs = 0;
+  };
+
+  static bool ProcessFiles(const std::vector<std::string>& p_Files,
+                           const std::function<bool(const std::string&, unsigned)>& p_Func);
+  static bool GetFileStamp(const std::string& p_Path, FileStamp& p_FileStamp);
+  static void SetFileStamp(const std::string& p_Path, const FileStamp& p_FileStamp);
+  static void SetFileStampBackdated(const std::string& p_Path);
+  static bool IsFileStampCurrent(const std::string& p_Path);
+
+private:
+  static std::mutex m_FileStampsMutex;
+  static std::map<std::string, FileStamp> m_FileStamps;
 };
@@ -0,0 +1,367 @@
+// coprocess.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "coprocess.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "loghelp.h"
+
+static const int s_TimeoutMs = 30 * 1000;
+static const int s_HandshakeTimeoutMs = 2 * 1000;
+static const size_t s_MaxCoProcesses = 8;
+static const int s_MaxFailures = 3;
+
+std::mutex CoProcessPool::m_PoolsMutex;
+std::map<std::string, std::unique_ptr<CoProcessPool>> CoProcessPool::m_Pools;
+
+CoProcess::CoProcess(const std::string& p_Cmd)
+  : m_Cmd(p_Cmd)
+{
+}
+
+CoProcess::~CoProcess()
+{
+  Stop();
+}
+
+bool CoProcess::Convert(const std::string& p_Input, std::string& p_Output)
+{
+  // writes to a co-process which exited would raise SIGPIPE, block it for this thread
+  sigset_t sigpipeMask;
+  sigset_t oldMask;
+  sigemptyset(&sigpipeMask);
+  sigaddset(&sigpipeMask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipeMask, &oldMask);
+
+  bool rv = true;
+  if (m_Pid == -1)
+  {
+    rv = Start();
+    if (rv)
+    {
+      // an empty document is exchanged first, so a converter not supporting the
+      // protocol (e.g. waiting for end of input) is detected without a long timeout
+      std::string handshakeOutput;
+      rv = Transfer("", handshakeOutput, s_HandshakeTimeoutMs) && handshakeOutput.empty();
+      if (!rv)
+      {
+        LOG_WARNING("co-process protocol not supported: %s", m_Cmd.c_str());
+        m_ProtocolFailed = true;
+      }
+    }
+  }
+
+  if (rv)
+  {
+    rv = Transfer(p_Input, p_Output, s_TimeoutMs);
+  }
+
+  sigset_t pendingMask;
+  if ((sigpending(&pendingMask) == 0) && sigismember(&pendingMask, SIGPIPE))
+  {
+    int sig = 0;
+    sigwait(&sigpipeMask, &sig);
+  }
+
+  pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+
+  if (!rv)
+  {
+    LOG_WARNING("co-process failed: %s", m_Cmd.c_str());
+    Stop();
+  }
+
+  return rv;
+}
+
+bool CoProcess::GetProtocolFailed() const
+{
+  return m_ProtocolFailed;
+}
+
+bool CoProcess::Start()
+{
+  int inPipe[2] = { -1, -1 };
+  int outPipe[2] = { -1, -1 };
+  if (!CreatePipe(inPipe) || !CreatePipe(outPipe))
+  {
+    LOG_WARNING("co-process pipe failed");
+    for (int fd : { inPipe[0], inPipe[1], outPipe[0], outPipe[1] })
+    {
+      if (fd != -1) close(fd);
+    }
+
+    return false;
+  }
+
+  int nullFd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    // only async-signal-safe calls until exec, dup2 clears close-on-exec for std fds
+    dup2(inPipe[0], STDIN_FILENO);
+    dup2(outPipe[1], STDOUT_FILENO);
+    if (nullFd != -1)
+    {
+      dup2(nullFd, STDERR_FILENO);
+    }
+
+    for (int fd : { inPipe[0], inPipe[1], outPipe[0], outPipe[1], nullFd })
+    {
+      if (fd > STDERR_FILENO) close(fd);
+    }
+
+    execl("/bin/sh", "sh", "-c", m_Cmd.c_str(), (char*)NULL);
+    _exit(127);
+  }
+
+  close(inPipe[0]);
+  close(outPipe[1]);
+  if (nullFd != -1)
+  {
+    close(nullFd);
+  }
+
+  if (pid == -1)
+  {
+    LOG_WARNING("co-process fork failed");
+    close(inPipe[1]);
+    close(outPipe[0]);
+    return false;
+  }
+
+  m_Pid = pid;
+  m_WriteFd = inPipe[1];
+  m_ReadFd = outPipe[0];
+  fcntl(m_WriteFd, F_SETFL, fcntl(m_WriteFd, F_GETFL) | O_NONBLOCK);
+  LOG_DEBUG("co-process %d started: %s", m_Pid, m_Cmd.c_str());
+
+  return true;
+}
+
+void CoProcess::Stop()
+{
+  if (m_WriteFd != -1)
+  {
+    close(m_WriteFd);
+    m_WriteFd = -1;
+  }
+
+  if (m_ReadFd != -1)
+  {
+    close(m_ReadFd);
+    m_ReadFd = -1;
+  }
+
+  if (m_Pid != -1)
+  {
+    kill(m_Pid, SIGKILL);
+    waitpid(m_Pid, NULL, 0);
+    m_Pid = -1;
+  }
+}
+
+bool CoProcess::Transfer(const std::string& p_Input, std::string& p_Output, int p_TimeoutMs)
+{
+  // output is read while writing input, so a converter replying in chunks cannot deadlock
+  const std::string header = std::to_string(p_Input.size()) + "\n";
+  const size_t writeTotal = header.size() + p_Input.size();
+  size_t written = 0;
+  std::string readBuf;
+  size_t outputLen = std::string::npos;
+
+  while (true)
+  {
+    struct pollfd fds[2];
+    nfds_t nfds = 0;
+    fds[nfds].fd = m_ReadFd;
+    fds[nfds].events = POLLIN;
+    fds[nfds++].revents = 0;
+    if (written < writeTotal)
+    {
+      fds[nfds].fd = m_WriteFd;
+      fds[nfds].events = POLLOUT;
+      fds[nfds++].revents = 0;
+    }
+
+    int rv = poll(fds, nfds, p_TimeoutMs);
+    if ((rv == -1) && (errno == EINTR)) continue;
+
+    if (rv <= 0)
+    {
+      LOG_WARNING("co-process %s", (rv == 0) ? "timeout" : "poll failed");
+      return false;
+    }
+
+    if ((nfds > 1) && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP)))
+    {
+      const bool inHeader = (written < header.size());
+      const char* data = inHeader ? (header.c_str() + written) : (p_Input.c_str() + written - header.size());
+      const size_t len = inHeader ? (header.size() - written) : (writeTotal - written);
+      ssize_t count = write(m_WriteFd, data, len);
+      if (count > 0)
+      {
+        written += static_cast<size_t>(count);
+      }
+      else if ((count == -1) && (errno != EAGAIN) && (errno != EINTR))
+      {
+        return false;
+      }
+    }
+
+    if (fds[0].revents & (POLLIN | POLLERR | POLLHUP))
+    {
+      char buf[64 * 1024];
+      ssize_t count = read(m_ReadFd, buf, sizeof(buf));
+      if (count <= 0)
+      {
+        if ((count == -1) && (errno == EINTR)) continue;
+
+        return false;
+      }
+
+      readBuf.append(buf, static_cast<size_t>(count));
+      if (outputLen == std::string::npos)
+      {
+        size_t headerEnd = readBuf.find('\n');
+        if (headerEnd == std::string::npos) continue;
+
+        const std::string lenStr = readBuf.substr(0, headerEnd);
+        if (lenStr.empty() || (lenStr.find_first_not_of("0123456789") != std::string::npos))
+        {
+          LOG_WARNING("co-process invalid frame header");
+          return false;
+        }
+
+        outputLen = static_cast<size_t>(strtoull(lenStr.c_str(), NULL, 10));
+        readBuf.erase(0, headerEnd + 1);
+      }
+
+      if (readBuf.size() >= outputLen)
+      {
+        // a reply before complete input, or trailing data, leaves the stream out of sync
+        if ((written < writeTotal) || (readBuf.size() > outputLen))
+        {
+          LOG_WARNING("co-process frame out of sync");
+          return false;
+        }
+
+        p_Output.swap(readBuf);
+        return true;
+      }
+    }
+  }
+}
+
+bool CoProcess::CreatePipe(int p_Fds[2])
+{
+  // close-on-exec is set atomically where supported, so a fork in another thread
+  // cannot inherit pipe ends and keep the co-process from seeing end of input
+#if defined(__linux__)
+  return pipe2(p_Fds, O_CLOEXEC) == 0;
+#else
+  if (pipe(p_Fds) != 0) return false;
+
+  fcntl(p_Fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p_Fds[1], F_SETFD, FD_CLOEXEC);
+  return true;
+#endif
+}
+
+void CoProcessPool::SetCmds(const std::set<std::string>& p_Cmds)
+{
+  std::lock_guard<std::mutex> lock(m_PoolsMutex);
+  m_Pools.clear();
+  for (const auto& cmd : p_Cmds)
+  {
+    if (cmd.empty()) continue;
+
+    LOG_DEBUG("co-process mode for: %s", cmd.c_str());
+    m_Pools[cmd].reset(new CoProcessPool(cmd));
+  }
+}
+
+bool CoProcessPool::Convert(const std::string& p_Cmd, const std::string& p_Input, std::string& p_Output)
+{
+  CoProcessPool* pool = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(m_PoolsMutex);
+    auto it = m_Pools.find(p_Cmd);
+    if (it == m_Pools.end()) return false;
+
+    pool = it->second.get();
+  }
+
+  return pool->PoolConvert(p_Input, p_Output);
+}
+
+void CoProcessPool::Cleanup()
+{
+  std::lock_guard<std::mutex> lock(m_PoolsMutex);
+  m_Pools.clear();
+}
+
+CoProcessPool::CoProcessPool(const std::string& p_Cmd)
+  : m_Cmd(p_Cmd)
+{
+}
+
+bool CoProcessPool::PoolConvert(const std::string& p_Input, std::string& p_Output)
+{
+  std::unique_ptr<CoProcess> coProcess;
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_CondVar.wait(lock, [&]() { return m_Disabled || !m_Idle.empty() || (m_Count < s_MaxCoProcesses); });
+    if (m_Disabled) return false;
+
+    if (!m_Idle.empty())
+    {
+      coProcess = std::move(m_Idle.back());
+      m_Idle.pop_back();
+    }
+    else
+    {
+      coProcess.reset(new CoProcess(m_Cmd));
+      ++m_Count;
+    }
+  }
+
+  const bool rv = coProcess->Convert(p_Input, p_Output);
+
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if (rv)
+    {
+      m_Failures = 0;
+    }
+    else if (coProcess->GetProtocolFailed())
+    {
+      LOG_WARNING("co-process mode disabled, protocol not supported: %s", m_Cmd.c_str());
+      m_Disabled = true;
+    }
+    else if (++m_Failures >= s_MaxFailures)
+    {
+      LOG_WARNING("co-process mode disabled after repeated failures: %s", m_Cmd.c_str());
+      m_Disabled = true;
+    }
+
+    m_Idle.push_back(std::move(coProcess));
+    m_CondVar.notify_all();
+  }
+
+  return rv;
+}
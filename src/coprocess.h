@@ -0,0 +1,73 @@
+// coprocess.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// Long-lived external converter process. Documents are exchanged over the process
+// stdin / stdout, each framed as a decimal byte count and a newline, followed by
+// the document data.
+class CoProcess
+{
+public:
+  explicit CoProcess(const std::string& p_Cmd);
+  virtual ~CoProcess();
+
+  bool Convert(const std::string& p_Input, std::string& p_Output);
+  bool GetProtocolFailed() const;
+
+private:
+  bool Start();
+  void Stop();
+  bool Transfer(const std::string& p_Input, std::string& p_Output, int p_TimeoutMs);
+  static bool CreatePipe(int p_Fds[2]);
+
+private:
+  std::string m_Cmd;
+  bool m_ProtocolFailed = false;
+  pid_t m_Pid = -1;
+  int m_WriteFd = -1;
+  int m_ReadFd = -1;
+};
+
+// Pool of co-processes per converter command, growing on demand with the number of
+// concurrent conversions. Conversion fails (for caller to fall back to one-shot
+// command execution) if co-process mode is not enabled for the command, or if the
+// co-processes keep failing.
+class CoProcessPool
+{
+public:
+  static void SetCmds(const std::set<std::string>& p_Cmds);
+  static bool Convert(const std::string& p_Cmd, const std::string& p_Input, std::string& p_Output);
+  static void Cleanup();
+
+private:
+  explicit CoProcessPool(const std::string& p_Cmd);
+
+  bool PoolConvert(const std::string& p_Input, std::string& p_Output);
+
+private:
+  std::string m_Cmd;
+  std::mutex m_Mutex;
+  std::condition_variable m_CondVar;
+  std::vector<std::unique_ptr<CoProcess>> m_Idle;
+  size_t m_Count = 0;
+  int m_Failures = 0;
+  bool m_Disabled = false;
+
+  static std::mutex m_PoolsMutex;
+  static std::map<std::string, std::unique_ptr<CoProcessPool>> m_Pools;
+};
@@ -1,183 +1,565 @@
 // crypto.cpp
 //
-// Copyright (c) 2019-2022 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #include "crypto.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <openssl/conf.h>
 #include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/ssl.h>
 
+#include <sys/stat.h>
+
 #include "loghelp.h"
 #include "util.h"
 
-void Crypto::Init()
+namespace
 {
-  SSL_library_init();
-  SSL_load_error_strings();
-}
+  // Chunked AES-256-GCM format. Chunks are sealed independently, with a nonce made of
+  // the file nonce prefix and chunk index, and the header as additional authenticated
+  // data. This allows chunks to be processed in parallel and read at arbitrary offsets,
+  // while truncation, reordering and modification are detected.
+  //   header: magic (8) | salt (8) | nonce prefix (8) | plaintext length (8, little endian)
+  //   chunk:  ciphertext (up to 64 KB) | tag (16)
+  // The magic specifies how the file key is obtained from the salt: derived from the
+  // pass using PBKDF2, or derived from the data key of the pass (see InitDataKey) using
+  // HMAC-SHA256.
+  const char s_GcmPassMagic[] = "nmailGC1";
+  const char s_GcmDataKeyMagic[] = "nmailGK1";
+  const size_t s_MagicLen = 8;
+  const size_t s_SaltLen = 8;
+  const size_t s_NoncePrefixLen = 8;
+  const size_t s_HeaderLen = s_MagicLen + s_SaltLen + s_NoncePrefixLen + 8;
+  const size_t s_ChunkLen = 64 * 1024;
+  const size_t s_TagLen = 16;
+  const size_t s_KeyLen = 32;
+  const int s_KdfIterations = 10000;
+
+  // Wrapped data key format, with the data key sealed by AES-256-GCM using a key
+  // derived from the pass, and the preceding fields as additional authenticated data.
+  //   magic (8) | salt (16) | iterations (4, big endian) | nonce (12) | data key (32) | tag (16)
+  const char s_WrapMagic[] = "nmailKW1";
+  const size_t s_WrapSaltLen = 16;
+  const size_t s_WrapNonceLen = 12;
+  const size_t s_WrapAadLen = s_MagicLen + s_WrapSaltLen + 4;
+  const size_t s_WrapLen = s_WrapAadLen + s_WrapNonceLen + s_KeyLen + s_TagLen;
+  const int s_WrapKdfIterations = 200000;
+
+  // files are processed in batches of chunks to bound memory usage
+  const size_t s_BatchChunks = 256;
+
+  // minimum number of chunks per worker thread, to amortize handing work to it
+  const size_t s_MinThreadChunks = 8;
+
+  // at most this many threads process chunks concurrently, callers included
+  const unsigned s_HwThreads = std::max(1U, std::min(8U, std::thread::hardware_concurrency()));
+
+  // Shared chunk worker threads, started on first use and reused by all calls, so that
+  // processing many files neither starts threads per file nor multiplies thread count.
+  class ChunkWorkers
+  {
+  public:
+    ~ChunkWorkers()
+    {
+      Stop();
+    }
 
-void Crypto::Cleanup()
-{
-}
+    void Run(const std::function<void()>& p_Task)
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (m_Threads.empty())
+      {
+        m_Running = true;
+        for (unsigned i = 1; i < s_HwThreads; ++i)
+        {
+          m_Threads.push_back(std::thread(&ChunkWorkers::Process, this));
+        }
+      }
 
-std::string Crypto::GetVersion()
-{
-  return std::string(SSLeay_version(SSLEAY_VERSION));
-}
+      m_Queue.push_back(p_Task);
+      m_CondVar.notify_one();
+    }
 
-std::string Crypto::AESEncrypt(const std::string& p_Plaintext, const std::string& p_Pass)
-{
-  unsigned char salt[8] = { 0 };
-  RAND_bytes(salt, sizeof(salt));
+    void Stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Running = false;
+        m_CondVar.notify_all();
+      }
 
-  unsigned char key[32] = { 0 };
-  unsigned char iv[32] = { 0 };
-  EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha1(), salt,
-                 (unsigned char*)const_cast<char*>(p_Pass.c_str()), p_Pass.size(), 1, key, iv);
+      for (auto& thread : m_Threads)
+      {
+        thread.join();
+      }
 
-  std::string ciphertext;
+      m_Threads.clear();
+    }
 
-  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-  if (ctx != NULL)
-  {
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) == 1)
+  private:
+    void Process()
     {
-      int buflen = p_Plaintext.size() + 256;
-      unsigned char* buf = (unsigned char*)calloc(buflen, 1);
-      if (buf != NULL)
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      while (true)
       {
-        int len = 0;
-        unsigned char* cipherbuf = buf + 16;
-        if (EVP_EncryptUpdate(ctx, cipherbuf, &len,
-                              (const unsigned char*)p_Plaintext.c_str(),
-                              p_Plaintext.size()) == 1)
-        {
-          int cipherbuflen = len;
-          if (EVP_EncryptFinal_ex(ctx, cipherbuf + len, &len) == 1)
-          {
-            cipherbuflen += len;
-            buflen = cipherbuflen + 16;
+        m_CondVar.wait(lock, [&]() { return !m_Running || !m_Queue.empty(); });
+        if (m_Queue.empty()) break;
+
+        std::function<void()> task = m_Queue.front();
+        m_Queue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+      }
+    }
 
-            memcpy(buf, "Salted__", 8);
-            memcpy(buf + 8, salt, 8);
+  private:
+    std::mutex m_Mutex;
+    std::condition_variable m_CondVar;
+    std::deque<std::function<void()>> m_Queue;
+    std::vector<std::thread> m_Threads;
+    bool m_Running = false;
+  };
 
-            ciphertext = std::string((char*)buf, buflen);
-          }
-        }
+  ChunkWorkers s_ChunkWorkers;
 
-        free(buf);
-      }
-    }
+  // tracks chunk worker tasks of one call, tasks not started when the call has completed
+  // all chunks itself are skipped
+  struct ChunkTasks
+  {
+    std::mutex m_Mutex;
+    std::condition_variable m_CondVar;
+    bool m_Closed = false;
+    unsigned m_Active = 0;
+  };
 
-    EVP_CIPHER_CTX_free(ctx);
+  std::mutex s_KeyMutex;
+  std::map<std::string, std::string> s_Keys;
+  std::map<std::string, std::string> s_DataKeys;
+
+  bool IsGcm(const char* p_Data, size_t p_Size)
+  {
+    return (p_Size >= s_HeaderLen) &&
+      ((memcmp(p_Data, s_GcmPassMagic, s_MagicLen) == 0) || (memcmp(p_Data, s_GcmDataKeyMagic, s_MagicLen) == 0));
   }
 
-  return ciphertext;
-}
+  bool IsPassEncrypted(const char* p_Data, size_t p_Size)
+  {
+    return ((p_Size >= s_HeaderLen) && (memcmp(p_Data, s_GcmPassMagic, s_MagicLen) == 0)) ||
+      ((p_Size >= 16) && (memcmp(p_Data, "Salted__", 8) == 0));
+  }
 
-std::string Crypto::AESDecrypt(const std::string& p_Ciphertext, const std::string& p_Pass)
-{
-  if (p_Ciphertext.empty()) return std::string();
+  uint64_t GetChunkCount(uint64_t p_PlaintextLen)
+  {
+    // empty plaintext is stored as one empty chunk, to authenticate the header
+    return std::max<uint64_t>(1, (p_PlaintextLen + s_ChunkLen - 1) / s_ChunkLen);
+  }
+
+  uint64_t GetCiphertextLen(uint64_t p_PlaintextLen)
+  {
+    return s_HeaderLen + p_PlaintextLen + (GetChunkCount(p_PlaintextLen) * s_TagLen);
+  }
+
+  std::string GetRandomBytes(size_t p_Len)
+  {
+    std::string str(p_Len, '\0');
+    RAND_bytes((unsigned char*)&str[0], p_Len);
+    return str;
+  }
 
-  unsigned char salt[8] = { 0 };
-  unsigned char* ciphertext = (unsigned char*)const_cast<char*>(p_Ciphertext.c_str());
-  int ciphertextlen = p_Ciphertext.size();
-  if (strncmp((const char*)ciphertext, "Salted__", 8) == 0)
+  std::string GetEncryptSalt()
   {
-    memcpy(salt, &ciphertext[8], 8);
-    ciphertext += 16;
-    ciphertextlen -= 16;
+    // one salt per process, so the key is derived once for all files written
+    static const std::string salt = GetRandomBytes(s_SaltLen);
+    return salt;
   }
 
-  unsigned char key[32] = { 0 };
-  unsigned char iv[32] = { 0 };
-  EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha1(), salt,
-                 (unsigned char*)const_cast<char*>(p_Pass.c_str()), p_Pass.size(), 1, key, iv);
+  std::string MakeHeader(const char* p_Magic, const std::string& p_Salt, uint64_t p_PlaintextLen)
+  {
+    std::string header(s_HeaderLen, '\0');
+    memcpy(&header[0], p_Magic, s_MagicLen);
+    memcpy(&header[s_MagicLen], p_Salt.data(), s_SaltLen);
+    RAND_bytes((unsigned char*)&header[s_MagicLen + s_SaltLen], s_NoncePrefixLen);
+    for (size_t i = 0; i < 8; ++i)
+    {
+      header[s_MagicLen + s_SaltLen + s_NoncePrefixLen + i] = (char)((p_PlaintextLen >> (8 * i)) & 0xff);
+    }
+
+    return header;
+  }
 
-  std::string plaintext;
-  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-  if (ctx != NULL)
+  bool ParseHeader(const std::string& p_Header, uint64_t& p_PlaintextLen)
   {
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) == 1)
+    if (!IsGcm(p_Header.data(), p_Header.size())) return false;
+
+    p_PlaintextLen = 0;
+    for (size_t i = 0; i < 8; ++i)
     {
-      int len = 0;
-      unsigned char* buf = (unsigned char*)calloc(ciphertextlen + 256, 1);
-      if (buf != NULL)
+      p_PlaintextLen |= (uint64_t)(unsigned char)p_Header[s_MagicLen + s_SaltLen + s_NoncePrefixLen + i] << (8 * i);
+    }
+
+    return true;
+  }
+
+  bool GetPassKey(const std::string& p_Pass, const std::string& p_Salt, unsigned char* p_Key)
+  {
+    // @note: caller must hold s_KeyMutex
+    const std::string id = p_Salt + p_Pass;
+    auto it = s_Keys.find(id);
+    if (it == s_Keys.end())
+    {
+      std::string key(s_KeyLen, '\0');
+      if (PKCS5_PBKDF2_HMAC(p_Pass.c_str(), p_Pass.size(), (const unsigned char*)p_Salt.data(), p_Salt.size(),
+                            s_KdfIterations, EVP_sha256(), s_KeyLen, (unsigned char*)&key[0]) != 1)
       {
-        if (EVP_DecryptUpdate(ctx, buf, &len, ciphertext, ciphertextlen) == 1)
-        {
-          int plaintextlen = len;
-          if (EVP_DecryptFinal_ex(ctx, buf + len, &len) == 1)
-          {
-            plaintextlen += len;
-            plaintext = std::string((char*)buf, plaintextlen);
-          }
-        }
+        LOG_WARNING("key derivation failed");
+        return false;
+      }
+
+      it = s_Keys.insert(std::make_pair(id, key)).first;
+    }
+
+    memcpy(p_Key, it->second.data(), s_KeyLen);
+    return true;
+  }
+
+  bool GetDataKeyKey(const std::string& p_DataKey, const std::string& p_Salt, unsigned char* p_Key)
+  {
+    unsigned int keyLen = 0;
+    return (HMAC(EVP_sha256(), p_DataKey.data(), p_DataKey.size(), (const unsigned char*)p_Salt.data(),
+                 p_Salt.size(), p_Key, &keyLen) != NULL) && (keyLen == s_KeyLen);
+  }
+
+  bool GetEncryptKey(const std::string& p_Pass, uint64_t p_PlaintextLen, std::string& p_Header, unsigned char* p_Key)
+  {
+    std::lock_guard<std::mutex> lock(s_KeyMutex);
+    auto it = s_DataKeys.find(p_Pass);
+    if (it != s_DataKeys.end())
+    {
+      // a per-file key is derived from the data key and a random salt, which is cheap
+      const std::string salt = GetRandomBytes(s_SaltLen);
+      p_Header = MakeHeader(s_GcmDataKeyMagic, salt, p_PlaintextLen);
+      return GetDataKeyKey(it->second, salt, p_Key);
+    }
+
+    const std::string salt = GetEncryptSalt();
+    p_Header = MakeHeader(s_GcmPassMagic, salt, p_PlaintextLen);
+    return GetPassKey(p_Pass, salt, p_Key);
+  }
 
-        free(buf);
+  bool GetDecryptKey(const std::string& p_Pass, const std::string& p_Header, unsigned char* p_Key)
+  {
+    std::lock_guard<std::mutex> lock(s_KeyMutex);
+    const std::string salt = p_Header.substr(s_MagicLen, s_SaltLen);
+    if (memcmp(p_Header.data(), s_GcmDataKeyMagic, s_MagicLen) == 0)
+    {
+      auto it = s_DataKeys.find(p_Pass);
+      if (it == s_DataKeys.end())
+      {
+        LOG_WARNING("data key not available");
+        return false;
       }
 
+      return GetDataKeyKey(it->second, salt, p_Key);
+    }
+
+    return GetPassKey(p_Pass, salt, p_Key);
+  }
+
+  bool WrapDataKey(const std::string& p_DataKey, const std::string& p_Pass, std::string& p_Wrapped)
+  {
+    std::string wrapped(s_WrapLen, '\0');
+    memcpy(&wrapped[0], s_WrapMagic, s_MagicLen);
+    RAND_bytes((unsigned char*)&wrapped[s_MagicLen], s_WrapSaltLen);
+    for (size_t i = 0; i < 4; ++i)
+    {
+      wrapped[s_MagicLen + s_WrapSaltLen + i] = (char)((s_WrapKdfIterations >> (8 * (3 - i))) & 0xff);
+    }
+
+    RAND_bytes((unsigned char*)&wrapped[s_WrapAadLen], s_WrapNonceLen);
+
+    unsigned char kek[s_KeyLen] = { 0 };
+    bool rv = (PKCS5_PBKDF2_HMAC(p_Pass.c_str(), p_Pass.size(), (const unsigned char*)&wrapped[s_MagicLen],
+                                 s_WrapSaltLen, s_WrapKdfIterations, EVP_sha256(), s_KeyLen, kek) == 1);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (rv && (ctx != NULL))
+    {
+      unsigned char* out = (unsigned char*)&wrapped[s_WrapAadLen + s_WrapNonceLen];
+      int len = 0;
+      rv = (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, kek, (unsigned char*)&wrapped[s_WrapAadLen]) == 1) &&
+        (EVP_EncryptUpdate(ctx, NULL, &len, (const unsigned char*)wrapped.data(), s_WrapAadLen) == 1) &&
+        (EVP_EncryptUpdate(ctx, out, &len, (const unsigned char*)p_DataKey.data(), s_KeyLen) == 1) &&
+        (EVP_EncryptFinal_ex(ctx, out + len, &len) == 1) &&
+        (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, s_TagLen, out + s_KeyLen) == 1);
     }
 
     EVP_CIPHER_CTX_free(ctx);
+    OPENSSL_cleanse(kek, sizeof(kek));
+    if (rv)
+    {
+      p_Wrapped = wrapped;
+    }
+
+    return rv;
   }
 
-  return plaintext;
-}
+  bool UnwrapDataKey(const std::string& p_Wrapped, const std::string& p_Pass, std::string& p_DataKey)
+  {
+    if ((p_Wrapped.size() != s_WrapLen) || (memcmp(p_Wrapped.data(), s_WrapMagic, s_MagicLen) != 0)) return false;
 
-std::string Crypto::SHA256(const std::string& p_Str)
-{
-  std::string hexDigest;
-  EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
-  if (mdctx != nullptr)
+    int iterations = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      iterations = (iterations << 8) | (unsigned char)p_Wrapped[s_MagicLen + s_WrapSaltLen + i];
+    }
+
+    if (iterations <= 0) return false;
+
+    unsigned char kek[s_KeyLen] = { 0 };
+    std::string dataKey(s_KeyLen, '\0');
+    bool rv = (PKCS5_PBKDF2_HMAC(p_Pass.c_str(), p_Pass.size(), (const unsigned char*)&p_Wrapped[s_MagicLen],
+                                 s_WrapSaltLen, iterations, EVP_sha256(), s_KeyLen, kek) == 1);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (rv && (ctx != NULL))
+    {
+      const unsigned char* in = (const unsigned char*)&p_Wrapped[s_WrapAadLen + s_WrapNonceLen];
+      unsigned char* out = (unsigned char*)&dataKey[0];
+      int len = 0;
+      rv = (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, kek, (const unsigned char*)&p_Wrapped[s_WrapAadLen]) == 1) &&
+        (EVP_DecryptUpdate(ctx, NULL, &len, (const unsigned char*)p_Wrapped.data(), s_WrapAadLen) == 1) &&
+        (EVP_DecryptUpdate(ctx, out, &len, in, s_KeyLen) == 1) &&
+        (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, s_TagLen, const_cast<unsigned char*>(in + s_KeyLen)) == 1) &&
+        (EVP_DecryptFinal_ex(ctx, out + len, &len) == 1);
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+    OPENSSL_cleanse(kek, sizeof(kek));
+    if (rv)
+    {
+      p_DataKey = dataKey;
+    }
+
+    OPENSSL_cleanse(&dataKey[0], dataKey.size());
+    return rv;
+  }
+
+  bool WriteWrappedDataKey(const std::string& p_KeyPath, const std::string& p_Wrapped)
   {
-    if (EVP_DigestInit_ex(mdctx, EVP_sha256(), nullptr) == 1)
+    // replace key file atomically, as losing it makes all data key encrypted files unreadable
+    const std::string tmpPath = p_KeyPath + ".tmp";
+    Util::WriteFile(tmpPath, p_Wrapped);
+    chmod(tmpPath.c_str(), S_IRUSR | S_IWUSR);
+    if ((Util::ReadFile(tmpPath) != p_Wrapped) || (rename(tmpPath.c_str(), p_KeyPath.c_str()) != 0))
     {
-      if (EVP_DigestUpdate(mdctx, p_Str.c_str(), p_Str.size()) == 1)
+      LOG_WARNING("failed to write %s", p_KeyPath.c_str());
+      Util::DeleteFile(tmpPath);
+      return false;
+    }
+
+    return true;
+  }
+
+  void GetNonce(const std::string& p_Header, uint64_t p_Index, unsigned char* p_Nonce)
+  {
+    memcpy(p_Nonce, &p_Header[s_MagicLen + s_SaltLen], s_NoncePrefixLen);
+    for (size_t i = 0; i < 4; ++i)
+    {
+      p_Nonce[s_NoncePrefixLen + i] = (unsigned char)((p_Index >> (8 * (3 - i))) & 0xff);
+    }
+  }
+
+  bool SealChunk(EVP_CIPHER_CTX* p_Ctx, const std::string& p_Header, uint64_t p_Index,
+                 const char* p_In, size_t p_Len, char* p_Out)
+  {
+    unsigned char nonce[12] = { 0 };
+    GetNonce(p_Header, p_Index, nonce);
+
+    int len = 0;
+    return (EVP_EncryptInit_ex(p_Ctx, NULL, NULL, NULL, nonce) == 1) &&
+           (EVP_EncryptUpdate(p_Ctx, NULL, &len, (const unsigned char*)p_Header.data(), p_Header.size()) == 1) &&
+           (EVP_EncryptUpdate(p_Ctx, (unsigned char*)p_Out, &len, (const unsigned char*)p_In, p_Len) == 1) &&
+           (EVP_EncryptFinal_ex(p_Ctx, (unsigned char*)p_Out + len, &len) == 1) &&
+           (EVP_CIPHER_CTX_ctrl(p_Ctx, EVP_CTRL_GCM_GET_TAG, s_TagLen, p_Out + p_Len) == 1);
+  }
+
+  bool OpenChunk(EVP_CIPHER_CTX* p_Ctx, const std::string& p_Header, uint64_t p_Index,
+                 const char* p_In, size_t p_Len, char* p_Out)
+  {
+    unsigned char nonce[12] = { 0 };
+    GetNonce(p_Header, p_Index, nonce);
+
+    int len = 0;
+    return (EVP_DecryptInit_ex(p_Ctx, NULL, NULL, NULL, nonce) == 1) &&
+           (EVP_DecryptUpdate(p_Ctx, NULL, &len, (const unsigned char*)p_Header.data(), p_Header.size()) == 1) &&
+           (EVP_DecryptUpdate(p_Ctx, (unsigned char*)p_Out, &len, (const unsigned char*)p_In, p_Len) == 1) &&
+           (EVP_CIPHER_CTX_ctrl(p_Ctx, EVP_CTRL_GCM_SET_TAG, s_TagLen, const_cast<char*>(p_In + p_Len)) == 1) &&
+           (EVP_DecryptFinal_ex(p_Ctx, (unsigned char*)p_Out + len, &len) == 1);
+  }
+
+  // each worker sets up a cipher context with the key once, and then only changes nonce
+  // for each chunk it processes
+  bool ProcessChunks(uint64_t p_Count, const unsigned char* p_Key, bool p_Encrypt, unsigned p_MaxThreads,
+                     const std::function<bool(EVP_CIPHER_CTX*, uint64_t)>& p_Func)
+  {
+    const unsigned maxThreads = (p_MaxThreads != 0) ? std::min(s_HwThreads, p_MaxThreads) : s_HwThreads;
+    const unsigned numThreads =
+      (unsigned)std::min<uint64_t>(maxThreads, std::max<uint64_t>(1, p_Count / s_MinThreadChunks));
+
+    std::atomic<uint64_t> nextIndex(0);
+    std::atomic<bool> ok(true);
+    auto worker = [&]()
+    {
+      EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+      if ((ctx == NULL) || (EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, p_Key, NULL, p_Encrypt ? 1 : 0) != 1))
       {
-        unsigned int resultLen = 0;
-        unsigned int digestLen = EVP_MD_size(EVP_sha256());
-        std::vector<char> digest(digestLen);
+        EVP_CIPHER_CTX_free(ctx);
+        ok = false;
+        return;
+      }
 
-        if ((EVP_DigestFinal_ex(mdctx, (unsigned char*)digest.data(), &resultLen) == 1) &&
-            (resultLen == digestLen))
+      uint64_t index = 0;
+      while (ok && ((index = nextIndex++) < p_Count))
+      {
+        if (!p_Func(ctx, index))
         {
-          hexDigest = Util::ToHex(std::string(digest.begin(), digest.end()));
+          ok = false;
         }
       }
+
+      EVP_CIPHER_CTX_free(ctx);
+    };
+
+    std::shared_ptr<ChunkTasks> tasks = std::make_shared<ChunkTasks>();
+    for (unsigned i = 1; i < numThreads; ++i)
+    {
+      s_ChunkWorkers.Run([tasks, &worker]()
+      {
+        {
+          std::lock_guard<std::mutex> lock(tasks->m_Mutex);
+          if (tasks->m_Closed) return;
+
+          ++tasks->m_Active;
+        }
+
+        worker();
+
+        std::lock_guard<std::mutex> lock(tasks->m_Mutex);
+        --tasks->m_Active;
+        tasks->m_CondVar.notify_all();
+      });
     }
 
-    EVP_MD_CTX_free(mdctx);
+    worker();
+
+    std::unique_lock<std::mutex> lock(tasks->m_Mutex);
+    tasks->m_Closed = true;
+    tasks->m_CondVar.wait(lock, [&]() { return tasks->m_Active == 0; });
+
+    return ok;
   }
 
-  return hexDigest;
-}
+  bool EncryptChunks(const unsigned char* p_Key, const std::string& p_Header, uint64_t p_FirstIndex,
+                     const char* p_In, size_t p_Len, char* p_Out, unsigned p_MaxThreads = 0)
+  {
+    return ProcessChunks(std::max<uint64_t>(1, (p_Len + s_ChunkLen - 1) / s_ChunkLen), p_Key, true, p_MaxThreads,
+                         [&](EVP_CIPHER_CTX* p_Ctx, uint64_t p_Index)
+    {
+      const size_t offset = p_Index * s_ChunkLen;
+      const size_t len = std::min(s_ChunkLen, p_Len - offset);
+      return SealChunk(p_Ctx, p_Header, p_FirstIndex + p_Index, p_In + offset, len,
+                       p_Out + (p_Index * (s_ChunkLen + s_TagLen)));
+    });
+  }
 
-bool Crypto::AESEncryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass)
-{
-  unsigned char salt[8] = { 0 };
-  RAND_bytes(salt, sizeof(salt));
+  // p_Len is the plaintext length of the chunks, which are all full size except the last
+  bool DecryptChunks(const unsigned char* p_Key, const std::string& p_Header, uint64_t p_FirstIndex,
+                     const char* p_In, size_t p_Len, char* p_Out, unsigned p_MaxThreads = 0)
+  {
+    return ProcessChunks(std::max<uint64_t>(1, (p_Len + s_ChunkLen - 1) / s_ChunkLen), p_Key, false, p_MaxThreads,
+                         [&](EVP_CIPHER_CTX* p_Ctx, uint64_t p_Index)
+    {
+      const size_t offset = p_Index * s_ChunkLen;
+      const size_t len = std::min(s_ChunkLen, p_Len - offset);
+      return OpenChunk(p_Ctx, p_Header, p_FirstIndex + p_Index,
+                       p_In + (p_Index * (s_ChunkLen + s_TagLen)), len, p_Out + offset);
+    });
+  }
+
+  std::string LegacyDecrypt(const std::string& p_Ciphertext, const std::string& p_Pass)
+  {
+    if (p_Ciphertext.empty()) return std::string();
+
+    unsigned char salt[8] = { 0 };
+    unsigned char* ciphertext = (unsigned char*)const_cast<char*>(p_Ciphertext.c_str());
+    int ciphertextlen = p_Ciphertext.size();
+    if (strncmp((const char*)ciphertext, "Salted__", 8) == 0)
+    {
+      memcpy(salt, &ciphertext[8], 8);
+      ciphertext += 16;
+      ciphertextlen -= 16;
+    }
 
-  unsigned char key[32] = { 0 };
-  unsigned char iv[32] = { 0 };
-  EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha1(), salt, (unsigned char*)const_cast<char*>(p_Pass.c_str()),
-                 p_Pass.size(), 1, key, iv);
+    unsigned char key[32] = { 0 };
+    unsigned char iv[32] = { 0 };
+    EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha1(), salt,
+                   (unsigned char*)const_cast<char*>(p_Pass.c_str()), p_Pass.size(), 1, key, iv);
 
-  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-  if (ctx != NULL)
+    std::string plaintext;
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx != NULL)
+    {
+      if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) == 1)
+      {
+        int len = 0;
+        unsigned char* buf = (unsigned char*)calloc(ciphertextlen + 256, 1);
+        if (buf != NULL)
+        {
+          if (EVP_DecryptUpdate(ctx, buf, &len, ciphertext, ciphertextlen) == 1)
+          {
+            int plaintextlen = len;
+            if (EVP_DecryptFinal_ex(ctx, buf + len, &len) == 1)
+            {
+              plaintextlen += len;
+              plaintext = std::string((char*)buf, plaintextlen);
+            }
+          }
+
+          free(buf);
+        }
+
+      }
+
+      EVP_CIPHER_CTX_free(ctx);
+    }
+
+    return plaintext;
+  }
+
+  bool LegacyDecryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass)
   {
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) == 1)
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx != NULL)
     {
       // @todo: add file error handling
       std::ifstream inStream;
@@ -190,139 +572,330 @@ bool Crypto::AESEncryptFile(const std::string& p_InPath, const std::string& p_Ou
       std::ofstream outStream;
       outStream.open(p_OutPath, std::ios::binary);
 
-      outStream.write("Salted__", 8);
-      outStream.write((char*)salt, 8);
-
       const std::streamsize inBufLen = 64 * 1024;
       std::vector<char> inBuf(inBufLen);
 
-      const std::streamsize outBufLen = inBufLen + EVP_CIPHER_CTX_block_size(ctx);
-      std::vector<char> outBuf(outBufLen);
+      if (inFileRemainingLen < 16)
+      {
+        return false;
+      }
+
+      inStream.read(inBuf.data(), 8);
+      inFileRemainingLen -= 8;
+      if (strncmp((const char*)inBuf.data(), "Salted__", 8) != 0)
+      {
+        return false;
+      }
+
+      unsigned char salt[8] = { 0 };
+      inStream.read((char*)salt, 8);
+      inFileRemainingLen -= 8;
+
+      unsigned char key[32] = { 0 };
+      unsigned char iv[32] = { 0 };
+      EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha1(), salt, (unsigned char*)const_cast<char*>(p_Pass.c_str()),
+                     p_Pass.size(), 1, key, iv);
 
-      while (inFileRemainingLen > 0)
+      if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) == 1)
       {
-        std::streamsize readLen = std::min(inFileRemainingLen, inBufLen);
-        inStream.read(inBuf.data(), readLen);
+        const std::streamsize outBufLen = inBufLen + EVP_CIPHER_CTX_block_size(ctx);
+        std::vector<char> outBuf(outBufLen);
+
+        while (inFileRemainingLen > 0)
+        {
+          std::streamsize readLen = std::min(inFileRemainingLen, inBufLen);
+          inStream.read(inBuf.data(), readLen);
+
+          int writeLen = 0;
+          if (EVP_DecryptUpdate(ctx, (unsigned char*)outBuf.data(), &writeLen, (unsigned char*)inBuf.data(),
+                                readLen) == 0)
+          {
+            EVP_CIPHER_CTX_free(ctx);
+            return false;
+          }
+
+          outStream.write(outBuf.data(), writeLen);
+          inFileRemainingLen -= readLen;
+        }
 
         int writeLen = 0;
-        if (EVP_EncryptUpdate(ctx, (unsigned char*)outBuf.data(), &writeLen, (unsigned char*)inBuf.data(),
-                              readLen) == 0)
+        if (EVP_DecryptFinal_ex(ctx, (unsigned char*)outBuf.data(), &writeLen) == 0)
         {
           EVP_CIPHER_CTX_free(ctx);
           return false;
         }
 
         outStream.write(outBuf.data(), writeLen);
-        inFileRemainingLen -= readLen;
       }
-
-      int writeLen = 0;
-      if (EVP_EncryptFinal_ex(ctx, (unsigned char*)outBuf.data(), &writeLen) == 0)
+      else
       {
         EVP_CIPHER_CTX_free(ctx);
         return false;
       }
 
-      outStream.write(outBuf.data(), writeLen);
+      EVP_CIPHER_CTX_free(ctx);
     }
     else
     {
       return false;
     }
 
-    EVP_CIPHER_CTX_free(ctx);
+    return true;
   }
-  else
+}
+
+void Crypto::Init()
+{
+  SSL_library_init();
+  SSL_load_error_strings();
+}
+
+void Crypto::Cleanup()
+{
+  s_ChunkWorkers.Stop();
+
+  std::lock_guard<std::mutex> lock(s_KeyMutex);
+  for (auto& key : s_Keys)
   {
-    return false;
+    OPENSSL_cleanse(&key.second[0], key.second.size());
   }
 
-  return true;
+  s_Keys.clear();
+
+  for (auto& dataKey : s_DataKeys)
+  {
+    OPENSSL_cleanse(&dataKey.second[0], dataKey.second.size());
+  }
+
+  s_DataKeys.clear();
+}
+
+std::string Crypto::GetVersion()
+{
+  return std::string(SSLeay_version(SSLEAY_VERSION));
+}
+
+std::string Crypto::AESEncrypt(const std::string& p_Plaintext, const std::string& p_Pass)
+{
+  std::string header;
+  unsigned char key[s_KeyLen] = { 0 };
+  if (!GetEncryptKey(p_Pass, p_Plaintext.size(), header, key)) return std::string();
+
+  std::string ciphertext(GetCiphertextLen(p_Plaintext.size()), '\0');
+  memcpy(&ciphertext[0], header.data(), s_HeaderLen);
+  const bool rv = EncryptChunks(key, header, 0, p_Plaintext.data(), p_Plaintext.size(), &ciphertext[s_HeaderLen]);
+  OPENSSL_cleanse(key, sizeof(key));
+
+  if (!rv)
+  {
+    ciphertext.clear();
+  }
+
+  return ciphertext;
 }
 
-bool Crypto::AESDecryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass)
+std::string Crypto::AESDecrypt(const std::string& p_Ciphertext, const std::string& p_Pass)
 {
-  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-  if (ctx != NULL)
+  if (!IsGcm(p_Ciphertext.data(), p_Ciphertext.size())) return LegacyDecrypt(p_Ciphertext, p_Pass);
+
+  const std::string header = p_Ciphertext.substr(0, s_HeaderLen);
+  uint64_t plaintextLen = 0;
+  if (!ParseHeader(header, plaintextLen) || (p_Ciphertext.size() != GetCiphertextLen(plaintextLen)))
   {
-    // @todo: add file error handling
-    std::ifstream inStream;
-    inStream.open(p_InPath, std::ios::binary);
+    LOG_WARNING("invalid ciphertext length");
+    return std::string();
+  }
 
-    inStream.seekg(0, std::ios::end);
-    std::streamsize inFileRemainingLen = inStream.tellg();
-    inStream.seekg(0, std::ios::beg);
+  unsigned char key[s_KeyLen] = { 0 };
+  if (!GetDecryptKey(p_Pass, header, key)) return std::string();
 
-    std::ofstream outStream;
-    outStream.open(p_OutPath, std::ios::binary);
+  std::string plaintext(plaintextLen, '\0');
+  const bool rv = DecryptChunks(key, header, 0, p_Ciphertext.data() + s_HeaderLen, plaintextLen, &plaintext[0]);
+  OPENSSL_cleanse(key, sizeof(key));
 
-    const std::streamsize inBufLen = 64 * 1024;
-    std::vector<char> inBuf(inBufLen);
+  if (!rv)
+  {
+    plaintext.clear();
+  }
 
-    if (inFileRemainingLen < 16)
+  return plaintext;
+}
+
+bool Crypto::InitDataKey(const std::string& p_KeyPath, const std::string& p_Pass)
+{
+  std::string dataKey;
+  if (Util::Exists(p_KeyPath))
+  {
+    if (!UnwrapDataKey(Util::ReadFile(p_KeyPath), p_Pass, dataKey))
     {
+      LOG_WARNING("failed to unwrap data key %s", p_KeyPath.c_str());
       return false;
     }
-
-    inStream.read(inBuf.data(), 8);
-    inFileRemainingLen -= 8;
-    if (strncmp((const char*)inBuf.data(), "Salted__", 8) != 0)
+  }
+  else
+  {
+    LOG_DEBUG("create data key %s", p_KeyPath.c_str());
+    dataKey = GetRandomBytes(s_KeyLen);
+    std::string wrapped;
+    if (!WrapDataKey(dataKey, p_Pass, wrapped) || !WriteWrappedDataKey(p_KeyPath, wrapped))
     {
+      OPENSSL_cleanse(&dataKey[0], dataKey.size());
       return false;
     }
+  }
 
-    unsigned char salt[8] = { 0 };
-    inStream.read((char*)salt, 8);
-    inFileRemainingLen -= 8;
+  std::lock_guard<std::mutex> lock(s_KeyMutex);
+  s_DataKeys[p_Pass] = dataKey;
+  OPENSSL_cleanse(&dataKey[0], dataKey.size());
+  return true;
+}
 
-    unsigned char key[32] = { 0 };
-    unsigned char iv[32] = { 0 };
-    EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha1(), salt, (unsigned char*)const_cast<char*>(p_Pass.c_str()),
-                   p_Pass.size(), 1, key, iv);
+bool Crypto::AddDataKeyPass(const std::string& p_Pass, const std::string& p_NewPass)
+{
+  // in memory only, the stored data key remains wrapped by p_Pass
+  std::lock_guard<std::mutex> lock(s_KeyMutex);
+  auto it = s_DataKeys.find(p_Pass);
+  if (it == s_DataKeys.end()) return false;
 
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) == 1)
-    {
-      const std::streamsize outBufLen = inBufLen + EVP_CIPHER_CTX_block_size(ctx);
-      std::vector<char> outBuf(outBufLen);
+  s_DataKeys[p_NewPass] = it->second;
+  return true;
+}
+
+bool Crypto::ChangeDataKeyPass(const std::string& p_KeyPath, const std::string& p_OldPass,
+                               const std::string& p_NewPass)
+{
+  // only the wrapped data key is re-encrypted, data encrypted using it is unaffected
+  if (!InitDataKey(p_KeyPath, p_OldPass)) return false;
+
+  std::lock_guard<std::mutex> lock(s_KeyMutex);
+  const std::string dataKey = s_DataKeys[p_OldPass];
+  std::string wrapped;
+  if (!WrapDataKey(dataKey, p_NewPass, wrapped) || !WriteWrappedDataKey(p_KeyPath, wrapped)) return false;
+
+  s_DataKeys[p_NewPass] = dataKey;
+  return true;
+}
+
+bool Crypto::IsPassEncrypted(const std::string& p_Ciphertext)
+{
+  return ::IsPassEncrypted(p_Ciphertext.data(), p_Ciphertext.size());
+}
+
+bool Crypto::IsPassEncryptedFile(const std::string& p_Path)
+{
+  std::ifstream inStream(p_Path, std::ios::binary);
+  std::vector<char> header(s_HeaderLen);
+  inStream.read(header.data(), header.size());
+  return ::IsPassEncrypted(header.data(), inStream.gcount());
+}
 
-      while (inFileRemainingLen > 0)
+std::string Crypto::SHA256(const std::string& p_Str)
+{
+  std::string hexDigest;
+  EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+  if (mdctx != nullptr)
+  {
+    if (EVP_DigestInit_ex(mdctx, EVP_sha256(), nullptr) == 1)
+    {
+      if (EVP_DigestUpdate(mdctx, p_Str.c_str(), p_Str.size()) == 1)
       {
-        std::streamsize readLen = std::min(inFileRemainingLen, inBufLen);
-        inStream.read(inBuf.data(), readLen);
+        unsigned int resultLen = 0;
+        unsigned int digestLen = EVP_MD_size(EVP_sha256());
+        std::vector<char> digest(digestLen);
 
-        int writeLen = 0;
-        if (EVP_DecryptUpdate(ctx, (unsigned char*)outBuf.data(), &writeLen, (unsigned char*)inBuf.data(),
-                              readLen) == 0)
+        if ((EVP_DigestFinal_ex(mdctx, (unsigned char*)digest.data(), &resultLen) == 1) &&
+            (resultLen == digestLen))
         {
-          EVP_CIPHER_CTX_free(ctx);
-          return false;
+          hexDigest = Util::ToHex(std::string(digest.begin(), digest.end()));
         }
-
-        outStream.write(outBuf.data(), writeLen);
-        inFileRemainingLen -= readLen;
       }
+    }
 
-      int writeLen = 0;
-      if (EVP_DecryptFinal_ex(ctx, (unsigned char*)outBuf.data(), &writeLen) == 0)
-      {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
-      }
+    EVP_MD_CTX_free(mdctx);
+  }
 
-      outStream.write(outBuf.data(), writeLen);
-    }
-    else
-    {
-      EVP_CIPHER_CTX_free(ctx);
-      return false;
-    }
+  return hexDigest;
+}
 
-    EVP_CIPHER_CTX_free(ctx);
+bool Crypto::AESEncryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass,
+                            unsigned p_MaxThreads /* = 0 */)
+{
+  std::ifstream inStream(p_InPath, std::ios::binary | std::ios::ate);
+  if (!inStream.is_open()) return false;
+
+  const uint64_t plaintextLen = inStream.tellg();
+  inStream.seekg(0, std::ios::beg);
+
+  std::ofstream outStream(p_OutPath, std::ios::binary | std::ios::trunc);
+  if (!outStream.is_open()) return false;
+
+  std::string header;
+  unsigned char key[s_KeyLen] = { 0 };
+  if (!GetEncryptKey(p_Pass, plaintextLen, header, key)) return false;
+
+  outStream.write(header.data(), header.size());
+
+  const uint64_t chunkCount = GetChunkCount(plaintextLen);
+  std::vector<char> inBuf(std::min<uint64_t>(chunkCount, s_BatchChunks) * s_ChunkLen);
+  std::vector<char> outBuf(std::min<uint64_t>(chunkCount, s_BatchChunks) * (s_ChunkLen + s_TagLen));
+  bool rv = true;
+  for (uint64_t index = 0; rv && (index < chunkCount); index += s_BatchChunks)
+  {
+    const uint64_t offset = index * s_ChunkLen;
+    const size_t len = std::min<uint64_t>(plaintextLen - offset, s_BatchChunks * s_ChunkLen);
+    rv = inStream.read(inBuf.data(), len) &&
+      EncryptChunks(key, header, index, inBuf.data(), len, outBuf.data(), p_MaxThreads) &&
+      outStream.write(outBuf.data(), GetCiphertextLen(len) - s_HeaderLen);
   }
-  else
+
+  OPENSSL_cleanse(key, sizeof(key));
+
+  return rv && outStream.flush();
+}
+
+bool Crypto::AESDecryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass,
+                            unsigned p_MaxThreads /* = 0 */)
+{
+  std::ifstream inStream(p_InPath, std::ios::binary | std::ios::ate);
+  if (!inStream.is_open()) return false;
+
+  const uint64_t ciphertextLen = inStream.tellg();
+  inStream.seekg(0, std::ios::beg);
+
+  std::string header(s_HeaderLen, '\0');
+  uint64_t plaintextLen = 0;
+  if (!inStream.read(&header[0], s_HeaderLen) || !ParseHeader(header, plaintextLen))
+  {
+    inStream.close();
+    return LegacyDecryptFile(p_InPath, p_OutPath, p_Pass);
+  }
+
+  if (ciphertextLen != GetCiphertextLen(plaintextLen))
   {
+    LOG_WARNING("invalid ciphertext length %s", p_InPath.c_str());
     return false;
   }
 
-  return true;
+  std::ofstream outStream(p_OutPath, std::ios::binary | std::ios::trunc);
+  if (!outStream.is_open()) return false;
+
+  unsigned char key[s_KeyLen] = { 0 };
+  if (!GetDecryptKey(p_Pass, header, key)) return false;
+
+  const uint64_t chunkCount = GetChunkCount(plaintextLen);
+  std::vector<char> inBuf(std::min<uint64_t>(chunkCount, s_BatchChunks) * (s_ChunkLen + s_TagLen));
+  std::vector<char> outBuf(std::min<uint64_t>(chunkCount, s_BatchChunks) * s_ChunkLen);
+  bool rv = true;
+  for (uint64_t index = 0; rv && (index < chunkCount); index += s_BatchChunks)
+  {
+    const uint64_t offset = index * s_ChunkLen;
+    const size_t len = std::min<uint64_t>(plaintextLen - offset, s_BatchChunks * s_ChunkLen);
+    rv = inStream.read(inBuf.data(), GetCiphertextLen(len) - s_HeaderLen) &&
+      DecryptChunks(key, header, index, inBuf.data(), len, outBuf.data(), p_MaxThreads) &&
+      outStream.write(outBuf.data(), len);
+  }
+
+  OPENSSL_cleanse(key, sizeof(key));
+
+  return rv && outStream.flush();
 }
@@ -1,12 +1,13 @@
 // crypto.h
 //
-// Copyright (c) 2019-2021 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 class Crypto
@@ -19,8 +20,21 @@ public:
   static std::string AESEncrypt(const std::string& p_Plaintext, const std::string& p_Pass);
   static std::string AESDecrypt(const std::string& p_Ciphertext, const std::string& p_Pass);
 
+  // Data encrypted with a pass that has a data key is encrypted using keys derived from
+  // the data key, which in turn is stored wrapped by a key derived from the pass. This
+  // makes changing the pass independent of the amount of encrypted data.
+  static bool InitDataKey(const std::string& p_KeyPath, const std::string& p_Pass);
+  static bool AddDataKeyPass(const std::string& p_Pass, const std::string& p_NewPass);
+  static bool ChangeDataKeyPass(const std::string& p_KeyPath, const std::string& p_OldPass,
+                                const std::string& p_NewPass);
+  static bool IsPassEncrypted(const std::string& p_Ciphertext);
+  static bool IsPassEncryptedFile(const std::string& p_Path);
+
   static std::string SHA256(const std::string& p_Str);
 
-  static bool AESEncryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass);
-  static bool AESDecryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass);
+  // p_MaxThreads limits the worker threads used for the file, 0 for default (up to 8)
+  static bool AESEncryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass,
+                             unsigned p_MaxThreads = 0);
+  static bool AESDecryptFile(const std::string& p_InPath, const std::string& p_OutPath, const std::string& p_Pass,
+                             unsigned p_MaxThreads = 0);
 };
@@ -7,28 +7,134 @@
 
 #include "encoding.h"
 
+#include <cerrno>
+#include <cstring>
+#include <map>
 #include <string>
 
 #include <iconv.h>
-#include <libetpan/charconv.h>
 #include <magic.h>
+#include <strings.h>
 
 #include "imapurl.h"
 
 #include "log.h"
 #include "loghelp.h"
+#include "util.h"
+
+namespace
+{
+  // libmagic cookies are not thread-safe and loading the database is costly, so each
+  // thread lazily opens a cookie which is kept for the lifetime of the thread
+  class MagicCookie
+  {
+  public:
+    ~MagicCookie()
+    {
+      if (m_Cookie != NULL)
+      {
+        magic_close(m_Cookie);
+      }
+    }
+
+    magic_t Get()
+    {
+      if (!m_Opened)
+      {
+        m_Opened = true;
+        m_Cookie = magic_open(MAGIC_MIME_ENCODING);
+        if ((m_Cookie != NULL) && (magic_load(m_Cookie, NULL) != 0))
+        {
+          LOG_WARNING("magic load failed");
+          magic_close(m_Cookie);
+          m_Cookie = NULL;
+        }
+      }
+
+      return m_Cookie;
+    }
+
+  private:
+    bool m_Opened = false;
+    magic_t m_Cookie = NULL;
+  };
+
+  // per-thread iconv descriptors keyed by destination and source charset, failed
+  // opens are cached too, to not retry unknown charsets for every part
+  class IconvCache
+  {
+  public:
+    ~IconvCache()
+    {
+      Clear();
+    }
+
+    iconv_t Get(const std::string& p_DstEnc, const std::string& p_SrcEnc)
+    {
+      const std::pair<std::string, std::string> key(p_DstEnc, p_SrcEnc);
+      auto it = m_Descriptors.find(key);
+      if (it != m_Descriptors.end())
+      {
+        if (it->second != (iconv_t)-1)
+        {
+          // reset conversion state
+          iconv(it->second, NULL, NULL, NULL, NULL);
+        }
+
+        return it->second;
+      }
+
+      static const size_t maxDescriptors = 32;
+      if (m_Descriptors.size() >= maxDescriptors)
+      {
+        Clear();
+      }
+
+      iconv_t cd = iconv_open(p_DstEnc.c_str(), p_SrcEnc.c_str());
+      m_Descriptors[key] = cd;
+      return cd;
+    }
+
+  private:
+    void Clear()
+    {
+      for (auto& descriptor : m_Descriptors)
+      {
+        if (descriptor.second != (iconv_t)-1)
+        {
+          iconv_close(descriptor.second);
+        }
+      }
+
+      m_Descriptors.clear();
+    }
+
+  private:
+    std::map<std::pair<std::string, std::string>, iconv_t> m_Descriptors;
+  };
+
+  thread_local MagicCookie s_MagicCookie;
+  thread_local IconvCache s_IconvCache;
+}
 
 void Encoding::ConvertToUtf8(const std::string& p_Enc, std::string& p_Str)
 {
   std::string enc = p_Enc;
   if (enc == "utf-8") return;
 
+  // common case of ascii in ascii-compatible charset, or valid utf-8 without charset
   bool detected = false;
   if (enc.empty() || (enc == "binary"))
   {
+    if (Util::IsValidUtf8(p_Str)) return;
+
     enc = Detect(p_Str);
     detected = true;
   }
+  else if (IsAsciiCompatible(enc) && Util::IsAscii(p_Str))
+  {
+    return;
+  }
 
   if (!enc.empty() && (enc != "binary"))
   {
@@ -78,22 +184,16 @@ std::string Encoding::Utf8ToImapUtf7(const std::string& p_Src)
 
 std::string Encoding::Detect(const std::string& p_Str)
 {
-  int flags = MAGIC_MIME_ENCODING;
-  magic_t cookie = magic_open(flags);
+  magic_t cookie = s_MagicCookie.Get();
   if (cookie == NULL) return "";
 
   std::string mime;
-  if (magic_load(cookie, NULL) == 0)
+  const char* rv = magic_buffer(cookie, p_Str.c_str(), p_Str.size());
+  if (rv != NULL)
   {
-    const char* rv = magic_buffer(cookie, p_Str.c_str(), p_Str.size());
-    if (rv != NULL)
-    {
-      mime = std::string(rv);
-    }
+    mime = std::string(rv);
   }
 
-  magic_close(cookie);
-
   if (mime == "unknown-8bit")
   {
     mime = "iso-8859-1"; // @todo: consider making default 8bit fallback configurable
@@ -105,22 +205,91 @@ std::string Encoding::Detect(const std::string& p_Str)
 bool Encoding::Convert(const std::string& p_SrcEnc, const std::string& p_DstEnc,
                        const std::string& p_SrcStr, std::string& p_DstStr)
 {
-  std::string str;
-  char* convStr = NULL;
-  size_t convLen = 0;
-  errno = 0;
-  bool rv = false;
-  if ((charconv_buffer(p_DstEnc.c_str(), p_SrcEnc.c_str(), p_SrcStr.c_str(), p_SrcStr.size(),
-                       &convStr, &convLen) == MAIL_CHARCONV_NO_ERROR) && (convStr != NULL))
+  iconv_t cd = s_IconvCache.Get(p_DstEnc, GetIconvCharset(p_SrcEnc));
+  if (cd == (iconv_t)-1)
   {
-    rv = (errno == 0);
-    p_DstStr = std::string(convStr, convLen);
-    charconv_buffer_free(convStr);
+    p_DstStr = p_SrcStr;
+    return false;
   }
-  else
+
+  // invalid input sequences are replaced by '?' and conversion continues (like libetpan
+  // charconv), an incomplete sequence at the end of input ends conversion
+  bool rv = true;
+  std::string dstStr((p_SrcStr.size() * 2) + 16, '\0');
+  char* inBuf = const_cast<char*>(p_SrcStr.data());
+  size_t inLeft = p_SrcStr.size();
+  size_t outPos = 0;
+  bool flush = false;
+  while (true)
   {
-    p_DstStr = p_SrcStr;
+    char* outBuf = &dstStr[outPos];
+    size_t outLeft = dstStr.size() - outPos;
+    size_t count = flush ? iconv(cd, NULL, NULL, &outBuf, &outLeft) : iconv(cd, &inBuf, &inLeft, &outBuf, &outLeft);
+    const int err = errno;
+    outPos = dstStr.size() - outLeft;
+    if (count != (size_t)-1)
+    {
+      if (flush) break;
+
+      flush = true;
+      continue;
+    }
+
+    if (err == E2BIG)
+    {
+      dstStr.resize(dstStr.size() * 2);
+    }
+    else if ((err == EILSEQ) && !flush)
+    {
+      rv = false;
+      ++inBuf;
+      --inLeft;
+      if (outPos == dstStr.size())
+      {
+        dstStr.resize(dstStr.size() * 2);
+      }
+
+      dstStr[outPos++] = '?';
+    }
+    else
+    {
+      rv = false;
+      break;
+    }
   }
 
+  dstStr.resize(outPos);
+  p_DstStr.swap(dstStr);
   return rv;
 }
+
+std::string Encoding::GetIconvCharset(const std::string& p_Enc)
+{
+  // aliases unsupported by iconv, as mapped by libetpan charconv
+  const char* enc = p_Enc.c_str();
+  if ((strcasecmp(enc, "gb2312") == 0) || (strcasecmp(enc, "gb_2312-80") == 0)) return "gbk";
+
+  if ((strcasecmp(enc, "iso-8859-8-i") == 0) || (strcasecmp(enc, "iso_8859-8-i") == 0) ||
+      (strcasecmp(enc, "iso8859-8-i") == 0) || (strcasecmp(enc, "iso-8859-8-e") == 0) ||
+      (strcasecmp(enc, "iso_8859-8-e") == 0) || (strcasecmp(enc, "iso8859-8-e") == 0)) return "iso-8859-8";
+
+  if (strcasecmp(enc, "ks_c_5601-1987") == 0) return "euckr";
+
+  if (strcasecmp(enc, "iso-2022-jp") == 0) return "iso-2022-jp-2";
+
+  return p_Enc;
+}
+
+bool Encoding::IsAsciiCompatible(const std::string& p_Enc)
+{
+  // common charsets where ascii bytes always represent the same ascii chars
+  static const char* const compatibles[] = { "us-ascii", "ascii", "iso-8859-", "iso8859-", "iso_8859-",
+                                             "windows-125", "cp125", "koi8-", "gb2312", "gbk", "gb18030",
+                                             "big5", "euc-", "tis-620" };
+  for (const char* compatible : compatibles)
+  {
+    if (strncasecmp(p_Enc.c_str(), compatible, strlen(compatible)) == 0) return true;
+  }
+
+  return false;
+}
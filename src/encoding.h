@@ -20,4 +20,6 @@ private:
   static std::string Detect(const std::string& p_Str);
   static bool Convert(const std::string& p_SrcEnc, const std::string& p_DstEnc,
                       const std::string& p_SrcStr, std::string& p_DstStr);
+  static std::string GetIconvCharset(const std::string& p_Enc);
+  static bool IsAsciiCompatible(const std::string& p_Enc);
 };
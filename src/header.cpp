@@ -1,22 +1,23 @@
 // header.cpp
 //
-// Copyright (c) 2019-2023 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #include "header.h"
 
+#include <cstdlib>
 #include <cstring>
 #include <set>
 
 #include <libetpan/mailmime.h>
 
+#include "arenahelp.h"
 #include "body.h"
 #include "crypto.h"
 #include "log.h"
 #include "loghelp.h"
-#include "sethelp.h"
 #include "util.h"
 
 static const std::string labelServerTime("X-Nmail-ServerTime: ");
@@ -122,6 +123,20 @@ bool Header::GetHasAttachments() const
   return m_HasAttachments;
 }
 
+size_t Header::GetMemorySize() const
+{
+  size_t size = sizeof(Header) + m_Data.capacity() + m_Date.capacity() + m_DateTime.capacity() +
+    m_Time.capacity() + m_From.capacity() + m_ShortFrom.capacity() + m_To.capacity() +
+    m_ShortTo.capacity() + m_Cc.capacity() + m_Bcc.capacity() + m_ReplyTo.capacity() +
+    m_Subject.capacity() + m_MessageId.capacity() + m_UniqueId.capacity() + m_RawHeaderText.capacity();
+  for (const auto& address : m_Addresses)
+  {
+    size += sizeof(address) + address.capacity();
+  }
+
+  return size;
+}
+
 std::string Header::GetRawHeaderText(bool p_LocalHeaders)
 {
   std::string& raw = m_RawHeaderText;
@@ -168,39 +183,36 @@ void Header::Parse()
   time_t headerTimeStamp = 0;
   time_t serverTimeStamp = 0;
 
+  const size_t lineEnd = m_Data.find('\n');
+  if ((lineEnd != std::string::npos) && (lineEnd > labelServerTime.size()) &&
+      (m_Data.compare(0, labelServerTime.size(), labelServerTime) == 0))
   {
-    std::stringstream sstream(m_Data);
-    std::string line;
-    if (std::getline(sstream, line))
-    {
-      if ((line.rfind(labelServerTime, 0) == 0) && (line.size() > labelServerTime.size()))
-      {
-        std::string serverTime = line.substr(labelServerTime.size());
-        serverTimeStamp = std::stoi(serverTime);
-      }
-      else
-      {
-        LOG_WARNING("unexpected hdr content \"%s\"", line.c_str());
-      }
-    }
-    else
-    {
-      LOG_WARNING("unexpected empty hdr");
-    }
+    serverTimeStamp = static_cast<time_t>(strtoll(m_Data.c_str() + labelServerTime.size(), NULL, 10));
   }
-
+  else if (m_Data.empty())
+  {
+    LOG_WARNING("unexpected empty hdr");
+  }
+  else
   {
-    Body body;
-    body.FromHeader(m_Data);
-    m_HasAttachments = body.HasAttachments();
+    LOG_WARNING("unexpected hdr content \"%s\"", m_Data.substr(0, lineEnd).c_str());
   }
 
+  // single mime parse for both header fields and body structure attachment info
+  ArenaScope arenaScope;
   struct mailmime* mime = NULL;
   size_t current_index = 0;
   mailmime_parse(m_Data.c_str(), m_Data.size(), &current_index, &mime);
+  arenaScope.Hold();
 
   if (mime != NULL)
   {
+    {
+      Body body;
+      body.FromMime(mime);
+      m_HasAttachments = body.HasAttachments();
+    }
+
     if (mime->mm_type == MAILMIME_MESSAGE)
     {
       if (mime->mm_data.mm_message.mm_fields)
@@ -211,6 +223,7 @@ void Header::Parse()
           for (clistiter* it = clist_begin(fields->fld_list); it != NULL; it = clist_next(it))
           {
             std::vector<std::string> addrs;
+            std::vector<std::string> shortAddrs;
             struct mailimf_field* field = (struct mailimf_field*)clist_content(it);
             switch (field->fld_type)
             {
@@ -222,32 +235,30 @@ void Header::Parse()
                 break;
 
               case MAILIMF_FIELD_FROM:
-                addrs = MailboxListToStrings(field->fld_data.fld_from->frm_mb_list);
-                m_Addresses = m_Addresses + std::set<std::string>(addrs.begin(), addrs.end());
+                MailboxListToStrings(field->fld_data.fld_from->frm_mb_list, addrs, shortAddrs);
+                m_Addresses.insert(addrs.begin(), addrs.end());
                 m_From = Util::Join(addrs, ", ");
-                addrs = MailboxListToStrings(field->fld_data.fld_from->frm_mb_list, true);
-                m_ShortFrom = Util::Join(addrs, ", ");
+                m_ShortFrom = Util::Join(shortAddrs, ", ");
                 break;
 
               case MAILIMF_FIELD_TO:
-                addrs = AddressListToStrings(field->fld_data.fld_to->to_addr_list);
-                m_Addresses = m_Addresses + std::set<std::string>(addrs.begin(), addrs.end());
+                AddressListToStrings(field->fld_data.fld_to->to_addr_list, addrs, shortAddrs);
+                m_Addresses.insert(addrs.begin(), addrs.end());
                 m_To = Util::Join(addrs, ", ");
-                addrs = AddressListToStrings(field->fld_data.fld_to->to_addr_list, true);
-                m_ShortTo = Util::Join(addrs, ", ");
+                m_ShortTo = Util::Join(shortAddrs, ", ");
                 break;
 
               case MAILIMF_FIELD_CC:
-                addrs = AddressListToStrings(field->fld_data.fld_cc->cc_addr_list);
-                m_Addresses = m_Addresses + std::set<std::string>(addrs.begin(), addrs.end());
+                AddressListToStrings(field->fld_data.fld_cc->cc_addr_list, addrs);
+                m_Addresses.insert(addrs.begin(), addrs.end());
                 m_Cc = Util::Join(addrs, ", ");
                 break;
 
               case MAILIMF_FIELD_BCC:
                 if (field->fld_data.fld_bcc->bcc_addr_list != nullptr)
                 {
-                  addrs = AddressListToStrings(field->fld_data.fld_bcc->bcc_addr_list);
-                  m_Addresses = m_Addresses + std::set<std::string>(addrs.begin(), addrs.end());
+                  AddressListToStrings(field->fld_data.fld_bcc->bcc_addr_list, addrs);
+                  m_Addresses.insert(addrs.begin(), addrs.end());
                   m_Bcc = Util::Join(addrs, ", ");
                 }
                 break;
@@ -261,8 +272,8 @@ void Header::Parse()
                 break;
 
               case MAILIMF_FIELD_REPLY_TO:
-                addrs = AddressListToStrings(field->fld_data.fld_reply_to->rt_addr_list);
-                m_Addresses = m_Addresses + std::set<std::string>(addrs.begin(), addrs.end());
+                AddressListToStrings(field->fld_data.fld_reply_to->rt_addr_list, addrs);
+                m_Addresses.insert(addrs.begin(), addrs.end());
                 m_ReplyTo = Util::Join(addrs, ", ");
                 break;
 
@@ -308,90 +319,100 @@ void Header::Parse()
   m_ParseVersion = GetCurrentParseVersion();
 }
 
-std::vector<std::string> Header::MailboxListToStrings(mailimf_mailbox_list* p_MailboxList,
-                                                      const bool p_Short)
+void Header::MailboxListToStrings(mailimf_mailbox_list* p_MailboxList,
+                                  std::vector<std::string>& p_Strs,
+                                  std::vector<std::string>& p_ShortStrs)
 {
-  std::vector<std::string> strs;
   for (clistiter* it = clist_begin(p_MailboxList->mb_list); it != NULL; it = clist_next(it))
   {
     struct mailimf_mailbox* mb = (struct mailimf_mailbox*)clist_content(it);
-    strs.push_back(MailboxToString(mb, p_Short));
+    std::string str;
+    std::string shortStr;
+    MailboxToStrings(mb, str, shortStr);
+    p_Strs.push_back(str);
+    p_ShortStrs.push_back(shortStr);
   }
+}
 
-  return strs;
+void Header::AddressListToStrings(mailimf_address_list* p_AddrList,
+                                  std::vector<std::string>& p_Strs)
+{
+  std::vector<std::string> shortStrs;
+  AddressListToStrings(p_AddrList, p_Strs, shortStrs);
 }
 
-std::vector<std::string> Header::AddressListToStrings(mailimf_address_list* p_AddrList,
-                                                      const bool p_Short)
+void Header::AddressListToStrings(mailimf_address_list* p_AddrList,
+                                  std::vector<std::string>& p_Strs,
+                                  std::vector<std::string>& p_ShortStrs)
 {
-  std::vector<std::string> strs;
   for (clistiter* it = clist_begin(p_AddrList->ad_list); it != NULL; it = clist_next(it))
   {
     struct mailimf_address* addr = (struct mailimf_address*)clist_content(it);
+    std::string str;
+    std::string shortStr;
 
     switch (addr->ad_type)
     {
       case MAILIMF_ADDRESS_GROUP:
-        strs.push_back(GroupToString(addr->ad_data.ad_group, p_Short));
+        GroupToStrings(addr->ad_data.ad_group, str, shortStr);
         break;
 
       case MAILIMF_ADDRESS_MAILBOX:
-        strs.push_back(MailboxToString(addr->ad_data.ad_mailbox, p_Short));
+        MailboxToStrings(addr->ad_data.ad_mailbox, str, shortStr);
         break;
 
       default:
-        break;
+        continue;
     }
-  }
 
-  return strs;
+    p_Strs.push_back(str);
+    p_ShortStrs.push_back(shortStr);
+  }
 }
 
-std::string Header::MailboxToString(mailimf_mailbox* p_Mailbox, const bool p_Short)
+void Header::MailboxToStrings(mailimf_mailbox* p_Mailbox, std::string& p_Str, std::string& p_ShortStr)
 {
-  std::string str;
-  if (p_Short)
+  // display name is decoded once for both the full and the short representation
+  const std::string addrSpec(p_Mailbox->mb_addr_spec);
+  if (p_Mailbox->mb_display_name != NULL)
   {
-    if (p_Mailbox->mb_display_name != NULL)
+    const std::string displayName = Util::MimeToUtf8(std::string(p_Mailbox->mb_display_name));
+    p_ShortStr = displayName;
+    if (strlen(p_Mailbox->mb_display_name) > 0)
     {
-      str = Util::MimeToUtf8(std::string(p_Mailbox->mb_display_name));
+      p_Str = Util::EscapeName(displayName) + " <" + addrSpec + ">";
     }
     else
     {
-      str = std::string(p_Mailbox->mb_addr_spec);
+      p_Str = addrSpec;
     }
   }
   else
   {
-    if ((p_Mailbox->mb_display_name != NULL) && (strlen(p_Mailbox->mb_display_name) > 0))
-    {
-      str = Util::EscapeName(Util::MimeToUtf8(std::string(p_Mailbox->mb_display_name)));
-      str += std::string(" <") + std::string(p_Mailbox->mb_addr_spec) + std::string(">");
-    }
-    else
-    {
-      str += std::string(p_Mailbox->mb_addr_spec);
-    }
+    p_ShortStr = addrSpec;
+    p_Str = addrSpec;
   }
-
-  return str;
 }
 
-std::string Header::GroupToString(mailimf_group* p_Group, const bool p_Short)
+void Header::GroupToStrings(mailimf_group* p_Group, std::string& p_Str, std::string& p_ShortStr)
 {
-  std::string str;
-  str += Util::MimeToUtf8(std::string(p_Group->grp_display_name)) + std::string(": ");
+  const std::string displayName = Util::MimeToUtf8(std::string(p_Group->grp_display_name)) + ": ";
+  p_Str = displayName;
+  p_ShortStr = displayName;
 
   for (clistiter* it = clist_begin(p_Group->grp_mb_list->mb_list); it != NULL;
        it = clist_next(it))
   {
     struct mailimf_mailbox* mb = (struct mailimf_mailbox*)clist_content(it);
-    str += MailboxToString(mb, p_Short);
+    std::string str;
+    std::string shortStr;
+    MailboxToStrings(mb, str, shortStr);
+    p_Str += str;
+    p_ShortStr += shortStr;
   }
 
-  str += std::string("; ");
-
-  return str;
+  p_Str += "; ";
+  p_ShortStr += "; ";
 }
 
 size_t Header::GetCurrentParseVersion()
@@ -1,6 +1,6 @@
 // header.h
 //
-// Copyright (c) 2019-2021 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -37,6 +37,7 @@ public:
   std::set<std::string> GetAddresses() const;
   bool GetHasAttachments() const;
   std::string GetRawHeaderText(bool p_LocalHeaders);
+  size_t GetMemorySize() const;
   inline bool ParseIfNeeded()
   {
     if (m_ParseVersion == GetCurrentParseVersion()) return false;
@@ -72,14 +73,16 @@ public:
 
 private:
   void Parse();
-  std::vector<std::string> MailboxListToStrings(struct mailimf_mailbox_list* p_MailboxList,
-                                                const bool p_Short = false);
-  std::vector<std::string> AddressListToStrings(struct mailimf_address_list* p_AddrList,
-                                                const bool p_Short = false);
-  std::string MailboxToString(struct mailimf_mailbox* p_Mailbox,
-                              const bool p_Short = false);
-  std::string GroupToString(struct mailimf_group* p_Group,
-                            const bool p_Short = false);
+  void MailboxListToStrings(struct mailimf_mailbox_list* p_MailboxList,
+                            std::vector<std::string>& p_Strs,
+                            std::vector<std::string>& p_ShortStrs);
+  void AddressListToStrings(struct mailimf_address_list* p_AddrList,
+                            std::vector<std::string>& p_Strs);
+  void AddressListToStrings(struct mailimf_address_list* p_AddrList,
+                            std::vector<std::string>& p_Strs,
+                            std::vector<std::string>& p_ShortStrs);
+  void MailboxToStrings(struct mailimf_mailbox* p_Mailbox, std::string& p_Str, std::string& p_ShortStr);
+  void GroupToStrings(struct mailimf_group* p_Group, std::string& p_Str, std::string& p_ShortStr);
   size_t GetCurrentParseVersion();
 
 private:
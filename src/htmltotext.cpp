@@ -0,0 +1,730 @@
+// htmltotext.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "htmltotext.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include <strings.h>
+
+#include "util.h"
+
+namespace
+{
+  enum TagType
+  {
+    TagOther = 0,
+    TagBreak,
+    TagParagraph,
+    TagBlock,
+    TagList,
+    TagListItem,
+    TagTable,
+    TagRow,
+    TagCell,
+    TagQuote,
+    TagPre,
+    TagRule,
+    TagLink,
+    TagImage,
+    TagSkip,
+    TagVoid,
+  };
+
+  TagType GetTagType(const std::string& p_Name)
+  {
+    static const std::unordered_map<std::string, TagType> tagTypes =
+    {
+      { "br", TagBreak },
+      { "p", TagParagraph }, { "h1", TagParagraph }, { "h2", TagParagraph }, { "h3", TagParagraph },
+      { "h4", TagParagraph }, { "h5", TagParagraph }, { "h6", TagParagraph }, { "dl", TagParagraph },
+      { "div", TagBlock }, { "section", TagBlock }, { "article", TagBlock }, { "header", TagBlock },
+      { "footer", TagBlock }, { "nav", TagBlock }, { "main", TagBlock }, { "center", TagBlock },
+      { "form", TagBlock }, { "address", TagBlock }, { "figure", TagBlock }, { "dt", TagBlock },
+      { "dd", TagBlock }, { "caption", TagBlock }, { "aside", TagBlock },
+      { "ul", TagList }, { "ol", TagList }, { "menu", TagList },
+      { "li", TagListItem },
+      { "table", TagTable },
+      { "tr", TagRow },
+      { "td", TagCell }, { "th", TagCell },
+      { "blockquote", TagQuote },
+      { "pre", TagPre }, { "listing", TagPre }, { "xmp", TagPre },
+      { "hr", TagRule },
+      { "a", TagLink },
+      { "img", TagImage },
+      { "script", TagSkip }, { "style", TagSkip }, { "title", TagSkip }, { "template", TagSkip },
+      { "meta", TagVoid }, { "link", TagVoid }, { "input", TagVoid }, { "col", TagVoid },
+      { "area", TagVoid }, { "base", TagVoid }, { "wbr", TagVoid }, { "source", TagVoid },
+    };
+
+    auto it = tagTypes.find(p_Name);
+    return (it != tagTypes.end()) ? it->second : TagOther;
+  }
+
+  uint32_t GetEntityCodepoint(const std::string& p_Name)
+  {
+    static const std::unordered_map<std::string, uint32_t> entities =
+    {
+      { "nbsp", 0xA0 }, { "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' },
+      { "copy", 0xA9 }, { "reg", 0xAE }, { "trade", 0x2122 }, { "hellip", 0x2026 }, { "mdash", 0x2014 },
+      { "ndash", 0x2013 }, { "lsquo", 0x2018 }, { "rsquo", 0x2019 }, { "sbquo", 0x201A },
+      { "ldquo", 0x201C }, { "rdquo", 0x201D }, { "bdquo", 0x201E }, { "bull", 0x2022 },
+      { "middot", 0xB7 }, { "euro", 0x20AC }, { "pound", 0xA3 }, { "yen", 0xA5 }, { "cent", 0xA2 },
+      { "laquo", 0xAB }, { "raquo", 0xBB }, { "lsaquo", 0x2039 }, { "rsaquo", 0x203A },
+      { "times", 0xD7 }, { "divide", 0xF7 }, { "deg", 0xB0 }, { "plusmn", 0xB1 }, { "sect", 0xA7 },
+      { "para", 0xB6 }, { "iexcl", 0xA1 }, { "iquest", 0xBF }, { "ordf", 0xAA }, { "ordm", 0xBA },
+      { "frac12", 0xBD }, { "frac14", 0xBC }, { "frac34", 0xBE }, { "sup2", 0xB2 }, { "sup3", 0xB3 },
+      { "micro", 0xB5 }, { "dagger", 0x2020 }, { "Dagger", 0x2021 }, { "permil", 0x2030 },
+      { "larr", 0x2190 }, { "rarr", 0x2192 }, { "uarr", 0x2191 }, { "darr", 0x2193 },
+      { "hearts", 0x2665 }, { "check", 0x2713 }, { "prime", 0x2032 },
+      { "ensp", 0x2002 }, { "emsp", 0x2003 }, { "thinsp", 0x2009 },
+      { "zwnj", 0x200C }, { "zwj", 0x200D }, { "shy", 0xAD }, { "lrm", 0x200E }, { "rlm", 0x200F },
+      { "auml", 0xE4 }, { "Auml", 0xC4 }, { "ouml", 0xF6 }, { "Ouml", 0xD6 }, { "uuml", 0xFC },
+      { "Uuml", 0xDC }, { "aring", 0xE5 }, { "Aring", 0xC5 }, { "szlig", 0xDF }, { "eacute", 0xE9 },
+      { "Eacute", 0xC9 }, { "egrave", 0xE8 }, { "Egrave", 0xC8 }, { "ecirc", 0xEA }, { "aacute", 0xE1 },
+      { "agrave", 0xE0 }, { "acirc", 0xE2 }, { "iacute", 0xED }, { "oacute", 0xF3 }, { "uacute", 0xFA },
+      { "ccedil", 0xE7 }, { "Ccedil", 0xC7 }, { "ntilde", 0xF1 }, { "Ntilde", 0xD1 }, { "oslash", 0xF8 },
+      { "Oslash", 0xD8 }, { "aelig", 0xE6 }, { "AElig", 0xC6 },
+    };
+
+    auto it = entities.find(p_Name);
+    return (it != entities.end()) ? it->second : 0;
+  }
+
+  bool IsZeroWidth(uint32_t p_Codepoint)
+  {
+    return (p_Codepoint == 0xAD) || (p_Codepoint == 0x34F) || (p_Codepoint == 0xFEFF) ||
+           ((p_Codepoint >= 0x200B) && (p_Codepoint <= 0x200F));
+  }
+
+  bool IsNameChar(char p_Ch)
+  {
+    return isalnum(static_cast<unsigned char>(p_Ch)) || (p_Ch == ':') || (p_Ch == '-') || (p_Ch == '_');
+  }
+}
+
+std::string HtmlToText::Convert(const std::string& p_Html)
+{
+  HtmlToText htmlToText(p_Html);
+  htmlToText.Parse();
+  return htmlToText.GetResult();
+}
+
+HtmlToText::HtmlToText(const std::string& p_Html)
+  : m_Html(p_Html)
+{
+}
+
+void HtmlToText::Parse()
+{
+  const char* html = m_Html.c_str();
+  const size_t len = m_Html.size();
+  m_Out.reserve(len / 4);
+
+  size_t pos = 0;
+  while (pos < len)
+  {
+    const char* lt = static_cast<const char*>(memchr(html + pos, '<', len - pos));
+    const size_t textEnd = (lt != nullptr) ? static_cast<size_t>(lt - html) : len;
+    if ((textEnd > pos) && (m_HiddenDepth == 0))
+    {
+      AddText(html + pos, textEnd - pos);
+    }
+
+    if (lt == nullptr) break;
+
+    pos = ParseTag(textEnd);
+  }
+
+  if (m_InLink)
+  {
+    EndLink();
+  }
+}
+
+size_t HtmlToText::ParseTag(size_t p_Pos)
+{
+  const char* html = m_Html.c_str();
+  const size_t len = m_Html.size();
+
+  if (m_Html.compare(p_Pos, 4, "<!--") == 0)
+  {
+    size_t commentEnd = m_Html.find("-->", p_Pos + 4);
+    return (commentEnd != std::string::npos) ? (commentEnd + 3) : len;
+  }
+
+  const bool isEnd = ((p_Pos + 1) < len) && (html[p_Pos + 1] == '/');
+  const size_t namePos = p_Pos + (isEnd ? 2 : 1);
+  if ((namePos >= len) || !isalpha(static_cast<unsigned char>(html[namePos])))
+  {
+    if (((p_Pos + 1) < len) && ((html[p_Pos + 1] == '!') || (html[p_Pos + 1] == '?')))
+    {
+      // doctype, cdata or processing instruction
+      size_t declEnd = m_Html.find('>', p_Pos);
+      return (declEnd != std::string::npos) ? (declEnd + 1) : len;
+    }
+
+    // not a tag, output as text
+    if (m_HiddenDepth == 0)
+    {
+      AddText(html + p_Pos, 1);
+    }
+
+    return p_Pos + 1;
+  }
+
+  size_t nameEnd = namePos;
+  while ((nameEnd < len) && IsNameChar(html[nameEnd]))
+  {
+    ++nameEnd;
+  }
+
+  std::string name(html + namePos, nameEnd - namePos);
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+  // find end of tag, skipping quoted attribute values
+  size_t tagEnd = nameEnd;
+  char quote = 0;
+  for ( ; tagEnd < len; ++tagEnd)
+  {
+    const char ch = html[tagEnd];
+    if (quote != 0)
+    {
+      if (ch == quote)
+      {
+        quote = 0;
+      }
+    }
+    else if ((ch == '"') || (ch == '\''))
+    {
+      quote = ch;
+    }
+    else if (ch == '>')
+    {
+      break;
+    }
+  }
+
+  if ((tagEnd >= len) && (quote != 0))
+  {
+    // unbalanced quote, fall back to first tag end
+    tagEnd = m_Html.find('>', nameEnd);
+    tagEnd = (tagEnd != std::string::npos) ? tagEnd : len;
+  }
+
+  HandleTag(name, isEnd, html + nameEnd, tagEnd - nameEnd);
+
+  size_t pos = (tagEnd < len) ? (tagEnd + 1) : len;
+  if (!isEnd && (GetTagType(name) == TagSkip))
+  {
+    // skip element content, i.e. script and style
+    const std::string closeTag = "</" + name;
+    while (pos < len)
+    {
+      size_t closePos = m_Html.find("</", pos);
+      if (closePos == std::string::npos)
+      {
+        pos = len;
+        break;
+      }
+
+      if (strncasecmp(html + closePos, closeTag.c_str(), closeTag.size()) == 0)
+      {
+        size_t closeEnd = m_Html.find('>', closePos);
+        pos = (closeEnd != std::string::npos) ? (closeEnd + 1) : len;
+        break;
+      }
+
+      pos = closePos + 2;
+    }
+  }
+
+  return pos;
+}
+
+void HtmlToText::HandleTag(const std::string& p_Name, bool p_IsEnd, const char* p_Attrs, size_t p_AttrsLen)
+{
+  const TagType tagType = GetTagType(p_Name);
+  const bool isVoid = (tagType == TagBreak) || (tagType == TagRule) || (tagType == TagImage) ||
+    (tagType == TagVoid) || ((p_AttrsLen > 0) && (p_Attrs[p_AttrsLen - 1] == '/'));
+
+  if (m_HiddenDepth > 0)
+  {
+    if ((p_Name == m_HiddenTag) && !isVoid)
+    {
+      m_HiddenDepth += p_IsEnd ? -1 : 1;
+    }
+
+    return;
+  }
+
+  if (!p_IsEnd && !isVoid && (tagType != TagSkip) && IsHidden(p_Attrs, p_AttrsLen))
+  {
+    // skip content not displayed, i.e. preheader texts
+    m_HiddenTag = p_Name;
+    m_HiddenDepth = 1;
+    return;
+  }
+
+  switch (tagType)
+  {
+    case TagBreak:
+      LineBreak();
+      break;
+
+    case TagParagraph:
+      BlockBreak(2);
+      break;
+
+    case TagBlock:
+    case TagTable:
+      BlockBreak(1);
+      break;
+
+    case TagList:
+      if (!p_IsEnd)
+      {
+        BlockBreak(m_Lists.empty() ? 2 : 1);
+        List list;
+        list.m_Ordered = (p_Name == "ol");
+        list.m_Count = list.m_Ordered ? (atoi(GetAttr(p_Attrs, p_AttrsLen, "start").c_str()) - 1) : 0;
+        list.m_Count = std::max(list.m_Count, 0);
+        list.m_Indent = !m_Lists.empty() ? m_Lists.back().m_ItemIndent : 0;
+        list.m_ItemIndent = list.m_Indent;
+        m_Lists.push_back(list);
+      }
+      else if (!m_Lists.empty())
+      {
+        m_Lists.pop_back();
+        m_ListMarker.clear();
+        BlockBreak(m_Lists.empty() ? 2 : 1);
+      }
+      break;
+
+    case TagListItem:
+      BlockBreak(1);
+      if (!p_IsEnd)
+      {
+        if (m_Lists.empty())
+        {
+          m_Lists.push_back(List());
+        }
+
+        List& list = m_Lists.back();
+        m_ListMarker = list.m_Ordered ? (std::to_string(++list.m_Count) + ". ") : std::string("* ");
+        list.m_ItemIndent = list.m_Indent + m_ListMarker.size();
+      }
+      break;
+
+    case TagRow:
+      BlockBreak(1);
+      m_CellCount = 0;
+      break;
+
+    case TagCell:
+      if (!p_IsEnd && (m_CellCount++ > 0))
+      {
+        m_PendingSpace = true;
+      }
+      break;
+
+    case TagQuote:
+      if (!p_IsEnd)
+      {
+        BlockBreak(2);
+        ++m_QuoteDepth;
+      }
+      else if (m_QuoteDepth > 0)
+      {
+        --m_QuoteDepth;
+        BlockBreak(2);
+      }
+      break;
+
+    case TagPre:
+      BlockBreak(2);
+      m_PreDepth = std::max(m_PreDepth + (p_IsEnd ? -1 : 1), 0);
+      break;
+
+    case TagRule:
+      BlockBreak(1);
+      AddContent("----------------------------------------", 40);
+      BlockBreak(1);
+      break;
+
+    case TagLink:
+      if (m_InLink)
+      {
+        EndLink();
+      }
+
+      if (!p_IsEnd)
+      {
+        std::string href = GetAttr(p_Attrs, p_AttrsLen, "href");
+        if ((strncasecmp(href.c_str(), "http://", 7) == 0) || (strncasecmp(href.c_str(), "https://", 8) == 0) ||
+            (strncasecmp(href.c_str(), "mailto:", 7) == 0) || (strncasecmp(href.c_str(), "ftp://", 6) == 0))
+        {
+          m_InLink = true;
+          m_LinkHref = href;
+          m_LinkTextPos = m_Out.size();
+        }
+      }
+      break;
+
+    case TagImage:
+      {
+        const std::string alt = GetAttr(p_Attrs, p_AttrsLen, "alt");
+        AddText(alt.c_str(), alt.size());
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void HtmlToText::AddText(const char* p_Text, size_t p_Len)
+{
+  size_t i = 0;
+  while (i < p_Len)
+  {
+    const char ch = p_Text[i];
+    if (ch == '&')
+    {
+      i += AddEntity(p_Text + i, p_Len - i);
+    }
+    else if (m_PreDepth > 0)
+    {
+      if (ch == '\n')
+      {
+        LineBreak();
+        ++i;
+      }
+      else if (ch == '\r')
+      {
+        ++i;
+      }
+      else
+      {
+        size_t end = i + 1;
+        while ((end < p_Len) && (p_Text[end] != '&') && (p_Text[end] != '\n') && (p_Text[end] != '\r'))
+        {
+          ++end;
+        }
+
+        AddContent(p_Text + i, end - i);
+        i = end;
+      }
+    }
+    else if (IsSpace(ch))
+    {
+      m_PendingSpace = true;
+      ++i;
+    }
+    else
+    {
+      size_t end = i + 1;
+      while ((end < p_Len) && (p_Text[end] != '&') && !IsSpace(p_Text[end]))
+      {
+        ++end;
+      }
+
+      AddContent(p_Text + i, end - i);
+      i = end;
+    }
+  }
+}
+
+size_t HtmlToText::AddEntity(const char* p_Text, size_t p_Len)
+{
+  // p_Text starts with '&', returns number of chars consumed
+  static const size_t maxEntityLen = 10;
+  size_t end = 1;
+  while ((end < p_Len) && (end <= maxEntityLen) &&
+         (isalnum(static_cast<unsigned char>(p_Text[end])) || ((end == 1) && (p_Text[end] == '#'))))
+  {
+    ++end;
+  }
+
+  const bool hasSemicolon = (end < p_Len) && (p_Text[end] == ';');
+  const std::string name(p_Text + 1, end - 1);
+  uint32_t codepoint = 0;
+  if ((name.size() > 1) && (name[0] == '#'))
+  {
+    const bool isHex = (name[1] == 'x') || (name[1] == 'X');
+    const char* digits = name.c_str() + (isHex ? 2 : 1);
+    char* digitsEnd = nullptr;
+    const unsigned long value = strtoul(digits, &digitsEnd, isHex ? 16 : 10);
+    if (digitsEnd != digits)
+    {
+      // nul, surrogates and out of range values are replaced, as invalid in utf-8
+      const bool isInvalid = (value == 0) || ((value >= 0xD800) && (value <= 0xDFFF)) || (value > 0x10FFFF);
+      codepoint = isInvalid ? 0xFFFD : static_cast<uint32_t>(value);
+    }
+  }
+  else if (!name.empty())
+  {
+    codepoint = GetEntityCodepoint(name);
+  }
+
+  if (codepoint == 0)
+  {
+    AddContent("&", 1);
+    return 1;
+  }
+
+  if (codepoint == 0xA0)
+  {
+    AddNonBreakingSpace();
+  }
+  else if (!IsZeroWidth(codepoint))
+  {
+    std::string str;
+    AppendUtf8(str, codepoint);
+    AddContent(str.c_str(), str.size());
+  }
+
+  return end + (hasSemicolon ? 1 : 0);
+}
+
+void HtmlToText::AddContent(const char* p_Str, size_t p_Len)
+{
+  if (p_Len == 0) return;
+
+  if (m_Out.empty() || (m_PendingNewLines > 0))
+  {
+    StartLine();
+  }
+  else if (m_PendingSpace)
+  {
+    m_Out += ' ';
+  }
+
+  m_PendingSpace = false;
+  m_Out.append(p_Str, p_Len);
+}
+
+void HtmlToText::AddNonBreakingSpace()
+{
+  const bool pendingSpace = m_PendingSpace;
+  AddContent(" ", 1);
+  m_PendingSpace = pendingSpace;
+}
+
+void HtmlToText::StartLine()
+{
+  if (!m_Out.empty())
+  {
+    m_Out += '\n';
+    for (int i = 1; i < m_PendingNewLines; ++i)
+    {
+      m_Out.append(m_BreakQuoteDepth, '>');
+      m_Out += '\n';
+    }
+  }
+
+  if (m_QuoteDepth > 0)
+  {
+    m_Out.append(m_QuoteDepth, '>');
+    m_Out += ' ';
+  }
+
+  if (!m_Lists.empty())
+  {
+    m_Out.append(m_ListMarker.empty() ? m_Lists.back().m_ItemIndent : m_Lists.back().m_Indent, ' ');
+    m_Out += m_ListMarker;
+    m_ListMarker.clear();
+  }
+
+  m_PendingNewLines = 0;
+  m_PendingSpace = false;
+}
+
+void HtmlToText::BlockBreak(int p_NewLines)
+{
+  m_BreakQuoteDepth = (m_PendingNewLines == 0) ? m_QuoteDepth : std::min(m_BreakQuoteDepth, m_QuoteDepth);
+  m_PendingNewLines = std::max(m_PendingNewLines, p_NewLines);
+}
+
+void HtmlToText::LineBreak()
+{
+  m_BreakQuoteDepth = (m_PendingNewLines == 0) ? m_QuoteDepth : std::min(m_BreakQuoteDepth, m_QuoteDepth);
+  ++m_PendingNewLines;
+}
+
+void HtmlToText::EndLink()
+{
+  m_InLink = false;
+
+  const bool isMailto = (strncasecmp(m_LinkHref.c_str(), "mailto:", 7) == 0);
+  const std::string url = isMailto ? m_LinkHref.substr(7) : m_LinkHref;
+  std::string text = (m_LinkTextPos < m_Out.size()) ? m_Out.substr(m_LinkTextPos) : "";
+  text = Util::Trim(text);
+  if ((text == url) || (text == m_LinkHref)) return;
+
+  if (text.empty())
+  {
+    // no link text to refer from, show the url in its place
+    AddText(url.c_str(), url.size());
+    return;
+  }
+
+  auto it = m_LinkIndex.find(m_LinkHref);
+  if (it == m_LinkIndex.end())
+  {
+    m_Links.push_back(m_LinkHref);
+    it = m_LinkIndex.insert(std::make_pair(m_LinkHref, m_Links.size())).first;
+  }
+
+  const bool pendingSpace = m_PendingSpace;
+  m_PendingSpace = false;
+  const std::string ref = "[" + std::to_string(it->second) + "]";
+  AddContent(ref.c_str(), ref.size());
+  m_PendingSpace = pendingSpace;
+}
+
+std::string HtmlToText::GetResult()
+{
+  while (!m_Out.empty() && IsSpace(m_Out.back()))
+  {
+    m_Out.pop_back();
+  }
+
+  if (!m_Links.empty())
+  {
+    m_Out += m_Out.empty() ? "Links:\n" : "\n\nLinks:\n";
+    for (size_t i = 0; i < m_Links.size(); ++i)
+    {
+      m_Out += "[" + std::to_string(i + 1) + "] " + m_Links.at(i) + "\n";
+    }
+  }
+  else if (!m_Out.empty())
+  {
+    m_Out += '\n';
+  }
+
+  return m_Out;
+}
+
+std::string HtmlToText::GetAttr(const char* p_Attrs, size_t p_AttrsLen, const std::string& p_Name)
+{
+  size_t pos = 0;
+  while (pos < p_AttrsLen)
+  {
+    while ((pos < p_AttrsLen) && (IsSpace(p_Attrs[pos]) || (p_Attrs[pos] == '/')))
+    {
+      ++pos;
+    }
+
+    const size_t nameStart = pos;
+    while ((pos < p_AttrsLen) && !IsSpace(p_Attrs[pos]) && (p_Attrs[pos] != '=') && (p_Attrs[pos] != '/'))
+    {
+      ++pos;
+    }
+
+    const size_t nameLen = pos - nameStart;
+    while ((pos < p_AttrsLen) && IsSpace(p_Attrs[pos]))
+    {
+      ++pos;
+    }
+
+    std::string value;
+    if ((pos < p_AttrsLen) && (p_Attrs[pos] == '='))
+    {
+      ++pos;
+      while ((pos < p_AttrsLen) && IsSpace(p_Attrs[pos]))
+      {
+        ++pos;
+      }
+
+      if ((pos < p_AttrsLen) && ((p_Attrs[pos] == '"') || (p_Attrs[pos] == '\'')))
+      {
+        const char quote = p_Attrs[pos++];
+        const size_t valueStart = pos;
+        while ((pos < p_AttrsLen) && (p_Attrs[pos] != quote))
+        {
+          ++pos;
+        }
+
+        value.assign(p_Attrs + valueStart, pos - valueStart);
+        ++pos;
+      }
+      else
+      {
+        const size_t valueStart = pos;
+        while ((pos < p_AttrsLen) && !IsSpace(p_Attrs[pos]))
+        {
+          ++pos;
+        }
+
+        value.assign(p_Attrs + valueStart, pos - valueStart);
+      }
+    }
+
+    if ((nameLen == p_Name.size()) && (strncasecmp(p_Attrs + nameStart, p_Name.c_str(), nameLen) == 0))
+    {
+      Util::ReplaceString(value, "&amp;", "&");
+      return Util::Trim(value);
+    }
+
+    if (nameLen == 0)
+    {
+      ++pos;
+    }
+  }
+
+  return "";
+}
+
+bool HtmlToText::IsHidden(const char* p_Attrs, size_t p_AttrsLen)
+{
+  static const size_t minHiddenLen = sizeof("style=display:none") - 1;
+  if (p_AttrsLen < minHiddenLen) return false;
+
+  std::string style = GetAttr(p_Attrs, p_AttrsLen, "style");
+  style.erase(std::remove_if(style.begin(), style.end(), IsSpace), style.end());
+  std::transform(style.begin(), style.end(), style.begin(), ::tolower);
+  return (style.find("display:none") != std::string::npos);
+}
+
+void HtmlToText::AppendUtf8(std::string& p_Str, uint32_t p_Codepoint)
+{
+  if ((p_Codepoint == 0) || ((p_Codepoint >= 0xD800) && (p_Codepoint <= 0xDFFF)) || (p_Codepoint > 0x10FFFF))
+  {
+    p_Codepoint = 0xFFFD;
+  }
+
+  if (p_Codepoint < 0x80)
+  {
+    p_Str += static_cast<char>(p_Codepoint);
+  }
+  else if (p_Codepoint < 0x800)
+  {
+    p_Str += static_cast<char>(0xC0 | (p_Codepoint >> 6));
+    p_Str += static_cast<char>(0x80 | (p_Codepoint & 0x3F));
+  }
+  else if (p_Codepoint < 0x10000)
+  {
+    p_Str += static_cast<char>(0xE0 | (p_Codepoint >> 12));
+    p_Str += static_cast<char>(0x80 | ((p_Codepoint >> 6) & 0x3F));
+    p_Str += static_cast<char>(0x80 | (p_Codepoint & 0x3F));
+  }
+  else
+  {
+    p_Str += static_cast<char>(0xF0 | (p_Codepoint >> 18));
+    p_Str += static_cast<char>(0x80 | ((p_Codepoint >> 12) & 0x3F));
+    p_Str += static_cast<char>(0x80 | ((p_Codepoint >> 6) & 0x3F));
+    p_Str += static_cast<char>(0x80 | (p_Codepoint & 0x3F));
+  }
+}
+
+bool HtmlToText::IsSpace(char p_Ch)
+{
+  return (p_Ch == ' ') || (p_Ch == '\t') || (p_Ch == '\n') || (p_Ch == '\r') || (p_Ch == '\f');
+}
@@ -0,0 +1,73 @@
+// htmltotext.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Built-in html to plain text converter, handling the subset of html commonly
+// found in emails in a single pass over the (utf-8) input.
+class HtmlToText
+{
+public:
+  static std::string Convert(const std::string& p_Html);
+
+private:
+  struct List
+  {
+    bool m_Ordered = false;
+    int m_Count = 0;
+    size_t m_Indent = 0;
+    size_t m_ItemIndent = 0;
+  };
+
+private:
+  explicit HtmlToText(const std::string& p_Html);
+
+  void Parse();
+  size_t ParseTag(size_t p_Pos);
+  void HandleTag(const std::string& p_Name, bool p_IsEnd, const char* p_Attrs, size_t p_AttrsLen);
+  void SkipElement(const std::string& p_Name);
+  void AddText(const char* p_Text, size_t p_Len);
+  size_t AddEntity(const char* p_Text, size_t p_Len);
+  void AddContent(const char* p_Str, size_t p_Len);
+  void AddNonBreakingSpace();
+  void StartLine();
+  void BlockBreak(int p_NewLines);
+  void LineBreak();
+  void EndLink();
+  std::string GetResult();
+
+  static std::string GetAttr(const char* p_Attrs, size_t p_AttrsLen, const std::string& p_Name);
+  static bool IsHidden(const char* p_Attrs, size_t p_AttrsLen);
+  static void AppendUtf8(std::string& p_Str, uint32_t p_Codepoint);
+  static bool IsSpace(char p_Ch);
+
+private:
+  const std::string& m_Html;
+  std::string m_Out;
+  bool m_PendingSpace = false;
+  int m_PendingNewLines = 0;
+  int m_BreakQuoteDepth = 0;
+  int m_QuoteDepth = 0;
+  int m_PreDepth = 0;
+  int m_CellCount = 0;
+  std::vector<List> m_Lists;
+  std::string m_ListMarker;
+
+  std::string m_HiddenTag;
+  int m_HiddenDepth = 0;
+
+  bool m_InLink = false;
+  std::string m_LinkHref;
+  size_t m_LinkTextPos = 0;
+  std::vector<std::string> m_Links;
+  std::map<std::string, size_t> m_LinkIndex;
+};
@@ -1,6 +1,6 @@
 // imap.cpp
 //
-// Copyright (c) 2019-2023 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -12,17 +12,36 @@
 #include <libetpan/mailimap.h>
 
 #include "auth.h"
+#include "bodyparser.h"
 #include "crypto.h"
 #include "encoding.h"
 #include "flag.h"
 #include "imapcache.h"
+#include "imaptrace.h"
 #include "log.h"
 #include "loghelp.h"
 #include "lockfile.h"
 #include "maphelp.h"
 #include "sethelp.h"
+#include "startupprofile.h"
 #include "util.h"
 
+namespace
+{
+  size_t GetSetSize(struct mailimap_set* p_Set)
+  {
+    size_t size = 0;
+    for (clistiter* it = clist_begin(p_Set->set_list); it != NULL; it = clist_next(it))
+    {
+      struct mailimap_set_item* item = (struct mailimap_set_item*)clist_content(it);
+      // @note: open-ended range (n:*) has set_last 0, its size is unknown, count it as one
+      size += (item->set_last == 0) ? 1 : ((item->set_last - item->set_first) + 1);
+    }
+
+    return size;
+  }
+}
+
 Imap::Imap(const std::string& p_User, const std::string& p_Pass, const std::string& p_Host,
            const uint16_t p_Port, const int64_t p_Timeout,
            const bool p_CacheEncrypt, const bool p_CacheIndexEncrypt,
@@ -48,14 +67,20 @@ Imap::Imap(const std::string& p_User, const std::string& p_Pass, const std::stri
 
   InitImap();
 
-  m_ImapCache.reset(new ImapCache(m_CacheEncrypt, m_Pass));
+  {
+    STARTUP_PHASE("imap_cache_init");
+    m_ImapCache.reset(new ImapCache(m_CacheEncrypt, m_Pass));
+  }
+
   m_ImapIndex.reset(new ImapIndex(m_CacheIndexEncrypt, m_Pass, m_ImapCache, p_StatusHandler));
+  m_BodyParser.reset(new BodyParser());
 }
 
 Imap::~Imap()
 {
   LOG_DEBUG_FUNC(STR());
 
+  m_BodyParser.reset();
   m_ImapIndex.reset();
   m_ImapCache.reset();
 
@@ -73,9 +98,9 @@ void Imap::InitImap()
 {
   m_Imap = LOG_IF_NULL(mailimap_new(0, NULL));
 
-  if (Log::GetTraceEnabled())
+  if (Log::GetTraceEnabled() || ImapTrace::IsEnabled())
   {
-    mailimap_set_logger(m_Imap, Logger, NULL);
+    mailimap_set_logger(m_Imap, Logger, this);
   }
 
   mailimap_set_timeout(m_Imap, m_Timeout);
@@ -99,25 +124,25 @@ bool Imap::Login()
   bool isStartTLS = (m_Port == 143);
 
   {
-    std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+    std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
     m_SelectedFolder.clear();
 
     int rv = 0;
     if (isSSL)
     {
-      rv = LOG_IF_IMAP_ERR(mailimap_ssl_connect(m_Imap, m_Host.c_str(), m_Port));
+      rv = LOG_IF_IMAP_ERR_TRACE("CONNECT", 0, mailimap_ssl_connect(m_Imap, m_Host.c_str(), m_Port));
     }
     else if (isStartTLS)
     {
-      rv = LOG_IF_IMAP_ERR(mailimap_socket_connect(m_Imap, m_Host.c_str(), m_Port));
+      rv = LOG_IF_IMAP_ERR_TRACE("CONNECT", 0, mailimap_socket_connect(m_Imap, m_Host.c_str(), m_Port));
       if (rv == MAILIMAP_NO_ERROR_NON_AUTHENTICATED)
       {
-        rv = LOG_IF_IMAP_ERR(mailimap_socket_starttls(m_Imap));
+        rv = LOG_IF_IMAP_ERR_TRACE("STARTTLS", 0, mailimap_socket_starttls(m_Imap));
       }
     }
     else
     {
-      rv = LOG_IF_IMAP_ERR(mailimap_socket_connect(m_Imap, m_Host.c_str(), m_Port));
+      rv = LOG_IF_IMAP_ERR_TRACE("CONNECT", 0, mailimap_socket_connect(m_Imap, m_Host.c_str(), m_Port));
     }
 
     if (rv == MAILIMAP_NO_ERROR_AUTHENTICATED)
@@ -133,7 +158,7 @@ bool Imap::Login()
       }
       else
       {
-        rv = LOG_IF_IMAP_ERR(mailimap_login(m_Imap, m_User.c_str(), m_Pass.c_str()));
+        rv = LOG_IF_IMAP_ERR_TRACE("LOGIN", 0, mailimap_login(m_Imap, m_User.c_str(), m_Pass.c_str()));
       }
 
       connected = (rv == MAILIMAP_NO_ERROR);
@@ -170,10 +195,10 @@ bool Imap::Logout()
   int rv = MAILIMAP_NO_ERROR;
   if (m_Connected)
   {
-    std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+    std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
     if (m_Imap != NULL)
     {
-      rv = LOG_IF_IMAP_LOGOUT_ERR(mailimap_logout(m_Imap));
+      rv = LOG_IF_IMAP_LOGOUT_ERR_TRACE("LOGOUT", 0, mailimap_logout(m_Imap));
     }
     m_SelectedFolder.clear();
 
@@ -194,7 +219,7 @@ bool Imap::AuthRefresh()
 
   int rv = MAILIMAP_NO_ERROR;
   std::string token = Auth::GetAccessToken();
-  rv = LOG_IF_IMAP_ERR(mailimap_oauth2_authenticate(m_Imap, m_User.c_str(), token.c_str()));
+  rv = LOG_IF_IMAP_ERR_TRACE("AUTHENTICATE", 0, mailimap_oauth2_authenticate(m_Imap, m_User.c_str(), token.c_str()));
 
   return (rv == MAILIMAP_NO_ERROR);
 }
@@ -210,9 +235,9 @@ bool Imap::GetFolders(const bool p_Cached, std::set<std::string>& p_Folders)
   }
 
   clist* list = NULL;
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_list(m_Imap, "", "*", &list));
+  int rv = LOG_IF_IMAP_ERR_TRACE("LIST", 0, mailimap_list(m_Imap, "", "*", &list));
   if (rv == MAILIMAP_NO_ERROR)
   {
     for (clistiter* it = clist_begin(list); it != NULL; it = it->next)
@@ -263,7 +288,7 @@ bool Imap::GetUids(const std::string& p_Folder, const bool p_Cached, std::set<ui
     return true;
   }
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   if (!SelectFolder(p_Folder, true))
   {
@@ -282,7 +307,7 @@ bool Imap::GetUids(const std::string& p_Folder, const bool p_Cached, std::set<ui
   mailimap_fetch_type_new_fetch_att_list_add(fetch_type, mailimap_fetch_att_new_uid());
   clist* fetch_result = NULL;
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_fetch(m_Imap, set, fetch_type, &fetch_result));
+  int rv = LOG_IF_IMAP_ERR_TRACE("FETCH UID", 0, mailimap_fetch(m_Imap, set, fetch_type, &fetch_result));
   if (rv == MAILIMAP_NO_ERROR)
   {
     for (clistiter* it = clist_begin(fetch_result); it != NULL; it = clist_next(it))
@@ -352,7 +377,7 @@ bool Imap::GetHeaders(const std::string& p_Folder, const std::set<uint32_t>& p_U
   {
     clist* fetch_result = NULL;
     std::map<uint32_t, Header> cacheHeaders;
-    std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+    std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
     if (!SelectFolder(p_Folder))
     {
@@ -366,7 +391,8 @@ bool Imap::GetHeaders(const std::string& p_Folder, const std::set<uint32_t>& p_U
     mailimap_fetch_type_new_fetch_att_list_add(fetch_type, mailimap_fetch_att_new_internaldate());
     mailimap_fetch_type_new_fetch_att_list_add(fetch_type, mailimap_fetch_att_new_bodystructure());
 
-    rv = LOG_IF_IMAP_ERR(mailimap_uid_fetch(m_Imap, set, fetch_type, &fetch_result));
+    rv = LOG_IF_IMAP_ERR_TRACE("UID FETCH HEADER", GetSetSize(set),
+                               mailimap_uid_fetch(m_Imap, set, fetch_type, &fetch_result));
     if (rv == MAILIMAP_NO_ERROR)
     {
       for (clistiter* it = clist_begin(fetch_result); it != NULL; it = clist_next(it))
@@ -480,7 +506,7 @@ bool Imap::GetFlags(const std::string& p_Folder, const std::set<uint32_t>& p_Uid
     mailimap_set_add_single(set, uid);
   }
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   if (!SelectFolder(p_Folder))
   {
@@ -494,7 +520,8 @@ bool Imap::GetFlags(const std::string& p_Folder, const std::set<uint32_t>& p_Uid
 
   clist* fetch_result = NULL;
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_uid_fetch(m_Imap, set, fetch_type, &fetch_result));
+  int rv = LOG_IF_IMAP_ERR_TRACE("UID FETCH FLAGS", p_Uids.size(),
+                                 mailimap_uid_fetch(m_Imap, set, fetch_type, &fetch_result));
   if (rv == MAILIMAP_NO_ERROR)
   {
     for (clistiter* it = clist_begin(fetch_result); it != NULL; it = clist_next(it))
@@ -569,11 +596,22 @@ bool Imap::GetBodys(const std::string& p_Folder, const std::set<uint32_t>& p_Uid
   bool needFetch = false;
   struct mailimap_set* set = mailimap_set_new_empty();
 
+  if (!p_Prefetch)
+  {
+    // bodies fetched by prefetch may still be in parse stage, before being written to cache
+    m_BodyParser->WaitPendingUids(p_Folder, p_Uids);
+  }
+
   p_Bodys = m_ImapCache->GetBodys(p_Folder, p_Uids, p_Prefetch);
 
   if (!p_Cached)
   {
     std::set<uint32_t> uidsNotCached = p_Uids - MapKey(p_Bodys);
+    if (p_Prefetch)
+    {
+      uidsNotCached = uidsNotCached - m_BodyParser->GetPendingUids(p_Folder);
+    }
+
     for (auto& uid : uidsNotCached)
     {
       mailimap_set_add_single(set, uid);
@@ -597,87 +635,137 @@ bool Imap::GetBodys(const std::string& p_Folder, const std::set<uint32_t>& p_Uid
 
   if (needFetch)
   {
-    std::lock_guard<std::mutex> imapLock(m_ImapMutex);
-
-    if (!SelectFolder(p_Folder))
+    std::map<uint32_t, std::string> datas;
+    rv = FetchBodyDatas(p_Folder, set, datas);
+    if (rv == MAILIMAP_ERROR_SELECT)
     {
       mailimap_set_free(set);
       return false;
     }
 
-    struct mailimap_fetch_type* fetch_type = mailimap_fetch_type_new_fetch_att_list_empty();
-    struct mailimap_fetch_att* body_att =
-      mailimap_fetch_att_new_body_peek_section(mailimap_section_new(NULL));
-    mailimap_fetch_type_new_fetch_att_list_add(fetch_type, body_att);
-    mailimap_fetch_type_new_fetch_att_list_add(fetch_type, mailimap_fetch_att_new_uid());
+    // parsing is done by body parser worker threads, outside imap lock
+    if (p_Prefetch)
+    {
+      m_BodyParser->AsyncParse(p_Folder, datas,
+                               [this](const std::string& p_ParsedFolder, const std::map<uint32_t, Body>& p_ParsedBodys)
+      {
+        m_ImapCache->SetBodys(p_ParsedFolder, p_ParsedBodys);
+        m_ImapIndex->SetBodys(p_ParsedFolder, MapKey(p_ParsedBodys));
+      });
+    }
+    else
+    {
+      const std::map<uint32_t, Body>& bodys = m_BodyParser->Parse(datas);
+      p_Bodys.insert(bodys.begin(), bodys.end());
+      m_ImapCache->SetBodys(p_Folder, bodys);
+      m_ImapIndex->SetBodys(p_Folder, MapKey(bodys));
+    }
+  }
 
-    clist* fetch_result = NULL;
-    std::map<uint32_t, Body> cacheBodys;
+  mailimap_set_free(set);
 
-    rv = LOG_IF_IMAP_ERR(mailimap_uid_fetch(m_Imap, set, fetch_type, &fetch_result));
-    if (rv == MAILIMAP_NO_ERROR)
+  return (rv == MAILIMAP_NO_ERROR);
+}
+
+int Imap::FetchBodyDatas(const std::string& p_Folder, struct mailimap_set* p_Set,
+                         std::map<uint32_t, std::string>& p_Datas)
+{
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
+
+  if (!SelectFolder(p_Folder))
+  {
+    return MAILIMAP_ERROR_SELECT;
+  }
+
+  struct mailimap_fetch_type* fetch_type = mailimap_fetch_type_new_fetch_att_list_empty();
+  struct mailimap_fetch_att* body_att =
+    mailimap_fetch_att_new_body_peek_section(mailimap_section_new(NULL));
+  mailimap_fetch_type_new_fetch_att_list_add(fetch_type, body_att);
+  mailimap_fetch_type_new_fetch_att_list_add(fetch_type, mailimap_fetch_att_new_uid());
+
+  clist* fetch_result = NULL;
+
+  // body literals are read from the network directly into strings owned by us, keyed by the
+  // section being parsed. A section freed by a failed parse may have its address reused, so an
+  // entry is only valid for a section with no body of its own, and is consumed on use.
+  std::map<struct mailimap_msg_att_body_section*, std::string> bodyBuffers;
+#ifdef LIBETPAN_CUSTOM
+  mailimap_set_msg_body_buffer_handler(m_Imap, BodyBufferHandler, &bodyBuffers);
+#endif
+
+  int rv = LOG_IF_IMAP_ERR_TRACE("UID FETCH BODY", GetSetSize(p_Set),
+                                 mailimap_uid_fetch(m_Imap, p_Set, fetch_type, &fetch_result));
+
+#ifdef LIBETPAN_CUSTOM
+  mailimap_set_msg_body_buffer_handler(m_Imap, NULL, NULL);
+#endif
+
+  if (rv != MAILIMAP_NO_ERROR)
+  {
+    // buffers of partially parsed sections are not valid
+    bodyBuffers.clear();
+  }
+  else
+  {
+    for (clistiter* it = clist_begin(fetch_result); it != NULL; it = clist_next(it))
     {
-      for (clistiter* it = clist_begin(fetch_result); it != NULL; it = clist_next(it))
-      {
-        struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(it);
+      struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(it);
 
-        uint32_t uid = 0;
-        Body body;
-        for (clistiter* ait = clist_begin(msg_att->att_list); ait != NULL; ait = clist_next(ait))
-        {
-          struct mailimap_msg_att_item* item =
-            (struct mailimap_msg_att_item*)clist_content(ait);
+      uint32_t uid = 0;
+      std::string data;
+      for (clistiter* ait = clist_begin(msg_att->att_list); ait != NULL; ait = clist_next(ait))
+      {
+        struct mailimap_msg_att_item* item =
+          (struct mailimap_msg_att_item*)clist_content(ait);
 
-          if (item->att_type == MAILIMAP_MSG_ATT_ITEM_DYNAMIC) continue;
+        if (item->att_type == MAILIMAP_MSG_ATT_ITEM_DYNAMIC) continue;
 
-          if (item->att_type == MAILIMAP_MSG_ATT_ITEM_STATIC)
+        if (item->att_type == MAILIMAP_MSG_ATT_ITEM_STATIC)
+        {
+          if (item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_BODY_SECTION)
           {
-            if (item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_BODY_SECTION)
+            struct mailimap_msg_att_body_section* body_section =
+              item->att_data.att_static->att_data.att_body_section;
+            auto bit = bodyBuffers.find(body_section);
+            if ((bit != bodyBuffers.end()) && (body_section->sec_length == 0))
             {
-              std::string data(item->att_data.att_static->att_data.att_body_section->sec_body_part,
-                               item->att_data.att_static->att_data.att_body_section->sec_length);
-              body.SetData(data);
+              data.swap(bit->second);
+              bodyBuffers.erase(bit);
             }
-
-            if (item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_UID)
+            else
             {
-              uid = item->att_data.att_static->att_data.att_uid;
+              data.assign(body_section->sec_body_part, body_section->sec_length);
             }
           }
-        }
-
-        if (uid == 0)
-        {
-          LOG_WARNING("skip body uid = %d", uid);
-          continue;
-        }
 
-        if (body.GetData().empty())
-        {
-          LOG_WARNING("skip body = \"\"");
-          continue;
+          if (item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_UID)
+          {
+            uid = item->att_data.att_static->att_data.att_uid;
+          }
         }
+      }
 
-        if (!p_Prefetch)
-        {
-          p_Bodys[uid] = body;
-        }
+      if (uid == 0)
+      {
+        LOG_WARNING("skip body uid = %d", uid);
+        continue;
+      }
 
-        cacheBodys[uid] = body;
+      if (data.empty())
+      {
+        LOG_WARNING("skip body = \"\"");
+        continue;
       }
 
-      mailimap_fetch_list_free(fetch_result);
+      p_Datas[uid].swap(data);
     }
 
-    m_ImapCache->SetBodys(p_Folder, cacheBodys);
-    m_ImapIndex->SetBodys(p_Folder, MapKey(cacheBodys));
-
-    mailimap_fetch_type_free(fetch_type);
+    mailimap_fetch_list_free(fetch_result);
   }
 
-  mailimap_set_free(set);
+  mailimap_fetch_type_free(fetch_type);
 
-  return (rv == MAILIMAP_NO_ERROR);
+  return rv;
 }
 
 bool Imap::SetFlagSeen(const std::string& p_Folder, const std::set<uint32_t>& p_Uids,
@@ -685,7 +773,7 @@ bool Imap::SetFlagSeen(const std::string& p_Folder, const std::set<uint32_t>& p_
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids, p_Value));
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   if (!SelectFolder(p_Folder))
   {
@@ -704,7 +792,7 @@ bool Imap::SetFlagSeen(const std::string& p_Folder, const std::set<uint32_t>& p_
   struct mailimap_store_att_flags* storeflags = p_Value
     ? mailimap_store_att_flags_new_add_flags(flaglist) : mailimap_store_att_flags_new_remove_flags(flaglist);
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_uid_store(m_Imap, set, storeflags));
+  int rv = LOG_IF_IMAP_ERR_TRACE("UID STORE", p_Uids.size(), mailimap_uid_store(m_Imap, set, storeflags));
 
   if (storeflags != NULL)
   {
@@ -726,7 +814,7 @@ bool Imap::SetFlagDeleted(const std::string& p_Folder, const std::set<uint32_t>&
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids, p_Value));
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   if (!SelectFolder(p_Folder))
   {
@@ -745,7 +833,7 @@ bool Imap::SetFlagDeleted(const std::string& p_Folder, const std::set<uint32_t>&
   struct mailimap_store_att_flags* storeflags = p_Value
     ? mailimap_store_att_flags_new_add_flags(flaglist) : mailimap_store_att_flags_new_remove_flags(flaglist);
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_uid_store(m_Imap, set, storeflags));
+  int rv = LOG_IF_IMAP_ERR_TRACE("UID STORE", p_Uids.size(), mailimap_uid_store(m_Imap, set, storeflags));
 
   mailimap_set_free(set);
 
@@ -762,7 +850,7 @@ bool Imap::MoveMessages(const std::string& p_Folder, const std::set<uint32_t>& p
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids, p_DestFolder));
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   if (!SelectFolder(p_Folder))
   {
@@ -776,7 +864,8 @@ bool Imap::MoveMessages(const std::string& p_Folder, const std::set<uint32_t>& p
   }
 
   const std::string encDestFolder = EncodeFolderName(p_DestFolder);
-  int rv = LOG_IF_IMAP_ERR(mailimap_uid_move(m_Imap, set, encDestFolder.c_str()));
+  int rv = LOG_IF_IMAP_ERR_TRACE("UID MOVE", p_Uids.size(),
+                                 mailimap_uid_move(m_Imap, set, encDestFolder.c_str()));
 
   mailimap_set_free(set);
 
@@ -796,8 +885,9 @@ bool Imap::DeleteMessages(const std::string& p_Folder, const std::set<uint32_t>&
   bool rv = true;
   rv &= SetFlagDeleted(p_Folder, p_Uids, true);
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
-  rv &= (LOG_IF_IMAP_ERR(mailimap_expunge(m_Imap)) == MAILIMAP_NO_ERROR);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
+  const int expungeRv = LOG_IF_IMAP_ERR_TRACE("EXPUNGE", 0, mailimap_expunge(m_Imap));
+  rv &= (expungeRv == MAILIMAP_NO_ERROR);
 
   if (rv)
   {
@@ -812,11 +902,10 @@ bool Imap::CheckConnection()
 {
   LOG_DEBUG_FUNC(STR());
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
-  bool rv = true;
-  rv &= (LOG_IF_IMAP_ERR(mailimap_noop(m_Imap)) == MAILIMAP_NO_ERROR);
-  return rv;
+  const int rv = LOG_IF_IMAP_ERR_TRACE("NOOP", 0, mailimap_noop(m_Imap));
+  return (rv == MAILIMAP_NO_ERROR);
 }
 
 bool Imap::GetConnected()
@@ -825,21 +914,24 @@ bool Imap::GetConnected()
   return m_Connected;
 }
 
-int Imap::IdleStart(const std::string& p_Folder)
+int Imap::IdleStart(const std::string& p_Folder, bool& p_HasPending)
 {
   LOG_DEBUG_FUNC(STR(p_Folder));
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   if (!SelectFolder(p_Folder))
   {
     return -1;
   }
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_idle(m_Imap));
+  int rv = LOG_IF_IMAP_ERR_TRACE("IDLE", 0, mailimap_idle(m_Imap));
   if (rv == MAILIMAP_NO_ERROR)
   {
     int fd = mailimap_idle_get_fd(m_Imap);
+    // @note: a notification received along with the idle continuation is already consumed from
+    // the socket into the stream buffer, and would not be signalled by the fd.
+    p_HasPending = (m_Imap->imap_stream != NULL) && (m_Imap->imap_stream->read_buffer_len > 0);
     m_ImapIndex->NotifyIdle(true);
     return fd;
   }
@@ -851,8 +943,8 @@ bool Imap::IdleDone()
 {
   LOG_DEBUG_FUNC(STR());
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
-  int rv = LOG_IF_IMAP_ERR(mailimap_idle_done(m_Imap));
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
+  int rv = LOG_IF_IMAP_ERR_TRACE("DONE", 0, mailimap_idle_done(m_Imap));
   m_ImapIndex->NotifyIdle(false);
   return (rv == MAILIMAP_NO_ERROR);
 }
@@ -877,11 +969,13 @@ bool Imap::UploadMessage(const std::string& p_Folder, const std::string& p_Msg,
     mailimap_date_time_new(lt->tm_mday, (lt->tm_mon + 1), (lt->tm_year + 1900),
                            lt->tm_hour, lt->tm_min, lt->tm_sec, 0 /* dt_zone */);
 
-  std::lock_guard<std::mutex> imapLock(m_ImapMutex);
+  std::lock_guard<ProfMutex> imapLock(m_ImapMutex);
 
   const std::string encFolder = EncodeFolderName(p_Folder);
-  bool rv = (LOG_IF_IMAP_ERR(mailimap_append(m_Imap, encFolder.c_str(), flaglist, datetime,
-                                             p_Msg.c_str(), p_Msg.size())) == MAILIMAP_NO_ERROR);
+  const int appendRv = LOG_IF_IMAP_ERR_TRACE("APPEND", 0,
+                                             mailimap_append(m_Imap, encFolder.c_str(), flaglist, datetime,
+                                                             p_Msg.c_str(), p_Msg.size()));
+  bool rv = (appendRv == MAILIMAP_NO_ERROR);
 
   mailimap_date_time_free(datetime);
 
@@ -929,8 +1023,8 @@ Imap::FolderInfo Imap::GetFolderInfo(const std::string& p_Folder)
 
   struct mailimap_mailbox_data_status* status = nullptr;
 
-  int rv = LOG_IF_IMAP_ERR(mailimap_status(m_Imap, p_Folder.c_str(),
-                                           status_att_list, &status));
+  int rv = LOG_IF_IMAP_ERR_TRACE("STATUS", 0, mailimap_status(m_Imap, p_Folder.c_str(),
+                                                              status_att_list, &status));
   if ((rv == MAILIMAP_NO_ERROR) && (status != nullptr))
   {
     for (clistiter* it = clist_begin(status->st_info_list); it != nullptr;
@@ -976,7 +1070,7 @@ bool Imap::SelectFolder(const std::string& p_Folder, bool p_Force)
   if (p_Force || (p_Folder != m_SelectedFolder))
   {
     const std::string encFolder = EncodeFolderName(p_Folder);
-    int rv = LOG_IF_IMAP_ERR(mailimap_select(m_Imap, encFolder.c_str()));
+    int rv = LOG_IF_IMAP_ERR_TRACE("SELECT", 0, mailimap_select(m_Imap, encFolder.c_str()));
     if (rv == MAILIMAP_NO_ERROR)
     {
       m_SelectedFolder = p_Folder;
@@ -1046,12 +1140,51 @@ std::string Imap::EncodeFolderName(const std::string& p_Folder)
   return encFolder;
 }
 
+void Imap::SetStreamBufferSize(size_t p_Size)
+{
+#ifdef LIBETPAN_CUSTOM
+  if (p_Size > 0)
+  {
+    mailstream_set_default_buffer_size(p_Size);
+  }
+#else
+  (void)p_Size;
+#endif
+}
+
+char* Imap::BodyBufferHandler(int p_MsgAttType, struct mailimap_msg_att_body_section* p_Section, size_t p_Length,
+                              void* p_UserData)
+{
+  if ((p_MsgAttType != MAILIMAP_MSG_ATT_BODY_SECTION) || (p_Section == NULL) || (p_Length == 0)) return NULL;
+
+  std::map<struct mailimap_msg_att_body_section*, std::string>* bodyBuffers =
+    static_cast<std::map<struct mailimap_msg_att_body_section*, std::string>*>(p_UserData);
+  // replaces any stale buffer of a freed section at the same address
+  std::string& buffer = (*bodyBuffers)[p_Section];
+  buffer.assign(p_Length, '\0');
+  return &buffer[0];
+}
+
 void Imap::Logger(struct mailimap* p_Imap, int p_LogType, const char* p_Buffer, size_t p_Size, void* p_UserData)
 {
+  (void)p_Imap;
+  Imap* imap = static_cast<Imap*>(p_UserData);
+  if (imap->m_TraceCommand != nullptr)
+  {
+    if ((p_LogType == MAILSTREAM_LOG_TYPE_DATA_SENT) || (p_LogType == MAILSTREAM_LOG_TYPE_DATA_SENT_PRIVATE))
+    {
+      imap->m_TraceCommand->OnSent(p_Size);
+    }
+    else if (p_LogType == MAILSTREAM_LOG_TYPE_DATA_RECEIVED)
+    {
+      imap->m_TraceCommand->OnReceived(p_Size);
+    }
+  }
+
+  if (!Log::GetTraceEnabled()) return;
+
   if (p_LogType == MAILSTREAM_LOG_TYPE_DATA_SENT_PRIVATE) return; // dont log private data, like passwords
 
-  (void)p_Imap;
-  (void)p_UserData;
   char* buffer = (char*)malloc(p_Size + 1);
   memcpy(buffer, p_Buffer, p_Size);
   buffer[p_Size] = 0;
@@ -1,6 +1,6 @@
 // imap.h
 //
-// Copyright (c) 2019-2023 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -14,9 +14,12 @@
 #include <string>
 
 #include "body.h"
+#include "bodyparser.h"
 #include "header.h"
 #include "imapcache.h"
 #include "imapindex.h"
+#include "imaptrace.h"
+#include "profmutex.h"
 
 class Imap
 {
@@ -74,7 +77,7 @@ public:
   bool CheckConnection();
 
   bool GetConnected();
-  int IdleStart(const std::string& p_Folder);
+  int IdleStart(const std::string& p_Folder, bool& p_HasPending);
   bool IdleDone();
   bool UploadMessage(const std::string& p_Folder, const std::string& p_Msg, bool p_IsDraft);
 
@@ -89,9 +92,13 @@ public:
 
   FolderInfo GetFolderInfo(const std::string& p_Folder);
 
+  static void SetStreamBufferSize(size_t p_Size);
+
 private:
   bool SelectFolder(const std::string& p_Folder, bool p_Force = false);
   bool SelectedFolderIsEmpty();
+  int FetchBodyDatas(const std::string& p_Folder, struct mailimap_set* p_Set,
+                     std::map<uint32_t, std::string>& p_Datas);
   uint32_t GetUidValidity();
   void InitImap();
   void CleanupImap();
@@ -99,6 +106,8 @@ private:
   static std::string DecodeFolderName(const std::string& p_Folder);
   static std::string EncodeFolderName(const std::string& p_Folder);
   static void Logger(struct mailimap* p_Imap, int p_LogType, const char* p_Buffer, size_t p_Size, void* p_UserData);
+  static char* BodyBufferHandler(int p_MsgAttType, struct mailimap_msg_att_body_section* p_Section, size_t p_Length,
+                                 void* p_UserData);
 
 private:
   std::string m_User;
@@ -110,8 +119,9 @@ private:
   bool m_CacheIndexEncrypt = false;
   std::set<std::string> m_FoldersExclude;
 
-  std::mutex m_ImapMutex;
+  ProfMutex m_ImapMutex{"imap"};
   struct mailimap* m_Imap = NULL;
+  ImapTrace::Command* m_TraceCommand = nullptr;
 
   std::string m_SelectedFolder;
   bool m_SelectedFolderIsEmpty = true;
@@ -122,4 +132,5 @@ private:
 
   std::shared_ptr<ImapCache> m_ImapCache;
   std::unique_ptr<ImapIndex> m_ImapIndex;
+  std::unique_ptr<BodyParser> m_BodyParser;
 };
@@ -1,6 +1,6 @@
 // imapcache.cpp
 //
-// Copyright (c) 2020-2022 Kristofer Berggren
+// Copyright (c) 2020-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -17,6 +17,8 @@
 #include "lockfile.h"
 #include "loghelp.h"
 #include "maphelp.h"
+#include "memorybudget.h"
+#include "partcache.h"
 #include "util.h"
 #include "serialization.h"
 #include "sethelp.h"
@@ -40,6 +42,13 @@ struct ImapCache::DbConnection
     m_Database.reset(new sqlite::database(m_DbPath));
     *m_Database << "PRAGMA synchronous = OFF";
     *m_Database << "PRAGMA journal_mode = MEMORY";
+
+    const int64_t cacheKb = MemoryBudget::GetSqliteCacheKb();
+    if (cacheKb > 0)
+    {
+      // negative cache_size is in KiB
+      *m_Database << ("PRAGMA cache_size = -" + std::to_string(cacheKb));
+    }
   }
 
   std::shared_ptr<sqlite::database> m_Database;
@@ -72,70 +81,27 @@ bool ImapCache::ChangePass(const bool p_CacheEncrypt,
 {
   if (!p_CacheEncrypt) return true;
 
-  std::string headersDir = GetCacheDbDir(HeadersDb);
-  std::vector<std::string> headerFiles = Util::ListDir(headersDir);
-  for (const auto& headerFile : headerFiles)
-  {
-    std::string path = headersDir + headerFile;
-    std::string tmpPath = path + ".tmp";
-    if (!Crypto::AESDecryptFile(path, tmpPath, p_OldPass)) return false;
-
-    if (!Crypto::AESEncryptFile(tmpPath, path, p_NewPass)) return false;
-
-    Util::DeleteFile(tmpPath);
-
-    std::cout << ".";
-  }
-
-  std::string bodysDir = GetCacheDbDir(BodysDb);
-  std::vector<std::string> bodyFiles = Util::ListDir(bodysDir);
-  for (const auto& bodyFile : bodyFiles)
+  const std::vector<std::string> dbDirs =
   {
-    std::string path = bodysDir + bodyFile;
-    std::string tmpPath = path + ".tmp";
-    if (!Crypto::AESDecryptFile(path, tmpPath, p_OldPass)) return false;
-
-    if (!Crypto::AESEncryptFile(tmpPath, path, p_NewPass)) return false;
-
-    Util::DeleteFile(tmpPath);
-
-    std::cout << ".";
-  }
-
-  std::string uidFlagsDir = GetCacheDbDir(UidFlagsDb);
-  std::vector<std::string> uidFlagFiles = Util::ListDir(uidFlagsDir);
-  for (const auto& uidFlagFile : uidFlagFiles)
+    GetCacheDbDir(HeadersDb),
+    GetCacheDbDir(BodysDb),
+    GetCacheDbDir(UidFlagsDb),
+    GetCacheDbDir(ValidityDb),
+  };
+  for (const auto& dbDir : dbDirs)
   {
-    std::string path = uidFlagsDir + uidFlagFile;
-    std::string tmpPath = path + ".tmp";
-    if (!Crypto::AESDecryptFile(path, tmpPath, p_OldPass)) return false;
-
-    if (!Crypto::AESEncryptFile(tmpPath, path, p_NewPass)) return false;
-
-    Util::DeleteFile(tmpPath);
+    if (!CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, dbDir)) return false;
 
     std::cout << ".";
   }
 
-  std::string validityDir = GetCacheDbDir(ValidityDb);
-  std::vector<std::string> validityFiles = Util::ListDir(validityDir);
-  for (const auto& validityFile : validityFiles)
+  std::string path = GetHeadersFoldersPath();
+  std::string data = Util::ReadFile(path);
+  if (Crypto::IsPassEncrypted(data))
   {
-    std::string path = validityDir + validityFile;
-    std::string tmpPath = path + ".tmp";
-    if (!Crypto::AESDecryptFile(path, tmpPath, p_OldPass)) return false;
-
-    if (!Crypto::AESEncryptFile(tmpPath, path, p_NewPass)) return false;
-
-    Util::DeleteFile(tmpPath);
-
-    std::cout << ".";
+    Util::WriteFile(path, Crypto::AESEncrypt(Crypto::AESDecrypt(data, p_OldPass), p_NewPass));
   }
 
-  std::string path = GetHeadersFoldersPath();
-  std::string data = Crypto::AESDecrypt(Util::ReadFile(path), p_OldPass);
-  Util::WriteFile(path, Crypto::AESEncrypt(data, p_NewPass));
-
   std::cout << "\n";
   return true;
 }
@@ -144,7 +110,7 @@ bool ImapCache::ChangePass(const bool p_CacheEncrypt,
 std::set<std::string> ImapCache::GetFolders()
 {
   LOG_DURATION();
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   return Serialization::FromString<std::set<std::string>>(ReadCacheFile(GetHeadersFoldersPath()));
 }
 
@@ -156,7 +122,7 @@ void ImapCache::SetFolders(const std::set<std::string>& p_Folders)
 
   std::set<std::string> deletedFolders;
   {
-    std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+    std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
     deletedFolders = m_Folders - p_Folders;
     WriteCacheFile(GetHeadersFoldersPath(), Serialization::ToString(p_Folders));
   }
@@ -172,7 +138,7 @@ void ImapCache::SetFolders(const std::set<std::string>& p_Folders)
 std::set<uint32_t> ImapCache::GetUids(const std::string& p_Folder)
 {
   LOG_DURATION();
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, p_Folder, false /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -199,7 +165,7 @@ void ImapCache::SetUids(const std::string& p_Folder, const std::set<uint32_t>& p
 {
   LOG_DURATION();
 
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
 
   std::string delUidList;
 
@@ -281,7 +247,7 @@ std::map<uint32_t, Header> ImapCache::GetHeaders(const std::string& p_Folder, co
 
   try
   {
-    std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+    std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
     std::shared_ptr<DbConnection> dbCon = GetDb(HeadersDb, p_Folder, false /* p_Writable */);
     std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -343,7 +309,7 @@ void ImapCache::SetHeaders(const std::string& p_Folder, const std::map<uint32_t,
   LOG_DURATION();
   if (p_Headers.empty()) return;
 
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(HeadersDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -371,7 +337,7 @@ std::map<uint32_t, uint32_t> ImapCache::GetFlags(const std::string& p_Folder, co
   std::map<uint32_t, uint32_t> flags;
   if (p_Uids.empty()) return flags;
 
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, p_Folder, false /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -401,7 +367,7 @@ std::map<uint32_t, uint32_t> ImapCache::GetFlags(const std::string& p_Folder, co
 void ImapCache::SetFlags(const std::string& p_Folder, const std::map<uint32_t, uint32_t>& p_Flags)
 {
   LOG_DURATION();
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -432,7 +398,7 @@ std::map<uint32_t, Body> ImapCache::GetBodys(const std::string& p_Folder, const
 
   try
   {
-    std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+    std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
     std::shared_ptr<DbConnection> dbCon = GetDb(BodysDb, p_Folder, false /* p_Writable */);
     std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -485,7 +451,7 @@ void ImapCache::SetBodys(const std::string& p_Folder, const std::map<uint32_t, B
   LOG_DURATION();
   if (p_Bodys.empty()) return;
 
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(BodysDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -512,7 +478,7 @@ bool ImapCache::CheckUidValidity(const std::string& p_Folder, int p_Uid)
   bool rv = true;
   try
   {
-    std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+    std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
     int storedUid = -1;
 
     const std::string commonFolder = "common";
@@ -600,7 +566,7 @@ void ImapCache::SetFlagSeen(const std::string& p_Folder, const std::set<uint32_t
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids, p_Value));
 
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -623,7 +589,10 @@ void ImapCache::SetFlagSeen(const std::string& p_Folder, const std::set<uint32_t
 void ImapCache::ClearFolder(const std::string& p_Folder)
 {
   LOG_DEBUG_FUNC(STR(p_Folder));
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
+
+  // uids may be reused after a uidvalidity change, so decoded parts indexed by uid are dropped
+  PartCache::ClearFolder(p_Folder);
 
   try
   {
@@ -673,7 +642,7 @@ void ImapCache::DeleteMessages(const std::string& p_Folder, const std::set<uint3
 void ImapCache::DeleteUids(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -707,7 +676,7 @@ void ImapCache::DeleteUids(const std::string& p_Folder, const std::set<uint32_t>
 void ImapCache::DeleteFlags(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -730,7 +699,7 @@ void ImapCache::DeleteFlags(const std::string& p_Folder, const std::set<uint32_t
 void ImapCache::DeleteHeaders(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(HeadersDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -753,7 +722,7 @@ void ImapCache::DeleteHeaders(const std::string& p_Folder, const std::set<uint32
 void ImapCache::DeleteBodys(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   std::shared_ptr<DbConnection> dbCon = GetDb(BodysDb, p_Folder, true /* p_Writable */);
   std::shared_ptr<sqlite::database> db = dbCon->m_Database;
 
@@ -807,9 +776,178 @@ bool ImapCache::Export(const std::string& p_Path)
   return true;
 }
 
+// get per-folder message counts and sizes
+std::map<std::string, ImapCache::FolderStats> ImapCache::GetStats()
+{
+  LOG_DURATION();
+  const std::set<std::string> folders = GetFolders();
+
+  std::map<std::string, FolderStats> stats;
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
+  for (const auto& folder : folders)
+  {
+    FolderStats& folderStats = stats[folder];
+    if (DbExists(UidFlagsDb, folder))
+    {
+      try
+      {
+        std::shared_ptr<DbConnection> dbCon = GetDb(UidFlagsDb, folder, false /* p_Writable */);
+        std::shared_ptr<sqlite::database> db = dbCon->m_Database;
+        auto lambda = [&](const std::vector<uint32_t>& data)
+        {
+          folderStats.m_Uids = data.size();
+        };
+
+        *db << "SELECT uids.uids FROM uids LIMIT 1" >> lambda;
+        *db << "SELECT COUNT(*) FROM flags;" >> folderStats.m_Flags;
+      }
+      catch (const sqlite::sqlite_exception& ex)
+      {
+        HANDLE_SQLITE_EXCEPTION(ex);
+      }
+    }
+
+    if (DbExists(HeadersDb, folder))
+    {
+      try
+      {
+        std::shared_ptr<DbConnection> dbCon = GetDb(HeadersDb, folder, false /* p_Writable */);
+        std::shared_ptr<sqlite::database> db = dbCon->m_Database;
+        *db << "SELECT COUNT(*), COALESCE(SUM(LENGTH(data)), 0) FROM headers;" >>
+          std::tie(folderStats.m_Headers, folderStats.m_HeadersSize);
+      }
+      catch (const sqlite::sqlite_exception& ex)
+      {
+        HANDLE_SQLITE_EXCEPTION(ex);
+      }
+    }
+
+    if (DbExists(BodysDb, folder))
+    {
+      try
+      {
+        std::shared_ptr<DbConnection> dbCon = GetDb(BodysDb, folder, false /* p_Writable */);
+        std::shared_ptr<sqlite::database> db = dbCon->m_Database;
+        *db << "SELECT COUNT(*), COALESCE(SUM(LENGTH(data)), 0) FROM bodys;" >>
+          std::tie(folderStats.m_Bodys, folderStats.m_BodysSize);
+      }
+      catch (const sqlite::sqlite_exception& ex)
+      {
+        HANDLE_SQLITE_EXCEPTION(ex);
+      }
+    }
+
+    for (const auto& dbType : { HeadersDb, BodysDb, UidFlagsDb })
+    {
+      folderStats.m_FileSize += GetDbFileSize(dbType, folder);
+    }
+  }
+
+  return stats;
+}
+
+// get uids of cached bodys per folder
+std::map<std::string, std::set<uint32_t>> ImapCache::GetBodyUids()
+{
+  LOG_DURATION();
+  const std::set<std::string> folders = GetFolders();
+
+  std::map<std::string, std::set<uint32_t>> bodyUids;
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
+  for (const auto& folder : folders)
+  {
+    bodyUids[folder] = GetDbUids(BodysDb, folder);
+  }
+
+  return bodyUids;
+}
+
+// check db integrity and that cached headers, bodys and flags belong to known uids
+std::vector<std::string> ImapCache::Verify()
+{
+  LOG_DURATION();
+  const std::set<std::string> folders = GetFolders();
+
+  std::vector<std::string> issues;
+  for (const auto& folder : folders)
+  {
+    bool hasUids = false;
+    {
+      std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
+      hasUids = DbExists(UidFlagsDb, folder);
+    }
+
+    const std::set<uint32_t> uids = hasUids ? GetUids(folder) : std::set<uint32_t>();
+
+    std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
+    for (const auto& dbType : { HeadersDb, BodysDb, UidFlagsDb })
+    {
+        if (!DbExists(dbType, folder)) continue;
+
+      try
+      {
+        std::shared_ptr<DbConnection> dbCon = GetDb(dbType, folder, false /* p_Writable */);
+        std::shared_ptr<sqlite::database> db = dbCon->m_Database;
+        *db << "PRAGMA integrity_check;" >> [&](const std::string& result)
+        {
+          if (result != "ok")
+          {
+            issues.push_back(folder + ": " + GetDbTypeName(dbType) + " db: " + result);
+          }
+        };
+      }
+      catch (const sqlite::sqlite_exception& ex)
+      {
+        HANDLE_SQLITE_EXCEPTION(ex);
+        issues.push_back(folder + ": " + GetDbTypeName(dbType) + " db: " + ex.what());
+      }
+
+      const std::set<uint32_t> orphanUids = GetDbUids(dbType, folder) - uids;
+      if (!orphanUids.empty())
+      {
+        issues.push_back(folder + ": " + std::to_string(orphanUids.size()) + " " +
+                         ((dbType == UidFlagsDb) ? "flags" : GetDbTypeName(dbType)) +
+                         " not in uid list");
+      }
+    }
+  }
+
+  return issues;
+}
+
+// rebuild all dbs to reclaim space from deleted messages
+void ImapCache::Vacuum()
+{
+  LOG_DURATION();
+  const std::set<std::string> folders = GetFolders();
+
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
+  for (const auto& folder : folders)
+  {
+    for (const auto& dbType : { HeadersDb, BodysDb, UidFlagsDb })
+    {
+      try
+      {
+        // @note: for encrypted cache the previous writable db is written back when switching
+        std::shared_ptr<DbConnection> dbCon = GetDb(dbType, folder, true /* p_Writable */);
+        std::shared_ptr<sqlite::database> db = dbCon->m_Database;
+        *db << "VACUUM;";
+      }
+      catch (const sqlite::sqlite_exception& ex)
+      {
+        HANDLE_SQLITE_EXCEPTION(ex);
+      }
+    }
+  }
+
+  CloseDbs(HeadersDb);
+  CloseDbs(BodysDb);
+  CloseDbs(UidFlagsDb);
+}
+
 void ImapCache::InitHeadersCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   static const int version = 2;
   CacheUtil::CommonInitCacheDir(GetCacheDir(HeadersDb), version, m_CacheEncrypt);
   Util::MkDir(GetCacheDbDir(HeadersDb));
@@ -822,13 +960,13 @@ void ImapCache::InitHeadersCache()
 
 void ImapCache::CleanupHeadersCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   CloseDbs(HeadersDb);
 }
 
 void ImapCache::InitBodysCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   static const int version = 2;
   CacheUtil::CommonInitCacheDir(GetCacheDir(BodysDb), version, m_CacheEncrypt);
   Util::MkDir(GetCacheDbDir(BodysDb));
@@ -841,13 +979,13 @@ void ImapCache::InitBodysCache()
 
 void ImapCache::CleanupBodysCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   CloseDbs(BodysDb);
 }
 
 void ImapCache::InitUidFlagsCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   static const int version = 2;
   CacheUtil::CommonInitCacheDir(GetCacheDir(UidFlagsDb), version, m_CacheEncrypt);
   Util::MkDir(GetCacheDbDir(UidFlagsDb));
@@ -860,13 +998,13 @@ void ImapCache::InitUidFlagsCache()
 
 void ImapCache::CleanupUidFlagsCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   CloseDbs(UidFlagsDb);
 }
 
 void ImapCache::InitValidityCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   static const int version = 1;
   CacheUtil::CommonInitCacheDir(GetCacheDir(ValidityDb), version, m_CacheEncrypt);
   Util::MkDir(GetCacheDbDir(ValidityDb));
@@ -879,7 +1017,7 @@ void ImapCache::InitValidityCache()
 
 void ImapCache::CleanupValidityCache()
 {
-  std::lock_guard<std::mutex> cacheLock(m_CacheMutex);
+  std::lock_guard<ProfMutex> cacheLock(m_CacheMutex);
   CloseDbs(ValidityDb);
 }
 
@@ -920,6 +1058,48 @@ std::string ImapCache::GetDbName(const std::string& p_Folder)
   return (m_CacheEncrypt ? Crypto::SHA256(p_Folder) : Util::ToHex(p_Folder)) + ".sqlite";
 }
 
+int64_t ImapCache::GetDbFileSize(ImapCache::DbType p_DbType, const std::string& p_Folder)
+{
+  const std::string& dbName = GetDbName(p_Folder);
+  const std::set<Fileinfo, FileinfoCompare> fileinfos = Util::ListPaths(GetCacheDbDir(p_DbType));
+  for (const auto& fileinfo : fileinfos)
+  {
+    if (fileinfo.m_Name == dbName) return fileinfo.m_Size;
+  }
+
+  return 0;
+}
+
+// must be called with cachelock
+std::set<uint32_t> ImapCache::GetDbUids(ImapCache::DbType p_DbType, const std::string& p_Folder)
+{
+  static const std::map<DbType, std::string> uidTableNames =
+  {
+    { HeadersDb, "headers" },
+    { BodysDb, "bodys" },
+    { UidFlagsDb, "flags" },
+  };
+
+  std::set<uint32_t> uids;
+  if (!DbExists(p_DbType, p_Folder)) return uids;
+
+  try
+  {
+    std::shared_ptr<DbConnection> dbCon = GetDb(p_DbType, p_Folder, false /* p_Writable */);
+    std::shared_ptr<sqlite::database> db = dbCon->m_Database;
+    *db << ("SELECT uid FROM " + uidTableNames.at(p_DbType) + ";") >> [&](const uint32_t& uid)
+    {
+      uids.insert(uid);
+    };
+  }
+  catch (const sqlite::sqlite_exception& ex)
+  {
+    HANDLE_SQLITE_EXCEPTION(ex);
+  }
+
+  return uids;
+}
+
 std::string ImapCache::GetDbPath(ImapCache::DbType p_DbType, const std::string& p_Folder)
 {
   LOG_DEBUG_FUNC(STR(GetDbTypeName(p_DbType), p_Folder));
@@ -949,6 +1129,15 @@ std::string ImapCache::GetDbPath(ImapCache::DbType p_DbType, const std::string&
   return dbPath;
 }
 
+// must be called with cachelock, used to not create empty dbs (as GetDb() does) when only reading
+bool ImapCache::DbExists(ImapCache::DbType p_DbType, const std::string& p_Folder)
+{
+  if (m_DbConnections[p_DbType].count(p_Folder) > 0) return true;
+
+  // @note: for encrypted cache this decrypts an existing db, as GetDb() would
+  return Util::Exists(GetDbPath(p_DbType, p_Folder));
+}
+
 void ImapCache::WriteDb(ImapCache::DbType p_DbType, const std::string& p_Folder)
 {
   LOG_DEBUG_FUNC(STR(GetDbTypeName(p_DbType), p_Folder));
@@ -1,6 +1,6 @@
 // imapcache.h
 //
-// Copyright (c) 2020-2022 Kristofer Berggren
+// Copyright (c) 2020-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -15,6 +15,8 @@
 
 #include <sqlite_modern_cpp.h>
 
+#include "profmutex.h"
+
 class Body;
 class Header;
 
@@ -36,6 +38,18 @@ private:
 
   struct DbConnection;
 
+public:
+  struct FolderStats
+  {
+    size_t m_Uids = 0;
+    size_t m_Flags = 0;
+    size_t m_Headers = 0;
+    size_t m_Bodys = 0;
+    int64_t m_HeadersSize = 0;
+    int64_t m_BodysSize = 0;
+    int64_t m_FileSize = 0;
+  };
+
 public:
   ImapCache(const bool p_CacheEncrypt, const std::string& p_Pass);
   virtual ~ImapCache();
@@ -69,6 +83,11 @@ public:
 
   bool Export(const std::string& p_Path);
 
+  std::map<std::string, FolderStats> GetStats();
+  std::map<std::string, std::set<uint32_t>> GetBodyUids();
+  std::vector<std::string> Verify();
+  void Vacuum();
+
 private:
   void InitHeadersCache();
   void CleanupHeadersCache();
@@ -89,7 +108,10 @@ private:
   static std::string GetHeadersFoldersPath();
 
   std::string GetDbName(const std::string& p_Folder);
+  int64_t GetDbFileSize(ImapCache::DbType p_DbType, const std::string& p_Folder);
+  std::set<uint32_t> GetDbUids(ImapCache::DbType p_DbType, const std::string& p_Folder);
   std::string GetDbPath(ImapCache::DbType p_DbType, const std::string& p_Folder);
+  bool DbExists(ImapCache::DbType p_DbType, const std::string& p_Folder);
   void WriteDb(ImapCache::DbType p_DbType, const std::string& p_Folder);
   void CreateDb(ImapCache::DbType p_DbType, const std::string& p_DbPath);
   std::shared_ptr<DbConnection> GetDb(DbType p_DbType, const std::string& p_Folder, bool p_Writable);
@@ -107,7 +129,7 @@ private:
   std::string m_Pass;
   std::set<std::string> m_Folders;
 
-  std::mutex m_CacheMutex;
+  ProfMutex m_CacheMutex{"cache"};
   std::map<DbType, std::map<std::string, std::shared_ptr<DbConnection>>> m_DbConnections;
   std::map<DbType, std::string> m_CurrentWriteDb;
 };
@@ -20,6 +20,7 @@
 #include "loghelp.h"
 #include "maphelp.h"
 #include "sethelp.h"
+#include "startupprofile.h"
 
 ImapIndex::ImapIndex(const bool p_CacheIndexEncrypt,
                      const std::string& p_Pass,
@@ -44,7 +45,7 @@ ImapIndex::~ImapIndex()
   LOG_DEBUG("stop thread");
   if (m_Running)
   {
-    std::unique_lock<std::mutex> lock(m_ProcessMutex);
+    std::unique_lock<ProfMutex> lock(m_ProcessMutex);
     m_Running = false;
     m_ProcessCondVar.notify_one();
   }
@@ -60,21 +61,98 @@ bool ImapIndex::ChangePass(const bool p_CacheEncrypt,
 {
   if (!p_CacheEncrypt) return true;
 
-  InitCacheTempDir();
-  if (!CacheUtil::DecryptCacheDir(p_OldPass, GetCacheIndexDbDir(), GetCacheIndexDbTempDir())) return false;
+  return CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, GetCacheIndexDbDir());
+}
 
-  Util::RmDir(GetCacheIndexDbDir());
+// get indexed uids per folder, for offline use when no ImapIndex instance is running
+std::map<std::string, std::set<uint32_t>> ImapIndex::GetFolderUids(const bool p_CacheIndexEncrypt,
+                                                                   const std::string& p_Pass)
+{
+  std::vector<std::string> docIds;
   Util::MkDir(GetCacheIndexDbDir());
-  if (!CacheUtil::EncryptCacheDir(p_NewPass, GetCacheIndexDbTempDir(), GetCacheIndexDbDir())) return false;
+  if (p_CacheIndexEncrypt)
+  {
+    InitCacheTempDir();
+    CacheUtil::DecryptCacheDir(p_Pass, GetCacheIndexDbDir(), GetCacheIndexDbTempDir());
+    docIds = SearchEngine(GetCacheIndexDbTempDir()).List();
+    CleanupCacheTempDir();
+  }
+  else
+  {
+    docIds = SearchEngine(GetCacheIndexDbDir()).List();
+  }
+
+  std::map<std::string, std::set<uint32_t>> folderUids;
+  for (const auto& docId : docIds)
+  {
+    folderUids[GetFolderFromDocId(docId)].insert(GetUidFromDocId(docId));
+  }
+
+  return folderUids;
+}
+
+// compact index db, for offline use when no ImapIndex instance is running
+bool ImapIndex::Compact(const bool p_CacheIndexEncrypt, const std::string& p_Pass)
+{
+  RestoreCacheIndexDbDir();
+  if (!Util::Exists(GetCacheIndexDbDir())) return true;
 
-  CleanupCacheTempDir();
+  // @note: compacted db is fully written to a new dir before replacing the current one
+  bool rv = false;
+  Util::RmDir(GetCacheIndexDbNewDir());
+  if (p_CacheIndexEncrypt)
+  {
+    InitCacheTempDir();
+    Util::RmDir(GetCacheIndexDbCompactDir());
+    if (CacheUtil::DecryptCacheDir(p_Pass, GetCacheIndexDbDir(), GetCacheIndexDbTempDir()) &&
+        SearchEngine::Compact(GetCacheIndexDbTempDir(), GetCacheIndexDbCompactDir()))
+    {
+      Util::MkDir(GetCacheIndexDbNewDir());
+      rv = CacheUtil::EncryptCacheDir(p_Pass, GetCacheIndexDbCompactDir(), GetCacheIndexDbNewDir());
+    }
 
-  return true;
+    Util::RmDir(GetCacheIndexDbCompactDir());
+    CleanupCacheTempDir();
+  }
+  else
+  {
+    rv = SearchEngine::Compact(GetCacheIndexDbDir(), GetCacheIndexDbNewDir());
+  }
+
+  if (rv)
+  {
+    // @note: current db is renamed aside, so that one complete db exists at any point in time
+    Util::RmDir(GetCacheIndexDbOldDir());
+    Util::Move(GetCacheIndexDbDir(), GetCacheIndexDbOldDir());
+    Util::Move(GetCacheIndexDbNewDir(), GetCacheIndexDbDir());
+    Util::RmDir(GetCacheIndexDbOldDir());
+  }
+  else
+  {
+    Util::RmDir(GetCacheIndexDbNewDir());
+  }
+
+  return rv;
+}
+
+int64_t ImapIndex::GetDbSize()
+{
+  int64_t size = 0;
+  const std::set<Fileinfo, FileinfoCompare> fileinfos = Util::ListPaths(GetCacheIndexDbDir());
+  for (const auto& fileinfo : fileinfos)
+  {
+    if (!fileinfo.IsDir())
+    {
+      size += fileinfo.m_Size;
+    }
+  }
+
+  return size;
 }
 
 void ImapIndex::NotifyIdle(bool p_IsIdle)
 {
-  std::unique_lock<std::mutex> lock(m_ProcessMutex);
+  std::unique_lock<ProfMutex> lock(m_ProcessMutex);
   m_IsIdle = p_IsIdle;
   if (m_IsIdle)
   {
@@ -88,7 +166,7 @@ void ImapIndex::SetFolders(const std::set<std::string>& p_Folders)
 
   Notify notify;
   notify.m_SetFolders = p_Folders;
-  std::unique_lock<std::mutex> lock(m_ProcessMutex);
+  std::unique_lock<ProfMutex> lock(m_ProcessMutex);
   m_Queue.push(notify);
   m_QueueSize = m_Queue.size();
   m_ProcessCondVar.notify_one();
@@ -98,7 +176,7 @@ void ImapIndex::SetUids(const std::string& p_Folder, const std::set<uint32_t>& p
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
 
-  std::unique_lock<std::mutex> lock(m_ProcessMutex);
+  std::unique_lock<ProfMutex> lock(m_ProcessMutex);
   if (!m_SyncDone) return; // to avoid double work at first idle (sync)
 
   Notify notify;
@@ -113,7 +191,7 @@ void ImapIndex::DeleteMessages(const std::string& p_Folder, const std::set<uint3
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
 
-  std::unique_lock<std::mutex> lock(m_ProcessMutex);
+  std::unique_lock<ProfMutex> lock(m_ProcessMutex);
   if (!m_SyncDone) return; // to avoid double work at first idle (sync)
 
   Notify notify;
@@ -128,7 +206,7 @@ void ImapIndex::SetBodys(const std::string& p_Folder, const std::set<uint32_t>&
 {
   LOG_DEBUG_FUNC(STR(p_Folder, p_Uids));
 
-  std::unique_lock<std::mutex> lock(m_ProcessMutex);
+  std::unique_lock<ProfMutex> lock(m_ProcessMutex);
   if (!m_SyncDone) return; // to avoid double work at first idle (sync)
 
   Notify notify;
@@ -167,24 +245,30 @@ void ImapIndex::Process()
 {
   LOG_DEBUG("start process");
 
-  AddressBook::Init(Util::GetAddressBookEncrypt(), m_Pass);
-
-  InitCacheIndexDir();
-  if (m_CacheIndexEncrypt)
   {
-    InitCacheTempDir();
-    CacheUtil::DecryptCacheDir(m_Pass, GetCacheIndexDbDir(), GetCacheIndexDbTempDir());
-    m_SearchEngine.reset(new SearchEngine(GetCacheIndexDbTempDir()));
+    STARTUP_PHASE("addressbook_init");
+    AddressBook::Init(Util::GetAddressBookEncrypt(), m_Pass);
   }
-  else
+
   {
-    m_SearchEngine.reset(new SearchEngine(GetCacheIndexDbDir()));
+    STARTUP_PHASE("search_index_init");
+    InitCacheIndexDir();
+    if (m_CacheIndexEncrypt)
+    {
+      InitCacheTempDir();
+      CacheUtil::DecryptCacheDir(m_Pass, GetCacheIndexDbDir(), GetCacheIndexDbTempDir());
+      m_SearchEngine.reset(new SearchEngine(GetCacheIndexDbTempDir()));
+    }
+    else
+    {
+      m_SearchEngine.reset(new SearchEngine(GetCacheIndexDbDir()));
+    }
   }
 
   LOG_DEBUG("entering loop");
   while (m_Running)
   {
-    std::unique_lock<std::mutex> lock(m_ProcessMutex);
+    std::unique_lock<ProfMutex> lock(m_ProcessMutex);
 
     while (m_Running && !(m_IsIdle && (!m_Queue.empty() || !m_SyncDone)))
     {
@@ -211,6 +295,7 @@ void ImapIndex::Process()
       Notify notify = m_Queue.front();
       m_Queue.pop();
       const bool isQueueEmpty = m_Queue.empty();
+      METRICS_GAUGE("index.queue_size", m_Queue.size());
       lock.unlock();
 
       float progress = 0;
@@ -237,8 +322,6 @@ void ImapIndex::Process()
   m_SearchEngine.reset();
   if (m_CacheIndexEncrypt && m_Dirty)
   {
-    Util::RmDir(GetCacheIndexDbDir());
-    Util::MkDir(GetCacheIndexDbDir());
     CacheUtil::EncryptCacheDir(m_Pass, GetCacheIndexDbTempDir(), GetCacheIndexDbDir());
     CleanupCacheTempDir();
     m_Dirty = false;
@@ -345,7 +428,7 @@ void ImapIndex::HandleSyncEnqueue()
     std::set<uint32_t> uidsToAdd = bodyUids - docUids; // present in cache, but not in index
     std::set<uint32_t> uidsToDel = docUids - bodyUids; // present in index, but not in cache
 
-    std::unique_lock<std::mutex> lock(m_ProcessMutex);
+    std::unique_lock<ProfMutex> lock(m_ProcessMutex);
     if (!uidsToAdd.empty())
     {
       const int maxAdd = 10;
@@ -382,6 +465,7 @@ void ImapIndex::HandleSyncEnqueue()
 void ImapIndex::AddMessage(const std::string& p_Folder, uint32_t p_Uid)
 {
   LOG_TRACE_FUNC(STR(p_Folder, p_Uid));
+  LOG_DURATION();
 
   const std::string& docId = GetDocId(p_Folder, p_Uid);
   if (!m_SearchEngine->Exists(docId))
@@ -403,6 +487,7 @@ void ImapIndex::AddMessage(const std::string& p_Folder, uint32_t p_Uid)
 
       LOG_DEBUG("add %s", docId.c_str());
       m_SearchEngine->Index(docId, timeStamp, bodyText, subject, from, to, p_Folder);
+      METRICS_COUNT("index.messages_added", 1);
       m_Dirty = true;
 
       // @todo: decouple addressbook population from cache index
@@ -458,11 +543,43 @@ std::string ImapIndex::GetCacheIndexDbTempDir()
   return Util::GetTempDir() + std::string("searchindexdb/");
 }
 
+std::string ImapIndex::GetCacheIndexDbNewDir()
+{
+  return CacheUtil::GetCacheDir() + std::string("searchindex/db.new/");
+}
+
+std::string ImapIndex::GetCacheIndexDbOldDir()
+{
+  return CacheUtil::GetCacheDir() + std::string("searchindex/db.old/");
+}
+
+std::string ImapIndex::GetCacheIndexDbCompactDir()
+{
+  return Util::GetTempDir() + std::string("searchindexcompact/");
+}
+
+// restore or remove db left renamed aside by an interrupted Compact()
+void ImapIndex::RestoreCacheIndexDbDir()
+{
+  if (!Util::Exists(GetCacheIndexDbOldDir())) return;
+
+  if (Util::Exists(GetCacheIndexDbDir()))
+  {
+    Util::RmDir(GetCacheIndexDbOldDir());
+  }
+  else
+  {
+    LOG_WARNING("restore search index db from interrupted compact");
+    Util::Move(GetCacheIndexDbOldDir(), GetCacheIndexDbDir());
+  }
+}
+
 void ImapIndex::InitCacheIndexDir()
 {
   static const int version = 8; // note: keep synchronized with AddressBook (for now)
   const std::string cacheDir = GetCacheIndexDir();
   CacheUtil::CommonInitCacheDir(cacheDir, version, m_CacheIndexEncrypt);
+  RestoreCacheIndexDbDir();
   Util::MkDir(GetCacheIndexDbDir());
 }
 
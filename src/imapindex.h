@@ -1,6 +1,6 @@
 // imapcacheindex.h
 //
-// Copyright (c) 2020-2021 Kristofer Berggren
+// Copyright (c) 2020-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -9,6 +9,7 @@
 
 #include <condition_variable>
 #include <functional>
+#include <map>
 #include <queue>
 #include <set>
 #include <string>
@@ -17,6 +18,7 @@
 #include "header.h"
 #include "imapcache.h"
 #include "log.h"
+#include "profmutex.h"
 #include "searchengine.h"
 #include "status.h"
 #include "util.h"
@@ -32,6 +34,10 @@ public:
 
   static bool ChangePass(const bool p_CacheEncrypt,
                          const std::string& p_OldPass, const std::string& p_NewPass);
+  static std::map<std::string, std::set<uint32_t>> GetFolderUids(const bool p_CacheIndexEncrypt,
+                                                                 const std::string& p_Pass);
+  static bool Compact(const bool p_CacheIndexEncrypt, const std::string& p_Pass);
+  static int64_t GetDbSize();
 
   void NotifyIdle(bool p_IsIdle);
 
@@ -61,13 +67,17 @@ private:
   void HandleSyncEnqueue();
   void AddMessage(const std::string& p_Folder, uint32_t p_Uid);
 
-  std::string GetDocId(const std::string& p_Folder, const uint32_t p_Uid);
-  std::string GetFolderFromDocId(const std::string& p_DocId);
-  uint32_t GetUidFromDocId(const std::string& p_DocId);
+  static std::string GetDocId(const std::string& p_Folder, const uint32_t p_Uid);
+  static std::string GetFolderFromDocId(const std::string& p_DocId);
+  static uint32_t GetUidFromDocId(const std::string& p_DocId);
 
   static std::string GetCacheIndexDir();
   static std::string GetCacheIndexDbDir();
   static std::string GetCacheIndexDbTempDir();
+  static std::string GetCacheIndexDbNewDir();
+  static std::string GetCacheIndexDbOldDir();
+  static std::string GetCacheIndexDbCompactDir();
+  static void RestoreCacheIndexDbDir();
   void InitCacheIndexDir();
   static void InitCacheTempDir();
   static void CleanupCacheTempDir();
@@ -84,8 +94,8 @@ private:
   bool m_Running = false;
   bool m_IsIdle = false;
   std::thread m_Thread;
-  std::mutex m_ProcessMutex;
-  std::condition_variable m_ProcessCondVar;
+  ProfMutex m_ProcessMutex{"index"};
+  std::condition_variable_any m_ProcessCondVar;
   std::queue<Notify> m_Queue;
   size_t m_QueueSize = 0;
   bool m_Dirty = false;
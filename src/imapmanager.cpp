@@ -10,7 +10,10 @@
 #include <vector>
 
 #include "auth.h"
+#include "imaptrace.h"
+#include "memorybudget.h"
 #include "loghelp.h"
+#include "startupprofile.h"
 #include "util.h"
 
 ImapManager::ImapManager(const std::string& p_User, const std::string& p_Pass,
@@ -148,14 +151,14 @@ void ImapManager::Start()
 void ImapManager::AsyncRequest(const ImapManager::Request& p_Request)
 {
   {
-    std::lock_guard<std::mutex> lock(m_CacheQueueMutex);
+    std::lock_guard<ProfMutex> lock(m_CacheQueueMutex);
     m_CacheRequests.push_front(p_Request);
     LOG_IF_NOT_EQUAL(write(m_CachePipe[1], "1", 1), 1);
   }
 
   if (m_Connecting || m_OnceConnected)
   {
-    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    std::lock_guard<ProfMutex> lock(m_QueueMutex);
     m_Requests.push_front(p_Request);
     LOG_IF_NOT_EQUAL(write(m_Pipe[1], "1", 1), 1);
     ProgressCountRequestAdd(p_Request, false /* p_IsPrefetch */);
@@ -170,7 +173,7 @@ void ImapManager::PrefetchRequest(const ImapManager::Request& p_Request)
 {
   if (m_Connecting || m_OnceConnected)
   {
-    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    std::lock_guard<ProfMutex> lock(m_QueueMutex);
     m_PrefetchRequests[p_Request.m_PrefetchLevel].push_front(p_Request);
     LOG_IF_NOT_EQUAL(write(m_Pipe[1], "1", 1), 1);
     ProgressCountRequestAdd(p_Request, true /* p_IsPrefetch */);
@@ -185,7 +188,7 @@ void ImapManager::AsyncAction(const ImapManager::Action& p_Action)
 {
   if (m_Connecting || m_OnceConnected)
   {
-    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    std::lock_guard<ProfMutex> lock(m_QueueMutex);
     m_Actions.push_front(p_Action);
     LOG_IF_NOT_EQUAL(write(m_Pipe[1], "1", 1), 1);
   }
@@ -218,6 +221,7 @@ void ImapManager::SetCurrentFolder(const std::string& p_Folder)
 bool ImapManager::ProcessIdle()
 {
   LOG_TRACE_FUNC("");
+  ImapTrace::CallerScope traceCaller("idle");
   m_Mutex.lock();
   const std::string idleFolder = (m_IdleInbox && !m_Inbox.empty()) ? m_Inbox : m_CurrentFolder;
   m_Mutex.unlock();
@@ -297,19 +301,25 @@ bool ImapManager::ProcessIdle()
   SetStatus(Status::FlagIdle);
   while (m_Running)
   {
-    int idlefd = m_Imap.IdleStart(idleFolder);
+    bool hasPending = false;
+    int idlefd = m_Imap.IdleStart(idleFolder, hasPending);
     if ((idlefd == -1) || !m_Running)
     {
       rv = false;
       break;
     }
 
+    if (hasPending)
+    {
+      LOG_DEBUG("idle notification pending");
+    }
+
     fd_set fds;
     FD_ZERO(&fds);
     FD_SET(m_Pipe[0], &fds);
     FD_SET(idlefd, &fds);
     int maxfd = std::max(m_Pipe[0], idlefd);
-    struct timeval idletv = {GetIdleDurationSec(), 0};
+    struct timeval idletv = {hasPending ? 0 : GetIdleDurationSec(), 0};
     int selrv = select(maxfd + 1, &fds, NULL, NULL, &idletv);
 
     bool idleRv = m_Imap.IdleDone();
@@ -458,8 +468,11 @@ void ImapManager::Process()
 
   if (m_Connect)
   {
+    ImapTrace::CallerScope traceCaller("connect");
+    StartupPhase loginPhase("imap_login");
     if (m_Imap.Login())
     {
+      loginPhase.End();
       SetStatus(Status::FlagConnected);
       m_OnceConnected = true;
     }
@@ -491,6 +504,7 @@ void ImapManager::Process()
     int selrv = 1;
     m_QueueMutex.lock();
     bool isQueueEmpty = m_Requests.empty() && m_PrefetchRequests.empty() && m_Actions.empty();
+    UpdateQueueMemoryUsage();
     m_QueueMutex.unlock();
 
     if (isQueueEmpty || !m_OnceConnected)
@@ -532,6 +546,7 @@ void ImapManager::Process()
              m_OnceConnected &&
              (!m_Requests.empty() || !m_PrefetchRequests.empty() || !m_Actions.empty()))
       {
+        UpdateQueueMemoryUsage();
         bool isConnected = true;
         float progress = 0;
 
@@ -754,6 +769,7 @@ bool ImapManager::AuthRefreshNeeded()
 
 bool ImapManager::PerformAuthRefresh()
 {
+  ImapTrace::CallerScope traceCaller("auth");
   return m_Imap.AuthRefresh();
 }
 
@@ -767,6 +783,7 @@ bool ImapManager::CheckConnectivity()
 
 void ImapManager::CheckConnectivityAndReconnect(bool p_SkipCheck)
 {
+  ImapTrace::CallerScope traceCaller("reconnect");
   if (p_SkipCheck || !CheckConnectivity())
   {
     LOG_WARNING("connection lost");
@@ -888,6 +905,9 @@ void ImapManager::SearchProcess()
 bool ImapManager::PerformRequest(const Request& p_Request, bool p_Cached, bool p_Prefetch,
                                  Response& p_Response)
 {
+  // @note: prefetch level 3 and above is full sync, see Ui::PrefetchLevelFullSync
+  ImapTrace::CallerScope traceCaller(!p_Prefetch ? "request" :
+                                     ((p_Request.m_PrefetchLevel >= 3) ? "sync" : "prefetch"));
   p_Response.m_ResponseStatus = ResponseStatusOk;
   p_Response.m_Folder = p_Request.m_Folder;
   p_Response.m_Cached = p_Cached;
@@ -939,6 +959,7 @@ bool ImapManager::PerformRequest(const Request& p_Request, bool p_Cached, bool p
 
 bool ImapManager::PerformAction(const ImapManager::Action& p_Action)
 {
+  ImapTrace::CallerScope traceCaller("action");
   bool rv = true;
 
   if (!p_Action.m_MoveDestination.empty())
@@ -1036,6 +1057,46 @@ void ImapManager::ClearStatus(uint32_t p_Flags)
   }
 }
 
+// must be called with m_QueueMutex held
+void ImapManager::UpdateQueueMemoryUsage()
+{
+  static std::chrono::steady_clock::time_point lastUpdate;
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if ((now - lastUpdate) < std::chrono::seconds(1)) return;
+
+  lastUpdate = now;
+
+  // @note: estimate
+  const int64_t uidSize = MemoryBudget::GetNodeOverhead() + sizeof(uint32_t);
+  auto requestSize = [&](const Request& p_Request)
+  {
+    return sizeof(Request) + p_Request.m_Folder.capacity() +
+      ((p_Request.m_GetHeaders.size() + p_Request.m_GetFlags.size() + p_Request.m_GetBodys.size()) * uidSize);
+  };
+
+  int64_t size = 0;
+  for (const auto& request : m_Requests)
+  {
+    size += requestSize(request);
+  }
+
+  for (const auto& prefetchRequests : m_PrefetchRequests)
+  {
+    for (const auto& request : prefetchRequests.second)
+    {
+      size += requestSize(request);
+    }
+  }
+
+  for (const auto& action : m_Actions)
+  {
+    size += sizeof(Action) + action.m_Folder.capacity() + action.m_MoveDestination.capacity() +
+      (action.m_Uids.size() * uidSize) + action.m_Msg.capacity();
+  }
+
+  MemoryBudget::SetUsage("imap_queue", size);
+}
+
 void ImapManager::ProgressCountRequestAdd(const Request& p_Request, bool p_IsPrefetch)
 {
   ProgressCount& progressCount = p_IsPrefetch ? m_PrefetchProgressCount : m_FetchProgressCount;
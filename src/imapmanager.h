@@ -23,6 +23,7 @@
 #include "header.h"
 #include "imap.h"
 #include "log.h"
+#include "profmutex.h"
 #include "status.h"
 
 class ImapManager
@@ -163,6 +164,7 @@ private:
   void SendActionResult(const Action& p_Action, bool p_Result);
   void SetStatus(uint32_t p_Flags, float p_Progress = -1);
   void ClearStatus(uint32_t p_Flags);
+  void UpdateQueueMemoryUsage();
   void ProgressCountRequestAdd(const Request& p_Request, bool p_IsPrefetch);
   void ProgressCountRequestDone(const Request& p_Request, bool p_IsPrefetch);
   void ProgressCountReset(bool p_IsPrefetch);
@@ -192,8 +194,8 @@ private:
   std::deque<Action> m_Actions;
   ProgressCount m_FetchProgressCount;
   ProgressCount m_PrefetchProgressCount;
-  std::mutex m_QueueMutex;
-  std::mutex m_CacheQueueMutex;
+  ProfMutex m_QueueMutex{"imap_queue"};
+  ProfMutex m_CacheQueueMutex{"cache_queue"};
 
   std::condition_variable m_ExitedCond;
   std::mutex m_ExitedCondMutex;
@@ -202,7 +204,7 @@ private:
   std::mutex m_ExitedCacheCondMutex;
 
   std::string m_CurrentFolder = "INBOX";
-  std::mutex m_Mutex;
+  ProfMutex m_Mutex{"imapmanager"};
 
   int m_Pipe[2] = { -1, -1 };
   int m_CachePipe[2] = { -1, -1 };
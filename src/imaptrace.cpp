@@ -0,0 +1,139 @@
+// imaptrace.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "imaptrace.h"
+
+#include "loghelp.h"
+
+std::mutex ImapTrace::m_Mutex;
+FILE* ImapTrace::m_File = NULL;
+std::atomic<bool> ImapTrace::m_Enabled(false);
+
+namespace
+{
+  thread_local const char* s_Caller = nullptr;
+
+  int64_t ToUs(const std::chrono::steady_clock::duration& p_Duration)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(p_Duration).count();
+  }
+}
+
+ImapTrace::Command::Command(Command*& p_Active, const char* p_Name, size_t p_UidCount /*= 0*/)
+  : m_Active(p_Active)
+  , m_Enabled(ImapTrace::IsEnabled())
+{
+  if (!m_Enabled) return;
+
+  m_Name = p_Name;
+  m_Caller = (s_Caller != nullptr) ? s_Caller : "other";
+  m_UidCount = p_UidCount;
+  m_StartTime = std::chrono::system_clock::now();
+  m_Start = std::chrono::steady_clock::now();
+  m_LastSent = m_Start;
+  m_Active = this;
+}
+
+ImapTrace::Command::~Command()
+{
+  if (!m_Enabled) return;
+
+  // command not ended explicitly, i.e. aborted
+  End(-1, 0);
+}
+
+void ImapTrace::Command::OnSent(size_t p_Size)
+{
+  m_Sent += p_Size;
+  m_LastSent = std::chrono::steady_clock::now();
+}
+
+void ImapTrace::Command::OnReceived(size_t p_Size)
+{
+  if (m_TtfbUs == -1)
+  {
+    // server latency, from end of request to first byte of response
+    m_TtfbUs = ToUs(std::chrono::steady_clock::now() - m_LastSent);
+  }
+
+  m_Received += p_Size;
+}
+
+void ImapTrace::Command::End(int p_Rv, int p_Tag)
+{
+  if (!m_Enabled) return;
+
+  m_Enabled = false;
+  if (m_Active == this)
+  {
+    m_Active = nullptr;
+  }
+
+  const int64_t durationUs = ToUs(std::chrono::steady_clock::now() - m_Start);
+  const int64_t startMs =
+    std::chrono::duration_cast<std::chrono::milliseconds>(m_StartTime.time_since_epoch()).count();
+
+  char line[512];
+  snprintf(line, sizeof(line),
+           "{\"ts\":%lld.%03lld,\"tag\":%d,\"cmd\":\"%s\",\"caller\":\"%s\",\"uids\":%zu,"
+           "\"sent\":%llu,\"recv\":%llu,\"ttfb_us\":%lld,\"dur_us\":%lld,\"rv\":%d}\n",
+           (long long)(startMs / 1000), (long long)(startMs % 1000), p_Tag, m_Name, m_Caller, m_UidCount,
+           (unsigned long long)m_Sent, (unsigned long long)m_Received, (long long)m_TtfbUs,
+           (long long)durationUs, p_Rv);
+  ImapTrace::Write(line);
+}
+
+ImapTrace::CallerScope::CallerScope(const char* p_Caller)
+  : m_PrevCaller(s_Caller)
+{
+  s_Caller = p_Caller;
+}
+
+ImapTrace::CallerScope::~CallerScope()
+{
+  s_Caller = m_PrevCaller;
+}
+
+void ImapTrace::Init(const std::string& p_Path)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_File = fopen(p_Path.c_str(), "w");
+  if (m_File == NULL)
+  {
+    LOG_WARNING("failed to open imap trace %s", p_Path.c_str());
+    return;
+  }
+
+  LOG_DEBUG("imap trace %s", p_Path.c_str());
+  m_Enabled = true;
+}
+
+void ImapTrace::Cleanup()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Enabled = false;
+  if (m_File != NULL)
+  {
+    fclose(m_File);
+    m_File = NULL;
+  }
+}
+
+bool ImapTrace::IsEnabled()
+{
+  return m_Enabled;
+}
+
+void ImapTrace::Write(const std::string& p_Line)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_File == NULL) return;
+
+  // @note: one line per imap command round-trip, flush to keep the trace useful after a crash
+  fputs(p_Line.c_str(), m_File);
+  fflush(m_File);
+}
@@ -0,0 +1,68 @@
+// imaptrace.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// Structured per-command IMAP wire trace. When enabled, one JSON line is written to the
+// trace file per IMAP command, with command, caller, uid count, bytes sent / received,
+// time to first response byte and total duration. Summarize with util/imaptrace-summary.
+class ImapTrace
+{
+public:
+  class Command
+  {
+  public:
+    Command(Command*& p_Active, const char* p_Name, size_t p_UidCount = 0);
+    ~Command();
+
+    void OnSent(size_t p_Size);
+    void OnReceived(size_t p_Size);
+    void End(int p_Rv, int p_Tag);
+
+  private:
+    Command*& m_Active;
+    bool m_Enabled = false;
+    const char* m_Name = nullptr;
+    const char* m_Caller = nullptr;
+    size_t m_UidCount = 0;
+    uint64_t m_Sent = 0;
+    uint64_t m_Received = 0;
+    std::chrono::system_clock::time_point m_StartTime;
+    std::chrono::steady_clock::time_point m_Start;
+    std::chrono::steady_clock::time_point m_LastSent;
+    int64_t m_TtfbUs = -1;
+  };
+
+  class CallerScope
+  {
+  public:
+    explicit CallerScope(const char* p_Caller);
+    ~CallerScope();
+
+  private:
+    const char* m_PrevCaller = nullptr;
+  };
+
+  static void Init(const std::string& p_Path);
+  static void Cleanup();
+  static bool IsEnabled();
+
+private:
+  static void Write(const std::string& p_Line);
+
+private:
+  static std::mutex m_Mutex;
+  static FILE* m_File;
+  static std::atomic<bool> m_Enabled;
+};
@@ -1,23 +1,422 @@
 // log.cpp
 //
-// Copyright (c) 2019-2021 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #include "log.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include <stdarg.h>
 #include <sys/time.h>
 
-std::string Log::m_Path;
 int Log::m_VerboseLevel = 0;
-std::mutex Log::m_Mutex;
+
+namespace
+{
+  // Each logging thread writes records to its own single-producer single-consumer ring
+  // buffer, without locking or system calls. A background writer thread drains all ring
+  // buffers into the log file, which is kept open and rotated when reaching max size.
+  // The message is formatted by the logging thread, as printf arguments do not outlive
+  // the log call, while timestamp formatting and file io are deferred to the writer.
+  const size_t s_RingSize = 256 * 1024;
+  const size_t s_NotifyLevel = s_RingSize / 2;
+  const size_t s_MaxRecordLen = s_RingSize / 4;
+  const long s_MaxFileSize = 64 * 1024 * 1024;
+  const int s_DrainIntervalMs = 100;
+  const int s_FlushTimeoutMs = 1000;
+
+  struct RecordHeader
+  {
+    uint64_t m_Seq;
+    struct timeval m_Time;
+    const char* m_Level; // NULL for raw dump
+    const char* m_Filename;
+    int m_LineNo;
+    uint32_t m_Len;
+  };
+
+  struct Record
+  {
+    RecordHeader m_Header;
+    std::string m_Msg;
+  };
+
+  class Ring
+  {
+  public:
+    Ring()
+      : m_Buf(s_RingSize)
+    {
+    }
+
+    bool Push(const RecordHeader& p_Header, const char* p_Msg)
+    {
+      const uint64_t size = sizeof(RecordHeader) + p_Header.m_Len;
+      const uint64_t head = m_Head.load(std::memory_order_relaxed);
+      const uint64_t tail = m_Tail.load(std::memory_order_acquire);
+      if ((s_RingSize - (head - tail)) < size) return false;
+
+      CopyIn(head, &p_Header, sizeof(RecordHeader));
+      CopyIn(head + sizeof(RecordHeader), p_Msg, p_Header.m_Len);
+      m_Head.store(head + size, std::memory_order_release);
+      return true;
+    }
+
+    void Pop(std::vector<Record>& p_Records)
+    {
+      uint64_t tail = m_Tail.load(std::memory_order_relaxed);
+      const uint64_t head = m_Head.load(std::memory_order_acquire);
+      while (tail < head)
+      {
+        Record record;
+        CopyOut(tail, &record.m_Header, sizeof(RecordHeader));
+        record.m_Msg.resize(record.m_Header.m_Len);
+        CopyOut(tail + sizeof(RecordHeader), &record.m_Msg[0], record.m_Header.m_Len);
+        tail += sizeof(RecordHeader) + record.m_Header.m_Len;
+        p_Records.push_back(std::move(record));
+      }
+
+      m_Tail.store(tail, std::memory_order_release);
+    }
+
+    size_t GetUsed() const
+    {
+      return m_Head.load(std::memory_order_relaxed) - m_Tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    void CopyIn(uint64_t p_Pos, const void* p_Data, size_t p_Len)
+    {
+      const size_t offset = p_Pos % s_RingSize;
+      const size_t first = std::min(p_Len, s_RingSize - offset);
+      memcpy(&m_Buf[offset], p_Data, first);
+      memcpy(&m_Buf[0], (const char*)p_Data + first, p_Len - first);
+    }
+
+    void CopyOut(uint64_t p_Pos, void* p_Data, size_t p_Len) const
+    {
+      const size_t offset = p_Pos % s_RingSize;
+      const size_t first = std::min(p_Len, s_RingSize - offset);
+      memcpy(p_Data, &m_Buf[offset], first);
+      memcpy((char*)p_Data + first, &m_Buf[0], p_Len - first);
+    }
+
+  public:
+    std::atomic<bool> m_Exited{false};
+
+  private:
+    std::vector<char> m_Buf;
+    std::atomic<uint64_t> m_Head{0};
+    std::atomic<uint64_t> m_Tail{0};
+  };
+
+  class Writer
+  {
+  public:
+    static Writer& Get()
+    {
+      // intentionally never destroyed, threads may log during static destruction
+      static Writer* writer = new Writer();
+      return *writer;
+    }
+
+    void SetPath(const std::string& p_Path)
+    {
+      std::lock_guard<std::mutex> lock(m_FileMutex);
+      CloseFile();
+      m_Path = p_Path;
+      remove(m_Path.c_str());
+    }
+
+    void Write(const char* p_Filename, int p_LineNo, const char* p_Level, const char* p_Msg, size_t p_Len)
+    {
+      RecordHeader header;
+      gettimeofday(&header.m_Time, NULL);
+      header.m_Seq = m_Seq++;
+      header.m_Level = p_Level;
+      header.m_Filename = p_Filename;
+      header.m_LineNo = p_LineNo;
+      header.m_Len = (uint32_t)p_Len;
+
+      Ring* ring = GetRing();
+      if (p_Len <= s_MaxRecordLen)
+      {
+        while (m_Running)
+        {
+          if (ring->Push(header, p_Msg))
+          {
+            if (ring->GetUsed() >= s_NotifyLevel)
+            {
+              Notify();
+            }
+
+            return;
+          }
+
+          // ring full, wait for writer to catch up
+          Notify();
+          std::this_thread::yield();
+        }
+      }
+
+      // oversized record, or writer stopped, write directly after queued records
+      while (m_Running && (ring->GetUsed() > 0))
+      {
+        Notify();
+        std::this_thread::yield();
+      }
+
+      std::vector<Record> records;
+      {
+        std::lock_guard<std::mutex> lock(m_RingsMutex);
+        ring->Pop(records);
+      }
+
+      Record record;
+      record.m_Header = header;
+      record.m_Msg.assign(p_Msg, p_Len);
+      records.push_back(std::move(record));
+
+      std::lock_guard<std::mutex> lock(m_FileMutex);
+      WriteRecords(records);
+      FlushFile();
+      m_WrittenCount += records.size();
+    }
+
+    void Flush()
+    {
+      if (!m_Running) return;
+
+      const uint64_t target = m_Seq;
+      Notify();
+      std::unique_lock<std::mutex> lock(m_CondMutex);
+      m_FlushCondVar.wait_for(lock, std::chrono::milliseconds(s_FlushTimeoutMs),
+                              [&]() { return !m_Running || (m_WrittenCount >= target); });
+    }
+
+    void Stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_CondMutex);
+        if (!m_Running) return;
+
+        m_Running = false;
+        m_CondVar.notify_one();
+      }
+
+      m_Thread.join();
+
+      // drain records queued before writer stopped
+      Drain();
+    }
+
+  private:
+    Writer()
+    {
+      m_Running = true;
+      m_Thread = std::thread(&Writer::Process, this);
+      atexit([]() { Writer::Get().Stop(); });
+    }
+
+    Ring* GetRing()
+    {
+      struct ThreadRing
+      {
+        ThreadRing()
+        {
+          m_Ring = std::make_shared<Ring>();
+          Writer::Get().AddRing(m_Ring);
+        }
+
+        ~ThreadRing()
+        {
+          m_Ring->m_Exited = true;
+        }
+
+        std::shared_ptr<Ring> m_Ring;
+      };
+
+      static thread_local ThreadRing threadRing;
+      return threadRing.m_Ring.get();
+    }
+
+    void AddRing(const std::shared_ptr<Ring>& p_Ring)
+    {
+      std::lock_guard<std::mutex> lock(m_RingsMutex);
+      m_Rings.push_back(p_Ring);
+    }
+
+    void Notify()
+    {
+      std::lock_guard<std::mutex> lock(m_CondMutex);
+      m_Notified = true;
+      m_CondVar.notify_one();
+    }
+
+    void Process()
+    {
+      std::unique_lock<std::mutex> lock(m_CondMutex);
+      while (m_Running)
+      {
+        m_CondVar.wait_for(lock, std::chrono::milliseconds(s_DrainIntervalMs),
+                           [&]() { return !m_Running || m_Notified; });
+        m_Notified = false;
+        lock.unlock();
+        Drain();
+        lock.lock();
+        m_FlushCondVar.notify_all();
+      }
+    }
+
+    void Drain()
+    {
+      std::vector<Record> records;
+      {
+        std::lock_guard<std::mutex> lock(m_RingsMutex);
+        for (auto it = m_Rings.begin(); it != m_Rings.end(); /* incremented in loop */)
+        {
+          const bool exited = (*it)->m_Exited;
+          (*it)->Pop(records);
+          if (exited)
+          {
+            it = m_Rings.erase(it);
+          }
+          else
+          {
+            ++it;
+          }
+        }
+      }
+
+      if (records.empty()) return;
+
+      // merge records from all threads in logging order
+      std::sort(records.begin(), records.end(), [](const Record& p_Lhs, const Record& p_Rhs)
+      {
+        return p_Lhs.m_Header.m_Seq < p_Rhs.m_Header.m_Seq;
+      });
+
+      std::lock_guard<std::mutex> lock(m_FileMutex);
+      WriteRecords(records);
+      FlushFile();
+      m_WrittenCount += records.size();
+    }
+
+    void WriteRecords(const std::vector<Record>& p_Records)
+    {
+      // @note: caller must hold m_FileMutex
+      if (!OpenFile()) return;
+
+      for (const auto& record : p_Records)
+      {
+        const RecordHeader& header = record.m_Header;
+        int len = 0;
+        if (header.m_Level == NULL)
+        {
+          len = fprintf(m_File, "%s", record.m_Msg.c_str());
+        }
+        else
+        {
+          // timestamp formatting is costly, reuse for records within the same second
+          if (header.m_Time.tv_sec != m_TimestampSec)
+          {
+            struct tm tminfo;
+            localtime_r(&header.m_Time.tv_sec, &tminfo);
+            strftime(m_Timestamp, sizeof(m_Timestamp), "%Y-%m-%d %H:%M:%S", &tminfo);
+            m_TimestampSec = header.m_Time.tv_sec;
+          }
+
+          long msec = header.m_Time.tv_usec / 1000;
+          len = fprintf(m_File, "%s.%03ld | %s | %s  (%s:%d)\n", m_Timestamp, msec, header.m_Level,
+                        record.m_Msg.c_str(), header.m_Filename, header.m_LineNo);
+        }
+
+        m_FileSize += std::max(len, 0);
+        if (m_FileSize >= s_MaxFileSize)
+        {
+          RotateFile();
+          if (!OpenFile()) return;
+        }
+      }
+    }
+
+    bool OpenFile()
+    {
+      if (m_File != NULL) return true;
+
+      if (m_Path.empty())
+      {
+        m_Path = "log.txt";
+        remove(m_Path.c_str());
+      }
+
+      m_File = fopen(m_Path.c_str(), "a");
+      if (m_File == NULL) return false;
+
+      fseek(m_File, 0, SEEK_END);
+      m_FileSize = std::max(ftell(m_File), 0L);
+      return true;
+    }
+
+    void CloseFile()
+    {
+      if (m_File == NULL) return;
+
+      fclose(m_File);
+      m_File = NULL;
+    }
+
+    void FlushFile()
+    {
+      if (m_File == NULL) return;
+
+      fflush(m_File);
+    }
+
+    void RotateFile()
+    {
+      CloseFile();
+      const std::string& oldPath = m_Path + ".1";
+      remove(oldPath.c_str());
+      rename(m_Path.c_str(), oldPath.c_str());
+    }
+
+  private:
+    std::atomic<bool> m_Running{false};
+    std::atomic<uint64_t> m_Seq{0};
+    std::thread m_Thread;
+
+    std::mutex m_RingsMutex;
+    std::vector<std::shared_ptr<Ring>> m_Rings;
+
+    std::mutex m_CondMutex;
+    std::condition_variable m_CondVar;
+    std::condition_variable m_FlushCondVar;
+    bool m_Notified = false;
+    std::atomic<uint64_t> m_WrittenCount{0};
+
+    std::mutex m_FileMutex;
+    std::string m_Path;
+    FILE* m_File = NULL;
+    long m_FileSize = 0;
+    time_t m_TimestampSec = -1;
+    char m_Timestamp[26] = { 0 };
+  };
+}
 
 void Log::SetPath(const std::string& p_Path)
 {
-  m_Path = p_Path;
-  remove(m_Path.c_str());
+  Writer::Get().SetPath(p_Path);
 }
 
 void Log::SetVerboseLevel(int p_Level)
@@ -73,41 +472,31 @@ void Log::Error(const char* p_Filename, int p_LineNo, const char* p_Format, ...)
 
 void Log::Dump(const char* p_Str)
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
-  if (m_Path.empty())
-  {
-    SetPath("log.txt");
-  }
+  Writer::Get().Write(NULL, 0, NULL, p_Str, strlen(p_Str));
+}
 
-  FILE* file = fopen(m_Path.c_str(), "a");
-  if (file != NULL)
-  {
-    fprintf(file, "%s", p_Str);
-    fclose(file);
-  }
+void Log::Flush()
+{
+  Writer::Get().Flush();
 }
 
 void Log::Write(const char* p_Filename, int p_LineNo, const char* p_Level, const char* p_Format, va_list p_VaList)
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
-  if (m_Path.empty())
+  char buf[1024];
+  va_list vaList;
+  va_copy(vaList, p_VaList);
+  int len = vsnprintf(buf, sizeof(buf), p_Format, vaList);
+  va_end(vaList);
+  if (len < 0) return;
+
+  if ((size_t)len < sizeof(buf))
   {
-    SetPath("log.txt");
+    Writer::Get().Write(p_Filename, p_LineNo, p_Level, buf, len);
   }
-
-  FILE* file = fopen(m_Path.c_str(), "a");
-  if (file != NULL)
+  else
   {
-    char timestamp[26];
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    struct tm* tminfo = localtime(&tv.tv_sec);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tminfo);
-    long msec = tv.tv_usec / 1000;
-    fprintf(file, "%s.%03ld | %s | ", timestamp, msec, p_Level);
-    vfprintf(file, p_Format, p_VaList);
-    fprintf(file, "  (%s:%d)", p_Filename, p_LineNo);
-    fprintf(file, "\n");
-    fclose(file);
+    std::vector<char> largeBuf(len + 1);
+    vsnprintf(largeBuf.data(), largeBuf.size(), p_Format, p_VaList);
+    Writer::Get().Write(p_Filename, p_LineNo, p_Level, largeBuf.data(), len);
   }
 }
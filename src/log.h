@@ -1,6 +1,6 @@
 // log.h
 //
-// Copyright (c) 2019-2021 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -10,6 +10,8 @@
 #include <mutex>
 #include <string>
 
+#include <stdarg.h>
+
 class Log
 {
 public:
@@ -30,12 +32,11 @@ public:
   static void Error(const char* p_Filename, int p_LineNo, const char* p_Format, ...);
 
   static void Dump(const char* p_Str);
+  static void Flush();
 
 private:
   static void Write(const char* p_Filename, int p_LineNo, const char* p_Level, const char* p_Format, va_list p_VaList);
 
 private:
-  static std::string m_Path;
   static int m_VerboseLevel;
-  static std::mutex m_Mutex;
 };
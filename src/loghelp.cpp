@@ -1,6 +1,6 @@
 // loghelp.cpp
 //
-// Copyright (c) 2019-2023 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -123,6 +123,7 @@ int LogHelp::LogImap(int p_Rv, const char* p_Expr, const char* p_File, int p_Lin
 {
   if (p_Rv > MAILIMAP_NO_ERROR_NON_AUTHENTICATED)
   {
+    METRICS_COUNT("imap.errors", 1);
     Log::Error(p_File, p_Line, "%s = %s", p_Expr, ImapErrToStr(p_Rv).c_str());
   }
   else if (Log::GetDebugEnabled())
@@ -160,3 +161,25 @@ int LogHelp::LogSmtp(int p_Rv, const char* p_Expr, const char* p_File, int p_Lin
 
   return p_Rv;
 }
+
+std::string LogHelp::GetImapMetricName(const char* p_Expr)
+{
+  // mailimap_uid_fetch(m_Imap, ...) -> imap.uid_fetch
+  std::string name(p_Expr);
+  name = name.substr(0, name.find('('));
+  const std::string prefix = "mailimap_";
+  if (name.compare(0, prefix.size(), prefix) == 0)
+  {
+    name = name.substr(prefix.size());
+  }
+
+  return "imap." + name;
+}
+
+std::string LogHelp::GetDurationMetricName(const char* p_File, const char* p_Func)
+{
+  // imapcache.cpp, GetBodys -> imapcache.GetBodys
+  std::string name(p_File);
+  name = name.substr(0, name.rfind('.'));
+  return name + "." + p_Func;
+}
@@ -1,18 +1,21 @@
 // loghelp.h
 //
-// Copyright (c) 2019-2023 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
 #pragma once
 
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <sstream>
 
 #include "cxx-prettyprint/prettyprint.hpp"
 
 #include "log.h"
+#include "metrics.h"
 
 #define __FILENAME__ (strrchr("/" __FILE__, '/') + 1)
 
@@ -45,11 +48,28 @@
 #define LOG_IF_NOT_EQUAL(EXPR, EXPECT) LogHelp::LogIfNotEqual(EXPR, EXPECT, #EXPR, __FILENAME__, __LINE__)
 
 // logs error on failure, logs debug on success
-#define LOG_IF_IMAP_ERR(EXPR) LogHelp::LogImap(EXPR, #EXPR, __FILENAME__, __LINE__)
+#define LOG_IF_IMAP_ERR(EXPR) LogHelp::LogImap([&]() { \
+                                 METRICS_DURATION(LogHelp::GetImapMetricName(#EXPR)); \
+                                 return (EXPR); }(), #EXPR, __FILENAME__, __LINE__)
 #define LOG_IF_IMAP_LOGOUT_ERR(EXPR) LogHelp::LogImapLogout(EXPR, #EXPR, __FILENAME__, __LINE__)
+
+// as above, and records the command in the imap trace (see ImapTrace), for use in Imap members
+#define LOG_IF_IMAP_ERR_TRACE(NAME, UIDS, EXPR) IMAP_TRACE(NAME, UIDS, LOG_IF_IMAP_ERR(EXPR))
+#define LOG_IF_IMAP_LOGOUT_ERR_TRACE(NAME, UIDS, EXPR) IMAP_TRACE(NAME, UIDS, LOG_IF_IMAP_LOGOUT_ERR(EXPR))
+#define IMAP_TRACE(NAME, UIDS, EXPR) [&]() { \
+                                       ImapTrace::Command traceCommand(m_TraceCommand, NAME, UIDS); \
+                                       const int traceRv = (EXPR); \
+                                       traceCommand.End(traceRv, m_Imap->imap_tag); \
+                                       return traceRv; }()
 #define LOG_IF_SMTP_ERR(EXPR) LogHelp::LogSmtp(EXPR, #EXPR, __FILENAME__, __LINE__)
 
-#define LOG_DURATION() LogDuration logDuration(__FUNCTION__, __FILENAME__, __LINE__)
+// logs duration at trace level, and records it in a histogram named after file and function
+#define LOG_DURATION() LogDuration logDuration(__FUNCTION__, __FILENAME__, __LINE__, \
+                                               [](const char* p_Func) { \
+                                                 static Metrics::Histogram* metricsHistogram = \
+                                                   Metrics::GetHistogram(LogHelp::GetDurationMetricName( \
+                                                                           __FILENAME__, p_Func)); \
+                                                 return metricsHistogram; }(__FUNCTION__))
 
 class LogHelp
 {
@@ -61,6 +81,9 @@ public:
   static int LogImapLogout(int p_Rv, const char* p_Expr, const char* p_File, int p_Line);
   static int LogSmtp(int p_Rv, const char* p_Expr, const char* p_File, int p_Line);
 
+  static std::string GetImapMetricName(const char* p_Expr);
+  static std::string GetDurationMetricName(const char* p_File, const char* p_Func);
+
   template<typename T>
   struct identity { typedef T type; };
 
@@ -124,23 +147,25 @@ std::string STR(const Args& ... p_Args)
 class LogDuration
 {
 public:
-  LogDuration(const char* p_Func, const char* p_File, int p_Line)
+  LogDuration(const char* p_Func, const char* p_File, int p_Line, Metrics::Histogram* p_Histogram)
     : m_Func(p_Func)
     , m_File(p_File)
     , m_Line(p_Line)
+    , m_Histogram(p_Histogram)
   {
     m_Start = std::chrono::high_resolution_clock::now();
   }
 
   ~LogDuration()
   {
+    const std::chrono::high_resolution_clock::time_point stop =
+      std::chrono::high_resolution_clock::now();
+    const std::chrono::duration<double> duration =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - m_Start);
+    long long durationUs = static_cast<long long>(round(duration.count() * 1000000.0));
+    m_Histogram->Record(durationUs);
     if (Log::GetTraceEnabled())
     {
-      const std::chrono::high_resolution_clock::time_point stop =
-        std::chrono::high_resolution_clock::now();
-      const std::chrono::duration<double> duration =
-        std::chrono::duration_cast<std::chrono::duration<double>>(stop - m_Start);
-      long long durationUs = static_cast<long long>(round(duration.count() * 1000000.0));
       Log::Trace(m_File, m_Line, "%s() duration %lld us", m_Func, durationUs);
     }
   }
@@ -150,4 +175,5 @@ private:
   const char* m_Func = nullptr;
   const char* m_File = nullptr;
   int m_Line = 0;
+  Metrics::Histogram* m_Histogram = nullptr;
 };
@@ -5,8 +5,10 @@
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
 
+#include <cstdio>
 #include <iostream>
 #include <memory>
+#include <thread>
 
 #include "apathy/path.hpp"
 
@@ -14,15 +16,22 @@
 #include "auth.h"
 #include "cacheutil.h"
 #include "config.h"
+#include "coprocess.h"
 #include "crypto.h"
+#include "imap.h"
 #include "imapmanager.h"
+#include "imaptrace.h"
 #include "lockfile.h"
 #include "log.h"
 #include "loghelp.h"
+#include "memorybudget.h"
+#include "metrics.h"
 #include "offlinequeue.h"
+#include "profmutex.h"
 #include "sasl.h"
 #include "sethelp.h"
 #include "smtpmanager.h"
+#include "startupprofile.h"
 #include "ui.h"
 #include "util.h"
 #include "version.h"
@@ -54,6 +63,8 @@ static bool ChangePasswords(std::shared_ptr<Config> p_MainConfig,
                             std::shared_ptr<Config> p_SecretConfig);
 static bool ChangeCachePasswords(std::shared_ptr<Config> p_MainConfig,
                                  const std::string& p_OldPass, const std::string& p_NewPass);
+static int CacheCommand(const std::string& p_Command, const bool p_CacheEncrypt,
+                        const bool p_CacheIndexEncrypt, const std::string& p_Pass);
 static void KeyDump();
 
 int main(int argc, char* argv[])
@@ -67,6 +78,7 @@ int main(int argc, char* argv[])
   bool setupAllowCacheEncrypt = false;
   std::string setup;
   std::string exportDir;
+  std::string cacheCommand;
 
   // Argument handling
   std::vector<std::string> args(argv + 1, argv + argc);
@@ -76,6 +88,10 @@ int main(int argc, char* argv[])
     {
       setupAllowCacheEncrypt = true;
     }
+    else if ((*it == "--cache-stats") || (*it == "--cache-verify") || (*it == "--cache-vacuum"))
+    {
+      cacheCommand = *it;
+    }
     else if (((*it == "-d") || (*it == "--confdir")) && (std::distance(it + 1, args.end()) > 0))
     {
       ++it;
@@ -117,6 +133,10 @@ int main(int argc, char* argv[])
       ShowVersion();
       return 0;
     }
+    else if (*it == "--startup-profile")
+    {
+      StartupProfile::SetEnabled(true);
+    }
     else if (((*it == "-x") || (*it == "--export")) && (std::distance(it + 1, args.end()) > 0))
     {
       ++it;
@@ -129,6 +149,7 @@ int main(int argc, char* argv[])
     }
   }
 
+  StartupPhase configPhase("config");
   if (!apathy::Path(Util::GetApplicationDir()).exists())
   {
     apathy::Path::makedirs(Util::GetApplicationDir());
@@ -177,7 +198,9 @@ int main(int argc, char* argv[])
     { "client_store_sent", "0" },
     { "coredump_enabled", "0" },
     { "html_to_text_cmd", "" },
+    { "html_to_text_coproc", "0" },
     { "text_to_html_cmd", "" },
+    { "text_to_html_coproc", "0" },
     { "parts_viewer_cmd", "" },
     { "html_viewer_cmd", "" },
     { "html_preview_cmd", "" },
@@ -190,6 +213,7 @@ int main(int argc, char* argv[])
     { "spell_cmd", "" },
     { "folders_exclude", "" },
     { "server_timestamps", "0" },
+    { "network_buffer_kb", "64" },
     { "network_timeout", "30" },
     { "queue_encrypt", "1" },
     { "auth", "pass" },
@@ -198,6 +222,9 @@ int main(int argc, char* argv[])
     { "file_picker_cmd", "" },
     { "downloads_dir", "" },
     { "idle_timeout", "29" },
+    { "imap_trace", "0" },
+    { "lock_profiling", "0" },
+    { "max_memory_mb", "0" },
   };
   const std::string mainConfigPath(Util::GetApplicationDir() + std::string("main.conf"));
   std::shared_ptr<Config> mainConfig = std::make_shared<Config>(mainConfigPath, defaultMainConfig);
@@ -271,6 +298,16 @@ int main(int argc, char* argv[])
   Util::SetPagerCmd(mainConfig->Get("pager_cmd"));
   Util::SetEditorCmd(mainConfig->Get("editor_cmd"));
   Util::SetSpellCmd(mainConfig->Get("spell_cmd"));
+  std::set<std::string> coProcessCmds;
+  if ((mainConfig->Get("html_to_text_coproc") == "1") && !Util::GetHtmlToTextConvertCmd().empty())
+  {
+    coProcessCmds.insert(Util::GetHtmlToTextConvertCmd());
+  }
+  if (mainConfig->Get("text_to_html_coproc") == "1")
+  {
+    coProcessCmds.insert(Util::GetTextToHtmlConvertCmd());
+  }
+  CoProcessPool::SetCmds(coProcessCmds);
   std::set<std::string> foldersExclude = ToSet(Util::SplitQuoted(mainConfig->Get("folders_exclude"), true));
   Util::SetUseServerTimestamps(mainConfig->Get("server_timestamps") == "1");
   const std::string auth = mainConfig->Get("auth");
@@ -303,6 +340,8 @@ int main(int argc, char* argv[])
 #endif
   }
 
+  configPhase.End();
+
   // Crypto init
   Crypto::Init();
 
@@ -319,14 +358,18 @@ int main(int argc, char* argv[])
   uint16_t smtpPort = 0;
   uint32_t prefetchLevel = 0;
   uint64_t networkTimeout = 0;
+  uint32_t networkBufferKb = 64;
   uint32_t idleTimeout = 29;
+  uint64_t maxMemoryMb = 0;
   try
   {
     imapPort = std::stoi(mainConfig->Get("imap_port"));
     smtpPort = std::stoi(mainConfig->Get("smtp_port"));
     prefetchLevel = std::stoi(mainConfig->Get("prefetch_level"));
     networkTimeout = std::stoll(mainConfig->Get("network_timeout"));
+    networkBufferKb = std::stoi(mainConfig->Get("network_buffer_kb"));
     idleTimeout = std::stoi(mainConfig->Get("idle_timeout"));
+    maxMemoryMb = std::stoull(mainConfig->Get("max_memory_mb"));
   }
   catch (...)
   {
@@ -343,6 +386,8 @@ int main(int argc, char* argv[])
     return ChangePasswords(mainConfig, secretConfig) ? 0 : 1;
   }
 
+  // @note: includes time waiting for user input, if passwords are not saved
+  StartupPhase passwordPhase("password");
   std::string pass;
   std::string smtpPass;
   if (auth == "pass")
@@ -360,6 +405,8 @@ int main(int argc, char* argv[])
     }
   }
 
+  passwordPhase.End();
+
   // Read config that may be updated during authentication
   const bool cacheEncrypt = (mainConfig->Get("cache_encrypt") == "1");
   const bool cacheIndexEncrypt = (mainConfig->Get("cache_index_encrypt") == "1");
@@ -367,6 +414,18 @@ int main(int argc, char* argv[])
   const bool queueEncrypt = (mainConfig->Get("queue_encrypt") == "1");
   const bool authEncrypt = (mainConfig->Get("auth_encrypt") == "1");
 
+  // Unwrap (or create) the data key once, used for all encrypted cache data
+  if (cacheEncrypt || cacheIndexEncrypt || addressBookEncrypt || queueEncrypt || authEncrypt)
+  {
+    STARTUP_PHASE("data_key");
+    if (!Crypto::InitDataKey(CacheUtil::GetDataKeyPath(), pass))
+    {
+      std::cerr << "error: failed to unlock cache data key (" << CacheUtil::GetDataKeyPath()
+                << "), check password.\n\n";
+      return 1;
+    }
+  }
+
   // Perform export if requested
   if (!exportDir.empty())
   {
@@ -376,14 +435,40 @@ int main(int argc, char* argv[])
     return exportRv ? 0 : 1;
   }
 
+  // Perform cache inspection / maintenance if requested
+  if (!cacheCommand.empty())
+  {
+    return CacheCommand(cacheCommand, cacheEncrypt, cacheIndexEncrypt, pass);
+  }
+
   Util::InitStdErrRedirect(logPath);
 
   Util::SetAddressBookEncrypt(addressBookEncrypt);
 
-  Auth::Init(auth, authEncrypt, pass, isSetup);
+  ProfMutex::SetEnabled(mainConfig->Get("lock_profiling") == "1");
+  MemoryBudget::Init(maxMemoryMb);
+
+  // Auth and offline queue (both possibly decrypting) are independent of ui and imap / smtp
+  // managers, and are only needed once the managers are started
+  std::thread initThread([&]()
+  {
+    STARTUP_PHASE("auth_queue_init");
+    Auth::Init(auth, authEncrypt, pass, isSetup);
+    OfflineQueue::Init(queueEncrypt, pass);
+  });
 
+  StartupPhase uiPhase("ui_init");
   Ui ui(inbox, address, name, prefetchLevel, prefetchAllHeaders);
+  uiPhase.End();
 
+  Imap::SetStreamBufferSize(networkBufferKb * 1024);
+
+  if (mainConfig->Get("imap_trace") == "1")
+  {
+    ImapTrace::Init(Util::GetApplicationDir() + std::string("imaptrace.jsonl"));
+  }
+
+  StartupPhase imapManagerPhase("imap_manager_init");
   std::shared_ptr<ImapManager> imapManager =
     std::make_shared<ImapManager>(user, pass, imapHost, imapPort, online,
                                   networkTimeout,
@@ -398,14 +483,19 @@ int main(int argc, char* argv[])
                                   std::bind(&Ui::SearchHandler, std::ref(ui), std::placeholders::_1,
                                             std::placeholders::_2),
                                   idleInbox, inbox);
+  imapManagerPhase.End();
 
+  StartupPhase smtpManagerPhase("smtp_manager_init");
   std::shared_ptr<SmtpManager> smtpManager =
     std::make_shared<SmtpManager>(smtpUser, smtpPass, smtpHost, smtpPort, name, address, online,
                                   networkTimeout,
                                   std::bind(&Ui::SmtpResultHandler, std::ref(ui), std::placeholders::_1),
                                   std::bind(&Ui::StatusHandler, std::ref(ui), std::placeholders::_1));
+  smtpManagerPhase.End();
 
-  OfflineQueue::Init(queueEncrypt, pass);
+  StartupPhase initWaitPhase("auth_queue_init_wait");
+  initThread.join();
+  initWaitPhase.End();
 
   ui.SetImapManager(imapManager);
   ui.SetTrashFolder(trash);
@@ -435,10 +525,18 @@ int main(int argc, char* argv[])
 
   OfflineQueue::Cleanup();
 
+  CoProcessPool::Cleanup();
+
   Util::CleanupTempDir();
 
   Util::CleanupStdErrRedirect();
 
+  ImapTrace::Cleanup();
+
+  StartupProfile::LogReport();
+  Metrics::LogReport();
+  ProfMutex::LogReport();
+
   LOG_INFO("exiting nmail");
 
   return 0;
@@ -454,6 +552,9 @@ static void ShowHelp()
     "\n"
     "Options:\n"
     "   -c, --cache-encrypt     prompt for cache encryption during oauth2 setup\n"
+    "   --cache-stats           show per-folder cache and search index statistics\n"
+    "   --cache-vacuum          compact cache and search index databases\n"
+    "   --cache-verify          check cache and search index consistency\n"
     "   -d, --confdir <DIR>     use a different directory than ~/.nmail\n"
     "   -e, --verbose           enable verbose logging\n"
     "   -ee, --extra-verbose    enable extra verbose logging\n"
@@ -464,6 +565,7 @@ static void ShowHelp()
     "   -s, --setup <SERVICE>   setup wizard for specified service, supported\n"
     "                           services: gmail, gmail-oauth2, icloud, outlook,\n"
     "                           outlook-oauth2\n"
+    "   --startup-profile       log duration of each startup phase\n"
     "   -v, --version           output version information and exit\n"
     "   -x, --export <DIR>      export cache to specified dir in Maildir format\n"
     "\n"
@@ -900,6 +1002,11 @@ bool ChangePasswords(std::shared_ptr<Config> p_MainConfig, std::shared_ptr<Confi
 bool ChangeCachePasswords(std::shared_ptr<Config> p_MainConfig,
                           const std::string& p_OldPass, const std::string& p_NewPass)
 {
+  // re-encrypt data in older formats first (using the data key), and re-wrap the data key last,
+  // so an interrupted change leaves all data readable with the old pass
+  const std::string keyPath = CacheUtil::GetDataKeyPath();
+  if (!Crypto::InitDataKey(keyPath, p_OldPass) || !Crypto::AddDataKeyPass(p_OldPass, p_NewPass)) return false;
+
   const bool cacheEncrypt = (p_MainConfig->Get("cache_encrypt") == "1");
   if (!ImapCache::ChangePass(cacheEncrypt, p_OldPass, p_NewPass)) return false;
 
@@ -915,7 +1022,138 @@ bool ChangeCachePasswords(std::shared_ptr<Config> p_MainConfig,
   const bool authEncrypt = (p_MainConfig->Get("auth_encrypt") == "1");
   if (!Auth::ChangePass(authEncrypt, p_OldPass, p_NewPass)) return false;
 
-  return true;
+  return Crypto::ChangeDataKeyPass(keyPath, p_OldPass, p_NewPass);
+}
+
+static int CacheCommand(const std::string& p_Command, const bool p_CacheEncrypt,
+                        const bool p_CacheIndexEncrypt, const std::string& p_Pass)
+{
+  ImapCache imapCache(p_CacheEncrypt, p_Pass);
+
+  if (p_Command == "--cache-stats")
+  {
+    const std::map<std::string, ImapCache::FolderStats> folderStats = imapCache.GetStats();
+    const std::map<std::string, std::set<uint32_t>> indexUids =
+      ImapIndex::GetFolderUids(p_CacheIndexEncrypt, p_Pass);
+
+    char line[512];
+    const char* format = "%-32s %8s %8s %8s %8s %10s %10s %10s\n";
+    snprintf(line, sizeof(line), format, "folder", "uids", "headers", "bodys", "indexed",
+             "headers sz", "bodys sz", "disk sz");
+    std::cout << line;
+
+    ImapCache::FolderStats total;
+    size_t totalIndexed = 0;
+    for (const auto& folderStat : folderStats)
+    {
+      const ImapCache::FolderStats& stats = folderStat.second;
+      auto indexIt = indexUids.find(folderStat.first);
+      const size_t indexed = (indexIt != indexUids.end()) ? indexIt->second.size() : 0;
+      snprintf(line, sizeof(line), format, folderStat.first.c_str(),
+               std::to_string(stats.m_Uids).c_str(), std::to_string(stats.m_Headers).c_str(),
+               std::to_string(stats.m_Bodys).c_str(), std::to_string(indexed).c_str(),
+               Util::GetPrefixedSize(stats.m_HeadersSize).c_str(),
+               Util::GetPrefixedSize(stats.m_BodysSize).c_str(),
+               Util::GetPrefixedSize(stats.m_FileSize).c_str());
+      std::cout << line;
+
+      total.m_Uids += stats.m_Uids;
+      total.m_Headers += stats.m_Headers;
+      total.m_Bodys += stats.m_Bodys;
+      total.m_HeadersSize += stats.m_HeadersSize;
+      total.m_BodysSize += stats.m_BodysSize;
+      total.m_FileSize += stats.m_FileSize;
+      totalIndexed += indexed;
+    }
+
+    snprintf(line, sizeof(line), format, "total",
+             std::to_string(total.m_Uids).c_str(), std::to_string(total.m_Headers).c_str(),
+             std::to_string(total.m_Bodys).c_str(), std::to_string(totalIndexed).c_str(),
+             Util::GetPrefixedSize(total.m_HeadersSize).c_str(),
+             Util::GetPrefixedSize(total.m_BodysSize).c_str(),
+             Util::GetPrefixedSize(total.m_FileSize).c_str());
+    std::cout << line;
+    std::cout << "search index disk size: " << Util::GetPrefixedSize(ImapIndex::GetDbSize()) << "\n";
+    return 0;
+  }
+  else if (p_Command == "--cache-verify")
+  {
+    std::vector<std::string> issues = imapCache.Verify();
+    const std::map<std::string, std::set<uint32_t>> bodyUids = imapCache.GetBodyUids();
+    const std::map<std::string, std::set<uint32_t>> indexUids =
+      ImapIndex::GetFolderUids(p_CacheIndexEncrypt, p_Pass);
+
+    size_t unindexedCount = 0;
+    for (const auto& folderIndexUids : indexUids)
+    {
+      const std::string& folder = folderIndexUids.first;
+      auto bodyIt = bodyUids.find(folder);
+      if (bodyIt == bodyUids.end())
+      {
+        issues.push_back(folder + ": " + std::to_string(folderIndexUids.second.size()) +
+                         " indexed messages in unknown folder");
+        continue;
+      }
+
+      const std::set<uint32_t> staleUids = folderIndexUids.second - bodyIt->second;
+      if (!staleUids.empty())
+      {
+        issues.push_back(folder + ": " + std::to_string(staleUids.size()) +
+                         " indexed messages not in cache");
+      }
+    }
+
+    for (const auto& folderBodyUids : bodyUids)
+    {
+      auto indexIt = indexUids.find(folderBodyUids.first);
+      unindexedCount += (indexIt != indexUids.end()) ? (folderBodyUids.second - indexIt->second).size()
+                                                     : folderBodyUids.second.size();
+    }
+
+    for (const auto& issue : issues)
+    {
+      std::cout << issue << "\n";
+    }
+
+    // @note: messages are indexed in background when idle, so unindexed messages are not an error
+    if (unindexedCount > 0)
+    {
+      std::cout << unindexedCount << " cached messages not yet indexed\n";
+    }
+
+    std::cout << "Verify " << (issues.empty() ? "success" : "failure") << "\n";
+    return issues.empty() ? 0 : 1;
+  }
+  else if (p_Command == "--cache-vacuum")
+  {
+    int64_t cacheSizeBefore = 0;
+    for (const auto& folderStat : imapCache.GetStats())
+    {
+      cacheSizeBefore += folderStat.second.m_FileSize;
+    }
+
+    const int64_t indexSizeBefore = ImapIndex::GetDbSize();
+
+    imapCache.Vacuum();
+    const bool compactRv = ImapIndex::Compact(p_CacheIndexEncrypt, p_Pass);
+
+    int64_t cacheSizeAfter = 0;
+    for (const auto& folderStat : imapCache.GetStats())
+    {
+      cacheSizeAfter += folderStat.second.m_FileSize;
+    }
+
+    const int64_t indexSizeAfter = ImapIndex::GetDbSize();
+
+    std::cout << "cache: " << Util::GetPrefixedSize(cacheSizeBefore) << " -> "
+              << Util::GetPrefixedSize(cacheSizeAfter) << "\n";
+    std::cout << "search index: " << Util::GetPrefixedSize(indexSizeBefore) << " -> "
+              << Util::GetPrefixedSize(indexSizeAfter) << "\n";
+    std::cout << "Vacuum " << (compactRv ? "success" : "failure") << "\n";
+    return compactRv ? 0 : 1;
+  }
+
+  return 1;
 }
 
 static void KeyDump()
@@ -0,0 +1,120 @@
+// memorybudget.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "memorybudget.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <sqlite3.h>
+
+#include "loghelp.h"
+#include "metrics.h"
+#include "util.h"
+
+std::mutex MemoryBudget::m_Mutex;
+uint64_t MemoryBudget::m_Max = 0;
+std::map<std::string, MemoryBudget::Usage> MemoryBudget::m_Usages;
+
+namespace
+{
+  // share of the budget for sqlite page caches and for pending (uncommitted) xapian documents
+  const uint64_t s_SqliteShareDiv = 8;
+  const uint64_t s_XapianShareDiv = 8;
+
+  // sqlite cache is per connection, and one is opened per cached folder and db type
+  const int64_t s_SqliteExpectedConnections = 16;
+  const int64_t s_SqliteMinCacheKb = 256;
+  const int64_t s_SqliteDefaultCacheKb = 2000;
+
+  const uint64_t s_XapianDocSize = 8 * 1024;
+  const uint64_t s_XapianMinFlushThreshold = 100;
+  const uint64_t s_XapianDefaultFlushThreshold = 10000;
+}
+
+void MemoryBudget::Init(uint64_t p_MaxMb)
+{
+  m_Max = p_MaxMb * 1024 * 1024;
+  if (m_Max == 0) return;
+
+  // @note: sqlite frees page cache memory to stay below the soft limit
+  sqlite3_soft_heap_limit64((sqlite3_int64)(m_Max / s_SqliteShareDiv));
+
+  // @note: xapian reads its flush threshold (number of uncommitted documents) from env when a
+  // writable database is opened. Set here, before threads that may call getenv() are started
+  // (only the log writer thread runs at this point, and it does not access env).
+  setenv("XAPIAN_FLUSH_THRESHOLD", std::to_string(GetXapianFlushThreshold()).c_str(), 0 /* overwrite */);
+  LOG_DEBUG("memory budget %llu mb, sqlite cache %lld kb, xapian flush threshold %u",
+            (unsigned long long)p_MaxMb, (long long)GetSqliteCacheKb(), GetXapianFlushThreshold());
+}
+
+uint64_t MemoryBudget::GetMax()
+{
+  return m_Max;
+}
+
+void MemoryBudget::SetUsage(const std::string& p_Subsystem, int64_t p_Bytes)
+{
+  Metrics::Gauge* gauge = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Usage& usage = m_Usages[p_Subsystem];
+    usage.m_Bytes = p_Bytes;
+    if (usage.m_Gauge == nullptr)
+    {
+      // gauge is resolved once per subsystem
+      usage.m_Gauge = Metrics::GetGauge("mem." + p_Subsystem + "_kb");
+    }
+
+    gauge = usage.m_Gauge;
+  }
+
+  gauge->Set(p_Bytes / 1024);
+}
+
+int64_t MemoryBudget::GetUsage()
+{
+  SetUsage("sqlite", sqlite3_memory_used());
+
+  int64_t usage = 0;
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const auto& subsystemUsage : m_Usages)
+  {
+    usage += subsystemUsage.second.m_Bytes;
+  }
+
+  METRICS_GAUGE("mem.total_kb", usage / 1024);
+  return usage;
+}
+
+bool MemoryBudget::IsExceeded()
+{
+  return GetExcess(1.0) > 0;
+}
+
+int64_t MemoryBudget::GetExcess(double p_TargetFraction)
+{
+  if (m_Max == 0) return 0;
+
+  return std::max<int64_t>(0, GetUsage() - (int64_t)(m_Max * p_TargetFraction));
+}
+
+int64_t MemoryBudget::GetSqliteCacheKb()
+{
+  if (m_Max == 0) return 0;
+
+  const int64_t cacheKb = (int64_t)(m_Max / s_SqliteShareDiv / 1024) / s_SqliteExpectedConnections;
+  return Util::Bound(s_SqliteMinCacheKb, cacheKb, s_SqliteDefaultCacheKb);
+}
+
+uint32_t MemoryBudget::GetXapianFlushThreshold()
+{
+  if (m_Max == 0) return 0;
+
+  const uint64_t threshold = m_Max / s_XapianShareDiv / s_XapianDocSize;
+  return (uint32_t)Util::Bound(s_XapianMinFlushThreshold, threshold, s_XapianDefaultFlushThreshold);
+}
@@ -0,0 +1,50 @@
+// memorybudget.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "metrics.h"
+
+// Estimated memory usage per subsystem (reported as mem.<subsystem>_kb gauges in the stats
+// view) and a global budget (max_memory_mb) which subsystems respect by evicting caches.
+class MemoryBudget
+{
+public:
+  // must be called before threads that may access env are started
+  static void Init(uint64_t p_MaxMb);
+  static uint64_t GetMax();
+  static void SetUsage(const std::string& p_Subsystem, int64_t p_Bytes);
+  static int64_t GetUsage();
+  static bool IsExceeded();
+  static int64_t GetExcess(double p_TargetFraction);
+
+  static int64_t GetSqliteCacheKb();
+  static uint32_t GetXapianFlushThreshold();
+
+  // Estimated overhead of a std::map / std::set node beyond its value, for usage estimates.
+  // Nodes hold three pointers and a color, which pads to four pointers.
+  static int64_t GetNodeOverhead()
+  {
+    return 4 * sizeof(void*);
+  }
+
+private:
+  struct Usage
+  {
+    int64_t m_Bytes = 0;
+    Metrics::Gauge* m_Gauge = nullptr;
+  };
+
+  static std::mutex m_Mutex;
+  static uint64_t m_Max;
+  static std::map<std::string, Usage> m_Usages;
+};
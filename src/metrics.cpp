@@ -0,0 +1,219 @@
+// metrics.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <stdarg.h>
+
+#include "loghelp.h"
+
+std::mutex Metrics::m_Mutex;
+std::map<std::string, std::unique_ptr<Metrics::Counter>> Metrics::m_Counters;
+std::map<std::string, std::unique_ptr<Metrics::Gauge>> Metrics::m_Gauges;
+std::map<std::string, std::unique_ptr<Metrics::Histogram>> Metrics::m_Histograms;
+
+namespace
+{
+  std::string FormatLine(const char* p_Format, ...)
+  {
+    char buf[256];
+    va_list vaList;
+    va_start(vaList, p_Format);
+    vsnprintf(buf, sizeof(buf), p_Format, vaList);
+    va_end(vaList);
+    return std::string(buf);
+  }
+}
+
+Metrics::Histogram::Histogram()
+{
+  for (auto& bucket : m_Buckets)
+  {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Metrics::Histogram::Record(uint64_t p_Us)
+{
+  m_Buckets[GetBucket(p_Us)].fetch_add(1, std::memory_order_relaxed);
+  m_Count.fetch_add(1, std::memory_order_relaxed);
+  m_Sum.fetch_add(p_Us, std::memory_order_relaxed);
+
+  uint64_t max = m_Max.load(std::memory_order_relaxed);
+  while ((p_Us > max) && !m_Max.compare_exchange_weak(max, p_Us, std::memory_order_relaxed))
+  {
+  }
+}
+
+uint64_t Metrics::Histogram::GetCount() const
+{
+  return m_Count.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Histogram::GetSum() const
+{
+  return m_Sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Histogram::GetMax() const
+{
+  return m_Max.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Histogram::GetPercentile(double p_Percentile) const
+{
+  // @note: buckets are read without snapshotting, values may be slightly off while recording
+  uint64_t total = 0;
+  for (const auto& bucket : m_Buckets)
+  {
+    total += bucket.load(std::memory_order_relaxed);
+  }
+
+  if (total == 0) return 0;
+
+  const uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(total * p_Percentile / 100.0));
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < s_BucketCount; ++i)
+  {
+    cumulative += m_Buckets[i].load(std::memory_order_relaxed);
+    if (cumulative >= target)
+    {
+      return std::min(GetBucketMax(i), GetMax());
+    }
+  }
+
+  return GetMax();
+}
+
+size_t Metrics::Histogram::GetBucket(uint64_t p_Us)
+{
+  if (p_Us < s_SubBucketCount) return p_Us;
+
+  int msb = 63 - __builtin_clzll(p_Us);
+  int shift = msb - s_SubBucketBits;
+  size_t subBucket = (p_Us >> shift) & (s_SubBucketCount - 1);
+  return ((shift + 1) * s_SubBucketCount) + subBucket;
+}
+
+uint64_t Metrics::Histogram::GetBucketMax(size_t p_Bucket)
+{
+  if (p_Bucket < s_SubBucketCount) return p_Bucket;
+
+  int shift = (p_Bucket / s_SubBucketCount) - 1;
+  uint64_t subBucket = p_Bucket % s_SubBucketCount;
+  uint64_t min = (s_SubBucketCount + subBucket) << shift;
+  return min + ((1ULL << shift) - 1);
+}
+
+Metrics::Counter* Metrics::GetCounter(const std::string& p_Name)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::unique_ptr<Counter>& counter = m_Counters[p_Name];
+  if (!counter)
+  {
+    counter.reset(new Counter());
+  }
+
+  return counter.get();
+}
+
+Metrics::Gauge* Metrics::GetGauge(const std::string& p_Name)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::unique_ptr<Gauge>& gauge = m_Gauges[p_Name];
+  if (!gauge)
+  {
+    gauge.reset(new Gauge());
+  }
+
+  return gauge.get();
+}
+
+Metrics::Histogram* Metrics::GetHistogram(const std::string& p_Name)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::unique_ptr<Histogram>& histogram = m_Histograms[p_Name];
+  if (!histogram)
+  {
+    histogram.reset(new Histogram());
+  }
+
+  return histogram.get();
+}
+
+std::vector<std::string> Metrics::GetReport()
+{
+  std::vector<std::string> lines;
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  lines.push_back(FormatLine("%-32s %8s %9s %9s %9s %9s %9s", "duration", "count", "mean", "p50", "p90",
+                             "p99", "max"));
+  for (const auto& histogram : m_Histograms)
+  {
+    const uint64_t count = histogram.second->GetCount();
+    if (count == 0) continue;
+
+    const uint64_t mean = histogram.second->GetSum() / count;
+    lines.push_back(FormatLine("%-32s %8llu %9s %9s %9s %9s %9s", histogram.first.c_str(),
+                               (unsigned long long)count,
+                               FormatDuration(mean).c_str(),
+                               FormatDuration(histogram.second->GetPercentile(50)).c_str(),
+                               FormatDuration(histogram.second->GetPercentile(90)).c_str(),
+                               FormatDuration(histogram.second->GetPercentile(99)).c_str(),
+                               FormatDuration(histogram.second->GetMax()).c_str()));
+  }
+
+  lines.push_back("");
+  lines.push_back(FormatLine("%-32s %8s", "counter", "value"));
+  for (const auto& counter : m_Counters)
+  {
+    lines.push_back(FormatLine("%-32s %8lld", counter.first.c_str(), (long long)counter.second->Get()));
+  }
+
+  lines.push_back("");
+  lines.push_back(FormatLine("%-32s %8s", "gauge", "value"));
+  for (const auto& gauge : m_Gauges)
+  {
+    lines.push_back(FormatLine("%-32s %8lld", gauge.first.c_str(), (long long)gauge.second->Get()));
+  }
+
+  return lines;
+}
+
+void Metrics::LogReport()
+{
+  const std::vector<std::string> lines = GetReport();
+  for (const auto& line : lines)
+  {
+    if (line.empty()) continue;
+
+    LOG_INFO("metrics %s", line.c_str());
+  }
+}
+
+std::string Metrics::FormatDuration(uint64_t p_Us)
+{
+  char buf[32];
+  if (p_Us < 10000)
+  {
+    snprintf(buf, sizeof(buf), "%llu us", (unsigned long long)p_Us);
+  }
+  else if (p_Us < 10000000)
+  {
+    snprintf(buf, sizeof(buf), "%.1f ms", (double)p_Us / 1000.0);
+  }
+  else
+  {
+    snprintf(buf, sizeof(buf), "%.1f s", (double)p_Us / 1000000.0);
+  }
+
+  return std::string(buf);
+}
@@ -0,0 +1,118 @@
+// metrics.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Registry lookups take a lock, so each call site resolves its metric once and keeps the
+// pointer, making the recording itself a few relaxed atomic operations.
+#define METRICS_COUNT(NAME, DELTA) do { static Metrics::Counter* metricsCounter = \
+                                          Metrics::GetCounter(NAME); \
+                                        metricsCounter->Add(DELTA); } while (0)
+
+#define METRICS_GAUGE(NAME, VALUE) do { static Metrics::Gauge* metricsGauge = \
+                                          Metrics::GetGauge(NAME); \
+                                        metricsGauge->Set(VALUE); } while (0)
+
+#define METRICS_DURATION(NAME) MetricsDuration metricsDuration([]() { \
+                                 static Metrics::Histogram* metricsHistogram = \
+                                   Metrics::GetHistogram(NAME); \
+                                 return metricsHistogram; }())
+
+class Metrics
+{
+public:
+  class Counter
+  {
+  public:
+    inline void Add(int64_t p_Delta) { m_Value.fetch_add(p_Delta, std::memory_order_relaxed); }
+    inline int64_t Get() const { return m_Value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> m_Value{0};
+  };
+
+  class Gauge
+  {
+  public:
+    inline void Set(int64_t p_Value) { m_Value.store(p_Value, std::memory_order_relaxed); }
+    inline int64_t Get() const { return m_Value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> m_Value{0};
+  };
+
+  // Log-linear latency histogram in microseconds, with eight sub-buckets per power of two,
+  // i.e. percentiles are accurate within 12.5% over the full value range.
+  class Histogram
+  {
+  public:
+    Histogram();
+    void Record(uint64_t p_Us);
+    uint64_t GetCount() const;
+    uint64_t GetSum() const;
+    uint64_t GetMax() const;
+    uint64_t GetPercentile(double p_Percentile) const;
+
+  private:
+    static size_t GetBucket(uint64_t p_Us);
+    static uint64_t GetBucketMax(size_t p_Bucket);
+
+  private:
+    static const int s_SubBucketBits = 3;
+    static const size_t s_SubBucketCount = (1 << s_SubBucketBits);
+    static const size_t s_BucketCount = (64 - s_SubBucketBits + 1) * s_SubBucketCount;
+
+    std::atomic<uint64_t> m_Buckets[s_BucketCount];
+    std::atomic<uint64_t> m_Count{0};
+    std::atomic<uint64_t> m_Sum{0};
+    std::atomic<uint64_t> m_Max{0};
+  };
+
+  static Counter* GetCounter(const std::string& p_Name);
+  static Gauge* GetGauge(const std::string& p_Name);
+  static Histogram* GetHistogram(const std::string& p_Name);
+
+  static std::vector<std::string> GetReport();
+  static void LogReport();
+
+  static std::string FormatDuration(uint64_t p_Us);
+
+private:
+  static std::mutex m_Mutex;
+  static std::map<std::string, std::unique_ptr<Counter>> m_Counters;
+  static std::map<std::string, std::unique_ptr<Gauge>> m_Gauges;
+  static std::map<std::string, std::unique_ptr<Histogram>> m_Histograms;
+};
+
+class MetricsDuration
+{
+public:
+  explicit MetricsDuration(Metrics::Histogram* p_Histogram)
+    : m_Histogram(p_Histogram)
+    , m_Start(std::chrono::steady_clock::now())
+  {
+  }
+
+  ~MetricsDuration()
+  {
+    const std::chrono::steady_clock::duration duration = std::chrono::steady_clock::now() - m_Start;
+    m_Histogram->Record(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+  }
+
+private:
+  Metrics::Histogram* m_Histogram = nullptr;
+  std::chrono::steady_clock::time_point m_Start;
+};
@@ -0,0 +1,500 @@
+// mimecodec.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "mimecodec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MIMECODEC_X86
+#include <immintrin.h>
+#endif
+
+#include "log.h"
+#include "loghelp.h"
+
+namespace
+{
+  const char s_Base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  // base64 line length of 76 chars, i.e. 57 input bytes, as written by libetpan
+  const size_t s_Base64LineBytes = 57;
+
+  // block functions process as many whole simd blocks as possible and return number
+  // of input chars / bytes consumed, leaving the remainder to the scalar code
+  typedef size_t (*Base64DecodeBlocksFunc)(const char* p_Src, size_t p_Len, char* p_Dst);
+  typedef size_t (*Base64EncodeBlocksFunc)(const unsigned char* p_Src, size_t p_Len, size_t p_Avail,
+                                           char* p_Dst);
+  typedef size_t (*FindQpSpecialFunc)(const char* p_Src, size_t p_Len);
+
+  struct Codec
+  {
+    const char* m_Name;
+    Base64DecodeBlocksFunc m_Base64DecodeBlocks;
+    Base64EncodeBlocksFunc m_Base64EncodeBlocks;
+    FindQpSpecialFunc m_FindQpSpecial;
+  };
+
+  const int8_t* GetBase64Values()
+  {
+    // chars outside the base64 alphabet, including padding, are ignored by the decoder
+    static const struct Base64Values
+    {
+      Base64Values()
+      {
+        memset(m_Values, -1, sizeof(m_Values));
+        for (int i = 0; i < 64; ++i)
+        {
+          m_Values[static_cast<unsigned char>(s_Base64Chars[i])] = static_cast<int8_t>(i);
+        }
+      }
+
+      int8_t m_Values[256];
+    } base64Values;
+
+    return base64Values.m_Values;
+  }
+
+  inline void Base64EncodeGroup(const unsigned char* p_Src, size_t p_Count, char* p_Dst)
+  {
+    const unsigned a = p_Src[0];
+    const unsigned b = (p_Count > 1) ? p_Src[1] : 0;
+    const unsigned c = (p_Count > 2) ? p_Src[2] : 0;
+    p_Dst[0] = s_Base64Chars[a >> 2];
+    p_Dst[1] = s_Base64Chars[((a & 0x3) << 4) | (b >> 4)];
+    p_Dst[2] = (p_Count > 1) ? s_Base64Chars[((b & 0xf) << 2) | (c >> 6)] : '=';
+    p_Dst[3] = (p_Count > 2) ? s_Base64Chars[c & 0x3f] : '=';
+  }
+
+  size_t Base64DecodeBlocksScalar(const char* /*p_Src*/, size_t /*p_Len*/, char* /*p_Dst*/)
+  {
+    return 0;
+  }
+
+  size_t Base64EncodeBlocksScalar(const unsigned char* /*p_Src*/, size_t /*p_Len*/, size_t /*p_Avail*/,
+                                  char* /*p_Dst*/)
+  {
+    return 0;
+  }
+
+  size_t FindQpSpecialScalar(const char* p_Src, size_t p_Len)
+  {
+    for (size_t i = 0; i < p_Len; ++i)
+    {
+      const char ch = p_Src[i];
+      if ((ch == '=') || (ch == '\r') || (ch == '\n')) return i;
+    }
+
+    return p_Len;
+  }
+
+#ifdef MIMECODEC_X86
+  // vector base64 translation and packing based on the algorithms by Wojciech Mula
+  // and Daniel Lemire, see http://0x80.pl/articles/index.html#base64-algorithm-new
+
+  __attribute__((target("ssse3")))
+  size_t Base64DecodeBlocksSsse3(const char* p_Src, size_t p_Len, char* p_Dst)
+  {
+    // writes 16 bytes per 12 decoded bytes, caller must provide 4 bytes output slack
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2f = _mm_set1_epi8(0x2f);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t pos = 0;
+    for (; (pos + 16) <= p_Len; pos += 16)
+    {
+      __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_Src + pos));
+      const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2f);
+      const __m128i loNibbles = _mm_and_si128(str, mask2f);
+      const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+      const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff) break;
+
+      const __m128i eq2f = _mm_cmpeq_epi8(str, mask2f);
+      const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2f, hiNibbles));
+      str = _mm_add_epi8(str, roll);
+
+      const __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+      __m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+      out = _mm_shuffle_epi8(out, pack);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p_Dst + ((pos / 4) * 3)), out);
+    }
+
+    return pos;
+  }
+
+  __attribute__((target("avx2")))
+  size_t Base64DecodeBlocksAvx2(const char* p_Src, size_t p_Len, char* p_Dst)
+  {
+    // writes 32 bytes per 24 decoded bytes, caller must provide 8 bytes output slack
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    size_t pos = 0;
+    for (; (pos + 32) <= p_Len; pos += 32)
+    {
+      __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_Src + pos));
+      const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2f);
+      const __m256i loNibbles = _mm256_and_si256(str, mask2f);
+      const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+      const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+      if (!_mm256_testz_si256(lo, hi)) break;
+
+      const __m256i eq2f = _mm256_cmpeq_epi8(str, mask2f);
+      const __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2f, hiNibbles));
+      str = _mm256_add_epi8(str, roll);
+
+      const __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+      __m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+      out = _mm256_shuffle_epi8(out, pack);
+      out = _mm256_permutevar8x32_epi32(out, permute);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_Dst + ((pos / 4) * 3)), out);
+    }
+
+    return pos;
+  }
+
+  __attribute__((target("ssse3")))
+  inline __m128i Base64EncodeTranslateSsse3(__m128i p_In)
+  {
+    const __m128i t0 = _mm_and_si128(p_In, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(p_In, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    const __m128i shiftLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(shiftLut, result);
+    return _mm_add_epi8(result, indices);
+  }
+
+  __attribute__((target("ssse3")))
+  size_t Base64EncodeBlocksSsse3(const unsigned char* p_Src, size_t p_Len, size_t p_Avail, char* p_Dst)
+  {
+    // reads 16 bytes per 12 encoded bytes
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+    size_t pos = 0;
+    for (; ((pos + 12) <= p_Len) && ((pos + 16) <= p_Avail); pos += 12)
+    {
+      __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_Src + pos));
+      in = _mm_shuffle_epi8(in, spread);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p_Dst + ((pos / 3) * 4)), Base64EncodeTranslateSsse3(in));
+    }
+
+    return pos;
+  }
+
+  __attribute__((target("avx2")))
+  size_t Base64EncodeBlocksAvx2(const unsigned char* p_Src, size_t p_Len, size_t p_Avail, char* p_Dst)
+  {
+    // reads 28 bytes per 24 encoded bytes, as two overlapping 16 byte lanes
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shiftLut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                              '/' - 63, 'A', 0, 0,
+                                              'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                              '/' - 63, 'A', 0, 0);
+
+    size_t pos = 0;
+    for (; ((pos + 24) <= p_Len) && ((pos + 28) <= p_Avail); pos += 24)
+    {
+      const __m128i inLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_Src + pos));
+      const __m128i inHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_Src + pos + 12));
+      __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(inLo), inHi, 1);
+      in = _mm256_shuffle_epi8(in, spread);
+
+      const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+      const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+      const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+      const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+      const __m256i indices = _mm256_or_si256(t1, t3);
+
+      __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+      const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+      result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+      result = _mm256_shuffle_epi8(shiftLut, result);
+      result = _mm256_add_epi8(result, indices);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_Dst + ((pos / 3) * 4)), result);
+    }
+
+    return pos;
+  }
+
+  __attribute__((target("sse2")))
+  size_t FindQpSpecialSse2(const char* p_Src, size_t p_Len)
+  {
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    size_t pos = 0;
+    for (; (pos + 16) <= p_Len; pos += 16)
+    {
+      const __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_Src + pos));
+      const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(str, eq),
+                                           _mm_or_si128(_mm_cmpeq_epi8(str, cr), _mm_cmpeq_epi8(str, lf)));
+      const int mask = _mm_movemask_epi8(special);
+      if (mask != 0) return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+
+    return pos + FindQpSpecialScalar(p_Src + pos, p_Len - pos);
+  }
+
+  __attribute__((target("avx2")))
+  size_t FindQpSpecialAvx2(const char* p_Src, size_t p_Len)
+  {
+    const __m256i eq = _mm256_set1_epi8('=');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    size_t pos = 0;
+    for (; (pos + 32) <= p_Len; pos += 32)
+    {
+      const __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_Src + pos));
+      const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(str, eq),
+                                              _mm256_or_si256(_mm256_cmpeq_epi8(str, cr),
+                                                              _mm256_cmpeq_epi8(str, lf)));
+      const int mask = _mm256_movemask_epi8(special);
+      if (mask != 0) return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+
+    return pos + FindQpSpecialSse2(p_Src + pos, p_Len - pos);
+  }
+#endif
+
+  Codec SelectCodec()
+  {
+    Codec codec = { "scalar", Base64DecodeBlocksScalar, Base64EncodeBlocksScalar, FindQpSpecialScalar };
+#ifdef MIMECODEC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+      codec = { "sse2", Base64DecodeBlocksScalar, Base64EncodeBlocksScalar, FindQpSpecialSse2 };
+    }
+
+    if (__builtin_cpu_supports("ssse3"))
+    {
+      codec = { "ssse3", Base64DecodeBlocksSsse3, Base64EncodeBlocksSsse3, FindQpSpecialSse2 };
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+      codec = { "avx2", Base64DecodeBlocksAvx2, Base64EncodeBlocksAvx2, FindQpSpecialAvx2 };
+    }
+#endif
+
+    LOG_DEBUG("mime codec %s", codec.m_Name);
+    return codec;
+  }
+
+  const Codec& GetCodec()
+  {
+    static const Codec codec = SelectCodec();
+    return codec;
+  }
+
+  inline int HexValue(char p_Ch)
+  {
+    if ((p_Ch >= '0') && (p_Ch <= '9')) return p_Ch - '0';
+    if ((p_Ch >= 'a') && (p_Ch <= 'f')) return p_Ch - 'a' + 10;
+    if ((p_Ch >= 'A') && (p_Ch <= 'F')) return p_Ch - 'A' + 10;
+
+    return 0;
+  }
+}
+
+std::string MimeCodec::Base64Decode(const char* p_Data, size_t p_Len)
+{
+  const Codec& codec = GetCodec();
+  const int8_t* values = GetBase64Values();
+
+  // slack for simd stores beyond the decoded data
+  std::string out((p_Len / 4) * 3 + 3 + 32, '\0');
+  char* dst = &out[0];
+
+  uint8_t chunk[4] = { 0, 0, 0, 0 };
+  int chunkIndex = 0;
+  bool trySimd = true;
+  size_t pos = 0;
+  while (pos < p_Len)
+  {
+    // simd blocks are attempted at the start of each line, i.e. after skipped line breaks
+    if (trySimd && (chunkIndex == 0))
+    {
+      const size_t count = codec.m_Base64DecodeBlocks(p_Data + pos, p_Len - pos, dst);
+      pos += count;
+      dst += (count / 4) * 3;
+      trySimd = false;
+      continue;
+    }
+
+    const int8_t value = values[static_cast<unsigned char>(p_Data[pos++])];
+    if (value < 0)
+    {
+      trySimd = true;
+      continue;
+    }
+
+    chunk[chunkIndex++] = static_cast<uint8_t>(value);
+    if (chunkIndex == 4)
+    {
+      *dst++ = static_cast<char>((chunk[0] << 2) | (chunk[1] >> 4));
+      *dst++ = static_cast<char>((chunk[1] << 4) | (chunk[2] >> 2));
+      *dst++ = static_cast<char>((chunk[2] << 6) | chunk[3]);
+      chunkIndex = 0;
+    }
+  }
+
+  // incomplete trailing group is decoded as far as possible, like libetpan does
+  if (chunkIndex > 0)
+  {
+    const uint8_t second = (chunkIndex > 1) ? chunk[1] : 0;
+    *dst++ = static_cast<char>((chunk[0] << 2) | (second >> 4));
+    if (chunkIndex >= 3)
+    {
+      *dst++ = static_cast<char>((chunk[1] << 4) | (chunk[2] >> 2));
+    }
+  }
+
+  out.resize(static_cast<size_t>(dst - out.data()));
+  return out;
+}
+
+std::string MimeCodec::Base64Encode(const char* p_Data, size_t p_Len)
+{
+  const Codec& codec = GetCodec();
+  const unsigned char* src = reinterpret_cast<const unsigned char*>(p_Data);
+  const size_t lines = (p_Len + s_Base64LineBytes - 1) / s_Base64LineBytes;
+
+  std::string out((((p_Len + 2) / 3) * 4) + (std::max<size_t>(lines, 1) * 2), '\0');
+  char* dst = &out[0];
+
+  // lines are terminated by crlf, and an empty input results in a single crlf
+  size_t pos = 0;
+  while (pos < p_Len)
+  {
+    const size_t lineLen = std::min(s_Base64LineBytes, p_Len - pos);
+    size_t count = codec.m_Base64EncodeBlocks(src + pos, lineLen, p_Len - pos, dst);
+    dst += (count / 3) * 4;
+    for (; count < lineLen; count += 3)
+    {
+      Base64EncodeGroup(src + pos + count, std::min<size_t>(3, lineLen - count), dst);
+      dst += 4;
+    }
+
+    pos += lineLen;
+    *dst++ = '\r';
+    *dst++ = '\n';
+  }
+
+  if (p_Len == 0)
+  {
+    *dst++ = '\r';
+    *dst++ = '\n';
+  }
+
+  out.resize(static_cast<size_t>(dst - out.data()));
+  return out;
+}
+
+std::string MimeCodec::QuotedPrintableDecode(const char* p_Data, size_t p_Len)
+{
+  const Codec& codec = GetCodec();
+  std::string out;
+  out.reserve(p_Len);
+
+  // mirrors libetpan decoding: line breaks are normalized to crlf, soft line breaks
+  // removed, and invalid escapes kept or decoded leniently
+  size_t pos = 0;
+  while (pos < p_Len)
+  {
+    const size_t count = codec.m_FindQpSpecial(p_Data + pos, p_Len - pos);
+    out.append(p_Data + pos, count);
+    pos += count;
+    if (pos >= p_Len) break;
+
+    const char ch = p_Data[pos];
+    if (ch == '\n')
+    {
+      out.append("\r\n", 2);
+      pos += 1;
+    }
+    else if (ch == '\r')
+    {
+      // trailing lone cr is dropped
+      pos += 1;
+      if (pos >= p_Len) break;
+
+      out.append("\r\n", 2);
+      if (p_Data[pos] == '\n')
+      {
+        pos += 1;
+      }
+    }
+    else if ((pos + 1) >= p_Len)
+    {
+      out.push_back('=');
+      pos += 1;
+    }
+    else if (p_Data[pos + 1] == '\n')
+    {
+      pos += 2;
+    }
+    else if (p_Data[pos + 1] == '\r')
+    {
+      if ((pos + 2) >= p_Len) break;
+
+      pos += (p_Data[pos + 2] == '\n') ? 3 : 2;
+    }
+    else if ((pos + 2) >= p_Len)
+    {
+      out.push_back('=');
+      pos += 1;
+    }
+    else
+    {
+      out.push_back(static_cast<char>((HexValue(p_Data[pos + 1]) << 4) | HexValue(p_Data[pos + 2])));
+      pos += 3;
+    }
+  }
+
+  return out;
+}
+
+std::string MimeCodec::GetSimdName()
+{
+  return GetCodec().m_Name;
+}
@@ -0,0 +1,22 @@
+// mimecodec.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <string>
+
+// Base64 and quoted-printable transfer encoding codecs, producing the same output as
+// the libetpan mime parser / writer. Uses SSSE3 / AVX2 when supported by the cpu
+// (determined at run-time), and falls back to scalar implementation otherwise.
+class MimeCodec
+{
+public:
+  static std::string Base64Decode(const char* p_Data, size_t p_Len);
+  static std::string Base64Encode(const char* p_Data, size_t p_Len);
+  static std::string QuotedPrintableDecode(const char* p_Data, size_t p_Len);
+  static std::string GetSimdName();
+};
@@ -44,10 +44,9 @@ bool OfflineQueue::ChangePass(const bool p_CacheEncrypt,
 {
   if (!p_CacheEncrypt) return true;
 
-  // @todo: implement password change for offline queue
-  (void)p_OldPass;
-  (void)p_NewPass;
-  return true;
+  return CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, GetDraftQueueDir()) &&
+         CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, GetOutboxQueueDir()) &&
+         CacheUtil::ChangePassCacheDir(p_OldPass, p_NewPass, GetComposeQueueDir());
 }
 
 void OfflineQueue::PushDraftMessage(const std::string& p_Str)
@@ -0,0 +1,178 @@
+// partcache.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "partcache.h"
+
+#include <cerrno>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <linux/fs.h>
+#endif
+
+#include "crypto.h"
+#include "loghelp.h"
+#include "util.h"
+
+std::mutex PartCache::m_Mutex;
+std::map<std::pair<std::string, uint32_t>, std::map<ssize_t, std::string>> PartCache::m_Paths;
+
+std::string PartCache::GetDir()
+{
+  return Util::GetTempDir() + std::string("parts/");
+}
+
+bool PartCache::Lookup(const std::string& p_Folder, uint32_t p_Uid, std::map<ssize_t, std::string>& p_Paths)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Paths.find(std::make_pair(p_Folder, p_Uid));
+  if (it == m_Paths.end()) return false;
+
+  for (const auto& path : it->second)
+  {
+    if (!Util::Exists(path.second))
+    {
+      LOG_DEBUG("cached part %s missing", path.second.c_str());
+      m_Paths.erase(it);
+      return false;
+    }
+  }
+
+  p_Paths = it->second;
+  return true;
+}
+
+void PartCache::Store(const std::string& p_Folder, uint32_t p_Uid, const std::map<ssize_t, std::string>& p_PartDatas,
+                      std::map<ssize_t, std::string>& p_Paths)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  p_Paths.clear();
+  for (const auto& partData : p_PartDatas)
+  {
+    const std::string& path = StoreData(partData.second);
+    if (path.empty()) continue;
+
+    p_Paths[partData.first] = path;
+  }
+
+  m_Paths[std::make_pair(p_Folder, p_Uid)] = p_Paths;
+}
+
+void PartCache::ClearFolder(const std::string& p_Folder)
+{
+  // drop index entries only, as part files are content-addressed and may be shared
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Paths.lower_bound(std::make_pair(p_Folder, (uint32_t)0));
+  while ((it != m_Paths.end()) && (it->first.first == p_Folder))
+  {
+    it = m_Paths.erase(it);
+  }
+}
+
+bool PartCache::LinkFile(const std::string& p_SrcPath, const std::string& p_DstPath)
+{
+  Util::MkDir(Util::DirName(p_DstPath));
+  unlink(p_DstPath.c_str());
+  if (link(p_SrcPath.c_str(), p_DstPath.c_str()) == 0) return true;
+
+  LOG_DEBUG("link %s failed (%d), fallback to clone", p_DstPath.c_str(), errno);
+  return CloneFile(p_SrcPath, p_DstPath);
+}
+
+bool PartCache::CloneFile(const std::string& p_SrcPath, const std::string& p_DstPath)
+{
+  Util::MkDir(Util::DirName(p_DstPath));
+
+#if defined(__APPLE__)
+  unlink(p_DstPath.c_str());
+  if (clonefile(p_SrcPath.c_str(), p_DstPath.c_str(), 0) == 0)
+  {
+    // clone inherits the read-only mode of the cached part
+    chmod(p_DstPath.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    return true;
+  }
+#elif defined(__linux__) && defined(FICLONE)
+  int srcFd = open(p_SrcPath.c_str(), O_RDONLY);
+  if (srcFd != -1)
+  {
+    int dstFd = open(p_DstPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dstFd != -1)
+    {
+      const bool cloned = (ioctl(dstFd, FICLONE, srcFd) == 0);
+      close(dstFd);
+      close(srcFd);
+      if (cloned) return true;
+    }
+    else
+    {
+      close(srcFd);
+    }
+  }
+#endif
+
+  return CopyFile(p_SrcPath, p_DstPath);
+}
+
+std::string PartCache::StoreData(const std::string& p_Data)
+{
+  // @note: caller must hold m_Mutex
+  const std::string path = GetDir() + Crypto::SHA256(p_Data);
+  struct stat sb;
+  if (stat(path.c_str(), &sb) == 0)
+  {
+    if (sb.st_size == (off_t)p_Data.size()) return path;
+
+    LOG_WARNING("replace incomplete part %s", path.c_str());
+    unlink(path.c_str());
+  }
+
+  const std::string tmpPath = path + ".tmp";
+  Util::MkDir(GetDir());
+  unlink(tmpPath.c_str());
+  std::ofstream tmpFile(tmpPath, std::ios::binary);
+  tmpFile.write(p_Data.data(), p_Data.size());
+  tmpFile.close();
+  if (!tmpFile)
+  {
+    LOG_WARNING("failed to write part %s", tmpPath.c_str());
+    unlink(tmpPath.c_str());
+    return "";
+  }
+
+  // cached parts are shared by hard links, protect them from being modified through one
+  chmod(tmpPath.c_str(), S_IRUSR);
+  if (rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    LOG_WARNING("failed to store part %s (%d)", path.c_str(), errno);
+    unlink(tmpPath.c_str());
+    return "";
+  }
+
+  return path;
+}
+
+bool PartCache::CopyFile(const std::string& p_SrcPath, const std::string& p_DstPath)
+{
+  std::ifstream srcFile(p_SrcPath, std::ios::binary);
+  std::ofstream dstFile(p_DstPath, std::ios::binary);
+  if (!srcFile.is_open() || !dstFile.is_open()) return false;
+
+  if (srcFile.peek() != std::ifstream::traits_type::eof())
+  {
+    dstFile << srcFile.rdbuf();
+  }
+
+  return dstFile.good();
+}
@@ -0,0 +1,41 @@
+// partcache.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <sys/types.h>
+
+// Session-scoped cache of decoded message parts. Part files are stored once under the
+// temp dir, named by SHA-256 of their content, and indexed by folder / uid so that
+// reopening a part does not require re-parsing the message. Consumers get the cached
+// files by hard link, reflink or (as last resort) copy, rather than re-writing them.
+class PartCache
+{
+public:
+  static std::string GetDir();
+  static bool Lookup(const std::string& p_Folder, uint32_t p_Uid, std::map<ssize_t, std::string>& p_Paths);
+  static void Store(const std::string& p_Folder, uint32_t p_Uid, const std::map<ssize_t, std::string>& p_PartDatas,
+                    std::map<ssize_t, std::string>& p_Paths);
+  static void ClearFolder(const std::string& p_Folder);
+
+  static bool LinkFile(const std::string& p_SrcPath, const std::string& p_DstPath);
+  static bool CloneFile(const std::string& p_SrcPath, const std::string& p_DstPath);
+
+private:
+  static std::string StoreData(const std::string& p_Data);
+  static bool CopyFile(const std::string& p_SrcPath, const std::string& p_DstPath);
+
+private:
+  static std::mutex m_Mutex;
+  static std::map<std::pair<std::string, uint32_t>, std::map<ssize_t, std::string>> m_Paths;
+};
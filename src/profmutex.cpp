@@ -0,0 +1,207 @@
+// profmutex.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "profmutex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+#include "loghelp.h"
+#include "util.h"
+
+std::atomic<bool> ProfMutex::m_Enabled{false};
+
+namespace
+{
+  struct Contention
+  {
+    uint64_t m_Count = 0;
+    uint64_t m_WaitUs = 0;
+    uint64_t m_MaxWaitUs = 0;
+  };
+
+  // @note: intentionally leaked, as profiled mutexes may be locked during static destruction
+  std::mutex& GetContentionMutex()
+  {
+    static std::mutex* contentionMutex = new std::mutex();
+    return *contentionMutex;
+  }
+
+  std::map<std::pair<const char*, void*>, Contention>& GetContentions()
+  {
+    static std::map<std::pair<const char*, void*>, Contention>* contentions =
+      new std::map<std::pair<const char*, void*>, Contention>();
+    return *contentions;
+  }
+
+  uint64_t ToUs(const std::chrono::steady_clock::duration& p_Duration)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(p_Duration).count();
+  }
+
+  static const size_t s_MaxReportSites = 10;
+}
+
+ProfMutex::ProfMutex(const char* p_Name)
+  : m_Name(p_Name)
+{
+}
+
+// @note: kept out-of-line so the return address identifies the function taking the lock
+__attribute__((noinline)) void ProfMutex::lock()
+{
+  if (!m_Enabled.load(std::memory_order_relaxed))
+  {
+    m_Mutex.lock();
+    m_Profiled = false;
+    return;
+  }
+
+  if (!m_Mutex.try_lock())
+  {
+    const std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+    m_Mutex.lock();
+    const uint64_t waitUs = ToUs(std::chrono::steady_clock::now() - waitStart);
+    GetWaitHistogram()->Record(waitUs);
+    AddContention(m_Name, __builtin_return_address(0), waitUs);
+  }
+  else
+  {
+    GetWaitHistogram()->Record(0);
+  }
+
+  OnLocked();
+}
+
+void ProfMutex::unlock()
+{
+  if (m_Profiled)
+  {
+    m_Profiled = false;
+    GetHoldHistogram()->Record(ToUs(std::chrono::steady_clock::now() - m_LockedAt));
+  }
+
+  m_Mutex.unlock();
+}
+
+bool ProfMutex::try_lock()
+{
+  if (!m_Mutex.try_lock()) return false;
+
+  if (m_Enabled.load(std::memory_order_relaxed))
+  {
+    OnLocked();
+  }
+  else
+  {
+    m_Profiled = false;
+  }
+
+  return true;
+}
+
+void ProfMutex::SetEnabled(bool p_Enabled)
+{
+  m_Enabled.store(p_Enabled, std::memory_order_relaxed);
+}
+
+bool ProfMutex::GetEnabled()
+{
+  return m_Enabled.load(std::memory_order_relaxed);
+}
+
+std::vector<std::string> ProfMutex::GetReport()
+{
+  std::vector<std::pair<std::pair<const char*, void*>, Contention>> contentions;
+  {
+    std::lock_guard<std::mutex> lock(GetContentionMutex());
+    contentions.assign(GetContentions().begin(), GetContentions().end());
+  }
+
+  std::sort(contentions.begin(), contentions.end(),
+            [](const std::pair<std::pair<const char*, void*>, Contention>& p_Lhs,
+               const std::pair<std::pair<const char*, void*>, Contention>& p_Rhs)
+  {
+    return p_Lhs.second.m_WaitUs > p_Rhs.second.m_WaitUs;
+  });
+
+  std::vector<std::string> lines;
+  if (contentions.empty()) return lines;
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%-16s %8s %9s %9s  %s", "contended lock", "count", "wait",
+           "max", "call site");
+  lines.push_back(buf);
+  for (size_t i = 0; i < std::min(contentions.size(), s_MaxReportSites); ++i)
+  {
+    const Contention& contention = contentions.at(i).second;
+    std::string site = Util::GetSymbolName(contentions.at(i).first.second);
+    if (site.empty())
+    {
+      snprintf(buf, sizeof(buf), "%p", contentions.at(i).first.second);
+      site = buf;
+    }
+
+    snprintf(buf, sizeof(buf), "%-16s %8llu %9s %9s  %s", contentions.at(i).first.first,
+             (unsigned long long)contention.m_Count,
+             Metrics::FormatDuration(contention.m_WaitUs).c_str(),
+             Metrics::FormatDuration(contention.m_MaxWaitUs).c_str(), site.c_str());
+    lines.push_back(buf);
+  }
+
+  return lines;
+}
+
+void ProfMutex::LogReport()
+{
+  const std::vector<std::string> lines = GetReport();
+  for (const auto& line : lines)
+  {
+    LOG_INFO("lockprof %s", line.c_str());
+  }
+}
+
+void ProfMutex::OnLocked()
+{
+  m_Profiled = true;
+  m_LockedAt = std::chrono::steady_clock::now();
+}
+
+Metrics::Histogram* ProfMutex::GetWaitHistogram()
+{
+  // @note: resolved on first use, as some profiled mutexes are constructed before main()
+  Metrics::Histogram* histogram = m_WaitHistogram.load(std::memory_order_relaxed);
+  if (histogram == nullptr)
+  {
+    histogram = Metrics::GetHistogram(std::string("lock.") + m_Name + ".wait");
+    m_WaitHistogram.store(histogram, std::memory_order_relaxed);
+  }
+
+  return histogram;
+}
+
+Metrics::Histogram* ProfMutex::GetHoldHistogram()
+{
+  Metrics::Histogram* histogram = m_HoldHistogram.load(std::memory_order_relaxed);
+  if (histogram == nullptr)
+  {
+    histogram = Metrics::GetHistogram(std::string("lock.") + m_Name + ".hold");
+    m_HoldHistogram.store(histogram, std::memory_order_relaxed);
+  }
+
+  return histogram;
+}
+
+void ProfMutex::AddContention(const char* p_Name, void* p_Site, uint64_t p_WaitUs)
+{
+  std::lock_guard<std::mutex> lock(GetContentionMutex());
+  Contention& contention = GetContentions()[std::make_pair(p_Name, p_Site)];
+  ++contention.m_Count;
+  contention.m_WaitUs += p_WaitUs;
+  contention.m_MaxWaitUs = std::max(contention.m_MaxWaitUs, p_WaitUs);
+}
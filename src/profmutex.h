@@ -0,0 +1,53 @@
+// profmutex.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+// Drop-in replacement for std::mutex (usable with std::lock_guard, std::unique_lock and
+// std::condition_variable_any) which, when lock profiling is enabled, records wait and
+// hold time histograms (lock.<name>.wait / lock.<name>.hold) and the contended call sites.
+// When disabled it adds a single relaxed load per lock / unlock.
+class ProfMutex
+{
+public:
+  explicit ProfMutex(const char* p_Name);
+
+  void lock();
+  void unlock();
+  bool try_lock();
+
+  static void SetEnabled(bool p_Enabled);
+  static bool GetEnabled();
+  static std::vector<std::string> GetReport();
+  static void LogReport();
+
+private:
+  void OnLocked();
+  Metrics::Histogram* GetWaitHistogram();
+  Metrics::Histogram* GetHoldHistogram();
+  static void AddContention(const char* p_Name, void* p_Site, uint64_t p_WaitUs);
+
+private:
+  std::mutex m_Mutex;
+  const char* m_Name = nullptr;
+  std::atomic<Metrics::Histogram*> m_WaitHistogram{nullptr};
+  std::atomic<Metrics::Histogram*> m_HoldHistogram{nullptr};
+
+  // only accessed by the thread holding m_Mutex
+  bool m_Profiled = false;
+  std::chrono::steady_clock::time_point m_LockedAt;
+
+  static std::atomic<bool> m_Enabled;
+};
@@ -8,10 +8,14 @@
 #include "searchengine.h"
 
 #include "loghelp.h"
+#include "memorybudget.h"
 
 SearchEngine::SearchEngine(const std::string& p_DbPath)
   : m_DbPath(p_DbPath)
 {
+  // @note: xapian's own flush threshold env is set by MemoryBudget::Init()
+  m_FlushThreshold = MemoryBudget::GetXapianFlushThreshold();
+
   m_WritableDatabase.reset(new Xapian::WritableDatabase(m_DbPath, Xapian::DB_CREATE_OR_OPEN));
   m_Database.reset(new Xapian::Database(m_DbPath, Xapian::DB_CREATE_OR_OPEN));
 }
@@ -45,25 +49,41 @@ void SearchEngine::Index(const std::string& p_DocId, const int64_t p_Time, const
   doc.add_boolean_term(p_DocId);
   doc.add_value(m_DateSlot, Xapian::sortable_serialise((double)p_Time));
 
-  std::lock_guard<std::mutex> writableDatabaseLock(m_WritableDatabaseMutex);
+  std::lock_guard<ProfMutex> writableDatabaseLock(m_WritableDatabaseMutex);
   m_WritableDatabase->replace_document(p_DocId, doc);
+
+  // rough estimate of uncommitted data, xapian flushes by itself at the threshold
+  ++m_PendingCount;
+  m_PendingSize += p_Body.size() + p_Subject.size() + p_From.size() + p_To.size() + p_Folder.size();
+  if ((m_FlushThreshold > 0) && (m_PendingCount >= m_FlushThreshold))
+  {
+    m_PendingCount = 0;
+    m_PendingSize = 0;
+  }
+
+  MemoryBudget::SetUsage("search_pending", m_PendingSize);
 }
 
 void SearchEngine::Remove(const std::string& p_DocId)
 {
-  std::lock_guard<std::mutex> writableDatabaseLock(m_WritableDatabaseMutex);
+  std::lock_guard<ProfMutex> writableDatabaseLock(m_WritableDatabaseMutex);
   m_WritableDatabase->delete_document(p_DocId);
 }
 
 void SearchEngine::Commit()
 {
-  std::lock_guard<std::mutex> writableDatabaseLock(m_WritableDatabaseMutex);
+  LOG_DURATION();
+  std::lock_guard<ProfMutex> writableDatabaseLock(m_WritableDatabaseMutex);
   m_WritableDatabase->commit();
+  m_PendingCount = 0;
+  m_PendingSize = 0;
+  MemoryBudget::SetUsage("search_pending", m_PendingSize);
 }
 
 std::vector<std::string> SearchEngine::Search(const std::string& p_QueryStr, const unsigned p_Offset,
                                               const unsigned p_Max, bool& p_HasMore)
 {
+  LOG_DURATION();
   std::vector<std::string> docIds;
 
   try
@@ -91,7 +111,7 @@ std::vector<std::string> SearchEngine::Search(const std::string& p_QueryStr, con
 
     Xapian::Query query = queryParser.parse_query(p_QueryStr, flags);
 
-    std::lock_guard<std::mutex> DatabaseLock(m_DatabaseMutex);
+    std::lock_guard<ProfMutex> DatabaseLock(m_DatabaseMutex);
     m_Database->reopen();
     Xapian::Enquire enquire(*m_Database);
     enquire.set_query(query);
@@ -123,7 +143,7 @@ std::vector<std::string> SearchEngine::Search(const std::string& p_QueryStr, con
 
 std::vector<std::string> SearchEngine::List()
 {
-  std::lock_guard<std::mutex> DatabaseLock(m_DatabaseMutex);
+  std::lock_guard<ProfMutex> DatabaseLock(m_DatabaseMutex);
   m_Database->reopen();
   std::vector<std::string> docIds;
   for (Xapian::PostingIterator it = m_Database->postlist_begin("");
@@ -138,7 +158,7 @@ std::vector<std::string> SearchEngine::List()
 
 bool SearchEngine::Exists(const std::string& p_DocId)
 {
-  std::lock_guard<std::mutex> DatabaseLock(m_DatabaseMutex);
+  std::lock_guard<ProfMutex> DatabaseLock(m_DatabaseMutex);
   m_Database->reopen();
   return (m_Database->postlist_begin(p_DocId) != m_Database->postlist_end(p_DocId));
 }
@@ -147,3 +167,20 @@ std::string SearchEngine::GetXapianVersion()
 {
   return std::string(XAPIAN_VERSION);
 }
+
+bool SearchEngine::Compact(const std::string& p_SrcDbPath, const std::string& p_DstDbPath)
+{
+  try
+  {
+    Xapian::Database database(p_SrcDbPath);
+    database.compact(p_DstDbPath, Xapian::DBCOMPACT_NO_RENUMBER);
+  }
+  catch (const Xapian::Error& error)
+  {
+    const std::string& msg = error.get_msg();
+    LOG_WARNING("compact error \"%s\"", msg.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -14,6 +14,8 @@
 
 #include <xapian.h>
 
+#include "profmutex.h"
+
 class SearchEngine
 {
 public:
@@ -32,12 +34,16 @@ public:
   bool Exists(const std::string& p_DocId);
 
   static std::string GetXapianVersion();
+  static bool Compact(const std::string& p_SrcDbPath, const std::string& p_DstDbPath);
 
 private:
   std::string m_DbPath;
   std::unique_ptr<Xapian::Database> m_Database;
   std::unique_ptr<Xapian::WritableDatabase> m_WritableDatabase;
-  std::mutex m_DatabaseMutex;
-  std::mutex m_WritableDatabaseMutex;
+  ProfMutex m_DatabaseMutex{"search"};
+  ProfMutex m_WritableDatabaseMutex{"search_writable"};
+  uint32_t m_FlushThreshold = 0;
+  uint32_t m_PendingCount = 0;
+  int64_t m_PendingSize = 0;
   const Xapian::valueno m_DateSlot = 1;
 };
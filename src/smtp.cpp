@@ -8,11 +8,15 @@
 #include "smtp.h"
 
 #include <cstring>
+#include <list>
 
+#include <fcntl.h>
 #include <netdb.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "libetpan_help.h"
 #include <libetpan/mailimf.h>
@@ -23,6 +27,7 @@
 #include "auth.h"
 #include "log.h"
 #include "loghelp.h"
+#include "mimecodec.h"
 #include "sasl.h"
 
 Smtp::Smtp(const std::string& p_User, const std::string& p_Pass, const std::string& p_Host,
@@ -65,6 +70,8 @@ SmtpStatus Smtp::Send(const std::string& p_Subject, const std::string& p_Message
   std::vector<Contact> hdrbcc;
   const std::string& header = GetHeader(p_Subject, p_To, p_Cc, hdrbcc, p_RefMsgId, p_From);
   const std::string& body = GetBody(p_Message, p_HtmlMessage, p_AttachmentPaths, p_Flowed);
+  if (body.empty()) return SmtpStatusFileFailed;
+
   const std::string& data = header + body;
   p_ResultMessage = data;
   std::vector<Contact> recipients;
@@ -395,6 +402,7 @@ std::string Smtp::GetBody(const std::string& p_Message, const std::string& p_Htm
   }
 
   struct mailmime* mainMultipart = nullptr;
+  std::list<std::string> encodedFileDatas; // referenced by mime parts until written
   const bool hasAttachment = !p_AttachmentPaths.empty();
   if (hasAttachment)
   {
@@ -408,7 +416,15 @@ std::string Smtp::GetBody(const std::string& p_Message, const std::string& p_Htm
       if (Util::Exists(path))
       {
         const std::string fileMimeType = GetMimeType(path);
-        struct mailmime* fileBodyPart = GetMimeFilePart(path, fileMimeType);
+        encodedFileDatas.push_back(std::string());
+        struct mailmime* fileBodyPart = GetMimeFilePart(path, fileMimeType, encodedFileDatas.back());
+        if (fileBodyPart == NULL)
+        {
+          LOG_WARNING("attachment path \"%s\" could not be read", path.c_str());
+          mailmime_free(mainMultipart);
+          return "";
+        }
+
         mailmime_smart_add_part(mainMultipart, fileBodyPart);
         LOG_DEBUG("attachment path \"%s\" added", path.c_str());
       }
@@ -474,6 +490,10 @@ std::string Smtp::GetErrorMessage(SmtpStatus p_SmtpStatus)
       msg = "libetpan missing sasl";
       break;
 
+    case SmtpStatusFileFailed:
+      msg = "attachment read error";
+      break;
+
     default:
       break;
   }
@@ -511,8 +531,35 @@ mailmime* Smtp::GetMimeTextPart(const char* p_MimeType, const std::string& p_Mes
   return mime;
 }
 
-mailmime* Smtp::GetMimeFilePart(const std::string& p_Path, const std::string& p_MimeType)
+mailmime* Smtp::GetMimeFilePart(const std::string& p_Path, const std::string& p_MimeType,
+                                std::string& p_EncodedData)
 {
+  // encode up-front from a read-only mapping, for libetpan to write the data as-is
+  int fd = open(p_Path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return NULL;
+
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  if (st.st_size > 0)
+  {
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      close(fd);
+      return NULL;
+    }
+
+    p_EncodedData = MimeCodec::Base64Encode(static_cast<const char*>(data), (size_t)st.st_size);
+    munmap(data, (size_t)st.st_size);
+  }
+
+  close(fd);
+
   const std::string& filename = Util::BaseName(p_Path);
   char* dispositionname = strdup(filename.c_str());
   int encodingtype = MAILMIME_MECHANISM_BASE64;
@@ -524,7 +571,21 @@ mailmime* Smtp::GetMimeFilePart(const std::string& p_Path, const std::string& p_
   struct mailmime_fields* mimefields =
     mailmime_fields_new_with_data(encoding, NULL, NULL, disposition, NULL);
   struct mailmime* mime = GetMimePart(content, mimefields, 1);
-  mailmime_set_body_file(mime, strdup(p_Path.c_str()));
+
+  // @note: empty files are written by libetpan, as pre-encoded empty data gets an extra line break
+  if (p_EncodedData.empty())
+  {
+    mailmime_set_body_file(mime, strdup(p_Path.c_str()));
+    return mime;
+  }
+
+  mime->mm_data.mm_single = mailmime_data_new(MAILMIME_DATA_TEXT, encodingtype, 1 /* dt_encoded */,
+                                              p_EncodedData.c_str(), p_EncodedData.size(), NULL);
+  if (mime->mm_data.mm_single == NULL)
+  {
+    mailmime_free(mime);
+    return NULL;
+  }
 
   return mime;
 }
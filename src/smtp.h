@@ -25,6 +25,7 @@ enum SmtpStatus
   SmtpStatusInitFailed = 5,
   SmtpStatusMessageFailed = 6,
   SmtpStatusImplFailed = 7,
+  SmtpStatusFileFailed = 8,
 };
 
 class Smtp
@@ -57,7 +58,8 @@ private:
   SmtpStatus SendMessage(const std::string& p_Data, const std::vector<Contact>& p_Recipients);
   struct mailmime* GetMimeTextPart(const char* p_MimeType, const std::string& p_Message, bool p_Flowed);
   struct mailmime* GetMimeFilePart(const std::string& p_Path,
-                                   const std::string& p_MimeType);
+                                   const std::string& p_MimeType,
+                                   std::string& p_EncodedData);
   std::string GetMimeType(const std::string& p_Path);
   struct mailmime* GetMimePart(struct mailmime_content* p_Content,
                                struct mailmime_fields* p_MimeFields,
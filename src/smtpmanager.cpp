@@ -190,8 +190,8 @@ SmtpManager::Result SmtpManager::PerformAction(const SmtpManager::Action& p_Acti
   {
     const std::string& header = smtp.GetHeader(p_Action.m_Subject, to, cc, bcc, ref, from);
     const std::string& body = smtp.GetBody(p_Action.m_Body, p_Action.m_HtmlBody, att, false);
-    result.m_Message = header + body;
-    result.m_SmtpStatus = !result.m_Message.empty() ? SmtpStatusOk : SmtpStatusFailed;
+    result.m_Message = !body.empty() ? (header + body) : "";
+    result.m_SmtpStatus = !body.empty() ? SmtpStatusOk : SmtpStatusFileFailed;
   }
   else if (p_Action.m_IsSendCreatedMessage)
   {
@@ -1,6 +1,6 @@
 // smtpmanager.h
 //
-// Copyright (c) 2019-2021 Kristofer Berggren
+// Copyright (c) 2019-2024 Kristofer Berggren
 // All rights reserved.
 //
 // nmail is distributed under the MIT license, see LICENSE for details.
@@ -20,6 +20,7 @@
 
 #include "contact.h"
 #include "log.h"
+#include "profmutex.h"
 #include "smtp.h"
 #include "status.h"
 
@@ -90,7 +91,7 @@ private:
   std::mutex m_ExitedCondMutex;
 
   std::deque<Action> m_Actions;
-  std::mutex m_QueueMutex;
+  ProfMutex m_QueueMutex{"smtp_queue"};
 
   int m_Pipe[2] = { -1, -1 };
 };
@@ -0,0 +1,115 @@
+// startupprofile.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "startupprofile.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "loghelp.h"
+#include "metrics.h"
+
+std::atomic<bool> StartupProfile::m_Enabled{false};
+std::mutex StartupProfile::m_Mutex;
+// @note: static initialization time is used as approximation of process start
+std::chrono::steady_clock::time_point StartupProfile::m_ProcessStart = std::chrono::steady_clock::now();
+std::thread::id StartupProfile::m_MainThreadId = std::this_thread::get_id();
+std::vector<StartupProfile::Phase> StartupProfile::m_Phases;
+
+namespace
+{
+  uint64_t ToUs(const std::chrono::steady_clock::duration& p_Duration)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(p_Duration).count();
+  }
+}
+
+void StartupProfile::SetEnabled(bool p_Enabled)
+{
+  m_Enabled.store(p_Enabled, std::memory_order_relaxed);
+}
+
+bool StartupProfile::GetEnabled()
+{
+  return m_Enabled.load(std::memory_order_relaxed);
+}
+
+void StartupProfile::AddPhase(const char* p_Name, const std::chrono::steady_clock::time_point& p_Begin,
+                              const std::chrono::steady_clock::time_point& p_End)
+{
+  Phase phase;
+  phase.m_Name = p_Name;
+  phase.m_BeginUs = ToUs(p_Begin - m_ProcessStart);
+  phase.m_DurationUs = ToUs(p_End - p_Begin);
+  phase.m_IsMainThread = (std::this_thread::get_id() == m_MainThreadId);
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Phases.push_back(phase);
+}
+
+void StartupProfile::Mark(const char* p_Name)
+{
+  if (!GetEnabled()) return;
+
+  Phase phase;
+  phase.m_Name = p_Name;
+  phase.m_BeginUs = ToUs(std::chrono::steady_clock::now() - m_ProcessStart);
+  phase.m_IsMilestone = true;
+  phase.m_IsMainThread = (std::this_thread::get_id() == m_MainThreadId);
+
+  // only first occurrence of a milestone is of interest
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const auto& existingPhase : m_Phases)
+  {
+    if (existingPhase.m_IsMilestone && (existingPhase.m_Name == phase.m_Name)) return;
+  }
+
+  m_Phases.push_back(phase);
+}
+
+std::vector<std::string> StartupProfile::GetReport()
+{
+  std::vector<Phase> phases;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    phases = m_Phases;
+  }
+
+  std::stable_sort(phases.begin(), phases.end(), [](const Phase& p_Lhs, const Phase& p_Rhs)
+  {
+    return p_Lhs.m_BeginUs < p_Rhs.m_BeginUs;
+  });
+
+  std::vector<std::string> lines;
+  if (phases.empty()) return lines;
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%-32s %9s %9s %9s  %s", "startup phase", "start", "duration", "end",
+           "thread");
+  lines.push_back(buf);
+  for (const auto& phase : phases)
+  {
+    const std::string name = phase.m_IsMilestone ? ("* " + phase.m_Name) : phase.m_Name;
+    snprintf(buf, sizeof(buf), "%-32s %9s %9s %9s  %s", name.c_str(),
+             Metrics::FormatDuration(phase.m_BeginUs).c_str(),
+             phase.m_IsMilestone ? "" : Metrics::FormatDuration(phase.m_DurationUs).c_str(),
+             Metrics::FormatDuration(phase.m_BeginUs + phase.m_DurationUs).c_str(),
+             phase.m_IsMainThread ? "main" : "async");
+    lines.push_back(buf);
+  }
+
+  return lines;
+}
+
+void StartupProfile::LogReport()
+{
+  const std::vector<std::string> lines = GetReport();
+  for (const auto& line : lines)
+  {
+    LOG_INFO("startup %s", line.c_str());
+  }
+}
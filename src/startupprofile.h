@@ -0,0 +1,79 @@
+// startupprofile.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STARTUP_PHASE(NAME) StartupPhase startupPhase(NAME)
+
+// Records the start offset (from process start) and duration of each startup phase, and the
+// first occurrence of startup milestones (e.g. first frame drawn), when enabled by the
+// --startup-profile option. When disabled it adds a single relaxed load per phase / milestone.
+class StartupProfile
+{
+public:
+  static void SetEnabled(bool p_Enabled);
+  static bool GetEnabled();
+  static void AddPhase(const char* p_Name, const std::chrono::steady_clock::time_point& p_Begin,
+                       const std::chrono::steady_clock::time_point& p_End);
+  static void Mark(const char* p_Name);
+  static std::vector<std::string> GetReport();
+  static void LogReport();
+
+private:
+  struct Phase
+  {
+    std::string m_Name;
+    uint64_t m_BeginUs = 0;
+    uint64_t m_DurationUs = 0;
+    bool m_IsMilestone = false;
+    bool m_IsMainThread = false;
+  };
+
+  static std::atomic<bool> m_Enabled;
+  static std::mutex m_Mutex;
+  static std::chrono::steady_clock::time_point m_ProcessStart;
+  static std::thread::id m_MainThreadId;
+  static std::vector<Phase> m_Phases;
+};
+
+class StartupPhase
+{
+public:
+  explicit StartupPhase(const char* p_Name)
+  {
+    if (StartupProfile::GetEnabled())
+    {
+      m_Name = p_Name;
+      m_Begin = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~StartupPhase()
+  {
+    End();
+  }
+
+  void End()
+  {
+    if (m_Name != nullptr)
+    {
+      StartupProfile::AddPhase(m_Name, m_Begin, std::chrono::steady_clock::now());
+      m_Name = nullptr;
+    }
+  }
+
+private:
+  const char* m_Name = nullptr;
+  std::chrono::steady_clock::time_point m_Begin;
+};
@@ -10,17 +10,23 @@
 #include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <cwchar>
 #include <sstream>
 
 #include "addressbook.h"
 #include "flag.h"
 #include "loghelp.h"
 #include "maphelp.h"
+#include "memorybudget.h"
+#include "metrics.h"
 #include "offlinequeue.h"
+#include "partcache.h"
 #include "sethelp.h"
 #include "sleepdetect.h"
+#include "startupprofile.h"
 #include "status.h"
 #include "version.h"
+#include "wordwrap.h"
 
 bool Ui::s_Running = false;
 
@@ -141,6 +147,7 @@ void Ui::Init()
     { "key_select_all", "a" },
     { "key_search_show_folder", "\\" },
     { "key_spell", "KEY_CTRLS" },
+    { "key_show_stats", "y" },
     { "colors_enabled", "1" },
     { "attachment_indicator", " \xF0\x9F\x93\x8E" },
     { "bottom_reply", "0" },
@@ -252,6 +259,7 @@ void Ui::Init()
   m_KeySearchCurrentSubject = Util::GetKeyCode(m_Config.Get("key_search_current_subject"));
   m_KeySearchCurrentName = Util::GetKeyCode(m_Config.Get("key_search_current_name"));
   m_KeySpell = Util::GetKeyCode(m_Config.Get("key_spell"));
+  m_KeyShowStats = Util::GetKeyCode(m_Config.Get("key_show_stats"));
 
   m_ShowProgress = Util::ToInteger(m_Config.Get("show_progress"));
   m_NewMsgBell = m_Config.Get("new_msg_bell") == "1";
@@ -445,6 +453,7 @@ void Ui::CleanupWindows()
 
 void Ui::DrawAll()
 {
+  LOG_DURATION();
   switch (m_State)
   {
     case StateViewMessageList:
@@ -510,6 +519,13 @@ void Ui::DrawAll()
       DrawDialog();
       break;
 
+    case StateViewStats:
+      DrawTop();
+      DrawStats();
+      DrawHelp();
+      DrawDialog();
+      break;
+
     default:
       werase(m_MainWin);
       mvwprintw(m_MainWin, 0, 0, "Unimplemented state %d", m_State);
@@ -598,7 +614,7 @@ void Ui::DrawDefaultDialog()
   werase(m_DialogWin);
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     std::chrono::time_point<std::chrono::system_clock> nowTime =
       std::chrono::system_clock::now();
     std::chrono::duration<double> elapsed = nowTime - m_DialogMessageTime;
@@ -617,7 +633,7 @@ void Ui::DrawDefaultDialog()
 
 void Ui::SetDialogMessage(const std::string& p_DialogMessage, bool p_Warn /*= false */)
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   m_DialogMessage = p_DialogMessage;
   m_DialogMessageTime = std::chrono::system_clock::now();
   if (!p_DialogMessage.empty())
@@ -749,6 +765,7 @@ void Ui::DrawHelp()
       GetKeyDisplay(m_KeyFindNext), "FindNext",
       GetKeyDisplay(m_KeyToggleFullHeader), "TgFullHdr",
       GetKeyDisplay(m_KeyGotoInbox), "GotoInbox",
+      GetKeyDisplay(m_KeyShowStats), "Stats",
     },
   };
 
@@ -793,6 +810,20 @@ void Ui::DrawHelp()
     },
   };
 
+  static std::vector<std::vector<std::string>> viewStatsHelp =
+  {
+    {
+      GetKeyDisplay(m_KeyBack), "Back",
+      GetKeyDisplay(m_KeyPrevMsg), "ScrollUp",
+      GetKeyDisplay(m_KeyRefresh), "Refresh",
+    },
+    {
+      "", "",
+      GetKeyDisplay(m_KeyNextMsg), "ScrollDn",
+      GetKeyDisplay(m_KeyQuit), "Quit",
+    },
+  };
+
   if (m_HelpEnabled)
   {
     werase(m_HelpWin);
@@ -842,6 +873,10 @@ void Ui::DrawHelp()
         DrawHelpText(viewPartListHelp);
         break;
 
+      case StateViewStats:
+        DrawHelpText(viewStatsHelp);
+        break;
+
       default:
         break;
     }
@@ -898,13 +933,13 @@ void Ui::DrawFolderList()
   bool hasFolders = false;
   if (m_FolderListFilterStr.empty())
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     hasFolders = !m_Folders.empty();
     folders = m_Folders;
   }
   else
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     hasFolders = !m_Folders.empty();
     for (const auto& folder : m_Folders)
     {
@@ -1128,9 +1163,10 @@ void Ui::DrawMessageList()
   std::set<uint32_t> fetchBodyPriUids;
   std::set<uint32_t> fetchBodySecUids;
   std::set<uint32_t> prefetchBodyUids;
+  bool hasAllHeaders = false;
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     std::map<uint32_t, Header>& headers = m_Headers[m_CurrentFolder];
     std::map<uint32_t, uint32_t>& flags = m_Flags[m_CurrentFolder];
     const std::map<std::string, uint32_t>& displayUids = GetDisplayUids(m_CurrentFolder);
@@ -1182,54 +1218,20 @@ void Ui::DrawMessageList()
                                        ((m_MainWinHeight - 1) / 2)),
                               std::max(0, (int)displayUids.size() - (int)m_MainWinHeight));
     int idxMax = idxOffs + std::min(m_MainWinHeight, (int)displayUids.size());
+    hasAllHeaders = (idxMax > idxOffs);
 
     for (int i = idxOffs; i < idxMax; ++i)
     {
       uint32_t uid = std::prev(displayUids.end(), i + 1)->second;
 
       bool isUnread = ((flags.find(uid) != flags.end()) && (!Flag::GetSeen(flags.at(uid))));
-      static const std::wstring wUnreadIndicator = Util::ToWString(m_UnreadIndicator);
-      static const int unreadIndicatorWidth = Util::WStringWidth(wUnreadIndicator);
-      std::string unreadFlag = isUnread ? std::string(m_UnreadIndicator)
-                                        : std::string(unreadIndicatorWidth, ' ');
-
-      std::string shortDate;
-      std::string shortFrom;
-      std::string subject;
-      std::string attachFlag;
-      auto hit = headers.find(uid);
-      if (hit != headers.end())
-      {
-        Header& header = headers.at(uid);
-        shortDate = header.GetDateOrTime(currentDate);
-        subject = header.GetSubject();
-        if (m_CurrentFolder == m_SentFolder)
-        {
-          shortFrom = header.GetShortTo();
-        }
-        else
-        {
-          shortFrom = header.GetShortFrom();
-        }
-
-        if (!m_AttachmentIndicator.empty())
-        {
-          static const std::wstring wIndicator = Util::ToWString(m_AttachmentIndicator);
-          static const int indicatorWidth = Util::WStringWidth(wIndicator);
-          attachFlag = header.GetHasAttachments() ? std::string(m_AttachmentIndicator)
-                                                  : std::string(indicatorWidth, ' ');
-        }
-      }
-
       bool isSelected = (folderSelectedUids.find(uid) != folderSelectedUids.end());
-      std::string selectFlag = (isSelected && !hasAttrsSelected) ? "X" : " ";
-
-      shortDate = Util::TrimPadString(shortDate, 10);
-      shortFrom = Util::ToString(Util::TrimPadWString(Util::ToWString(shortFrom), 20));
-      std::string headerLeft = selectFlag + unreadFlag + attachFlag + "  " + shortDate + "  " + shortFrom + "  ";
-      int subjectWidth = m_ScreenWidth - Util::WStringWidth(Util::ToWString(headerLeft)) - 1;
-      subject = Util::ToString(Util::TrimPadWString(Util::ToWString(subject), subjectWidth));
-      std::string header = headerLeft + subject + " ";
+      auto hit = headers.find(uid);
+      Header* header = (hit != headers.end()) ? &hit->second : nullptr;
+      hasAllHeaders = hasAllHeaders && (header != nullptr);
+      const std::wstring& wheader =
+        GetCachedMessageListRow(m_CurrentFolder, uid, header, isUnread, isSelected && !hasAttrsSelected,
+                                currentDate);
 
       bool isCurrent = (i == m_MessageListCurrentIndex[m_CurrentFolder]);
 
@@ -1243,7 +1245,6 @@ void Ui::DrawMessageList()
         wattron(m_MainWin, isCurrent ? m_AttrsSelectedHighlighted : m_AttrsSelectedItem);
       }
 
-      std::wstring wheader = Util::TrimPadWString(Util::ToWString(header), m_ScreenWidth - 1) + L" ";;
       mvwaddnwstr(m_MainWin, i - idxOffs, 0, wheader.c_str(), std::min((int)wheader.size(), m_ScreenWidth));
 
       if (isSelected)
@@ -1387,6 +1388,11 @@ void Ui::DrawMessageList()
   }
 
   wrefresh(m_MainWin);
+
+  if (hasAllHeaders)
+  {
+    StartupProfile::Mark("first_message_list");
+  }
 }
 
 void Ui::DrawMessageListSearch()
@@ -1397,7 +1403,7 @@ void Ui::DrawMessageListSearch()
   std::map<std::string, std::set<uint32_t>> fetchBodySecUids;
 
   {
-    std::lock_guard<std::mutex> searchLock(m_SearchMutex);
+    std::lock_guard<ProfMutex> searchLock(m_SearchMutex);
     std::vector<Header>& headers = m_MessageListSearchResultHeaders;
     int idxOffs = Util::Bound(0, (int)(m_MessageListCurrentIndex[m_CurrentFolder] - ((m_MainWinHeight - 1) / 2)),
                               std::max(0, (int)headers.size() - (int)m_MainWinHeight));
@@ -1414,7 +1420,7 @@ void Ui::DrawMessageListSearch()
 
       bool isUnread = false;
       {
-        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::lock_guard<ProfMutex> lock(m_Mutex);
 
         std::map<uint32_t, uint32_t>& flags = m_Flags[folder];
         std::set<uint32_t>& requestedFlags = m_RequestedFlags[folder];
@@ -1497,7 +1503,7 @@ void Ui::DrawMessageListSearch()
       std::set<uint32_t>& requestedBodys = m_RequestedBodys[folder];
       if (i == m_MessageListCurrentIndex[m_CurrentFolder])
       {
-        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::lock_guard<ProfMutex> lock(m_Mutex);
 
         if ((bodys.find(uid) == bodys.end()) &&
             (requestedBodys.find(uid) == requestedBodys.end()))
@@ -1523,7 +1529,7 @@ void Ui::DrawMessageListSearch()
       }
       else if (abs(i - m_MessageListCurrentIndex[m_CurrentFolder]) == 1)
       {
-        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::lock_guard<ProfMutex> lock(m_Mutex);
 
         if ((bodys.find(uid) == bodys.end()) &&
             (requestedBodys.find(uid) == requestedBodys.end()))
@@ -1596,7 +1602,7 @@ void Ui::DrawMessage()
   bool markSeen = false;
   bool unseen = false;
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
 
     std::map<uint32_t, Header>& headers = m_Headers[folder];
     std::set<uint32_t>& requestedHeaders = m_RequestedHeaders[folder];
@@ -1694,7 +1700,8 @@ void Ui::DrawMessage()
       const std::string text = headerText + bodyText;
       m_CurrentMessageViewText = text;
       m_CurrentMessageProcessFlowed = m_RespectFormatFlowed && m_Plaintext && body.IsFormatFlowed();
-      std::vector<std::wstring> wlines = GetCachedWordWrapLines(folder, bodyIt->first);
+      const size_t minLines = (size_t)std::max(m_MessageViewLineOffset, 0) + (2 * m_MainWinHeight);
+      const std::vector<std::wstring>& wlines = GetCachedWordWrapLines(folder, bodyIt->first, minLines);
       int countLines = wlines.size();
 
       m_MessageViewLineOffset = Util::Bound(0, m_MessageViewLineOffset,
@@ -1807,14 +1814,7 @@ void Ui::DrawMessage()
 
 void Ui::DrawComposeMessage()
 {
-  const bool processFlowed = false; // only process when viewing message
-  const bool outputFlowed = false; // only generate when sending after compose
-  const bool quoteWrap = false; // only wrap quoted lines when viewing message
-  const int expandTabSize = 0; // disabled
-  m_ComposeMessageLines = Util::WordWrap(m_ComposeMessageStr, m_MaxComposeLineLength,
-                                         processFlowed, outputFlowed, quoteWrap, expandTabSize,
-                                         m_ComposeMessagePos, m_ComposeMessageWrapLine,
-                                         m_ComposeMessageWrapPos);
+  UpdateComposeMessageLines();
 
   std::vector<std::wstring> headerLines;
   if (m_ShowRichHeader)
@@ -1856,7 +1856,7 @@ void Ui::DrawComposeMessage()
 
   werase(m_MainWin);
 
-  std::vector<std::wstring> composeLines;
+  std::vector<std::wstring> composeHeaderLines;
 
   for (int i = 0; i < (int)headerLines.size(); ++i)
   {
@@ -1864,22 +1864,17 @@ void Ui::DrawComposeMessage()
     {
       std::wstring line = headerLines.at(i) +
         m_ComposeHeaderStr.at(i).substr(cursX - m_ScreenWidth + 1);
-      composeLines.push_back(line.substr(0, m_ScreenWidth));
+      composeHeaderLines.push_back(line.substr(0, m_ScreenWidth));
       cursX = m_ScreenWidth - 1;
     }
     else
     {
       std::wstring line = headerLines.at(i) + m_ComposeHeaderStr.at(i);
-      composeLines.push_back(line.substr(0, m_ScreenWidth));
+      composeHeaderLines.push_back(line.substr(0, m_ScreenWidth));
     }
   }
 
-  composeLines.push_back(L"");
-
-  for (auto line = m_ComposeMessageLines.begin(); line != m_ComposeMessageLines.end(); ++line)
-  {
-    composeLines.push_back(*line);
-  }
+  composeHeaderLines.push_back(L"");
 
   if (cursY < m_ComposeMessageOffsetY)
   {
@@ -1891,15 +1886,17 @@ void Ui::DrawComposeMessage()
     m_ComposeMessageOffsetY += (m_MainWinHeight / 2);
   }
 
+  // only visible lines are processed
+  const int headerCount = composeHeaderLines.size();
+  const int lineCount = headerCount + m_ComposeMessageLines.size();
   int messageY = 0;
-  int idx = 0;
-  for (auto line = composeLines.begin(); line != composeLines.end(); ++line, ++idx)
+  for (int idx = m_ComposeMessageOffsetY; idx < lineCount; ++idx)
   {
-    if (idx < m_ComposeMessageOffsetY) continue;
-
     if (messageY > m_MainWinHeight) break;
 
-    const std::string& dispStr = Util::ToString(*line);
+    const std::wstring& line = (idx < headerCount) ? composeHeaderLines.at(idx)
+                                                   : m_ComposeMessageLines.at(idx - headerCount);
+    const std::string& dispStr = Util::ToString(line);
     const bool isQuote = (dispStr.rfind(">", 0) == 0);
 
     if (isQuote)
@@ -1929,7 +1926,7 @@ void Ui::DrawPartList()
 {
   werase(m_MainWin);
 
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   const std::string& folder = m_CurrentFolderUid.first;
   const int uid = m_CurrentFolderUid.second;
   std::map<uint32_t, Body>& bodys = m_Bodys[folder];
@@ -1984,6 +1981,38 @@ void Ui::DrawPartList()
   wrefresh(m_MainWin);
 }
 
+void Ui::DrawStats()
+{
+  werase(m_MainWin);
+
+  std::vector<std::string> lines = Metrics::GetReport();
+  const std::vector<std::string>& lockLines = ProfMutex::GetReport();
+  if (!lockLines.empty())
+  {
+    lines.push_back("");
+    lines.insert(lines.end(), lockLines.begin(), lockLines.end());
+  }
+
+  const std::vector<std::string>& startupLines = StartupProfile::GetReport();
+  if (!startupLines.empty())
+  {
+    lines.push_back("");
+    lines.insert(lines.end(), startupLines.begin(), startupLines.end());
+  }
+
+  const int itemsMax = m_MainWinHeight - 1;
+  m_StatsLineOffset = Util::Bound(0, m_StatsLineOffset, std::max(0, (int)lines.size() - itemsMax));
+  const int idxMax = std::min(m_StatsLineOffset + itemsMax, (int)lines.size());
+  for (int i = m_StatsLineOffset; i < idxMax; ++i)
+  {
+    const std::wstring& wline = Util::ToWString(lines.at(i));
+    mvwaddnwstr(m_MainWin, i - m_StatsLineOffset, 2, wline.c_str(),
+                std::max(0, std::min((int)wline.size(), m_ScreenWidth - 2)));
+  }
+
+  wrefresh(m_MainWin);
+}
+
 void Ui::AsyncUiRequest(char p_UiRequest)
 {
   LOG_IF_NOT_EQUAL(write(m_Pipe[1], &p_UiRequest, 1), 1);
@@ -2018,6 +2047,7 @@ void Ui::PerformUiRequest(char p_UiRequest)
 void Ui::Run()
 {
   DrawAll();
+  StartupProfile::Mark("first_frame");
   int64_t uiIdleTime = 0;
   LOG_INFO("entering ui loop");
   Util::RegisterIgnoredSignalHandlers(); // ignore ctrl-c while ui is running
@@ -2096,6 +2126,10 @@ void Ui::Run()
           ViewPartListKeyHandler(key);
           break;
 
+        case StateViewStats:
+          ViewStatsKeyHandler(key);
+          break;
+
         default:
           break;
       }
@@ -2677,7 +2711,7 @@ void Ui::ViewMessageListKeyHandler(int p_Key)
           usleep(stepSleepMs * 1000);
           totalWaitMs += stepSleepMs;
           {
-            std::lock_guard<std::mutex> lock(m_Mutex);
+            std::lock_guard<ProfMutex> lock(m_Mutex);
             std::map<uint32_t, Header>& headers = m_Headers[m_CurrentFolder];
             std::set<uint32_t>& uids = m_Uids[m_CurrentFolder];
 
@@ -2739,6 +2773,10 @@ void Ui::ViewMessageListKeyHandler(int p_Key)
     UpdateUidFromIndex(true /* p_UserTriggered */);
     SearchMessageBasedOnCurrent(false /* p_Subject */);
   }
+  else if (p_Key == m_KeyShowStats)
+  {
+    SetState(StateViewStats);
+  }
   else if (m_InvalidInputNotify)
   {
     SetDialogMessage("Invalid input (" + Util::ToHexString(p_Key) + ")");
@@ -2896,7 +2934,7 @@ void Ui::ViewMessageKeyHandler(int p_Key)
     if (IsConnected())
     {
       {
-        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::lock_guard<ProfMutex> lock(m_Mutex);
         m_MessageViewToggledSeen = true;
       }
       ToggleSeen();
@@ -2947,6 +2985,10 @@ void Ui::ViewMessageKeyHandler(int p_Key)
     m_MessageViewLineOffset = 0;
     m_MessageFindMatchLine = -1;
   }
+  else if (p_Key == m_KeyShowStats)
+  {
+    SetState(StateViewStats);
+  }
   else if (m_InvalidInputNotify)
   {
     SetDialogMessage("Invalid input (" + Util::ToHexString(p_Key) + ")");
@@ -3078,32 +3120,18 @@ void Ui::ComposeMessageKeyHandler(int p_Key)
     }
     else if (p_Key == m_KeyPrevPage)
     {
-      const bool processFlowed = false; // only process when viewing message
-      const bool outputFlowed = false; // only generate when sending after compose
-      const bool quoteWrap = false; // only wrap quoted lines when viewing message
-      const int expandTabSize = 0; // disabled
       for (int i = 0; i < (m_MainWinHeight / 2); ++i)
       {
         ComposeMessagePrevLine();
-        m_ComposeMessageLines = Util::WordWrap(m_ComposeMessageStr, m_MaxComposeLineLength,
-                                               processFlowed, outputFlowed, quoteWrap, expandTabSize,
-                                               m_ComposeMessagePos, m_ComposeMessageWrapLine,
-                                               m_ComposeMessageWrapPos);
+        UpdateComposeMessageLines();
       }
     }
     else if (p_Key == m_KeyNextPage)
     {
-      const bool processFlowed = false; // only process when viewing message
-      const bool outputFlowed = false; // only generate when sending after compose
-      const bool quoteWrap = false; // only wrap quoted lines when viewing message
-      const int expandTabSize = 0; // disabled
       for (int i = 0; i < (m_MainWinHeight / 2); ++i)
       {
         ComposeMessageNextLine();
-        m_ComposeMessageLines = Util::WordWrap(m_ComposeMessageStr, m_MaxComposeLineLength,
-                                               processFlowed, outputFlowed, quoteWrap, expandTabSize,
-                                               m_ComposeMessagePos, m_ComposeMessageWrapLine,
-                                               m_ComposeMessageWrapPos);
+        UpdateComposeMessageLines();
       }
     }
     else if ((p_Key == KEY_LEFT) && (m_ComposeMessagePos == 0))
@@ -3212,50 +3240,61 @@ void Ui::ViewPartListKeyHandler(int p_Key)
       }
     }
 
-    std::string tempFilePath;
-    std::string partData;
+    std::string tempFilePath = Util::GetAttachmentsTempDir() + fileName;
+    bool hasPart = false;
 
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       const std::string& folder = m_CurrentFolderUid.first;
       const int uid = m_CurrentFolderUid.second;
       std::map<uint32_t, Body>& bodys = m_Bodys[folder];
       std::map<uint32_t, Body>::iterator bodyIt = bodys.find(uid);
+      std::map<ssize_t, std::string> partPaths;
       if (bodyIt != bodys.end())
       {
+        GetCachedPartPaths(folder, uid, bodyIt->second, partPaths);
+      }
+
+      std::map<ssize_t, std::string>::iterator partPathIt = partPaths.find(m_PartListCurrentIndex);
+      if (partPathIt != partPaths.end())
+      {
+        hasPart = true;
         Body& body = bodyIt->second;
-        const std::map<ssize_t, PartInfo>& parts = body.GetPartInfos();
-        const std::map<ssize_t, std::string>& partDatas = body.GetPartDatas();
-        partData = partDatas.at(m_PartListCurrentIndex);
+        const std::string& partPath = partPathIt->second;
 
         if (m_ShowEmbeddedImages && isUnamedTextHtml)
         {
+          const std::map<ssize_t, PartInfo>& parts = body.GetPartInfos();
           for (auto& part : parts)
           {
-            if (!part.second.m_ContentId.empty())
+            if (!part.second.m_ContentId.empty() && partPaths.count(part.first))
             {
               const std::string& tempPartFilePath = Util::GetAttachmentsTempDir() + part.second.m_ContentId;
-              LOG_DEBUG("writing \"%s\"", tempPartFilePath.c_str());
-              Util::WriteFile(tempPartFilePath, partDatas.at(part.first));
+              LOG_DEBUG("linking \"%s\"", tempPartFilePath.c_str());
+              PartCache::LinkFile(partPaths.at(part.first), tempPartFilePath);
             }
           }
+
+          std::string partData = Util::ReadFile(partPath);
+          Util::ReplaceString(partData, "src=cid:", "src=file://" + Util::GetAttachmentsTempDir());
+          Util::ReplaceString(partData, "src=\"cid:", "src=\"file://" + Util::GetAttachmentsTempDir());
+          LOG_DEBUG("writing \"%s\"", tempFilePath.c_str());
+          Util::DeleteFile(tempFilePath);
+          Util::WriteFile(tempFilePath, partData);
+        }
+        else
+        {
+          LOG_DEBUG("linking \"%s\"", tempFilePath.c_str());
+          PartCache::LinkFile(partPath, tempFilePath);
         }
       }
+    }
 
-      if (m_ShowEmbeddedImages && isUnamedTextHtml)
-      {
-        tempFilePath = Util::GetAttachmentsTempDir() + fileName;
-        Util::ReplaceString(partData, "src=cid:", "src=file://" + Util::GetAttachmentsTempDir());
-        Util::ReplaceString(partData, "src=\"cid:", "src=\"file://" + Util::GetAttachmentsTempDir());
-        LOG_DEBUG("writing \"%s\"", tempFilePath.c_str());
-        Util::WriteFile(tempFilePath, partData);
-      }
-      else
-      {
-        tempFilePath = Util::GetAttachmentsTempDir() + fileName;
-        LOG_DEBUG("writing \"%s\"", tempFilePath.c_str());
-        Util::WriteFile(tempFilePath, partData);
-      }
+    if (!hasPart)
+    {
+      LOG_WARNING("part %d not available", m_PartListCurrentIndex);
+      SetDialogMessage("Part not available", true /* p_Warn */);
+      return;
     }
 
     LOG_DEBUG("opening \"%s\" in external viewer", tempFilePath.c_str());
@@ -3282,9 +3321,9 @@ void Ui::ViewPartListKeyHandler(int p_Key)
       {
         filename = Util::ExpandPath(filename);
 
-        std::string partData;
+        std::string partPath;
         {
-          std::lock_guard<std::mutex> lock(m_Mutex);
+          std::lock_guard<ProfMutex> lock(m_Mutex);
           const std::string& folder = m_CurrentFolderUid.first;
           const int uid = m_CurrentFolderUid.second;
           std::map<uint32_t, Body>& bodys = m_Bodys[folder];
@@ -3292,13 +3331,24 @@ void Ui::ViewPartListKeyHandler(int p_Key)
           if (bodyIt != bodys.end())
           {
             Body& body = bodyIt->second;
-            const std::map<ssize_t, std::string>& partDatas = body.GetPartDatas();
-            partData = partDatas.at(m_PartListCurrentIndex);
+            std::map<ssize_t, std::string> partPaths;
+            GetCachedPartPaths(folder, uid, body, partPaths);
+            std::map<ssize_t, std::string>::iterator partPathIt = partPaths.find(m_PartListCurrentIndex);
+            if (partPathIt != partPaths.end())
+            {
+              partPath = partPathIt->second;
+            }
           }
         }
 
-        Util::WriteFile(filename, partData);
-        SetDialogMessage("File saved");
+        if (!partPath.empty() && PartCache::CloneFile(partPath, filename))
+        {
+          SetDialogMessage("File saved");
+        }
+        else
+        {
+          SetDialogMessage("Save failed", true /* p_Warn */);
+        }
       }
       else
       {
@@ -3322,15 +3372,52 @@ void Ui::ViewPartListKeyHandler(int p_Key)
   DrawAll();
 }
 
+void Ui::ViewStatsKeyHandler(int p_Key)
+{
+  if (p_Key == m_KeyQuit)
+  {
+    Quit();
+  }
+  else if ((p_Key == KEY_BACKSPACE) || (p_Key == KEY_DELETE) || (p_Key == m_KeyBack) || (p_Key == KEY_LEFT) ||
+           (p_Key == m_KeyCancel) || (p_Key == m_KeyShowStats))
+  {
+    SetState(m_LastMessageState);
+  }
+  else if (p_Key == m_KeyRefresh)
+  {
+    // stats are re-read on every draw
+  }
+  else if (p_Key == m_KeyPrevMsg)
+  {
+    --m_StatsLineOffset;
+  }
+  else if (p_Key == m_KeyNextMsg)
+  {
+    ++m_StatsLineOffset;
+  }
+  else if (HandleListKey(p_Key, m_StatsLineOffset))
+  {
+    // none
+  }
+  else if (m_InvalidInputNotify)
+  {
+    SetDialogMessage("Invalid input (" + Util::ToHexString(p_Key) + ")");
+  }
+
+  DrawAll();
+}
+
 void Ui::SetState(Ui::State p_State)
 {
-  if ((p_State == StateAddressList) || (p_State == StateFromAddressList) || (p_State == StateFileList))
+  if ((p_State == StateAddressList) || (p_State == StateFromAddressList) || (p_State == StateFileList) ||
+      (p_State == StateViewStats))
   {
-    // going to address or file list
+    // going to address or file list, or stats view
     m_LastMessageState = m_State;
     m_State = p_State;
   }
-  else if ((m_State != StateAddressList) && (m_State != StateFromAddressList) && (m_State != StateFileList))
+  else if ((m_State != StateAddressList) && (m_State != StateFromAddressList) && (m_State != StateFileList) &&
+           (m_State != StateViewStats))
   {
     // normal state transition
     m_LastState = m_State;
@@ -3338,7 +3425,7 @@ void Ui::SetState(Ui::State p_State)
   }
   else
   {
-    // exiting address or file list
+    // exiting address or file list, or stats view
     m_State = p_State;
     return;
   }
@@ -3386,8 +3473,9 @@ void Ui::SetState(Ui::State p_State)
     curs_set(0);
     m_HelpViewMessagesListOffset = 0;
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       m_MessageViewToggledSeen = false;
+      EvictFilterIndex();
     }
   }
   else if (m_State == StateViewMessage)
@@ -3415,7 +3503,7 @@ void Ui::SetState(Ui::State p_State)
     m_CurrentMarkdownHtmlCompose = m_MarkdownHtmlCompose;
     m_ComposeQuotedStart.clear();
 
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
 
@@ -3456,16 +3544,17 @@ void Ui::SetState(Ui::State p_State)
 
         int idx = 0;
         std::string tmppath = Util::GetTempDirectory();
-        const std::map<ssize_t, std::string>& partDatas = body.GetPartDatas();
+        std::map<ssize_t, std::string> partPaths;
+        GetCachedPartPaths(folder, uid, body, partPaths);
         for (auto& part : body.GetPartInfos())
         {
-          if (!part.second.m_Filename.empty())
+          if (!part.second.m_Filename.empty() && partPaths.count(part.first))
           {
             std::string tmpfiledir = tmppath + "/" + std::to_string(idx++) + "/";
             Util::MkDir(tmpfiledir);
             std::string tmpfilepath = tmpfiledir + part.second.m_Filename;
 
-            Util::WriteFile(tmpfilepath, partDatas.at(part.first));
+            PartCache::LinkFile(partPaths.at(part.first), tmpfilepath);
             tmpfilepath = Util::EscapePath(tmpfilepath);
             if (GetComposeStr(HeaderAtt).empty())
             {
@@ -3502,7 +3591,7 @@ void Ui::SetState(Ui::State p_State)
     m_CurrentMarkdownHtmlCompose = m_MarkdownHtmlCompose;
     m_ComposeQuotedStart.clear();
 
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
 
@@ -3618,7 +3707,7 @@ void Ui::SetState(Ui::State p_State)
     m_CurrentMarkdownHtmlCompose = m_MarkdownHtmlCompose;
     m_ComposeQuotedStart.clear();
 
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
 
@@ -3634,16 +3723,17 @@ void Ui::SetState(Ui::State p_State)
 
       int idx = 0;
       std::string tmppath = Util::GetTempDirectory();
-      const std::map<ssize_t, std::string>& partDatas = body.GetPartDatas();
+      std::map<ssize_t, std::string> partPaths;
+      GetCachedPartPaths(folder, uid, body, partPaths);
       for (auto& part : body.GetPartInfos())
       {
-        if (!part.second.m_Filename.empty())
+        if (!part.second.m_Filename.empty() && partPaths.count(part.first))
         {
           std::string tmpfiledir = tmppath + "/" + std::to_string(idx++) + "/";
           Util::MkDir(tmpfiledir);
           std::string tmpfilepath = tmpfiledir + part.second.m_Filename;
 
-          Util::WriteFile(tmpfilepath, partDatas.at(part.first));
+          PartCache::LinkFile(partPaths.at(part.first), tmpfilepath);
           tmpfilepath = Util::EscapePath(tmpfilepath);
           if (GetComposeStr(HeaderAtt).empty())
           {
@@ -3710,7 +3800,7 @@ void Ui::SetState(Ui::State p_State)
     m_CurrentMarkdownHtmlCompose = m_MarkdownHtmlCompose;
     m_ComposeQuotedStart.clear();
 
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
 
@@ -3771,6 +3861,11 @@ void Ui::SetState(Ui::State p_State)
     curs_set(0);
     m_PartListCurrentIndex = 0;
   }
+  else if (m_State == StateViewStats)
+  {
+    curs_set(0);
+    m_StatsLineOffset = 0;
+  }
 }
 
 void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManager::Response& p_Response)
@@ -3788,7 +3883,7 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
 
     if (p_Request.m_GetFolders && !(p_Response.m_ResponseStatus & ImapManager::ResponseStatusGetFoldersFailed))
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       m_Folders = p_Response.m_Folders;
       uiRequest |= UiRequestDrawAll;
       LOG_DEBUG_VAR("new folders =", p_Response.m_Folders);
@@ -3796,7 +3891,7 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
 
     if (p_Request.m_GetUids && !(p_Response.m_ResponseStatus & ImapManager::ResponseStatusGetUidsFailed))
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
 
       const std::set<uint32_t> newUids = p_Response.m_Uids - m_Uids[p_Response.m_Folder];
       if (!p_Response.m_Cached && (p_Response.m_Folder == m_Inbox) && !newUids.empty())
@@ -3814,6 +3909,8 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
         LOG_DEBUG_VAR("del uids =", removedUids);
         UpdateDisplayUids(p_Response.m_Folder, removedUids);
         m_Headers[p_Response.m_Folder] = m_Headers[p_Response.m_Folder] - removedUids;
+        InvalidateMessageListRows(p_Response.m_Folder, removedUids);
+        RemoveFilterIndex(p_Response.m_Folder, removedUids);
       }
 
       m_Uids[p_Response.m_Folder] = p_Response.m_Uids;
@@ -3857,15 +3954,18 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
     if (!p_Request.m_GetHeaders.empty() &&
         !(p_Response.m_ResponseStatus & ImapManager::ResponseStatusGetHeadersFailed))
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
 
       const std::map<uint32_t, Header>& headers = p_Response.m_Headers;
 
       m_Headers[p_Response.m_Folder].insert(headers.begin(), headers.end());
+      InvalidateMessageListRows(p_Response.m_Folder, MapKey(headers));
+      AddFilterIndex(p_Response.m_Folder, MapKey(headers));
       if (m_PrefetchAllHeaders)
       {
         UpdateDisplayUids(p_Response.m_Folder, std::set<uint32_t>(), MapKey(headers));
       }
+      UpdateMemoryUsage(false /* p_Force */);
       uiRequest |= UiRequestDrawAll;
       updateIndexFromUid = true;
       LOG_DEBUG_VAR("new headers =", MapKey(headers));
@@ -3874,7 +3974,7 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
     if (!p_Request.m_GetFlags.empty() &&
         !(p_Response.m_ResponseStatus & ImapManager::ResponseStatusGetFlagsFailed))
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       std::map<uint32_t, uint32_t> newFlags = p_Response.m_Flags;
       newFlags.insert(m_Flags[p_Response.m_Folder].begin(), m_Flags[p_Response.m_Folder].end());
       m_Flags[p_Response.m_Folder] = newFlags;
@@ -3885,8 +3985,9 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
     if (!p_Request.m_GetBodys.empty() &&
         !(p_Response.m_ResponseStatus & ImapManager::ResponseStatusGetBodysFailed))
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       m_Bodys[p_Response.m_Folder].insert(p_Response.m_Bodys.begin(), p_Response.m_Bodys.end());
+      UpdateMemoryUsage(!p_Response.m_Bodys.empty() /* p_Force */);
       uiRequest |= UiRequestDrawAll;
       LOG_DEBUG_VAR("new bodys =", MapKey(p_Response.m_Bodys));
     }
@@ -3942,7 +4043,7 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
     if (p_Request.m_GetFolders &&
         !(p_Response.m_ResponseStatus & ImapManager::ResponseStatusGetFoldersFailed))
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       for (auto& folder : p_Response.m_Folders)
       {
         if (!s_Running)
@@ -3973,7 +4074,7 @@ void Ui::ResponseHandler(const ImapManager::Request& p_Request, const ImapManage
       std::set<uint32_t> prefetchBodys;
 
       {
-        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::lock_guard<ProfMutex> lock(m_Mutex);
 
         std::map<uint32_t, Header>& headers = m_Headers[folder];
         std::set<uint32_t>& requestedHeaders = m_RequestedHeaders[folder];
@@ -4305,7 +4406,7 @@ void Ui::SmtpResultHandler(const SmtpManager::Result& p_Result)
 
     if (!m_SentFolder.empty())
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       m_HasRequestedUids[m_SentFolder] = false;
     }
 
@@ -4325,7 +4426,7 @@ void Ui::SmtpResultHandler(const SmtpManager::Result& p_Result)
 
 void Ui::StatusHandler(const StatusUpdate& p_StatusUpdate)
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   m_Status.Update(p_StatusUpdate);
 
   if (!m_HasRequestedFolders && !m_HasPrefetchRequestedFolders && (m_PrefetchLevel >= PrefetchLevelFullSync) &&
@@ -4352,7 +4453,7 @@ void Ui::SearchHandler(const ImapManager::SearchQuery& p_SearchQuery,
                        const ImapManager::SearchResult& p_SearchResult)
 {
   {
-    std::lock_guard<std::mutex> lock(m_SearchMutex);
+    std::lock_guard<ProfMutex> lock(m_SearchMutex);
     if (p_SearchQuery.m_Offset == 0)
     {
       m_MessageListSearchResultHeaders = p_SearchResult.m_Headers;
@@ -4422,7 +4523,7 @@ void Ui::SetClientStoreSent(bool p_ClientStoreSent)
 
 bool Ui::IsConnected()
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   return m_Status.IsSet(Status::FlagConnected);
 }
 
@@ -4466,13 +4567,13 @@ std::string Ui::GetKeyDisplay(int p_Key)
 
 std::string Ui::GetStatusStr()
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   return m_Status.ToString();
 }
 
 std::string Ui::GetStateStr()
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
 
   switch (m_State)
   {
@@ -4527,6 +4628,8 @@ std::string Ui::GetStateStr()
       return "File Selection";
     case StateViewPartList:
       return "Message Parts";
+    case StateViewStats:
+      return "Performance Stats";
     default: return "Unknown State";
   }
 }
@@ -4747,7 +4850,7 @@ bool Ui::DeleteMessage()
 
         bool isHeaderUidsEmpty = false;
         {
-          std::lock_guard<std::mutex> lock(m_Mutex);
+          std::lock_guard<ProfMutex> lock(m_Mutex);
           isHeaderUidsEmpty = GetHeaderUids(folder).empty();
         }
 
@@ -4799,11 +4902,13 @@ void Ui::MoveMessages(const std::set<uint32_t>& p_Uids, const std::string& p_Fro
   const std::string& folder = p_From;
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
 
     UpdateDisplayUids(folder, action.m_Uids);
     m_Uids[folder] = m_Uids[folder] - action.m_Uids;
     m_Headers[folder] = m_Headers[folder] - action.m_Uids;
+    InvalidateMessageListRows(folder, action.m_Uids);
+    RemoveFilterIndex(folder, action.m_Uids);
 
     m_HasRequestedUids[p_From] = false;
     m_HasRequestedUids[p_To] = false;
@@ -4811,7 +4916,7 @@ void Ui::MoveMessages(const std::set<uint32_t>& p_Uids, const std::string& p_Fro
 
   if (m_MessageListSearch)
   {
-    std::lock_guard<std::mutex> lock(m_SearchMutex);
+    std::lock_guard<ProfMutex> lock(m_SearchMutex);
     int resultCount = m_MessageListSearchResultHeaders.size();
     for (int i = 0; i < resultCount; ++i)
     {
@@ -4857,17 +4962,19 @@ void Ui::DeleteMessages(const std::set<uint32_t>& p_Uids, const std::string& p_F
   m_ImapManager->AsyncAction(action);
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     UpdateDisplayUids(p_Folder, action.m_Uids);
     m_Uids[p_Folder] = m_Uids[p_Folder] - action.m_Uids;
     m_Headers[p_Folder] = m_Headers[p_Folder] - action.m_Uids;
+    InvalidateMessageListRows(p_Folder, action.m_Uids);
+    RemoveFilterIndex(p_Folder, action.m_Uids);
 
     m_HasRequestedUids[p_Folder] = false;
   }
 
   if (m_MessageListSearch)
   {
-    std::lock_guard<std::mutex> lock(m_SearchMutex);
+    std::lock_guard<ProfMutex> lock(m_SearchMutex);
     int resultCount = m_MessageListSearchResultHeaders.size();
     for (int i = 0; i < resultCount; ++i)
     {
@@ -4892,7 +4999,7 @@ void Ui::ToggleSeen()
     const int uid = m_CurrentFolderUid.second;
     std::map<uint32_t, uint32_t> flags;
     {
-      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::lock_guard<ProfMutex> lock(m_Mutex);
       flags = m_Flags[folder];
     }
     bool oldSeen = ((flags.find(uid) != flags.end()) && (Flag::GetSeen(flags.at(uid))));
@@ -4914,7 +5021,7 @@ void Ui::ToggleSeen()
         {
           std::map<uint32_t, uint32_t> flags;
           {
-            std::lock_guard<std::mutex> lock(m_Mutex);
+            std::lock_guard<ProfMutex> lock(m_Mutex);
             flags = m_Flags[selectedFolder.first];
           }
 
@@ -4940,7 +5047,7 @@ void Ui::SetSeen(const std::string& p_Folder, const std::set<uint32_t>& p_Uids,
   m_ImapManager->AsyncAction(action);
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     for (auto& uid : p_Uids)
     {
       Flag::SetSeen(m_Flags[p_Folder][uid], p_Seen);
@@ -4955,7 +5062,7 @@ void Ui::MarkSeen()
   const int uid = m_CurrentFolderUid.second;
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     flags = m_Flags[folder];
   }
 
@@ -4973,7 +5080,7 @@ void Ui::MarkSeen()
   m_ImapManager->AsyncAction(action);
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     Flag::SetSeen(m_Flags[folder][uid], newSeen);
   }
 }
@@ -4982,7 +5089,7 @@ void Ui::UpdateUidFromIndex(bool p_UserTriggered)
 {
   if (m_MessageListSearch)
   {
-    std::lock_guard<std::mutex> lock(m_SearchMutex);
+    std::lock_guard<ProfMutex> lock(m_SearchMutex);
     const std::vector<Header>& headers = m_MessageListSearchResultHeaders;
     m_MessageListCurrentIndex[m_CurrentFolder] =
       Util::Bound(0, m_MessageListCurrentIndex[m_CurrentFolder], (int)headers.size() - 1);
@@ -5014,7 +5121,7 @@ void Ui::UpdateUidFromIndex(bool p_UserTriggered)
     return;
   }
 
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   const std::map<std::string, uint32_t>& displayUids = GetDisplayUids(m_CurrentFolder);
 
   m_MessageListCurrentIndex[m_CurrentFolder] =
@@ -5052,7 +5159,7 @@ void Ui::UpdateIndexFromUid()
   bool found = false;
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
 
     if (m_MessageListUidSet[m_CurrentFolder])
     {
@@ -5084,6 +5191,179 @@ void Ui::UpdateIndexFromUid()
             m_MessageListCurrentIndex[m_CurrentFolder]);
 }
 
+void Ui::UpdateComposeMessageLines()
+{
+  // keeps m_ComposeMessageLines wrapped per paragraph (text between newlines), only
+  // re-wrapping paragraphs in the range that differs from the previously wrapped text
+  const std::wstring& text = m_ComposeMessageStr;
+  if (m_ComposeWrapLineLength != m_MaxComposeLineLength)
+  {
+    m_ComposeWrapLineLength = m_MaxComposeLineLength;
+    m_ComposeWrapText.clear();
+    m_ComposeParagraphs.assign(1, ComposeParagraph());
+    m_ComposeMessageLines.clear();
+  }
+
+  const size_t oldLen = m_ComposeWrapText.size();
+  const size_t newLen = text.size();
+  const size_t minLen = std::min(oldLen, newLen);
+  const wchar_t* newStr = text.c_str();
+  const wchar_t* oldStr = m_ComposeWrapText.c_str();
+
+  // common prefix, compared block-wise first
+  const size_t blockLen = 4096;
+  size_t prefixLen = 0;
+  while (((prefixLen + blockLen) <= minLen) && (wmemcmp(newStr + prefixLen, oldStr + prefixLen, blockLen) == 0))
+  {
+    prefixLen += blockLen;
+  }
+
+  while ((prefixLen < minLen) && (newStr[prefixLen] == oldStr[prefixLen]))
+  {
+    ++prefixLen;
+  }
+
+  if ((prefixLen != oldLen) || (oldLen != newLen))
+  {
+    // common suffix, a single insert or delete typically leaves the whole remainder equal
+    size_t suffixLen = minLen - prefixLen;
+    if (wmemcmp(newStr + newLen - suffixLen, oldStr + oldLen - suffixLen, suffixLen) != 0)
+    {
+      suffixLen = 0;
+      while ((suffixLen < (minLen - prefixLen)) &&
+             (newStr[newLen - suffixLen - 1] == oldStr[oldLen - suffixLen - 1]))
+      {
+        ++suffixLen;
+      }
+    }
+
+    // find range of affected paragraphs in previous text
+    size_t paraIdx = 0;
+    size_t paraStart = 0;
+    size_t lineIdx = 0;
+    while ((paraStart + m_ComposeParagraphs[paraIdx].m_Len) < prefixLen)
+    {
+      paraStart += m_ComposeParagraphs[paraIdx].m_Len + 1;
+      lineIdx += m_ComposeParagraphs[paraIdx].m_LineCount;
+      ++paraIdx;
+    }
+
+    const size_t firstParaIdx = paraIdx;
+    const size_t firstParaStart = paraStart;
+    const size_t firstLineIdx = lineIdx;
+    const size_t oldChangeEnd = oldLen - suffixLen;
+    while ((paraStart + m_ComposeParagraphs[paraIdx].m_Len) < oldChangeEnd)
+    {
+      paraStart += m_ComposeParagraphs[paraIdx].m_Len + 1;
+      lineIdx += m_ComposeParagraphs[paraIdx].m_LineCount;
+      ++paraIdx;
+    }
+
+    const size_t lastParaEnd = paraStart + m_ComposeParagraphs[paraIdx].m_Len + newLen - oldLen;
+    const size_t endLineIdx = lineIdx + m_ComposeParagraphs[paraIdx].m_LineCount;
+    const size_t endParaIdx = paraIdx + 1;
+
+    // wrap affected paragraphs in current text
+    const bool processFlowed = false; // only process when viewing message
+    const bool outputFlowed = false; // only generate when sending after compose
+    const bool quoteWrap = false; // only wrap quoted lines when viewing message
+    const int expandTabSize = 0; // disabled
+    std::vector<ComposeParagraph> paragraphs;
+    std::vector<std::wstring> lines;
+    size_t pos = firstParaStart;
+    while (true)
+    {
+      size_t endPos = text.find(L'\n', pos);
+      if ((endPos == std::wstring::npos) || (endPos > lastParaEnd))
+      {
+        endPos = lastParaEnd;
+      }
+
+      ComposeParagraph paragraph;
+      paragraph.m_Len = endPos - pos;
+      const bool isLastEmpty = (endPos == newLen) && (paragraph.m_Len == 0); // not output, as for WordWrap
+      if (!isLastEmpty)
+      {
+        WordWrapper wordWrapper(text.substr(pos, paragraph.m_Len) + L"\n", m_MaxComposeLineLength,
+                                processFlowed, outputFlowed, quoteWrap, expandTabSize);
+        wordWrapper.Wrap();
+        std::vector<std::wstring>& paragraphLines = wordWrapper.GetLines();
+        paragraph.m_LineCount = paragraphLines.size();
+        std::move(paragraphLines.begin(), paragraphLines.end(), std::back_inserter(lines));
+      }
+
+      paragraphs.push_back(paragraph);
+      if (endPos >= lastParaEnd) break;
+
+      pos = endPos + 1;
+    }
+
+    if (paragraphs.size() == (endParaIdx - firstParaIdx))
+    {
+      std::copy(paragraphs.begin(), paragraphs.end(), m_ComposeParagraphs.begin() + firstParaIdx);
+    }
+    else
+    {
+      m_ComposeParagraphs.erase(m_ComposeParagraphs.begin() + firstParaIdx,
+                                m_ComposeParagraphs.begin() + endParaIdx);
+      m_ComposeParagraphs.insert(m_ComposeParagraphs.begin() + firstParaIdx,
+                                 paragraphs.begin(), paragraphs.end());
+    }
+
+    if (lines.size() == (endLineIdx - firstLineIdx))
+    {
+      std::move(lines.begin(), lines.end(), m_ComposeMessageLines.begin() + firstLineIdx);
+    }
+    else
+    {
+      m_ComposeMessageLines.erase(m_ComposeMessageLines.begin() + firstLineIdx,
+                                  m_ComposeMessageLines.begin() + endLineIdx);
+      m_ComposeMessageLines.insert(m_ComposeMessageLines.begin() + firstLineIdx,
+                                   std::make_move_iterator(lines.begin()),
+                                   std::make_move_iterator(lines.end()));
+    }
+
+    m_ComposeWrapText.replace(prefixLen, oldLen - suffixLen - prefixLen,
+                              text, prefixLen, newLen - suffixLen - prefixLen);
+  }
+
+  // cursor line and column, skipping whole paragraphs before it
+  const int overflowLineLength = m_MaxComposeLineLength;
+  int pos = m_ComposeMessagePos;
+  size_t lineIdx = 0;
+  m_ComposeMessageWrapPos = 0;
+  for (auto& paragraph : m_ComposeParagraphs)
+  {
+    if (pos <= 0) break;
+
+    if ((int)(paragraph.m_Len + 1) <= pos)
+    {
+      pos -= paragraph.m_Len + 1;
+      lineIdx += paragraph.m_LineCount;
+      continue;
+    }
+
+    for (size_t i = 0; (i < paragraph.m_LineCount) && (pos > 0); ++i)
+    {
+      int lineLength = std::min((int)m_ComposeMessageLines[lineIdx].size() + 1, overflowLineLength);
+      if (lineLength <= pos)
+      {
+        pos -= lineLength;
+        ++lineIdx;
+      }
+      else
+      {
+        m_ComposeMessageWrapPos = pos;
+        pos = 0;
+      }
+    }
+
+    break;
+  }
+
+  m_ComposeMessageWrapLine = lineIdx;
+}
+
 void Ui::ComposeMessagePrevLine()
 {
   if (m_ComposeMessageWrapLine > 0)
@@ -5247,7 +5527,7 @@ bool Ui::PromptString(const std::string& p_Prompt, const std::string& p_Action,
 
 bool Ui::CurrentMessageBodyHeaderAvailable()
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   const std::string& folder = m_CurrentFolderUid.first;
   const int uid = m_CurrentFolderUid.second;
   const std::map<uint32_t, Body>& bodys = m_Bodys[folder];
@@ -5259,10 +5539,139 @@ bool Ui::CurrentMessageBodyHeaderAvailable()
 
 void Ui::InvalidateUiCache(const std::string& p_Folder)
 {
-  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::lock_guard<ProfMutex> lock(m_Mutex);
   m_HasRequestedUids[p_Folder] = false;
   m_Flags[p_Folder].clear();
   m_RequestedFlags[p_Folder].clear();
+  m_MessageListRows[p_Folder].clear();
+}
+
+// must be called with m_Mutex held
+void Ui::UpdateMemoryUsage(bool p_Force)
+{
+  static std::chrono::steady_clock::time_point lastUpdate;
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (!p_Force && ((now - lastUpdate) < std::chrono::seconds(1))) return;
+
+  lastUpdate = now;
+
+  // @note: estimates
+  const int64_t nodeSize = MemoryBudget::GetNodeOverhead();
+  int64_t headersSize = 0;
+  for (const auto& folderHeaders : m_Headers)
+  {
+    for (const auto& header : folderHeaders.second)
+    {
+      headersSize += nodeSize + header.second.GetMemorySize();
+    }
+  }
+
+  int64_t bodysSize = 0;
+  for (const auto& folderBodys : m_Bodys)
+  {
+    for (const auto& body : folderBodys.second)
+    {
+      bodysSize += nodeSize + body.second.GetMemorySize();
+    }
+  }
+
+  int64_t uidsFlagsSize = 0;
+  for (const auto& folderUids : m_Uids)
+  {
+    uidsFlagsSize += folderUids.second.size() * (nodeSize + sizeof(uint32_t));
+  }
+
+  for (const auto& folderFlags : m_Flags)
+  {
+    uidsFlagsSize += folderFlags.second.size() * (nodeSize + (2 * sizeof(uint32_t)));
+  }
+
+  int64_t rowsSize = 0;
+  for (const auto& folderRows : m_MessageListRows)
+  {
+    for (const auto& row : folderRows.second)
+    {
+      rowsSize += nodeSize + sizeof(row) + (row.second.m_Text.capacity() * sizeof(wchar_t));
+    }
+  }
+
+  int64_t filterIndexSize = 0;
+  for (const auto& folderFilterIndex : m_FilterIndex)
+  {
+    filterIndexSize += GetFilterIndexMemorySize(folderFilterIndex.second);
+  }
+
+  MemoryBudget::SetUsage("ui_headers", headersSize);
+  MemoryBudget::SetUsage("ui_bodys", bodysSize);
+  MemoryBudget::SetUsage("ui_uids_flags", uidsFlagsSize);
+  MemoryBudget::SetUsage("ui_rows", rowsSize);
+  MemoryBudget::SetUsage("ui_filter_index", filterIndexSize);
+
+  // evict down to 75% of budget, to not evict again on every new message
+  const int64_t excess = MemoryBudget::IsExceeded() ? MemoryBudget::GetExcess(0.75) : 0;
+  if ((excess > 0) && (EvictMemory(excess) > 0))
+  {
+    // refresh estimates on next update
+    lastUpdate = std::chrono::steady_clock::time_point();
+  }
+}
+
+// must be called with m_Mutex held
+int64_t Ui::EvictMemory(int64_t p_Bytes)
+{
+  // filter indexes of other folders are rebuilt from headers when needed
+  int64_t evicted = EvictFilterIndex();
+
+  // message list rows and bodys are re-created from local cache when needed, start with
+  // those of other folders, then bodys of current folder other than the one being viewed
+  for (auto& folderRows : m_MessageListRows)
+  {
+    if ((evicted >= p_Bytes) || (folderRows.first == m_CurrentFolder)) continue;
+
+    for (const auto& row : folderRows.second)
+    {
+      evicted += sizeof(row) + (row.second.m_Text.capacity() * sizeof(wchar_t));
+    }
+
+    folderRows.second.clear();
+  }
+
+  for (int pass = 0; (pass < 2) && (evicted < p_Bytes); ++pass)
+  {
+    for (auto& folderBodys : m_Bodys)
+    {
+      const std::string& folder = folderBodys.first;
+      const bool isCurrentFolder = (folder == m_CurrentFolder);
+      if ((pass == 0) == isCurrentFolder) continue;
+
+      const int32_t currentUid = isCurrentFolder ? m_MessageListCurrentUid[folder] : -1;
+      std::set<uint32_t>& requestedBodys = m_RequestedBodys[folder];
+      std::set<uint32_t>& prefetchedBodys = m_PrefetchedBodys[folder];
+      std::map<uint32_t, Body>& bodys = folderBodys.second;
+      for (auto it = bodys.begin(); (it != bodys.end()) && (evicted < p_Bytes); /* incremented in loop */)
+      {
+        if ((int32_t)it->first == currentUid)
+        {
+          ++it;
+          continue;
+        }
+
+        evicted += it->second.GetMemorySize();
+        requestedBodys.erase(it->first);
+        prefetchedBodys.erase(it->first);
+        it = bodys.erase(it);
+      }
+    }
+  }
+
+  if (evicted > 0)
+  {
+    LOG_DEBUG("memory budget exceeded by %lld bytes, evicted %lld bytes", (long long)p_Bytes,
+              (long long)evicted);
+    METRICS_COUNT("mem.ui_evictions", 1);
+  }
+
+  return evicted;
 }
 
 void Ui::ExtEditor(const std::string& p_EditorCmd, std::wstring& p_ComposeMessageStr, int& p_ComposeMessagePos)
@@ -5326,6 +5735,16 @@ void Ui::ExtPager()
   }
 }
 
+bool Ui::GetCachedPartPaths(const std::string& p_Folder, uint32_t p_Uid, Body& p_Body,
+                            std::map<ssize_t, std::string>& p_PartPaths)
+{
+  // @note: caller must hold m_Mutex
+  if (PartCache::Lookup(p_Folder, p_Uid, p_PartPaths)) return true;
+
+  PartCache::Store(p_Folder, p_Uid, p_Body.GetPartDatas(), p_PartPaths);
+  return !p_PartPaths.empty();
+}
+
 int Ui::ExtPartsViewer(const std::string& p_Path)
 {
   const bool isDefaultPartsViewerCmd = Util::IsDefaultPartsViewerCmd();
@@ -5371,7 +5790,7 @@ void Ui::ExtHtmlViewer()
   Util::DeleteFile(tempPath);
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
     std::map<uint32_t, Body>& bodys = m_Bodys[folder];
@@ -5472,7 +5891,7 @@ void Ui::ExtMsgViewer()
   Util::DeleteFile(tempPath);
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
     std::map<uint32_t, Body>& bodys = m_Bodys[folder];
@@ -5538,7 +5957,7 @@ void Ui::SetLastStateOrMessageList()
   }
   else
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     isHeaderUidsEmpty = GetHeaderUids(m_CurrentFolder).empty();
   }
 
@@ -5564,7 +5983,7 @@ void Ui::ExportMessage()
     if (!filename.empty())
     {
       filename = Util::ExpandPath(filename);
-      std::unique_lock<std::mutex> lock(m_Mutex);
+      std::unique_lock<ProfMutex> lock(m_Mutex);
       const std::map<uint32_t, Body>& bodys = m_Bodys[folder];
       if (bodys.find(uid) != bodys.end())
       {
@@ -5631,7 +6050,7 @@ void Ui::SearchMessageBasedOnCurrent(bool p_Subject)
 
   if (m_MessageListSearch)
   {
-    std::lock_guard<std::mutex> lock(m_SearchMutex);
+    std::lock_guard<ProfMutex> lock(m_SearchMutex);
     std::vector<Header>& headers = m_MessageListSearchResultHeaders;
     int idx = m_MessageListCurrentIndex[m_CurrentFolder];
     if ((idx >= 0) && (idx < (int)headers.size()))
@@ -5643,7 +6062,7 @@ void Ui::SearchMessageBasedOnCurrent(bool p_Subject)
   }
   else
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::string& folder = m_CurrentFolderUid.first;
     const int uid = m_CurrentFolderUid.second;
     std::map<uint32_t, Header>& headers = m_Headers[folder];
@@ -5697,7 +6116,7 @@ void Ui::SearchMessage(const std::string& p_Query /*= std::string()*/)
       ClearSelection();
 
       {
-        std::lock_guard<std::mutex> lock(m_SearchMutex);
+        std::lock_guard<ProfMutex> lock(m_SearchMutex);
         m_MessageListSearchQuery = query;
         m_MessageListSearchOffset = 0;
         m_MessageListSearchMax = m_MainWinHeight + m_MainWinHeight;
@@ -5752,12 +6171,19 @@ void Ui::MessageFindNext()
 {
   int findFromLine = m_MessageFindMatchLine + 1;
   const std::wstring wquery = Util::ToLower(Util::ToWString(m_MessageFindQuery));;
-  std::vector<std::wstring> wlines = Ui::GetCachedWordWrapLines("", 0);
+  const std::vector<std::wstring>& wlines = Ui::GetCachedWordWrapLines("", 0, findFromLine + 1);
   int countLines = wlines.size();
 
   bool found = false;
   for (int i = findFromLine; i < countLines; ++i)
   {
+    if ((i + 1) == countLines)
+    {
+      // wrap more lines on demand
+      const size_t findChunkLines = 1000;
+      countLines = Ui::GetCachedWordWrapLines("", 0, countLines + findChunkLines).size();
+    }
+
     std::wstring wline = Util::ToLower(wlines.at(i));
     size_t pos = wline.find(wquery);
     if (pos != std::string::npos)
@@ -6143,6 +6569,18 @@ std::set<uint32_t>& Ui::GetHeaderUids(const std::string& p_Folder)
   return m_HeaderUids[p_Folder];
 }
 
+// display uids key sorting by date (and uid for equal dates), p_Header is null if not cached
+std::string Ui::GetDateUidKey(const Header* p_Header, uint32_t p_Uid, bool p_Ascending)
+{
+  std::string key = ((p_Header != nullptr) ? p_Header->GetDateTime() : "") + " " + Util::ZeroPad(p_Uid, 7);
+  if (p_Ascending)
+  {
+    Util::BitInvertString(key);
+  }
+
+  return key;
+}
+
 std::string Ui::GetDisplayUidsKey(const std::string& p_Folder, uint32_t p_Uid, SortFilter p_SortFilter)
 {
   std::map<uint32_t, Header>& headers = m_Headers[p_Folder];
@@ -6151,8 +6589,8 @@ std::string Ui::GetDisplayUidsKey(const std::string& p_Folder, uint32_t p_Uid, S
   std::string key;
   std::string priKey;
   std::map<uint32_t, Header>::iterator hit = headers.find(p_Uid);
-  std::string dateUidKey =
-    ((hit != headers.end()) ? hit->second.GetDateTime() : "") + " " + Util::ZeroPad(p_Uid, 7);
+  const Header* header = (hit != headers.end()) ? &hit->second : nullptr;
+  std::string dateUidKey = GetDateUidKey(header, p_Uid, false /* p_Ascending */);
   std::map<uint32_t, uint32_t>::const_iterator fit;
   switch (p_SortFilter)
   {
@@ -6162,8 +6600,7 @@ std::string Ui::GetDisplayUidsKey(const std::string& p_Folder, uint32_t p_Uid, S
       break;
 
     case SortDateAsc:
-      key = dateUidKey;
-      Util::BitInvertString(key);
+      key = GetDateUidKey(header, p_Uid, true /* p_Ascending */);
       break;
 
     case SortUnseenOnly:
@@ -6293,14 +6730,29 @@ void Ui::UpdateDisplayUids(const std::string& p_Folder,
   if (displayUidsVersion != headerUidsVersion)
   {
     displayUids.clear();
-    for (auto& uid : headerUids)
+    const std::set<uint32_t>* filterUids = GetFilterIndexUids(p_Folder, sortFilter);
+    if (filterUids != nullptr)
     {
-      if (uid == 0) continue;
+      // custom date, name or subject filter, only visit matching uids
+      for (auto& uid : *filterUids)
+      {
+        if ((uid == 0) || (headerUids.find(uid) == headerUids.end())) continue;
 
-      std::string key = GetDisplayUidsKey(p_Folder, uid, sortFilter);
-      if (key.empty()) continue;
+        std::string key = GetDisplayUidsKey(p_Folder, uid, SortDefault);
+        displayUids.insert(std::pair<std::string, uint32_t>(key, uid));
+      }
+    }
+    else
+    {
+      for (auto& uid : headerUids)
+      {
+        if (uid == 0) continue;
 
-      displayUids.insert(std::pair<std::string, uint32_t>(key, uid));
+        std::string key = GetDisplayUidsKey(p_Folder, uid, sortFilter);
+        if (key.empty()) continue;
+
+        displayUids.insert(std::pair<std::string, uint32_t>(key, uid));
+      }
     }
 
     displayUidsVersion = headerUidsVersion;
@@ -6358,7 +6810,7 @@ void Ui::SortFilterPreUpdate()
 void Ui::SortFilterUpdated(bool p_FilterUpdated)
 {
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     UpdateDisplayUids(m_CurrentFolder, std::set<uint32_t>(), std::set<uint32_t>(), p_FilterUpdated);
   }
 
@@ -6400,7 +6852,7 @@ void Ui::ToggleFilter(SortFilter p_SortFilter)
       return;
     }
 
-    // dont cache custom date, name or subject filters due to mem usage
+    // custom filter string changes, so rebuild display uids (from filter index)
     std::map<std::string, uint32_t>& displayUids = m_DisplayUids[m_CurrentFolder][newSortFilter];
     uint64_t& displayUidsVersion = m_DisplayUidsVersion[m_CurrentFolder][newSortFilter];
     displayUids.clear();
@@ -6440,50 +6892,300 @@ void Ui::ToggleSort(SortFilter p_SortFirst, SortFilter p_SortSecond)
   SortFilterUpdated(wasFilterEnabled);
 }
 
-const std::vector<std::wstring>& Ui::GetCachedWordWrapLines(const std::string& p_Folder, uint32_t p_Uid)
+const std::wstring& Ui::GetCachedMessageListRow(const std::string& p_Folder, uint32_t p_Uid,
+                                                Header* p_Header, bool p_IsUnread, bool p_IsSelected,
+                                                const std::string& p_CurrentDate)
 {
-  static std::string prevFolder;
-  static uint32_t prevUid = 0;
-  static bool prevPlaintext = false;
-  static bool prevProcessFlowed = false;
-  static int32_t prevMaxViewLineLength = 0;
-  static std::vector<std::wstring> wlines;
-  static size_t prevTextLen = 0;
+  // caller must hold m_Mutex
+  std::map<uint32_t, MessageListRow>& rows = m_MessageListRows[p_Folder];
+  auto rit = rows.find(p_Uid);
+  if (rit != rows.end())
+  {
+    const MessageListRow& row = rit->second;
+    if ((row.m_Width == m_ScreenWidth) && (row.m_HasHeader == (p_Header != nullptr)) &&
+        (row.m_IsUnread == p_IsUnread) && (row.m_IsSelected == p_IsSelected) &&
+        (row.m_CurrentDate == p_CurrentDate))
+    {
+      return row.m_Text;
+    }
+  }
+  else
+  {
+    // bound cache size, rows are cheaply regenerated for the visible screen
+    static const size_t maxRowsPerFolder = 4096;
+    if (rows.size() >= maxRowsPerFolder)
+    {
+      rows.clear();
+    }
+  }
 
-  if (p_Folder.empty() && (p_Uid == 0)) return wlines;
+  static const std::wstring wUnreadIndicator = Util::ToWString(m_UnreadIndicator);
+  static const int unreadIndicatorWidth = Util::WStringWidth(wUnreadIndicator);
+  std::string unreadFlag = p_IsUnread ? std::string(m_UnreadIndicator)
+                                      : std::string(unreadIndicatorWidth, ' ');
 
-  if ((prevFolder == p_Folder) && (prevUid == p_Uid) && (prevPlaintext == m_Plaintext) &&
-      (prevProcessFlowed == m_CurrentMessageProcessFlowed) && (prevMaxViewLineLength == m_MaxViewLineLength) &&
-      (prevTextLen == m_CurrentMessageViewText.size()))
+  std::string shortDate;
+  std::string shortFrom;
+  std::string subject;
+  std::string attachFlag;
+  if (p_Header != nullptr)
   {
-    return wlines;
+    shortDate = p_Header->GetDateOrTime(p_CurrentDate);
+    subject = p_Header->GetSubject();
+    if (p_Folder == m_SentFolder)
+    {
+      shortFrom = p_Header->GetShortTo();
+    }
+    else
+    {
+      shortFrom = p_Header->GetShortFrom();
+    }
+
+    if (!m_AttachmentIndicator.empty())
+    {
+      static const std::wstring wIndicator = Util::ToWString(m_AttachmentIndicator);
+      static const int indicatorWidth = Util::WStringWidth(wIndicator);
+      attachFlag = p_Header->GetHasAttachments() ? std::string(m_AttachmentIndicator)
+                                                 : std::string(indicatorWidth, ' ');
+    }
+  }
+
+  std::string selectFlag = p_IsSelected ? "X" : " ";
+
+  shortDate = Util::TrimPadString(shortDate, 10);
+  shortFrom = Util::ToString(Util::TrimPadWString(Util::ToWString(shortFrom), 20));
+  std::string headerLeft = selectFlag + unreadFlag + attachFlag + "  " + shortDate + "  " + shortFrom + "  ";
+  int subjectWidth = m_ScreenWidth - Util::WStringWidth(Util::ToWString(headerLeft)) - 1;
+  subject = Util::ToString(Util::TrimPadWString(Util::ToWString(subject), subjectWidth));
+  std::string header = headerLeft + subject + " ";
+
+  MessageListRow& row = rows[p_Uid];
+  row.m_Text = Util::TrimPadWString(Util::ToWString(header), m_ScreenWidth - 1) + L" ";
+  row.m_Width = m_ScreenWidth;
+  row.m_HasHeader = (p_Header != nullptr);
+  row.m_IsUnread = p_IsUnread;
+  row.m_IsSelected = p_IsSelected;
+  row.m_CurrentDate = p_CurrentDate;
+  return row.m_Text;
+}
+
+void Ui::InvalidateMessageListRows(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
+{
+  // caller must hold m_Mutex
+  auto fit = m_MessageListRows.find(p_Folder);
+  if (fit != m_MessageListRows.end())
+  {
+    fit->second = fit->second - p_Uids;
+  }
+}
+
+void Ui::AddFilterIndex(FilterIndex& p_FilterIndex, const std::string& p_Folder, uint32_t p_Uid, Header& p_Header)
+{
+  // caller must hold m_Mutex
+  if (p_FilterIndex.m_UidPostings.find(p_Uid) != p_FilterIndex.m_UidPostings.end()) return;
+
+  std::string name = (p_Folder != m_SentFolder) ? p_Header.GetShortFrom() : p_Header.GetShortTo();
+  Util::NormalizeName(name);
+  std::string subj = p_Header.GetSubject();
+  Util::NormalizeSubject(subj, true /*p_ToLower*/);
+
+  auto dit = p_FilterIndex.m_Dates.insert(std::make_pair(p_Header.GetDate(), std::set<uint32_t>())).first;
+  auto nit = p_FilterIndex.m_Names.insert(std::make_pair(name, std::set<uint32_t>())).first;
+  auto sit = p_FilterIndex.m_Subjects.insert(std::make_pair(subj, std::set<uint32_t>())).first;
+  dit->second.insert(p_Uid);
+  nit->second.insert(p_Uid);
+  sit->second.insert(p_Uid);
+  p_FilterIndex.m_UidPostings[p_Uid] = { { dit, nit, sit } };
+}
+
+void Ui::AddFilterIndex(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
+{
+  // caller must hold m_Mutex, index is only maintained for folders where it has been built
+  auto fit = m_FilterIndex.find(p_Folder);
+  if (fit == m_FilterIndex.end()) return;
+
+  std::map<uint32_t, Header>& headers = m_Headers[p_Folder];
+  for (auto& uid : p_Uids)
+  {
+    auto hit = headers.find(uid);
+    if (hit == headers.end()) continue;
+
+    AddFilterIndex(fit->second, p_Folder, uid, hit->second);
   }
+}
 
-  prevFolder = p_Folder;
-  prevUid = p_Uid;
-  prevPlaintext = m_Plaintext;
-  prevProcessFlowed = m_CurrentMessageProcessFlowed;
-  prevMaxViewLineLength = m_MaxViewLineLength;
-  prevTextLen = m_CurrentMessageViewText.size(); // cater for search results async header load
+void Ui::RemoveFilterIndex(const std::string& p_Folder, const std::set<uint32_t>& p_Uids)
+{
+  // caller must hold m_Mutex
+  auto fit = m_FilterIndex.find(p_Folder);
+  if (fit == m_FilterIndex.end()) return;
 
-  const std::wstring wtext = Util::ToWString(m_CurrentMessageViewText);
-  const bool outputFlowed = false; // only generate when sending after compose
-  const bool quoteWrap = m_RewrapQuotedLines;
-  const int expandTabSize = m_TabSize; // enabled
-  wlines = Util::WordWrap(wtext, m_MaxViewLineLength, m_CurrentMessageProcessFlowed,
-                          outputFlowed, quoteWrap, expandTabSize);
-  wlines.push_back(L"");
+  FilterIndex& filterIndex = fit->second;
+  PostingList* postingLists[3] = { &filterIndex.m_Dates, &filterIndex.m_Names, &filterIndex.m_Subjects };
+  for (auto& uid : p_Uids)
+  {
+    auto uit = filterIndex.m_UidPostings.find(uid);
+    if (uit == filterIndex.m_UidPostings.end()) continue;
 
-  size_t wlinesSize = wlines.size();
-  for (size_t i = 0; i < wlinesSize; ++i)
+    for (size_t i = 0; i < uit->second.size(); ++i)
+    {
+      PostingList::iterator pit = uit->second[i];
+      pit->second.erase(uid);
+      if (pit->second.empty())
+      {
+        postingLists[i]->erase(pit);
+      }
+    }
+
+    filterIndex.m_UidPostings.erase(uit);
+  }
+}
+
+const std::set<uint32_t>* Ui::GetFilterIndexUids(const std::string& p_Folder, SortFilter p_SortFilter)
+{
+  // caller must hold m_Mutex, returns nullptr for sort/filters not served by the index
+  if ((p_SortFilter != SortCurrDateOnly) && (p_SortFilter != SortCurrNameOnly) &&
+      (p_SortFilter != SortCurrSubjOnly))
+  {
+    return nullptr;
+  }
+
+  auto fit = m_FilterIndex.find(p_Folder);
+  if (fit == m_FilterIndex.end())
   {
-    if (wlines[i].empty())
+    LOG_DURATION();
+    fit = m_FilterIndex.insert(std::make_pair(p_Folder, FilterIndex())).first;
+    for (auto& header : m_Headers[p_Folder])
     {
-      m_MessageViewHeaderLineCount = i;
-      break;
+      AddFilterIndex(fit->second, p_Folder, header.first, header.second);
     }
   }
 
+  static const std::set<uint32_t> noUids;
+  FilterIndex& filterIndex = fit->second;
+  const PostingList& postingList = (p_SortFilter == SortCurrDateOnly) ? filterIndex.m_Dates
+    : ((p_SortFilter == SortCurrNameOnly) ? filterIndex.m_Names : filterIndex.m_Subjects);
+  auto pit = postingList.find(m_FilterCustomStr);
+  return (pit != postingList.end()) ? &pit->second : &noUids;
+}
+
+int64_t Ui::GetFilterIndexMemorySize(const FilterIndex& p_FilterIndex)
+{
+  // @note: estimate
+  const int64_t nodeSize = MemoryBudget::GetNodeOverhead();
+  int64_t size = 0;
+  for (const PostingList* postingList : { &p_FilterIndex.m_Dates, &p_FilterIndex.m_Names, &p_FilterIndex.m_Subjects })
+  {
+    for (const auto& posting : *postingList)
+    {
+      size += nodeSize + sizeof(posting) + posting.first.capacity() +
+        (posting.second.size() * (nodeSize + sizeof(uint32_t)));
+    }
+  }
+
+  size += p_FilterIndex.m_UidPostings.size() * (nodeSize + sizeof(*p_FilterIndex.m_UidPostings.begin()));
+  return size;
+}
+
+int64_t Ui::EvictFilterIndex()
+{
+  // caller must hold m_Mutex, keeps index of current folder and of folder to return to from search
+  int64_t evicted = 0;
+  for (auto it = m_FilterIndex.begin(); it != m_FilterIndex.end(); /* incremented in loop */)
+  {
+    if ((it->first == m_CurrentFolder) || (it->first == m_PreviousFolder))
+    {
+      ++it;
+      continue;
+    }
+
+    evicted += GetFilterIndexMemorySize(it->second);
+    it = m_FilterIndex.erase(it);
+  }
+
+  return evicted;
+}
+
+const std::vector<std::wstring>& Ui::GetCachedWordWrapLines(const std::string& p_Folder, uint32_t p_Uid,
+                                                            size_t p_MinLines)
+{
+  static const size_t maxCacheEntries = 8;
+  static const std::vector<std::wstring> noLines;
+
+  if (p_Folder.empty() && (p_Uid == 0))
+  {
+    // use most recent entry
+    if (m_MessageViewLinesCache.empty()) return noLines;
+  }
+  else
+  {
+    auto it = std::find_if(m_MessageViewLinesCache.begin(), m_MessageViewLinesCache.end(),
+                           [&](const MessageViewLines& p_Entry)
+    {
+      return (p_Entry.m_Folder == p_Folder) && (p_Entry.m_Uid == p_Uid) &&
+             (p_Entry.m_Plaintext == m_Plaintext) && (p_Entry.m_ProcessFlowed == m_CurrentMessageProcessFlowed) &&
+             (p_Entry.m_ShowFullHeader == m_ShowFullHeader) &&
+             (p_Entry.m_MaxViewLineLength == m_MaxViewLineLength) &&
+             (p_Entry.m_TextLen == m_CurrentMessageViewText.size()); // cater for search results async header load
+    });
+
+    if (it != m_MessageViewLinesCache.end())
+    {
+      m_MessageViewLinesCache.splice(m_MessageViewLinesCache.begin(), m_MessageViewLinesCache, it);
+    }
+    else
+    {
+      MessageViewLines entry;
+      entry.m_Folder = p_Folder;
+      entry.m_Uid = p_Uid;
+      entry.m_Plaintext = m_Plaintext;
+      entry.m_ProcessFlowed = m_CurrentMessageProcessFlowed;
+      entry.m_ShowFullHeader = m_ShowFullHeader;
+      entry.m_MaxViewLineLength = m_MaxViewLineLength;
+      entry.m_TextLen = m_CurrentMessageViewText.size();
+
+      const bool outputFlowed = false; // only generate when sending after compose
+      const bool quoteWrap = m_RewrapQuotedLines;
+      const int expandTabSize = m_TabSize; // enabled
+      entry.m_WordWrapper = std::make_shared<WordWrapper>(m_CurrentMessageViewText, m_MaxViewLineLength,
+                                                          m_CurrentMessageProcessFlowed, outputFlowed,
+                                                          quoteWrap, expandTabSize);
+      m_MessageViewLinesCache.push_front(entry);
+      if (m_MessageViewLinesCache.size() > maxCacheEntries)
+      {
+        m_MessageViewLinesCache.pop_back();
+      }
+    }
+  }
+
+  // wrap lazily, only up to the lines requested
+  MessageViewLines& entry = m_MessageViewLinesCache.front();
+  std::vector<std::wstring>& wlines = entry.m_WordWrapper->GetLines();
+  if (!entry.m_WordWrapper->IsDone() && (wlines.size() < p_MinLines))
+  {
+    const size_t prevCount = wlines.size();
+    if (entry.m_WordWrapper->Wrap(p_MinLines))
+    {
+      wlines.push_back(L"");
+    }
+
+    if (entry.m_HeaderLineCount == -1)
+    {
+      size_t wlinesSize = wlines.size();
+      for (size_t i = prevCount; i < wlinesSize; ++i)
+      {
+        if (wlines[i].empty())
+        {
+          entry.m_HeaderLineCount = i;
+          break;
+        }
+      }
+    }
+  }
+
+  // set for every message / header layout, lines wrapped before the header end is found are all header
+  m_MessageViewHeaderLineCount = (entry.m_HeaderLineCount != -1) ? entry.m_HeaderLineCount : (int)wlines.size();
+
   return wlines;
 }
 
@@ -6530,7 +7232,7 @@ void Ui::ToggleSelectAll()
   int selectCount = 0;
   if (m_MessageListSearch)
   {
-    std::lock_guard<std::mutex> lock(m_SearchMutex);
+    std::lock_guard<ProfMutex> lock(m_SearchMutex);
     std::vector<Header>& headers = m_MessageListSearchResultHeaders;
     int idxMax = headers.size();
     for (int i = 0; i < idxMax; ++i)
@@ -6545,7 +7247,7 @@ void Ui::ToggleSelectAll()
   {
     std::set<uint32_t>& folderSelectedUids = m_SelectedUids[m_CurrentFolder];
 
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     const std::map<std::string, uint32_t>& displayUids = GetDisplayUids(m_CurrentFolder);
     for (auto& displayUid : displayUids)
     {
@@ -7007,7 +7709,7 @@ void Ui::AutoMoveSelectFolder()
   static const int minLengthPrefix = 8;
 
   {
-    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::lock_guard<ProfMutex> lock(m_Mutex);
     uint32_t uid = 0;
     auto selectedUidsIt = m_SelectedUids.find(m_CurrentFolder);
     if ((selectedUidsIt != m_SelectedUids.end()) && (!selectedUidsIt->second.empty()))
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <array>
 #include <csignal>
+#include <list>
 #include <string>
 #include <vector>
 
@@ -15,9 +17,11 @@
 
 #include "config.h"
 #include "imapmanager.h"
+#include "profmutex.h"
 #include "smtpmanager.h"
 
 class SleepDetect;
+class WordWrapper;
 
 class Ui
 {
@@ -38,6 +42,7 @@ public:
     StateFileList = 11,
     StateViewPartList = 12,
     StateFromAddressList = 13,
+    StateViewStats = 14,
   };
 
   enum UiRequest
@@ -94,6 +99,45 @@ public:
     LineWrapHardWrap = 2,
   };
 
+  struct MessageListRow
+  {
+    std::wstring m_Text;
+    int m_Width = -1;
+    bool m_HasHeader = false;
+    bool m_IsUnread = false;
+    bool m_IsSelected = false;
+    std::string m_CurrentDate;
+  };
+
+  struct ComposeParagraph
+  {
+    size_t m_Len = 0;
+    size_t m_LineCount = 0;
+  };
+
+  struct MessageViewLines
+  {
+    std::string m_Folder;
+    uint32_t m_Uid = 0;
+    bool m_Plaintext = false;
+    bool m_ProcessFlowed = false;
+    bool m_ShowFullHeader = false;
+    int m_MaxViewLineLength = 0;
+    size_t m_TextLen = 0;
+    int m_HeaderLineCount = -1;
+    std::shared_ptr<WordWrapper> m_WordWrapper;
+  };
+
+  typedef std::map<std::string, std::set<uint32_t>> PostingList;
+
+  struct FilterIndex
+  {
+    PostingList m_Dates;
+    PostingList m_Names;
+    PostingList m_Subjects;
+    std::map<uint32_t, std::array<PostingList::iterator, 3>> m_UidPostings;
+  };
+
   Ui(const std::string& p_Inbox, const std::string& p_Address, const std::string& p_Name,
      uint32_t p_PrefetchLevel, bool p_PrefetchAllHeaders);
   virtual ~Ui();
@@ -119,6 +163,7 @@ public:
 
 public:
   static void SetRunning(bool p_Running);
+  static std::string GetDateUidKey(const Header* p_Header, uint32_t p_Uid, bool p_Ascending);
 
 private:
   void Init();
@@ -142,6 +187,7 @@ private:
   void DrawMessage();
   void DrawComposeMessage();
   void DrawPartList();
+  void DrawStats();
 
   void AsyncUiRequest(char p_UiRequest);
   void PerformUiRequest(char p_UiRequest);
@@ -154,6 +200,7 @@ private:
   void ViewMessageKeyHandler(int p_Key);
   void ComposeMessageKeyHandler(int p_Key);
   void ViewPartListKeyHandler(int p_Key);
+  void ViewStatsKeyHandler(int p_Key);
 
   void SetState(State p_State);
   bool IsConnected();
@@ -180,6 +227,7 @@ private:
   void UpdateIndexFromUid();
   void AddUidDate(const std::string& p_Folder, const std::map<uint32_t, Header>& p_UidHeaders);
   void RemoveUidDate(const std::string& p_Folder, const std::set<uint32_t>& p_Uids);
+  void UpdateComposeMessageLines();
   void ComposeMessagePrevLine();
   void ComposeMessageNextLine();
   int ReadKeyBlocking();
@@ -188,9 +236,14 @@ private:
                     std::string& p_Entry);
   bool CurrentMessageBodyHeaderAvailable();
   void InvalidateUiCache(const std::string& p_Folder);
+  void UpdateMemoryUsage(bool p_Force);
+  int64_t EvictMemory(int64_t p_Bytes);
+  int64_t EvictFilterIndex();
   void ExtEditor(const std::string& p_EditorCmd, std::wstring& p_ComposeMessageStr, int& p_ComposeMessagePos);
   void ExtPager();
   int ExtPartsViewer(const std::string& p_Path);
+  bool GetCachedPartPaths(const std::string& p_Folder, uint32_t p_Uid, Body& p_Body,
+                          std::map<ssize_t, std::string>& p_PartPaths);
   void ExtHtmlViewer();
   int ExtHtmlViewer(const std::string& p_Path);
   int ExtHtmlPreview(const std::string& p_Path);
@@ -228,7 +281,17 @@ private:
   void DisableSortFilter();
   void ToggleFilter(SortFilter p_SortFilter);
   void ToggleSort(SortFilter p_SortFirst, SortFilter p_SortSecond);
-  const std::vector<std::wstring>& GetCachedWordWrapLines(const std::string& p_Folder, uint32_t p_Uid);
+  const std::vector<std::wstring>& GetCachedWordWrapLines(const std::string& p_Folder, uint32_t p_Uid,
+                                                          size_t p_MinLines);
+  const std::wstring& GetCachedMessageListRow(const std::string& p_Folder, uint32_t p_Uid,
+                                              Header* p_Header, bool p_IsUnread, bool p_IsSelected,
+                                              const std::string& p_CurrentDate);
+  void InvalidateMessageListRows(const std::string& p_Folder, const std::set<uint32_t>& p_Uids);
+  void AddFilterIndex(FilterIndex& p_FilterIndex, const std::string& p_Folder, uint32_t p_Uid, Header& p_Header);
+  void AddFilterIndex(const std::string& p_Folder, const std::set<uint32_t>& p_Uids);
+  void RemoveFilterIndex(const std::string& p_Folder, const std::set<uint32_t>& p_Uids);
+  const std::set<uint32_t>* GetFilterIndexUids(const std::string& p_Folder, SortFilter p_SortFilter);
+  static int64_t GetFilterIndexMemorySize(const FilterIndex& p_FilterIndex);
   void ClearSelection();
   void ToggleSelected();
   void ToggleSelectAll();
@@ -267,7 +330,7 @@ private:
   std::string m_CurrentFolder = "INBOX";
   std::string m_PreviousFolder;
 
-  std::mutex m_Mutex;
+  ProfMutex m_Mutex{"ui"};
   Status m_Status;
   std::set<std::string> m_Folders;
   std::map<std::string, std::set<uint32_t>> m_Uids;
@@ -279,6 +342,8 @@ private:
   std::map<std::string, std::map<SortFilter, std::map<std::string, uint32_t>>> m_DisplayUids;
   std::map<std::string, std::map<SortFilter, uint64_t>> m_DisplayUidsVersion;
   std::map<std::string, uint64_t> m_HeaderUidsVersion;
+  std::map<std::string, std::map<uint32_t, MessageListRow>> m_MessageListRows;
+  std::map<std::string, FilterIndex> m_FilterIndex;
 
   bool m_HasRequestedFolders = false;
   bool m_HasPrefetchRequestedFolders = false;
@@ -321,6 +386,7 @@ private:
   Fileinfo m_FileListCurrentFile;
 
   int m_PartListCurrentIndex = 0;
+  int m_StatsLineOffset = 0;
   PartInfo m_PartListCurrentPartInfo;
 
   int m_MessageViewLineOffset = 0;
@@ -414,6 +480,7 @@ private:
   int m_KeySearchCurrentSubject = 0;
   int m_KeySearchCurrentName = 0;
   int m_KeySpell = 0;
+  int m_KeyShowStats = 0;
 
   int m_ShowProgress = 1;
   bool m_NewMsgBell = false;
@@ -478,6 +545,9 @@ private:
   int m_ComposeMessageWrapLine = 0;
   int m_ComposeMessageWrapPos = 0;
   int m_ComposeMessageOffsetY = 0;
+  std::wstring m_ComposeWrapText;
+  std::vector<ComposeParagraph> m_ComposeParagraphs;
+  int m_ComposeWrapLineLength = -1;
   uint32_t m_ComposeDraftUid = 0;
   std::string m_ComposeQuotedStart;
 
@@ -495,13 +565,14 @@ private:
   bool m_MessageViewToggledSeen = false;
 
   std::string m_CurrentMessageViewText;
+  std::list<MessageViewLines> m_MessageViewLinesCache;
 
   int m_MaxViewLineLength = 0;
   int m_MaxComposeLineLength = 0;
 
   int m_Pipe[2] = { -1, -1 };
 
-  std::mutex m_SearchMutex;
+  ProfMutex m_SearchMutex{"ui_search"};
   bool m_MessageListSearch = false;
   std::string m_MessageListSearchQuery;
   size_t m_MessageListSearchOffset = 0;
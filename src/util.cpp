@@ -27,6 +27,10 @@
 
 #include <sys/resource.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef __APPLE__
 #include <libproc.h>
 #endif
@@ -43,8 +47,10 @@
 
 #include "apathy/path.hpp"
 
+#include "coprocess.h"
 #include "loghelp.h"
 #include "ui.h"
+#include "wordwrap.h"
 
 std::mutex ThreadRegister::m_Mutex;
 std::map<pthread_t, std::string> ThreadRegister::m_Threads;
@@ -486,24 +492,24 @@ time_t Util::MailtimeToTimet(mailimf_date_time* p_Dt)
     year += 2000;
   }
 
-  char buf[128];
-  snprintf(buf, sizeof(buf), "%04i-%02i-%02i %02i:%02i:%02i",
-           year, p_Dt->dt_month, p_Dt->dt_day, p_Dt->dt_hour,
-           p_Dt->dt_min, p_Dt->dt_sec);
-  int offs = p_Dt->dt_zone;
+  const int month = p_Dt->dt_month;
+  if ((month < 1) || (month > 12)) return 0;
 
-  struct tm tm;
-  memset(&tm, 0, sizeof(struct tm));
-  strptime(buf, "%Y-%m-%d %H:%M:%S", &tm);
-  tm.tm_isdst = -1;
+  // days since epoch from civil date, with year starting in march to place leap day last
+  const int64_t y = year - ((month <= 2) ? 1 : 0);
+  const int64_t era = ((y >= 0) ? y : (y - 399)) / 400;
+  const int64_t yoe = y - (era * 400);
+  const int64_t doy = (((153 * ((month > 2) ? (month - 3) : (month + 9))) + 2) / 5) + p_Dt->dt_day - 1;
+  const int64_t doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+  const int64_t days = (era * 146097) + doe - 719468;
 
-  time_t t = timegm(&tm);
+  int offs = p_Dt->dt_zone;
   int offs_h = offs / 100;
   int offs_m = offs % 100;
-  t -= offs_h * 3600;
-  t -= offs_m * 60;
+  const int64_t t = (days * 86400) + (p_Dt->dt_hour * 3600) + (p_Dt->dt_min * 60) + p_Dt->dt_sec -
+    (offs_h * 3600) - (offs_m * 60);
 
-  return t;
+  return static_cast<time_t>(t);
 }
 
 void Util::MailimapTimeToMailimfTime(mailimap_date_time* p_Src, mailimf_date_time* p_Dst)
@@ -519,6 +525,9 @@ void Util::MailimapTimeToMailimfTime(mailimap_date_time* p_Src, mailimf_date_tim
 
 std::string Util::GetHtmlToTextConvertCmd()
 {
+  // empty command means built-in conversion is used
+  if (m_HtmlToTextConvertCmd == "builtin") return "";
+
   if (!m_HtmlToTextConvertCmd.empty()) return m_HtmlToTextConvertCmd;
 
   static std::string defaultHtmlToTextConvertCmd = GetDefaultHtmlToTextConvertCmd();
@@ -613,12 +622,16 @@ std::string Util::ConvertTextToHtml(const std::string& p_Text)
 {
   std::string text = p_Text;
   ReplaceString(text, "\n", "  \n"); // prepend line-breaks with double spaces to enforce them
-  const std::string& tempPath = GetTempFilename(".md");
-  Util::WriteFile(tempPath, text);
   const std::string& textToHtmlCmd = GetTextToHtmlConvertCmd();
-  const std::string& cmd = textToHtmlCmd + " " + tempPath;
-  const std::string& htmlText = RunCommand(cmd);
-  Util::DeleteFile(tempPath);
+  std::string htmlText;
+  if (!CoProcessPool::Convert(textToHtmlCmd, text, htmlText))
+  {
+    const std::string& tempPath = GetTempFilename(".md");
+    Util::WriteFile(tempPath, text);
+    const std::string& cmd = textToHtmlCmd + " " + tempPath;
+    htmlText = RunCommand(cmd);
+    Util::DeleteFile(tempPath);
+  }
 
   return htmlText;
 }
@@ -826,6 +839,11 @@ void Util::SetSendIp(bool p_SendIp)
 
 std::string Util::ToString(const std::wstring& p_WStr)
 {
+  if (IsAscii(p_WStr))
+  {
+    return std::string(p_WStr.begin(), p_WStr.end());
+  }
+
   try
   {
     return std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t>{ }.to_bytes(p_WStr);
@@ -842,6 +860,11 @@ std::string Util::ToString(const std::wstring& p_WStr)
 
 std::wstring Util::ToWString(const std::string& p_Str)
 {
+  if (IsAscii(p_Str))
+  {
+    return std::wstring(p_Str.begin(), p_Str.end());
+  }
+
   try
   {
     return std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t>{ }.from_bytes(p_Str);
@@ -874,6 +897,14 @@ std::string Util::TrimPadString(const std::string& p_Str, int p_Len)
 std::wstring Util::TrimPadWString(const std::wstring& p_Str, int p_Len)
 {
   p_Len = std::max(p_Len, 0);
+  if (IsAscii(p_Str))
+  {
+    // one column per char
+    std::wstring str = p_Str;
+    str.resize(p_Len, L' ');
+    return str;
+  }
+
   std::wstring str = p_Str;
   if (WStringWidth(str) > p_Len)
   {
@@ -893,8 +924,172 @@ std::wstring Util::TrimPadWString(const std::wstring& p_Str, int p_Len)
 
 int Util::WStringWidth(const std::wstring& p_WStr)
 {
-  int width = wcswidth(p_WStr.c_str(), p_WStr.size());
-  return (width != -1) ? width : p_WStr.size();
+  // wcswidth() returns -1 for non-printable chars, in which case the char count is used, so
+  // for ascii strings the width is always the char count
+  if (IsAscii(p_WStr))
+  {
+    return p_WStr.size();
+  }
+
+  // wcwidth() lookup table for the basic multilingual plane, built on first use (after setlocale)
+  static const std::vector<int8_t> bmpWidths = []()
+  {
+    std::vector<int8_t> widths(0x10000);
+    for (size_t i = 0; i < widths.size(); ++i)
+    {
+      widths[i] = (int8_t)wcwidth((wchar_t)i);
+    }
+
+    return widths;
+  }();
+
+  int width = 0;
+  for (const wchar_t wch : p_WStr)
+  {
+    const uint32_t ch = (uint32_t)wch;
+    const int chWidth = (ch < bmpWidths.size()) ? bmpWidths[ch] : wcwidth(wch);
+    if (chWidth < 0)
+    {
+      return p_WStr.size();
+    }
+
+    width += chWidth;
+  }
+
+  return width;
+}
+
+bool Util::IsAscii(const std::string& p_Str)
+{
+  const char* data = p_Str.data();
+  const size_t size = p_Str.size();
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for ( ; (i + 16) <= size; i += 16)
+  {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    if (_mm_movemask_epi8(chunk) != 0)
+    {
+      return false;
+    }
+  }
+#endif
+
+  unsigned char bits = 0;
+  for ( ; i < size; ++i)
+  {
+    bits |= (unsigned char)data[i];
+  }
+
+  return (bits & 0x80) == 0;
+}
+
+bool Util::IsAscii(const std::wstring& p_WStr)
+{
+  const wchar_t* data = p_WStr.data();
+  const size_t size = p_WStr.size();
+  size_t i = 0;
+
+#ifdef __SSE2__
+  if (sizeof(wchar_t) == 4)
+  {
+    const __m128i nonAsciiMask = _mm_set1_epi32(~0x7f);
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; (i + 16) <= size; i += 16)
+    {
+      const __m128i* chunk = reinterpret_cast<const __m128i*>(data + i);
+      __m128i bits = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(chunk), _mm_loadu_si128(chunk + 1)),
+                                  _mm_or_si128(_mm_loadu_si128(chunk + 2), _mm_loadu_si128(chunk + 3)));
+      bits = _mm_and_si128(bits, nonAsciiMask);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(bits, zero)) != 0xFFFF)
+      {
+        return false;
+      }
+    }
+  }
+#endif
+
+  uint32_t bits = 0;
+  for ( ; i < size; ++i)
+  {
+    bits |= (uint32_t)data[i];
+  }
+
+  return (bits & ~0x7fu) == 0;
+}
+
+bool Util::IsValidUtf8(const std::string& p_Str)
+{
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(p_Str.data());
+  const size_t size = p_Str.size();
+  size_t i = 0;
+
+  while (i < size)
+  {
+#ifdef __SSE2__
+    // skip ascii runs 16 bytes at a time
+    while ((i + 16) <= size)
+    {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      const int mask = _mm_movemask_epi8(chunk);
+      if (mask != 0)
+      {
+        i += __builtin_ctz(static_cast<unsigned>(mask));
+        break;
+      }
+
+      i += 16;
+    }
+
+    if (i >= size) break;
+#endif
+
+    const unsigned char ch = data[i];
+    if (ch < 0x80)
+    {
+      ++i;
+      continue;
+    }
+
+    // reject overlong encodings, surrogates and code points above U+10FFFF
+    size_t len = 0;
+    unsigned char min = 0x80;
+    unsigned char max = 0xbf;
+    if ((ch >= 0xc2) && (ch <= 0xdf))
+    {
+      len = 2;
+    }
+    else if ((ch >= 0xe0) && (ch <= 0xef))
+    {
+      len = 3;
+      min = (ch == 0xe0) ? 0xa0 : 0x80;
+      max = (ch == 0xed) ? 0x9f : 0xbf;
+    }
+    else if ((ch >= 0xf0) && (ch <= 0xf4))
+    {
+      len = 4;
+      min = (ch == 0xf0) ? 0x90 : 0x80;
+      max = (ch == 0xf4) ? 0x8f : 0xbf;
+    }
+    else
+    {
+      return false;
+    }
+
+    if ((i + len) > size) return false;
+
+    if ((data[i + 1] < min) || (data[i + 1] > max)) return false;
+
+    for (size_t j = 2; j < len; ++j)
+    {
+      if ((data[i + j] & 0xc0) != 0x80) return false;
+    }
+
+    i += len;
+  }
+
+  return true;
 }
 
 std::string Util::ToLower(const std::string& p_Str)
@@ -1078,192 +1273,17 @@ std::vector<std::wstring> Util::WordWrap(std::wstring p_Text, unsigned p_LineLen
                                          bool p_QuoteWrap, int p_ExpandTabSize,
                                          int p_Pos, int& p_WrapLine, int& p_WrapPos)
 {
-  std::wostringstream wrapped;
   std::vector<std::wstring> lines;
 
   p_WrapLine = 0;
   p_WrapPos = 0;
 
-  const unsigned wrapLineLength = p_LineLength - 1; // lines with spaces allowed to width - 1
-  const unsigned overflowLineLength = p_LineLength; // overflowing lines allowed to full width
-
-  if (p_ProcessFormatFlowed)
-  {
-    bool prevLineFlowed = false;
-    std::wstring line;
-    std::wstring prevQuotePrefix;
-    std::wstring quotePrefix;
-    std::wstring prevUnquotedLine;
-    std::wstring unquotedLine;
-    std::wistringstream textss(p_Text);
-    std::wostringstream outss;
-    bool reflowUnquoted = true;
-    while (std::getline(textss, line))
-    {
-      line.erase(std::remove(line.begin(), line.end(), L'\r'), line.end());
-
-      if (!GetQuotePrefix(line, quotePrefix, unquotedLine))
-      {
-        if (reflowUnquoted)
-        {
-          if ((quotePrefix != prevQuotePrefix) || !prevLineFlowed)
-          {
-            outss << L"\n" << line;
-          }
-          else
-          {
-            if (!prevLineFlowed)
-            {
-              outss << L" ";
-            }
-            outss << line;
-          }
-
-          size_t unquotedLen = unquotedLine.size();
-          prevLineFlowed = ((unquotedLen > 0) && (unquotedLine[unquotedLen - 1] == L' '));
-        }
-        else
-        {
-          outss << L"\n" << line;
-        }
-      }
-      else
-      {
-        quotePrefix.erase(std::remove(quotePrefix.begin(), quotePrefix.end(), L' '), quotePrefix.end());
-
-        if (quotePrefix != prevQuotePrefix)
-        {
-          outss << L"\n" << quotePrefix << L" " << unquotedLine;
-        }
-        else
-        {
-          if (unquotedLine.empty())
-          {
-            outss << L"\n" << quotePrefix << L" ";
-          }
-          else
-          {
-            if (prevUnquotedLine.empty())
-            {
-              outss << L"\n" << quotePrefix << L" ";
-            }
-            else
-            {
-              size_t prevUnquotedLen = prevUnquotedLine.size();
-              if (prevUnquotedLine[prevUnquotedLen - 1] != L' ')
-              {
-                outss << L" ";
-              }
-            }
-
-            outss << unquotedLine;
-          }
-        }
-      }
-
-      prevQuotePrefix = quotePrefix;
-      prevUnquotedLine = unquotedLine;
-    }
-
-    p_Text = outss.str().substr(1);
-  }
-
-  if (p_ExpandTabSize > 0)
-  {
-    size_t pos = 0;
-    const std::wstring wsearch = L"\t";
-    while ((pos = p_Text.find(wsearch, pos)) != std::wstring::npos)
-    {
-      size_t lineStart = p_Text.rfind(L'\n', pos);
-      if (lineStart == std::wstring::npos)
-      {
-        lineStart = 0;
-      }
-
-      const size_t tabColumn = pos - lineStart - 1;
-      const int tabSpaces = (p_ExpandTabSize - (tabColumn % p_ExpandTabSize));
-      std::wstring replace(tabSpaces, L' ');
-
-      p_Text.replace(pos, wsearch.length(), replace);
-      pos += replace.length();
-    }
-  }
-
-  if (true)
-  {
-    std::wstring line;
-    std::wstring prevQuotePrefix;
-    std::wistringstream textss(p_Text);
-    const std::wstring flowedSuffix = p_OutputFormatFlowed ? L" " : L"";
-    const size_t quotePrefixMaxLen = p_LineLength / 2;
-    while (std::getline(textss, line))
-    {
-      std::wstring linePart = line;
-
-      std::wstring quotePrefix;
-      std::wstring tmpLine;
-      size_t quotePrefixLen = 0;
-      const bool hasQuotePrefix = p_QuoteWrap && GetQuotePrefix(linePart, quotePrefix, tmpLine);
-      if (hasQuotePrefix)
-      {
-        quotePrefix.erase(std::remove(quotePrefix.begin(), quotePrefix.end(), L' '), quotePrefix.end());
-        quotePrefix += L' ';
-        quotePrefixLen = quotePrefix.size();
-        if (quotePrefixLen > quotePrefixMaxLen)
-        {
-          quotePrefix = quotePrefix.substr(quotePrefixLen - quotePrefixMaxLen);
-          quotePrefixLen = quotePrefix.size();
-        }
-
-        linePart = quotePrefix + tmpLine;
-      }
-
-      while (true)
-      {
-        std::wstring tmpPrefix;
-        if (hasQuotePrefix && !GetQuotePrefix(linePart, tmpPrefix, tmpLine))
-        {
-          linePart = quotePrefix + linePart;
-        }
-
-        if (linePart.size() > wrapLineLength)
-        {
-          size_t spacePos = linePart.rfind(L' ', wrapLineLength);
-          if ((spacePos != std::wstring::npos) && (spacePos > quotePrefixLen))
-          {
-            lines.push_back(linePart.substr(0, spacePos) + flowedSuffix);
-            if (linePart.size() > (spacePos + 1))
-            {
-              linePart = linePart.substr(spacePos + 1);
-            }
-            else
-            {
-              linePart.clear();
-            }
-          }
-          else
-          {
-            lines.push_back(linePart.substr(0, overflowLineLength));
-            if (linePart.size() > overflowLineLength)
-            {
-              linePart = linePart.substr(overflowLineLength);
-            }
-            else
-            {
-              linePart.clear();
-            }
-          }
-        }
-        else
-        {
-          lines.push_back(linePart);
-          linePart.clear();
-          break;
-        }
-      }
-    }
-  }
+  WordWrapper wordWrapper(p_Text, p_LineLength, p_ProcessFormatFlowed, p_OutputFormatFlowed,
+                          p_QuoteWrap, p_ExpandTabSize);
+  wordWrapper.Wrap();
+  lines.swap(wordWrapper.GetLines());
 
+  const unsigned overflowLineLength = p_LineLength; // overflowing lines allowed to full width
   for (auto& line : lines)
   {
     if (p_Pos > 0)
@@ -1486,6 +1506,7 @@ void Util::SignalCrashHandler(int p_Signal)
       LOG_ERROR("%s", logMsg.c_str());
       LOG_DUMP(threadLabel.c_str());
       LOG_DUMP(callstackStr.c_str());
+      Log::Flush();
 
       CleanupStdErrRedirect();
       LOG_IF_NONZERO(system("reset"));
@@ -1508,6 +1529,7 @@ void Util::SignalCrashHandler(int p_Signal)
     std::lock_guard<std::mutex> lock(s_SignalMutex);
     LOG_DUMP(threadLabel.c_str());
     LOG_DUMP(callstackStr.c_str());
+    Log::Flush();
   }
 }
 
@@ -1526,34 +1548,41 @@ std::string Util::BacktraceSymbolsStr(void* p_Callstack[], int p_Size)
     ss << std::left << std::setw(2) << std::setfill(' ') << i << "  ";
     ss << "0x" << std::hex << std::setw(16) << std::setfill('0') << std::right
        << (unsigned long long)p_Callstack[i] << "  ";
+    ss << GetSymbolName(p_Callstack[i]);
+    ss << "\n";
+  }
 
-    Dl_info dlinfo;
-    if (dladdr(p_Callstack[i], &dlinfo) && dlinfo.dli_sname)
+  return ss.str();
+}
+
+std::string Util::GetSymbolName(void* p_Addr)
+{
+  std::string name;
+  Dl_info dlinfo;
+  if (dladdr(p_Addr, &dlinfo) && dlinfo.dli_sname)
+  {
+    if (dlinfo.dli_sname[0] == '_')
     {
-      if (dlinfo.dli_sname[0] == '_')
+      int status = -1;
+      char* demangled = NULL;
+      demangled = abi::__cxa_demangle(dlinfo.dli_sname, NULL, 0, &status);
+      if (demangled && (status == 0))
       {
-        int status = -1;
-        char* demangled = NULL;
-        demangled = abi::__cxa_demangle(dlinfo.dli_sname, NULL, 0, &status);
-        if (demangled && (status == 0))
-        {
-          ss << demangled;
-          free(demangled);
-        }
-        else
-        {
-          ss << dlinfo.dli_sname;
-        }
+        name = demangled;
+        free(demangled);
       }
       else
       {
-        ss << dlinfo.dli_sname;
+        name = dlinfo.dli_sname;
       }
     }
-    ss << "\n";
+    else
+    {
+      name = dlinfo.dli_sname;
+    }
   }
 
-  return ss.str();
+  return name;
 }
 
 bool Util::IsInteger(const std::string& p_Str)
@@ -1819,6 +1848,17 @@ std::string Util::GetUname()
 
 std::string Util::MimeToUtf8(const std::string& p_Str)
 {
+  // plain ascii words separated by single spaces, without encoded words, decode to themselves
+  bool isPlain = p_Str.empty() || ((p_Str.front() != ' ') && (p_Str.back() != ' '));
+  for (size_t i = 0; isPlain && (i < p_Str.size()); ++i)
+  {
+    const char ch = p_Str[i];
+    isPlain = ((ch > ' ') && (ch < 0x7f) && !((ch == '?') && (i > 0) && (p_Str[i - 1] == '='))) ||
+      ((ch == ' ') && (p_Str[i - 1] != ' '));
+  }
+
+  if (isPlain) return p_Str;
+
   const char* charset = "UTF-8";
   char* cdecoded = NULL;
   size_t curtoken = 0;
@@ -2022,12 +2062,11 @@ std::string Util::ZeroPad(uint32_t p_Num, int32_t p_Len)
 
 bool Util::GetQuotePrefix(const std::wstring& p_String, std::wstring& p_Prefix, std::wstring& p_Line)
 {
-  std::wsmatch sm;
-  std::wregex re(L"^(( *> *)+)");
-  if (std::regex_search(p_String, sm, re))
+  const size_t prefixLen = GetQuotePrefixLen(p_String);
+  if (prefixLen > 0)
   {
-    p_Prefix = sm.str();
-    p_Line = sm.suffix();
+    p_Prefix = p_String.substr(0, prefixLen);
+    p_Line = p_String.substr(prefixLen);
     return true;
   }
   else
@@ -2038,6 +2077,28 @@ bool Util::GetQuotePrefix(const std::wstring& p_String, std::wstring& p_Prefix,
   }
 }
 
+size_t Util::GetQuotePrefixLen(const std::wstring& p_String, size_t p_Pos)
+{
+  // length of quote prefix matching ^(( *> *)+) starting at p_Pos, or zero if none
+  bool hasQuote = false;
+  const size_t len = p_String.size();
+  size_t pos = p_Pos;
+  for ( ; pos < len; ++pos)
+  {
+    const wchar_t wch = p_String[pos];
+    if (wch == L'>')
+    {
+      hasQuote = true;
+    }
+    else if (wch != L' ')
+    {
+      break;
+    }
+  }
+
+  return hasQuote ? (pos - p_Pos) : 0;
+}
+
 std::string Util::ToHex(const std::string& p_String)
 {
   std::ostringstream oss;
@@ -188,6 +188,9 @@ public:
   static std::string TrimPadString(const std::string& p_Str, int p_Len);
   static std::wstring TrimPadWString(const std::wstring& p_Str, int p_Len);
   static int WStringWidth(const std::wstring& p_WStr);
+  static bool IsAscii(const std::string& p_Str);
+  static bool IsAscii(const std::wstring& p_WStr);
+  static bool IsValidUtf8(const std::string& p_Str);
 
   template<typename T>
   static inline T Bound(const T& p_Min, const T& p_Val, const T& p_Max)
@@ -227,6 +230,7 @@ public:
   static void SignalCrashHandler(int p_Signal);
   static void SignalTerminateHandler(int p_Signal);
   static std::string BacktraceSymbolsStr(void* p_Callstack[], int p_Size);
+  static std::string GetSymbolName(void* p_Addr);
 
   static bool IsInteger(const std::string& p_Str);
   static long ToInteger(const std::string& p_Str);
@@ -268,6 +272,7 @@ public:
   static void SetLocalizedSubjectPrefixes(const std::string& p_Prefixes);
   static std::string ZeroPad(uint32_t p_Num, int32_t p_Len);
   static bool GetQuotePrefix(const std::wstring& p_String, std::wstring& p_Prefix, std::wstring& p_Line);
+  static size_t GetQuotePrefixLen(const std::wstring& p_String, size_t p_Pos = 0);
   static std::string ToHex(const std::string& p_String);
   static std::string FromHex(const std::string& p_String);
   static void SetFilePickerCmd(const std::string& p_FilePickerCmd);
@@ -0,0 +1,313 @@
+// wordwrap.cpp
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#include "wordwrap.h"
+
+#include <algorithm>
+
+#include "util.h"
+
+// source text is converted to wide string in chunks of this size (ending on a newline)
+static const size_t s_SrcChunkSize = 64 * 1024;
+
+WordWrapper::WordWrapper(const std::string& p_Text, unsigned p_LineLength, bool p_ProcessFormatFlowed,
+                         bool p_OutputFormatFlowed, bool p_QuoteWrap, int p_ExpandTabSize)
+  : m_Src(p_Text)
+  , m_ProcessFormatFlowed(p_ProcessFormatFlowed)
+  , m_OutputFormatFlowed(p_OutputFormatFlowed)
+  , m_QuoteWrap(p_QuoteWrap)
+  , m_ExpandTabSize(p_ExpandTabSize)
+{
+  Init(p_LineLength);
+}
+
+WordWrapper::WordWrapper(const std::wstring& p_WText, unsigned p_LineLength, bool p_ProcessFormatFlowed,
+                         bool p_OutputFormatFlowed, bool p_QuoteWrap, int p_ExpandTabSize)
+  : m_Text(p_WText)
+  , m_ProcessFormatFlowed(p_ProcessFormatFlowed)
+  , m_OutputFormatFlowed(p_OutputFormatFlowed)
+  , m_QuoteWrap(p_QuoteWrap)
+  , m_ExpandTabSize(p_ExpandTabSize)
+{
+  Init(p_LineLength);
+}
+
+bool WordWrapper::Wrap(size_t p_MinLines)
+{
+  while (!m_Done && (m_Lines.size() < p_MinLines))
+  {
+    if (!ReadLogicalLine(m_Line))
+    {
+      m_Done = true;
+      break;
+    }
+
+    ExpandTabs(m_Line);
+    WrapLine(m_Line);
+  }
+
+  return m_Done;
+}
+
+bool WordWrapper::IsDone() const
+{
+  return m_Done;
+}
+
+std::vector<std::wstring>& WordWrapper::GetLines()
+{
+  return m_Lines;
+}
+
+void WordWrapper::Init(unsigned p_LineLength)
+{
+  m_WrapLineLength = static_cast<unsigned>(p_LineLength - 1); // lines with spaces allowed to width - 1
+  m_OverflowLineLength = p_LineLength; // overflowing lines allowed to full width
+  m_QuotePrefixMaxLen = p_LineLength / 2;
+}
+
+bool WordWrapper::FillText()
+{
+  if (m_SrcPos >= m_Src.size())
+  {
+    return false;
+  }
+
+  size_t endPos = m_Src.find('\n', m_SrcPos + s_SrcChunkSize);
+  endPos = (endPos != std::string::npos) ? (endPos + 1) : m_Src.size();
+  m_Text = Util::ToWString(m_Src.substr(m_SrcPos, endPos - m_SrcPos));
+  m_TextPos = 0;
+  m_SrcPos = endPos;
+  if (m_SrcPos >= m_Src.size())
+  {
+    std::string().swap(m_Src);
+    m_SrcPos = 0;
+  }
+
+  return true;
+}
+
+bool WordWrapper::ReadSourceLine(std::wstring& p_Line)
+{
+  if ((m_TextPos >= m_Text.size()) && !FillText())
+  {
+    return false;
+  }
+
+  size_t endPos = m_Text.find(L'\n', m_TextPos);
+  if (endPos == std::wstring::npos)
+  {
+    endPos = m_Text.size();
+  }
+
+  p_Line.assign(m_Text, m_TextPos, endPos - m_TextPos);
+  m_TextPos = endPos + 1;
+
+  if (m_ProcessFormatFlowed)
+  {
+    p_Line.erase(std::remove(p_Line.begin(), p_Line.end(), L'\r'), p_Line.end());
+  }
+
+  return true;
+}
+
+bool WordWrapper::ReadLogicalLine(std::wstring& p_Line)
+{
+  if (!m_ProcessFormatFlowed)
+  {
+    return ReadSourceLine(p_Line);
+  }
+
+  // join format=flowed source lines into logical lines, one source line at a time
+  while (ReadSourceLine(m_SourceLine))
+  {
+    const size_t prefixLen = Util::GetQuotePrefixLen(m_SourceLine);
+    m_QuotePrefix.clear();
+    for (size_t i = 0; i < prefixLen; ++i)
+    {
+      if (m_SourceLine[i] != L' ')
+      {
+        m_QuotePrefix += m_SourceLine[i];
+      }
+    }
+
+    bool newLine = false;
+    if (prefixLen == 0)
+    {
+      newLine = !m_PrevQuotePrefix.empty() || !m_PrevLineFlowed;
+      m_PrevLineFlowed = !m_SourceLine.empty() && (m_SourceLine.back() == L' ');
+    }
+    else
+    {
+      newLine = (m_QuotePrefix != m_PrevQuotePrefix) || (prefixLen == m_SourceLine.size()) ||
+        m_PrevUnquotedLine.empty();
+    }
+
+    bool hasLine = false;
+    if (newLine || !m_HasPending)
+    {
+      if (m_HasPending)
+      {
+        p_Line.swap(m_Pending);
+        hasLine = true;
+      }
+
+      m_Pending.clear();
+      m_HasPending = true;
+      if (prefixLen > 0)
+      {
+        m_Pending += m_QuotePrefix;
+        m_Pending += L' ';
+      }
+    }
+    else if ((prefixLen > 0) && (m_PrevUnquotedLine.back() != L' '))
+    {
+      m_Pending += L' ';
+    }
+
+    m_Pending.append(m_SourceLine, prefixLen, std::wstring::npos);
+    m_PrevQuotePrefix = m_QuotePrefix;
+    m_PrevUnquotedLine.assign(m_SourceLine, prefixLen, std::wstring::npos);
+
+    if (hasLine)
+    {
+      return true;
+    }
+  }
+
+  if (m_HasPending)
+  {
+    // trailing empty line is not output
+    m_HasPending = false;
+    p_Line.swap(m_Pending);
+    return !p_Line.empty();
+  }
+
+  return false;
+}
+
+void WordWrapper::ExpandTabs(std::wstring& p_Line)
+{
+  if ((m_ExpandTabSize <= 0) || (p_Line.find(L'\t') == std::wstring::npos))
+  {
+    return;
+  }
+
+  m_TabLine.clear();
+  for (const wchar_t wch : p_Line)
+  {
+    if (wch == L'\t')
+    {
+      const size_t tabSpaces = m_ExpandTabSize - (m_TabLine.size() % m_ExpandTabSize);
+      m_TabLine.append(tabSpaces, L' ');
+    }
+    else
+    {
+      m_TabLine += wch;
+    }
+  }
+
+  p_Line.swap(m_TabLine);
+}
+
+void WordWrapper::WrapLine(const std::wstring& p_Line)
+{
+  // the line part being wrapped is m_Carry followed by p_Line from pos, which avoids
+  // copying the remainder of long lines for each output line
+  const wchar_t* line = p_Line.c_str();
+  const size_t lineLen = p_Line.size();
+  size_t pos = 0;
+  size_t quotePrefixLen = 0;
+  bool hasQuotePrefix = false;
+
+  m_QuotePrefix.clear();
+  m_Carry.clear();
+  if (m_QuoteWrap)
+  {
+    const size_t prefixLen = Util::GetQuotePrefixLen(p_Line);
+    if (prefixLen > 0)
+    {
+      hasQuotePrefix = true;
+      for (size_t i = 0; i < prefixLen; ++i)
+      {
+        if (line[i] != L' ')
+        {
+          m_QuotePrefix += line[i];
+        }
+      }
+
+      m_QuotePrefix += L' ';
+      if (m_QuotePrefix.size() > m_QuotePrefixMaxLen)
+      {
+        m_QuotePrefix.erase(0, m_QuotePrefix.size() - m_QuotePrefixMaxLen);
+      }
+
+      quotePrefixLen = m_QuotePrefix.size();
+      m_Carry = m_QuotePrefix;
+      pos = prefixLen;
+    }
+  }
+
+  while (true)
+  {
+    // carry only holds quote prefix chars, so line part is quoted if carry or remainder is
+    if (hasQuotePrefix && (m_Carry.find(L'>') == std::wstring::npos) &&
+        (Util::GetQuotePrefixLen(p_Line, pos) == 0))
+    {
+      m_Carry.insert(0, m_QuotePrefix);
+    }
+
+    const size_t carryLen = m_Carry.size();
+    const size_t partLen = carryLen + (lineLen - pos);
+    m_Lines.emplace_back();
+    std::wstring& outLine = m_Lines.back();
+    if (partLen <= m_WrapLineLength)
+    {
+      outLine.reserve(partLen);
+      outLine.assign(m_Carry);
+      outLine.append(line + pos, lineLen - pos);
+      break;
+    }
+
+    size_t spacePos = std::wstring::npos;
+    for (size_t i = std::min(m_WrapLineLength, partLen - 1) + 1; i-- > 0; )
+    {
+      const wchar_t wch = (i < carryLen) ? m_Carry[i] : line[pos + i - carryLen];
+      if (wch == L' ')
+      {
+        spacePos = i;
+        break;
+      }
+    }
+
+    const bool isSpaceWrap = (spacePos != std::wstring::npos) && (spacePos > quotePrefixLen);
+    const size_t outLen = isSpaceWrap ? spacePos : std::min(m_OverflowLineLength, partLen);
+    const size_t consumeLen = isSpaceWrap ? (spacePos + 1) : outLen;
+
+    outLine.reserve(outLen + 1);
+    outLine.assign(m_Carry, 0, std::min(outLen, carryLen));
+    if (outLen > carryLen)
+    {
+      outLine.append(line + pos, outLen - carryLen);
+    }
+
+    if (isSpaceWrap && m_OutputFormatFlowed)
+    {
+      outLine += L' ';
+    }
+
+    if (consumeLen <= carryLen)
+    {
+      m_Carry.erase(0, consumeLen);
+    }
+    else
+    {
+      pos += consumeLen - carryLen;
+      m_Carry.clear();
+    }
+  }
+}
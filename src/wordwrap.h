@@ -0,0 +1,61 @@
+// wordwrap.h
+//
+// Copyright (c) 2024 Kristofer Berggren
+// All rights reserved.
+//
+// nmail is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <limits>
+#include <string>
+#include <vector>
+
+class WordWrapper
+{
+public:
+  WordWrapper(const std::string& p_Text, unsigned p_LineLength, bool p_ProcessFormatFlowed,
+              bool p_OutputFormatFlowed, bool p_QuoteWrap, int p_ExpandTabSize);
+  WordWrapper(const std::wstring& p_WText, unsigned p_LineLength, bool p_ProcessFormatFlowed,
+              bool p_OutputFormatFlowed, bool p_QuoteWrap, int p_ExpandTabSize);
+
+  bool Wrap(size_t p_MinLines = std::numeric_limits<size_t>::max());
+  bool IsDone() const;
+  std::vector<std::wstring>& GetLines();
+
+private:
+  void Init(unsigned p_LineLength);
+  bool FillText();
+  bool ReadSourceLine(std::wstring& p_Line);
+  bool ReadLogicalLine(std::wstring& p_Line);
+  void ExpandTabs(std::wstring& p_Line);
+  void WrapLine(const std::wstring& p_Line);
+
+private:
+  std::string m_Src;
+  size_t m_SrcPos = 0;
+  std::wstring m_Text;
+  size_t m_TextPos = 0;
+
+  bool m_ProcessFormatFlowed = false;
+  bool m_OutputFormatFlowed = false;
+  bool m_QuoteWrap = false;
+  int m_ExpandTabSize = 0;
+  size_t m_WrapLineLength = 0;
+  size_t m_OverflowLineLength = 0;
+  size_t m_QuotePrefixMaxLen = 0;
+
+  bool m_HasPending = false;
+  bool m_PrevLineFlowed = false;
+  std::wstring m_Pending;
+  std::wstring m_SourceLine;
+  std::wstring m_QuotePrefix;
+  std::wstring m_PrevQuotePrefix;
+  std::wstring m_PrevUnquotedLine;
+
+  std::wstring m_Line;
+  std::wstring m_Carry;
+  std::wstring m_TabLine;
+  std::vector<std::wstring> m_Lines;
+  bool m_Done = false;
+};